@@ -0,0 +1,390 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Python module that projects bones onto meshes given as NumPy arrays,
+// without creating any nodes. It links against OpenMaya for its math types
+// and is meant to be imported from mayapy.
+//
+//     import boneToMeshPython
+//     points, counts, connects = boneToMeshPython.project(vertices, triangles, boneMatrix)
+//
+// Vertices are float32 (n, 3), triangles int32 (m, 3) and matrices float64
+// (4, 4) in Maya's row vector order. Inputs of those types are read in
+// place, and the returned arrays own the buffers the projection was built in.
+
+#define NOMINMAX
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+
+#include <Python.h>
+#include <numpy/arrayobject.h>
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <maya/MMatrix.h>
+#include <maya/MStatus.h>
+
+// Keyword arguments shared by project and projectMany, after the arrays.
+struct ProjectArguments
+{
+    PyObject *points            = nullptr;
+    PyObject *triangles         = nullptr;
+    PyObject *boneMatrices      = nullptr;
+    PyObject *directionMatrices = Py_None;
+
+    BoneToMeshParams params;
+    int              lod = 0;
+};
+
+
+static const char* PROJECT_KEYWORDS[] = {
+    "points", "triangles", "boneMatrix", "directionMatrix",
+    "boneLength", "maxDistance", "radius",
+    "subdivisionsX", "subdivisionsY", "direction", "fillPartialLoops",
+    "hitPolicy", "hitIndex", "lod",
+    nullptr
+};
+
+
+static bool parseArguments(PyObject *args, PyObject *kwargs, ProjectArguments &arguments)
+{
+    BoneToMeshParams &params = arguments.params;
+
+    int subdivisionsX = (int) params.subdivisionsX;
+    int subdivisionsY = (int) params.subdivisionsY;
+
+    if (!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "OOO|Odddiiiiiii", const_cast<char**>(PROJECT_KEYWORDS),
+        &arguments.points, &arguments.triangles, &arguments.boneMatrices, &arguments.directionMatrices,
+        &params.boneLength, &params.maxDistance, &params.radius,
+        &subdivisionsX, &subdivisionsY, &params.direction, &params.fillPartialLoopsMethod,
+        &params.hitPolicy, &params.hitIndex, &arguments.lod
+    )) {
+        return false;
+    }
+
+    if (subdivisionsX < 3 || subdivisionsY < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "subdivisionsX must be at least 3 and subdivisionsY at least 1.");
+        return false;
+    }
+
+    if (params.direction < 0 || params.direction > 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "direction must be 0, 1 or 2 for the X, Y or Z axis.");
+        return false;
+    }
+
+    if (params.hitPolicy < HIT_NEAREST || params.hitPolicy > HIT_FRONT_FACING)
+    {
+        PyErr_SetString(PyExc_ValueError, "hitPolicy must be between 0 and 3.");
+        return false;
+    }
+
+    params.subdivisionsX = (uint) subdivisionsX;
+    params.subdivisionsY = (uint) subdivisionsY;
+    params.fillPartialLoopsMethod = std::max(0, std::min(5, params.fillPartialLoopsMethod));
+    params.hitIndex = std::max(1, std::min(HIT_MAX_NTH, params.hitIndex));
+    params.symmetry = 0;
+    arguments.lod = std::max(0, arguments.lod);
+
+    return true;
+}
+
+
+// Returns a C contiguous view of obj as the given type, copying only when
+// obj is not one already. The trailing dimensions must match shape.
+static PyArrayObject* asArray(PyObject *obj, int type, int minDims, int maxDims, const npy_intp *shape, int numShape, const char *name)
+{
+    PyArrayObject *array = (PyArrayObject*) PyArray_FROMANY(obj, type, minDims, maxDims, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+
+    if (array == nullptr) { return nullptr; }
+
+    int numDims = PyArray_NDIM(array);
+
+    for (int i = 0; i < numShape; i++)
+    {
+        if (PyArray_DIM(array, numDims - numShape + i) != shape[i])
+        {
+            PyErr_Format(PyExc_ValueError, "%s has the wrong shape.", name);
+            Py_DECREF(array);
+            return nullptr;
+        }
+    }
+
+    return array;
+}
+
+
+static void freeFloats(PyObject *capsule) { delete (std::vector<float>*) PyCapsule_GetPointer(capsule, nullptr); }
+static void freeInts(PyObject *capsule)   { delete (std::vector<int>*) PyCapsule_GetPointer(capsule, nullptr); }
+
+
+// Hands the buffer of values to a new array with numColumns columns,
+// which frees it once the array goes away.
+template <typename T>
+static PyObject* toArray(std::vector<T> &values, int numColumns, int type, PyCapsule_Destructor destructor)
+{
+    std::vector<T> *owner = new std::vector<T>();
+    owner->swap(values);
+
+    npy_intp dims[2] = {npy_intp(owner->size() / numColumns), numColumns};
+
+    PyObject *array = PyArray_SimpleNewFromData(numColumns > 1 ? 2 : 1, dims, type, owner->data());
+
+    if (array == nullptr)
+    {
+        delete owner;
+        return nullptr;
+    }
+
+    PyObject *capsule = PyCapsule_New(owner, nullptr, destructor);
+
+    if (capsule == nullptr)
+    {
+        Py_DECREF(array);
+        delete owner;
+        return nullptr;
+    }
+
+    PyArray_SetBaseObject((PyArrayObject*) array, capsule);
+
+    return array;
+}
+
+
+static PyObject* toTuple(BoneToMeshArrays &arrays)
+{
+    PyObject *points = toArray(arrays.points, 3, NPY_FLOAT32, freeFloats);
+    PyObject *counts = toArray(arrays.polygonCounts, 1, NPY_INT32, freeInts);
+    PyObject *connects = toArray(arrays.polygonConnects, 1, NPY_INT32, freeInts);
+
+    if (points == nullptr || counts == nullptr || connects == nullptr)
+    {
+        Py_XDECREF(points);
+        Py_XDECREF(counts);
+        Py_XDECREF(connects);
+        return nullptr;
+    }
+
+    return Py_BuildValue("(NNN)", points, counts, connects);
+}
+
+
+static MStatus projectBone(
+    const BoneToMeshScene &scene,
+    const double *boneMatrix,
+    const double *directionMatrix,
+    BoneToMeshParams params,
+    int lod,
+    BoneToMeshArrays &arrays
+) {
+    MStatus status;
+
+    MMatrix bone(reinterpret_cast<const double(*)[4]>(boneMatrix));
+    MMatrix direction(reinterpret_cast<const double(*)[4]>(directionMatrix));
+
+    BoneToMeshProjection proj;
+
+    status = initializeProjection(bone, direction, params, proj);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = projectionVectors(params, proj);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = projectBoneToMesh(scene, params, proj);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = fillPartialLoops(scene, params, proj);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    lodMeshArrays(params, proj, (uint) lod, arrays);
+
+    return MStatus::kSuccess;
+}
+
+
+// Projects every bone onto the mesh, many is false for a single (4, 4)
+// bone matrix. The mesh is built once and the bones are projected in
+// parallel with the interpreter released.
+static PyObject* projectBones(PyObject *args, PyObject *kwargs, bool many)
+{
+    ProjectArguments arguments;
+
+    if (!parseArguments(args, kwargs, arguments)) { return nullptr; }
+
+    const npy_intp pointShape[1] = {3};
+    const npy_intp matrixShape[2] = {4, 4};
+
+    int matrixDims = many ? 3 : 2;
+
+    PyArrayObject *points = asArray(arguments.points, NPY_FLOAT32, 2, 2, pointShape, 1, "points");
+    PyArrayObject *triangles = asArray(arguments.triangles, NPY_INT32, 2, 2, pointShape, 1, "triangles");
+    PyArrayObject *boneMatrices = asArray(arguments.boneMatrices, NPY_FLOAT64, matrixDims, matrixDims, matrixShape, 2, "boneMatrix");
+    PyArrayObject *directionMatrices = nullptr;
+
+    if (arguments.directionMatrices != Py_None && boneMatrices != nullptr)
+    {
+        directionMatrices = asArray(arguments.directionMatrices, NPY_FLOAT64, matrixDims, matrixDims, matrixShape, 2, "directionMatrix");
+
+        if (directionMatrices != nullptr && PyArray_SIZE(directionMatrices) != PyArray_SIZE(boneMatrices))
+        {
+            PyErr_SetString(PyExc_ValueError, "directionMatrix must have one matrix per bone.");
+            Py_CLEAR(directionMatrices);
+        }
+    }
+
+    bool parsed = (
+        points != nullptr &&
+        triangles != nullptr &&
+        boneMatrices != nullptr &&
+        (directionMatrices != nullptr || arguments.directionMatrices == Py_None)
+    );
+
+    PyObject *result = nullptr;
+
+    if (parsed)
+    {
+        int numPoints = (int) PyArray_DIM(points, 0);
+        int numTriangles = (int) PyArray_DIM(triangles, 0);
+        int numBones = many ? (int) PyArray_DIM(boneMatrices, 0) : 1;
+
+        const float *pointData = (const float*) PyArray_DATA(points);
+        const int *triangleData = (const int*) PyArray_DATA(triangles);
+        const double *boneData = (const double*) PyArray_DATA(boneMatrices);
+
+        // Bones project along their own axes unless told otherwise.
+        const double *directionData = directionMatrices != nullptr ? (const double*) PyArray_DATA(directionMatrices) : boneData;
+
+        BoneToMeshScene scene;
+        std::vector<BoneToMeshArrays> meshes(numBones);
+        std::vector<int> failed(numBones, 0);
+
+        MStatus status;
+
+        Py_BEGIN_ALLOW_THREADS
+
+        status = updateSceneArrays(pointData, numPoints, triangleData, numTriangles, scene);
+
+        if (status)
+        {
+            parallelFor(0, numBones, 1, [&](int begin, int end)
+            {
+                for (int b = begin; b < end; b++)
+                {
+                    MStatus boneStatus = projectBone(
+                        scene,
+                        boneData + (b * 16),
+                        directionData + (b * 16),
+                        arguments.params,
+                        arguments.lod,
+                        meshes[b]
+                    );
+
+                    failed[b] = boneStatus ? 0 : 1;
+                }
+            });
+        }
+
+        Py_END_ALLOW_THREADS
+
+        if (!status)
+        {
+            PyErr_SetString(PyExc_ValueError, "triangles must index the points.");
+        } else if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+            PyErr_SetString(PyExc_RuntimeError, "boneToMesh failed to project a bone.");
+        } else if (!many) {
+            result = toTuple(meshes[0]);
+        } else {
+            result = PyList_New(numBones);
+
+            for (int b = 0; result != nullptr && b < numBones; b++)
+            {
+                PyObject *mesh = toTuple(meshes[b]);
+
+                if (mesh == nullptr)
+                {
+                    Py_CLEAR(result);
+                } else {
+                    PyList_SET_ITEM(result, b, mesh);
+                }
+            }
+        }
+    }
+
+    Py_XDECREF(points);
+    Py_XDECREF(triangles);
+    Py_XDECREF(boneMatrices);
+    Py_XDECREF(directionMatrices);
+
+    return result;
+}
+
+
+static PyObject* project(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return projectBones(args, kwargs, false);
+}
+
+
+static PyObject* projectMany(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return projectBones(args, kwargs, true);
+}
+
+
+static PyMethodDef BONE_TO_MESH_METHODS[] = {
+    {
+        "project", (PyCFunction) project, METH_VARARGS | METH_KEYWORDS,
+        "project(points, triangles, boneMatrix, directionMatrix=None, boneLength=1.0, maxDistance=FLT_MAX, radius=1.0,\n"
+        "        subdivisionsX=8, subdivisionsY=4, direction=0, fillPartialLoops=0, hitPolicy=0, hitIndex=1, lod=0)\n"
+        "\n"
+        "Projects a bone onto a mesh and returns the points (n, 3), polygon counts and polygon connects of the proxy.\n"
+        "The direction matrix defaults to the bone matrix."
+    },
+    {
+        "projectMany", (PyCFunction) projectMany, METH_VARARGS | METH_KEYWORDS,
+        "projectMany(points, triangles, boneMatrices, directionMatrices=None, ...)\n"
+        "\n"
+        "Projects each of the (b, 4, 4) bone matrices onto the same mesh in parallel and returns a list of\n"
+        "(points, polygon counts, polygon connects), one per bone. Takes the same keywords as project."
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+
+#if PY_MAJOR_VERSION >= 3
+
+static struct PyModuleDef BONE_TO_MESH_MODULE = {
+    PyModuleDef_HEAD_INIT, "boneToMeshPython", "Projects bones onto meshes given as NumPy arrays.", -1, BONE_TO_MESH_METHODS
+};
+
+PyMODINIT_FUNC PyInit_boneToMeshPython()
+{
+    import_array();
+
+    // The worker threads must be joined before the interpreter goes away.
+    Py_AtExit(stopThreads);
+
+    return PyModule_Create(&BONE_TO_MESH_MODULE);
+}
+
+#else
+
+PyMODINIT_FUNC initboneToMeshPython()
+{
+    import_array();
+
+    // The worker threads must be joined before the interpreter goes away.
+    Py_AtExit(stopThreads);
+
+    Py_InitModule3("boneToMeshPython", BONE_TO_MESH_METHODS, "Projects bones onto meshes given as NumPy arrays.");
+}
+
+#endif
@@ -6,10 +6,15 @@
 #define NOMINMAX
 
 #include "boneToMesh.h"
+#include "boneToMeshRayQueue.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cfloat>
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <maya/MFloatArray.h>
@@ -34,19 +39,231 @@ const short FILL_SHORTEST = 1;
 const short FILL_LONGEST  = 2;
 const short FILL_AVERAGE  = 3;
 const short FILL_RADIUS   = 4;
+const short FILL_NEAREST  = 5;
+
+const short SYMMETRY_NONE = 0;
+const short SYMMETRY_X    = 1;
+const short SYMMETRY_Y    = 2;
+const short SYMMETRY_Z    = 3;
+
+
+const double RAY_ALIGNED_COSINE = 0.99;     // rings this square to the bone count as coherent
 
 MStatus boneToMesh(
     const MObject &inMesh, 
     const MObject &components,
     const MMatrix &boneMatrix, 
     const MMatrix &directionMatrix, 
-    BoneToMeshParams &params,
+    const BoneToMeshParams &params,
+    MObject &outMesh
+) {
+    std::vector<MObject> inMeshes(1, inMesh);
+    std::vector<MObject> meshComponents(1, components);
+
+    return boneToMesh(inMeshes, meshComponents, boneMatrix, directionMatrix, params, outMesh);
+}
+
+MStatus boneToMesh(
+    const std::vector<MObject> &inMeshes, 
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    const BoneToMeshParams &params,
     MObject &outMesh
 ) {
     MStatus status;
 
+    BoneToMeshScene scene;
     BoneToMeshProjection proj;
+    BoneToMeshParams projParams = params;
+
+    status = updateScene(inMeshes, components, scene);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    initializeProjection(boneMatrix, directionMatrix, projParams, proj);
+    projectionVectors(projParams, proj);
+    projectBoneToMesh(scene, projParams, proj);
+    fillPartialLoops(scene, projParams, proj);
+    createMesh(projParams, proj, outMesh);
+
+    return MStatus::kSuccess;
+}
+
+MStatus boneToMeshMirror(
+    BoneToMeshScene &mirrorScene,
+    const MMatrix &mirrorBoneMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshProjection &proj,
+    BoneToMeshProjection &mirrorProj,
+    bool &mirrored
+) {
+    MStatus status;
+
+    mirrored = false;
+
+    if (params.symmetry == SYMMETRY_NONE)
+    {
+        return MStatus::kInvalidParameter;
+    }
+
+    // Reflecting the direction matrix reflects every ray, so the mirror bone 
+    // is sampled along the mirror images of the traced rays.
+    MMatrix reflection = symmetryMatrix(params.symmetry);
+
+    initializeProjection(mirrorBoneMatrix, proj.directionMatrix * reflection, params, mirrorProj);
+
+    bool symmetricMesh = false;
+
+    if (isBoneSymmetric(params, proj, mirrorProj))
+    {
+        status = isMeshSymmetric(mirrorScene, params, symmetricMesh);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    if (symmetricMesh)
+    {
+        mirrorProjection(params, proj, mirrorProj);
+        mirrored = true;
+    } else {
+        // The selected faces belong to the traced side of the mesh, 
+        // so the mirror scene is expected to hold the whole meshes.
+        projectionVectors(params, mirrorProj);
+        projectBoneToMesh(mirrorScene, params, mirrorProj);
+        fillPartialLoops(mirrorScene, params, mirrorProj);
+
+        MFloatVector reflectedDirection = MFloatVector(MVector(proj.directionVector) * reflection);
+        mirrorProj.reverseWinding = (mirrorProj.directionVector * reflectedDirection) >= 0.0f;
+    }
+
+    return MStatus::kSuccess;
+}
+
+// The spokes of the child's first ring are matched to the spokes of the 
+// parent's last ring, keeping the child's winding, and the ring is given 
+// the parent's rays and hits.
+static void shareJointRing(BoneToMeshParams &params, const BoneToMeshProjection &parent, BoneToMeshProjection &child)
+{
+    uint numX = params.subdivisionsX;
+    uint lastRing = (params.subdivisionsY - 1) * numX;
+
+    const float* parentDirections = &parent.rayDirections[lastRing * 3];
+    float*       childDirections  = child.rayDirections.data();
+
+    auto alignment = [&](uint parentSpoke, uint childSpoke) {
+        const float* a = &parentDirections[parentSpoke * 3];
+        const float* b = &childDirections[childSpoke * 3];
+        return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+    };
+
+    uint  offset = 0;
+    float bestAlignment = -FLT_MAX;
+
+    for (uint sa = 0; sa < numX; sa++)
+    {
+        float a = alignment(sa, 0);
+
+        if (a > bestAlignment)
+        {
+            bestAlignment = a;
+            offset = sa;
+        }
+    }
+
+    // The child's spokes may turn the other way around the joint.
+    uint step = alignment((offset + 1) % numX, 1) >= alignment((offset + numX - 1) % numX, 1) ? 1 : numX - 1;
+
+    child.jointSpokes.resize(numX);
+
+    for (uint sa = 0; sa < numX; sa++)
+    {
+        child.jointSpokes[sa] = (offset + (sa * step)) % numX;
+    }
+
+    child.hits.resize(child.maxVertices);
+
+    std::copy(&parent.raySources[(params.subdivisionsY - 1) * 3], &parent.raySources[params.subdivisionsY * 3], child.raySources.begin());
+
+    for (uint sa = 0; sa < numX; sa++)
+    {
+        uint idx = lastRing + child.jointSpokes[sa];
+
+        std::copy(&parent.rayDirections[idx * 3], &parent.rayDirections[(idx + 1) * 3], &childDirections[sa * 3]);
+        child.hits[sa] = parent.hits[idx];
+    }
+}
+
+
+// Each bone of a chain ends at the next one, where the last ring of the bone
+// is also the first ring of the next. Joint rings are traced once and give 
+// both bones the same points.
+MStatus boneToMeshChain(
+    const BoneToMeshScene &scene,
+    const std::vector<MMatrix> &boneMatrices, 
+    const std::vector<MMatrix> &directionMatrices, 
+    BoneToMeshParams &params,
+    std::vector<BoneToMeshProjection> &projs
+) {
+    MStatus status;
+
+    size_t numBones = boneMatrices.size();
+
+    if (numBones == 0 || directionMatrices.size() != numBones || params.subdivisionsY < 2)
+    {
+        return MStatus::kInvalidParameter;
+    }
+
+    projs.resize(numBones);
+
+    for (size_t i = 0; i < numBones; i++)
+    {
+        BoneToMeshProjection &proj = projs[i];
+
+        initializeProjection(boneMatrices[i], directionMatrices[i], params, proj);
+
+        if (i + 1 < numBones)
+        {
+            proj.directionVector = MFloatPoint(MPoint::origin * boneMatrices[i + 1]) - proj.startPoint;
+        }
+
+        status = projectionVectors(params, proj);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (i > 0)
+        {
+            shareJointRing(params, projs[i - 1], proj);
+        }
+
+        status = projectBoneToMesh(scene, params, proj);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        status = fillPartialLoops(scene, params, proj);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // Filling the same hits fills the same spokes, but the filled points 
+        // are taken from the parent so that the joint matches exactly.
+        if (i > 0)
+        {
+            const BoneToMeshProjection &parent = projs[i - 1];
+
+            uint lastRing = (params.subdivisionsY - 1) * params.subdivisionsX;
+
+            for (uint sa = 0; sa < params.subdivisionsX; sa++)
+            {
+                proj.points[sa] = parent.points[lastRing + proj.jointSpokes[sa]];
+            }
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
 
+MStatus initializeProjection(
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshProjection &proj
+) {
     proj.boneMatrix = boneMatrix;
     proj.directionMatrix = directionMatrix;
 
@@ -79,284 +296,1513 @@ MStatus boneToMesh(
     proj.startPoint = MFloatPoint(MPoint::origin * proj.boneMatrix);
     proj.maxVertices = params.subdivisionsY * params.subdivisionsX;
 
-    projectionVectors(params, proj);
-    projectBoneToMesh(inMesh, components, params, proj);
-    fillPartialLoops(params, proj);
-    createMesh(params, proj, outMesh);
+    proj.vertexIndex = 0;
+    proj.reverseWinding = false;
+    proj.jointSpokes.clear();
 
     return MStatus::kSuccess;
 }
 
-MStatus projectionVectors(BoneToMeshParams &params, BoneToMeshProjection &proj)
+// Spoke directions are cos(a) * u + sin(a) * v, where u and v are the rows of 
+// the direction matrix that the projection vector of the long axis and its 
+// rotation by 90 degrees map to (Y then Z about X, Z then X about Y, X then Y 
+// about Z). The directions are the same for every ring.
+template <int Axis>
+static void projectionVectorsKernel(BoneToMeshParams &params, BoneToMeshProjection &proj)
 {
-    MStatus status;
+    const int uRow = (Axis + 1) % 3;
+    const int vRow = (Axis + 2) % 3;
+
+    const float u[3] = {
+        (float) proj.directionMatrix[uRow][0], 
+        (float) proj.directionMatrix[uRow][1], 
+        (float) proj.directionMatrix[uRow][2]
+    };
 
-    proj.raySources.resize(params.subdivisionsY);
-    proj.rayDirections.resize(proj.maxVertices);
+    const float v[3] = {
+        (float) proj.directionMatrix[vRow][0], 
+        (float) proj.directionMatrix[vRow][1], 
+        (float) proj.directionMatrix[vRow][2]
+    };
 
-   for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    const float start[3]     = {proj.startPoint.x, proj.startPoint.y, proj.startPoint.z};
+    const float direction[3] = {proj.directionVector.x, proj.directionVector.y, proj.directionVector.z};
+
+    const uint   numX   = params.subdivisionsX;
+    const float* circle = proj.circle.data();
+
+    float* raySources    = proj.raySources.data();
+    float* rayDirections = proj.rayDirections.data();
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
     {
         float t = float(sh) / float(params.subdivisionsY - 1);
-        MFloatPoint raySource(proj.startPoint + (proj.directionVector * t));
 
-        proj.raySources[sh] = raySource; 
+        raySources[(sh * 3) + 0] = start[0] + (direction[0] * t);
+        raySources[(sh * 3) + 1] = start[1] + (direction[1] * t);
+        raySources[(sh * 3) + 2] = start[2] + (direction[2] * t);
+
+        float* ringDirections = rayDirections + (sh * numX * 3);
+
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            float c = circle[(sa * 2) + 0];
+            float s = circle[(sa * 2) + 1];
+
+            ringDirections[(sa * 3) + 0] = (c * u[0]) + (s * v[0]);
+            ringDirections[(sa * 3) + 1] = (c * u[1]) + (s * v[1]);
+            ringDirections[(sa * 3) + 2] = (c * u[2]) + (s * v[2]);
+        }
+    }
+}
+
+
+MStatus projectionVectors(BoneToMeshParams &params, BoneToMeshProjection &proj)
+{
+    typedef void (*Kernel)(BoneToMeshParams&, BoneToMeshProjection&);
+
+    static const Kernel kernels[3] = {
+        projectionVectorsKernel<0>,
+        projectionVectorsKernel<1>,
+        projectionVectorsKernel<2>
+    };
 
-        MTransformationMatrix dxMatrix(proj.directionMatrix);
-        dxMatrix.setTranslation(MVector(raySource), MSpace::kWorld);
+    if (params.direction < 0 || params.direction > 2)
+    {
+        return MStatus::kInvalidParameter;
+    }
 
-        MMatrix dMatrix = dxMatrix.asMatrix();
+    if (proj.circleSubdivisions != params.subdivisionsX)
+    {
+        proj.circle.resize(params.subdivisionsX * 2);
+        proj.circleSubdivisions = params.subdivisionsX;
 
         for (uint sa = 0; sa < params.subdivisionsX; sa++)
         {
             double a = (2.0 * M_PI) * (float(sa) / float(params.subdivisionsX));
-            
-            uint idx = (sh * params.subdivisionsX) + sa;
-            MVector ray(proj.projectionVector);
-            ray = ray.rotateBy(proj.longAxis, a);
-            ray *= dMatrix;
 
-            proj.rayDirections[idx] = MFloatVector(ray);
+            proj.circle[(sa * 2) + 0] = (float) std::cos(a);
+            proj.circle[(sa * 2) + 1] = (float) std::sin(a);
         }
     }
+
+    proj.raySources.resize(params.subdivisionsY * 3);
+    proj.rayDirections.resize(proj.maxVertices * 3);
+
+    kernels[params.direction](params, proj);
     
     return MStatus::kSuccess;
 }
 
 
-MStatus projectBoneToMesh(
-    const MObject &inMesh, 
-    const MObject &components, 
-    BoneToMeshParams &params, 
-    BoneToMeshProjection &proj
-) {
-    MStatus status;
-
-    MFnMesh inMeshFn(inMesh);
+// Scene versions are shared by every node so a projection can never mistake
+// one scene for another.
+static std::atomic<uint64_t> sceneVersion(0);
 
-    MMeshIsectAccelParams accelParams = inMeshFn.autoUniformGridParams();
 
-    bool useComponents = !components.isNull();
+// Switching build methods or layouts starts the mesh over from an empty 
+// tree. Automatic meshes choose their own method on every update.
+static void matchSceneMesh(BoneToMeshScene &scene, size_t i)
+{
+    BoneToMeshBVH &bvh = scene.meshes[i];
 
-    MIntArray faceIds;
-    MIntArray* faceIds_ptr = NULL;
+    bool automatic = scene.buildMethod == BVH_BUILD_AUTOMATIC;
 
-    if (useComponents)
+    if (bvh.automatic != automatic || (!automatic && bvh.buildMethod != scene.buildMethod) || bvh.compact != scene.compact)
     {
-        MFnSingleIndexedComponent fnComponents(components);
+        bvh = BoneToMeshBVH();
+        bvh.buildMethod = automatic ? BVH_BUILD_SAH : scene.buildMethod;
+        bvh.compact = scene.compact;
+        bvh.automatic = automatic;
+    }
 
-        int numComponents = fnComponents.elementCount();
-        faceIds.setLength(numComponents);
+    bvh.rays = scene.rays;
+}
 
-        for (int i = 0; i < numComponents; i++)
-        {
-            faceIds[i] = fnComponents.element(i);
-        }
 
-        faceIds_ptr = &faceIds;
-    }
+MStatus updateScene(
+    const std::vector<MObject> &inMeshes, 
+    const std::vector<MObject> &components, 
+    BoneToMeshScene &scene
+) {
+    MStatus status;
 
-    float tolerance = (float) 1e-6;
-    float maxParams = (float) params.maxDistance; 
+    bool resized = scene.meshes.size() != inMeshes.size() || scene.nodes.empty();
+    bool changed = resized;
 
-    proj.indices.resize(proj.maxVertices, -1);
-    proj.points.resize(proj.maxVertices);
+    scene.meshes.resize(inMeshes.size());
+    scene.changes.resize(inMeshes.size());
 
-    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    // Only the meshes that changed since the last update are rebuilt.
+    for (size_t i = 0; i < inMeshes.size(); i++)
     {
-        for (uint sa = 0; sa < params.subdivisionsX; sa++)
-        {
-            uint idx = (sh * params.subdivisionsX) + sa;
-            MFloatPointArray hitPoints;
-
-            bool hits = inMeshFn.allIntersections(
-                proj.raySources[sh], 
-                proj.rayDirections[idx],
-                faceIds_ptr,    
-                NULL,           // tri Ids
-                true,           // sort ids 
-                MSpace::kObject,// space
-                maxParams,
-                false,          // test both directions
-                &accelParams,   // acceleration parameters
-                true,           // sort hits
-                hitPoints,      
-                NULL,           // hit ray params
-                NULL,           // hit faces
-                NULL,           // hit triangles
-                NULL,           // hit barycentric coordinates 
-                NULL,           // hit barycentric coordinates 
-                tolerance,
-                &status
-            );
-
-            if (hits)
-            {
-                proj.indices[idx] = proj.vertexIndex++;
-                proj.points[idx] = MFloatPoint(hitPoints[0]);
-            }
+        bool meshChanged = false;
 
-            CHECK_MSTATUS(status);
-        }
+        matchSceneMesh(scene, i);
+
+        status = updateSceneMesh(
+            inMeshes[i], 
+            i < components.size() ? components[i] : MObject::kNullObj,
+            scene.meshes[i],
+            scene.changes[i],
+            meshChanged
+        );
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        scene.changes[i].all = scene.changes[i].all || resized;
+
+        changed = changed || meshChanged;
+    }
+
+    if (changed)
+    {
+        buildSceneBVH(scene);
+
+        scene.previousVersion = scene.version;
+        scene.version = ++sceneVersion;
     }
 
     return MStatus::kSuccess;
 }
 
-MStatus fillPartialLoops(BoneToMeshParams &params, BoneToMeshProjection &proj)
+
+// FNV-1a over the triangle vertices and faces.
+static uint64_t topologyHash(const std::vector<int> &triangles, const std::vector<int> &faces)
 {
-    MStatus status; 
+    uint64_t hash = 14695981039346656037ull;
 
-    if (params.fillPartialLoopsMethod != FILL_NONE)
+    for (const std::vector<int> *values : {&triangles, &faces})
     {
-        // Fill in missing points.
-        for (uint sh = 0; sh < params.subdivisionsY; sh++)
+        for (int value : *values)
         {
-            int numHits = 0;
+            hash = (hash ^ uint64_t(uint32_t(value))) * 1099511628211ull;
+        }
+    }
 
-            float rayLength = params.fillPartialLoopsMethod == FILL_SHORTEST ? FLT_MAX : 0.0f;
+    return hash;
+}
 
-            for (uint sa = 0; sa < params.subdivisionsX; sa++)
-            {
-                uint idx = (sh * params.subdivisionsX) + sa;
 
-                if (proj.indices[idx] != -1) 
-                {
-                    switch (params.fillPartialLoopsMethod)
-                    {
-                        case FILL_SHORTEST: 
-                            rayLength = std::min(rayLength, (proj.points[idx] - proj.raySources[sh]).length());
-                            break;
-                        case FILL_LONGEST: 
-                            rayLength = std::max(rayLength, (proj.points[idx] - proj.raySources[sh]).length());
-                            break;
-                        case FILL_AVERAGE: 
-                            rayLength += (proj.points[idx] - proj.raySources[sh]).length();
-                            break;
-                    }
-                    
-                    numHits++;
-                }
-            }
+// Takes the points, triangles and faces of a mesh into its tree. Only the 
+// bounds are updated while the topology stays the same.
+static void updateMeshPoints(
+    const float *rawPoints, 
+    int numPoints, 
+    std::vector<int> &triangles, 
+    std::vector<int> &faces, 
+    BoneToMeshBVH &bvh, 
+    BoneToMeshChange &change, 
+    bool &changed
+) {
+    uint64_t topology = topologyHash(triangles, faces);
 
-            if (numHits == 0) 
-            {
-                continue; 
-            }
+    bool sameTopology = topology == bvh.topology && triangles.size() == bvh.triangles.size();
+    bool samePoints = (
+        sameTopology && 
+        bvh.points.size() == size_t(numPoints * 3) && 
+        std::equal(rawPoints, rawPoints + (numPoints * 3), bvh.points.begin())
+    );
 
-            switch(params.fillPartialLoopsMethod)
-            {
-                case FILL_AVERAGE: rayLength /= float(numHits); break;
-                case FILL_RADIUS:  rayLength = (float) params.radius;   break;
-            }
+    // A new method is built from scratch whatever changed.
+    if (bvh.automatic)
+    {
+        int buildMethod = chooseBuildMethod(bvh, int(triangles.size() / 3), bvh.rays, sameTopology, samePoints);
 
-            for (uint sa = 0; sa < params.subdivisionsX; sa++)
-            {
-                uint idx = (sh * params.subdivisionsX) + sa;
+        if (buildMethod != bvh.buildMethod)
+        {
+            bvh.buildMethod = buildMethod;
 
-                if (proj.indices[idx] == -1) 
-                {
-                    proj.indices[idx] = proj.vertexIndex++;
-                    proj.points[idx] = proj.raySources[sh] + (proj.rayDirections[idx] * rayLength);
-                }
-            }
+            sameTopology = false;
+            samePoints = false;
         }
+    }
 
-        // Reset the vertex indices
-        proj.vertexIndex = 0;
-
-        for (uint sh = 0; sh < params.subdivisionsY; sh++)
-        {
-            for (uint sa = 0; sa < params.subdivisionsX; sa++)
-            {
-                uint idx = (sh * params.subdivisionsX) + sa;
+    changed = !samePoints;
 
-                if (proj.indices[idx] != -1) 
-                {
-                    proj.indices[idx] = proj.vertexIndex++; 
-                }
-            }
-        }
+    if (samePoints)
+    {
+        change.all = false;
+        change.triangles.clear();
+    } else if (sameTopology) {
+        // Deforming mesh - keep the tree and update its bounds.
+        diffBVH(bvh, rawPoints, change);
+
+        bvh.points.assign(rawPoints, rawPoints + (numPoints * 3));
+
+        // A compact tree comes back from a rebuild with its triangles in a
+        // new order, so the moved triangles no longer line up.
+        change.all = refitBVH(bvh) && bvh.compact;
+    } else {
+        bvh.points.assign(rawPoints, rawPoints + (numPoints * 3));
+        bvh.triangles.swap(triangles);
+        bvh.faces.swap(faces);
+        bvh.topology = topology;
+
+        buildBVH(bvh);
+
+        change.all = true;
+        change.triangles.clear();
     }
 
-    return MStatus::kSuccess;
 }
 
 
-MStatus createMesh(BoneToMeshParams &params, BoneToMeshProjection &proj, MObject &outMesh) 
-{
-    MStatus status;   
+MStatus updateSceneMesh(
+    const MObject &inMesh, 
+    const MObject &components, 
+    BoneToMeshBVH &bvh, 
+    BoneToMeshChange &change,
+    bool &changed
+) {
+    MStatus status;
 
-    MFloatPointArray vertexArray(proj.maxVertices);
-    MIntArray polygonCounts(proj.maxVertices, 4);
-    MIntArray polygonConnects(proj.maxVertices * 4, -1);
+    MFnMesh inMeshFn(inMesh, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
 
-    int numVertices = 0;
-    int numPolygons = 0;
+    int numPoints = inMeshFn.numVertices();
+    int numPolygons = inMeshFn.numPolygons();
 
-    // Face order - clockwise vs counter-clockwise
-    int cw = (int) params.boneLength >= 0;
-    int cc = (int) params.boneLength < 0;
+    const float* rawPoints = inMeshFn.getRawPoints(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
 
-    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    MIntArray triangleCounts;
+    MIntArray triangleVertices;
+
+    status = inMeshFn.getTriangles(triangleCounts, triangleVertices);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    std::vector<bool> useFace(numPolygons, components.isNull());
+
+    if (!components.isNull())
     {
-        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        MFnSingleIndexedComponent fnComponents(components);
+
+        int numComponents = fnComponents.elementCount();
+
+        for (int i = 0; i < numComponents; i++)
         {
-            uint idx = (sh * params.subdivisionsX) + sa;
+            int f = fnComponents.element(i);
 
-            if (proj.indices[idx] != -1) 
-            { 
-                vertexArray.set(proj.points[idx], (uint) numVertices);
-                numVertices++;
-            } 
+            if (f >= 0 && f < numPolygons) { useFace[f] = true; }
         }
-    }           
+    }
+
+    std::vector<int> triangles;
+    std::vector<int> faces;
 
-    for (uint sh = 0; sh < params.subdivisionsY - 1; sh++)
+    triangles.reserve(triangleVertices.length());
+    faces.reserve(triangleVertices.length() / 3);
+
+    uint triangleVertex = 0;
+
+    for (int f = 0; f < numPolygons; f++)
     {
-        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        for (int t = 0; t < triangleCounts[f]; t++)
         {
-            uint na = (sa + 1) % (params.subdivisionsX);
+            if (useFace[f])
+            {
+                triangles.push_back(triangleVertices[triangleVertex + 0]);
+                triangles.push_back(triangleVertices[triangleVertex + 1]);
+                triangles.push_back(triangleVertices[triangleVertex + 2]);
+                faces.push_back(f);
+            }
+
+            triangleVertex += 3;
+        }
+    }
 
-            uint idx0 = (sh * params.subdivisionsX) + sa;
-            uint idx1 = (sh * params.subdivisionsX) + na;
-            uint idx2 = ((sh + 1) * params.subdivisionsX) + sa;
-            uint idx3 = ((sh + 1) * params.subdivisionsX) + na;
+    updateMeshPoints(rawPoints, numPoints, triangles, faces, bvh, change, changed);
 
-            int vtx0 = proj.indices[idx0];
-            int vtx1 = proj.indices[idx1];
-            int vtx2 = proj.indices[idx2];
-            int vtx3 = proj.indices[idx3];           
+    return MStatus::kSuccess;
+}
 
-            if (vtx0 == -1 || vtx1 == -1 || vtx2 == -1 || vtx3 == -1) { continue; }        
 
-            // (vtx# * clockwise) + (vtx# * counter-clockwise) 
-            // to avoid the if branch
-            polygonConnects[(numPolygons * 4) + 0] = (vtx0 * cw) + (vtx0 * cc);
-            polygonConnects[(numPolygons * 4) + 1] = (vtx1 * cw) + (vtx2 * cc);
-            polygonConnects[(numPolygons * 4) + 2] = (vtx3 * cw) + (vtx3 * cc);
-            polygonConnects[(numPolygons * 4) + 3] = (vtx2 * cw) + (vtx1 * cc);
+MStatus updateSceneArrays(
+    const float *points, 
+    int numPoints, 
+    const int *triangles, 
+    int numTriangles, 
+    BoneToMeshScene &scene
+) {
+    bool resized = scene.meshes.size() != 1 || scene.nodes.empty();
+    bool changed = false;
 
-            numPolygons++; 
-        }
+    scene.meshes.resize(1);
+    scene.changes.resize(1);
+
+    matchSceneMesh(scene, 0);
+
+    for (int i = 0; i < numTriangles * 3; i++)
+    {
+        if (triangles[i] < 0 || triangles[i] >= numPoints) { return MStatus::kInvalidParameter; }
     }
 
-    vertexArray.setLength(numVertices);
-    polygonCounts.setLength(numPolygons);
-    polygonConnects.setLength(numPolygons * 4);
+    std::vector<int> meshTriangles(triangles, triangles + (numTriangles * 3));
+    std::vector<int> faces(numTriangles);
 
-    MFnMesh outMeshFn;
+    for (int t = 0; t < numTriangles; t++) { faces[t] = t; }
 
-    outMeshFn.create(
-        numVertices,
-        numPolygons,
-        vertexArray,
-        polygonCounts,
-        polygonConnects,
-        outMesh,
-        &status
-    );
+    updateMeshPoints(points, numPoints, meshTriangles, faces, scene.meshes[0], scene.changes[0], changed);
 
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+    scene.changes[0].all = scene.changes[0].all || resized;
 
-    return MStatus::kSuccess;
+    if (changed || resized)
+    {
+        buildSceneBVH(scene);
+
+        scene.previousVersion = scene.version;
+        scene.version = ++sceneVersion;
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus projectBoneToMesh(
+    const BoneToMeshScene &scene, 
+    BoneToMeshParams &params, 
+    BoneToMeshProjection &proj
+) {
+    MStatus status;
+
+    float maxParams = (float) params.maxDistance; 
+
+    proj.indices.assign(proj.maxVertices, -1);
+    proj.points.resize(proj.maxVertices);
+    proj.vertexIndex = 0;
+
+    // The hits of the previous trace are kept when the rays are the same. If
+    // the scene has not changed since, all of them still stand, and if it 
+    // changed once only the rays near the moved triangles are traced again.
+    bool sameRays = (
+        proj.hits.size() == size_t(proj.maxVertices) &&
+        proj.hitMaxParam == maxParams &&
+        proj.hitPolicy == params.hitPolicy &&
+        proj.hitIndex == params.hitIndex &&
+        proj.hitRaySources == proj.raySources &&
+        proj.hitRayDirections == proj.rayDirections
+    );
+
+    bool retraceAll = !sameRays || (proj.hitVersion != scene.version && proj.hitVersion != scene.previousVersion);
+    bool retraceDirty = !retraceAll && proj.hitVersion != scene.version;
+
+    proj.hits.resize(proj.maxVertices);
+
+    // The rays to trace go to the shared ray queue, which traces them 
+    // together with the rays of every other node evaluating at the time.
+    std::shared_ptr<BoneToMeshRayBatch> batch = std::make_shared<BoneToMeshRayBatch>();
+    batch->scene = &scene;
+    batch->hitPolicy = params.hitPolicy;
+    batch->hitIndex = params.hitIndex;
+
+    // Rings that are not square to the bone, as in world space, spray rays 
+    // across the mesh in an order the queue may sort them out of.
+    const double* ringAxis = proj.directionMatrix[proj.longAxis];
+    MVector boneAxis(proj.directionVector);
+
+    double alignment = std::abs(boneAxis.normal() * MVector(ringAxis[0], ringAxis[1], ringAxis[2]).normal());
+
+    batch->incoherent = alignment < RAY_ALIGNED_COSINE;
+    batch->background = proj.cancelled != nullptr;
+    batch->cancelled = proj.cancelled;
+
+    std::vector<uint> batchIndices;
+
+    // A shared first ring already holds the hits of the parent bone.
+    uint firstRing = proj.jointSpokes.empty() ? 0 : 1;
+
+    for (uint sh = firstRing; sh < params.subdivisionsY; sh++)
+    {
+        const float* raySource = &proj.raySources[sh * 3];
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            const float* rayDirection = &proj.rayDirections[idx * 3];
+
+            BoneToMeshRay ray = {
+                {raySource[0], raySource[1], raySource[2]},
+                {rayDirection[0], rayDirection[1], rayDirection[2]},
+                maxParams
+            };
+
+            if (retraceAll || (retraceDirty && isRayDirty(scene, ray, proj.hits[idx], params.hitPolicy)))
+            {
+                batch->rays.push_back(ray);
+                batchIndices.push_back(idx);
+            }
+        }
+    }
+
+    if (!batch->rays.empty())
+    {
+        traceRays(batch);
+
+        for (size_t i = 0; i < batchIndices.size(); i++)
+        {
+            proj.hits[batchIndices[i]] = batch->hits[i];
+        }
+    }
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        const float* raySource = &proj.raySources[sh * 3];
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            const float* rayDirection = &proj.rayDirections[idx * 3];
+            const BoneToMeshHit &hit = proj.hits[idx];
+
+            if (hit.mesh != -1)
+            {
+                proj.indices[idx] = proj.vertexIndex++;
+                proj.points[idx] = MFloatPoint(
+                    raySource[0] + (rayDirection[0] * hit.param),
+                    raySource[1] + (rayDirection[1] * hit.param),
+                    raySource[2] + (rayDirection[2] * hit.param)
+                );
+            }
+        }
+    }
+
+    if (!sameRays)
+    {
+        proj.hitRaySources = proj.raySources;
+        proj.hitRayDirections = proj.rayDirections;
+        proj.hitMaxParam = maxParams;
+        proj.hitPolicy = params.hitPolicy;
+        proj.hitIndex = params.hitIndex;
+    }
+
+    proj.hitVersion = scene.version;
+
+    return MStatus::kSuccess;
+}
+
+// Filled in points are numbered after the hits, renumber them in grid order.
+static void renumberVertices(BoneToMeshProjection &proj)
+{
+    int vertexIndex = 0;
+
+    for (int idx = 0; idx < proj.maxVertices; idx++)
+    {
+        bool hit = proj.indices[idx] != -1;
+
+        proj.indices[idx] = hit ? vertexIndex : -1;
+        vertexIndex += (int) hit;
+    }
+
+    proj.vertexIndex = vertexIndex;
+}
+
+
+// The per-ring reductions are written without branches on the fill method 
+// or on whether a ray hit, so each instantiation is a plain min/max/sum loop.
+// Radius fills only need to know that a ring has hits, not how far they are.
+template <short Method>
+static void fillPartialLoopsKernel(const BoneToMeshScene &, BoneToMeshParams &params, BoneToMeshProjection &proj)
+{
+    const float missLength = Method == FILL_SHORTEST ? FLT_MAX : 0.0f;
+
+    // Fill in missing points.
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        const float* source = &proj.raySources[sh * 3];
+        const MFloatPoint raySource(source[0], source[1], source[2]);
+
+        const int*         indices = &proj.indices[sh * params.subdivisionsX];
+        const MFloatPoint* points  = &proj.points[sh * params.subdivisionsX];
+
+        int numHits = 0;
+
+        float rayLength = missLength;
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            bool hit = indices[sa] != -1;
+
+            numHits += (int) hit;
+
+            if (Method == FILL_RADIUS) { continue; }
+
+            float length = hit ? (points[sa] - raySource).length() : missLength;
+
+            if (Method == FILL_SHORTEST) { rayLength = std::min(rayLength, length); }
+            if (Method == FILL_LONGEST)  { rayLength = std::max(rayLength, length); }
+            if (Method == FILL_AVERAGE)  { rayLength += length; }
+        }
+
+        if (numHits == 0) 
+        {
+            continue; 
+        }
+
+        if (Method == FILL_AVERAGE) { rayLength /= float(numHits); }
+        if (Method == FILL_RADIUS)  { rayLength = (float) params.radius; }
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            if (proj.indices[idx] == -1) 
+            {
+                proj.indices[idx] = proj.vertexIndex++;
+                const float* rayDirection = &proj.rayDirections[idx * 3];
+
+                proj.points[idx] = MFloatPoint(
+                    source[0] + (rayDirection[0] * rayLength),
+                    source[1] + (rayDirection[1] * rayLength),
+                    source[2] + (rayDirection[2] * rayLength)
+                );
+            }
+        }
+    }
+
+    renumberVertices(proj);
+}
+
+
+// Missed rays are placed at the average length of the hits of their ring, 
+// then snapped to the nearest point on the meshes. The points of a ring are 
+// close together, so they are queried as one batch.
+static void fillPartialLoopsNearest(const BoneToMeshScene &scene, BoneToMeshParams &params, BoneToMeshProjection &proj)
+{
+    std::vector<float> guesses;
+    std::vector<float> closest;
+    std::vector<uint>  missed;
+
+    guesses.reserve(params.subdivisionsX * 3);
+    missed.reserve(params.subdivisionsX);
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        const float* source = &proj.raySources[sh * 3];
+        const MFloatPoint raySource(source[0], source[1], source[2]);
+
+        int numHits = 0;
+
+        float rayLength = 0.0f;
+
+        missed.clear();
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            if (proj.indices[idx] == -1)
+            {
+                missed.push_back(idx);
+            } else {
+                rayLength += (proj.points[idx] - raySource).length();
+                numHits++;
+            }
+        }
+
+        if (numHits == 0 || missed.empty()) 
+        {
+            continue; 
+        }
+
+        rayLength /= float(numHits);
+
+        guesses.resize(missed.size() * 3);
+        closest.resize(missed.size() * 3);
+
+        for (size_t i = 0; i < missed.size(); i++)
+        {
+            const float* rayDirection = &proj.rayDirections[missed[i] * 3];
+
+            for (int a = 0; a < 3; a++)
+            {
+                guesses[(i * 3) + a] = source[a] + (rayDirection[a] * rayLength);
+            }
+        }
+
+        if (!closestPoints(scene, guesses.data(), (int) missed.size(), closest.data())) 
+        {
+            closest = guesses;
+        }
+
+        for (size_t i = 0; i < missed.size(); i++)
+        {
+            proj.indices[missed[i]] = proj.vertexIndex++;
+            proj.points[missed[i]] = MFloatPoint(closest[(i * 3)], closest[(i * 3) + 1], closest[(i * 3) + 2]);
+        }
+    }
+
+    renumberVertices(proj);
+}
+
+
+static void fillPartialLoopsNone(const BoneToMeshScene &, BoneToMeshParams &, BoneToMeshProjection &)
+{
+}
+
+
+MStatus fillPartialLoops(const BoneToMeshScene &scene, BoneToMeshParams &params, BoneToMeshProjection &proj)
+{
+    typedef void (*Kernel)(const BoneToMeshScene&, BoneToMeshParams&, BoneToMeshProjection&);
+
+    static const Kernel kernels[6] = {
+        fillPartialLoopsNone,
+        fillPartialLoopsKernel<FILL_SHORTEST>,
+        fillPartialLoopsKernel<FILL_LONGEST>,
+        fillPartialLoopsKernel<FILL_AVERAGE>,
+        fillPartialLoopsKernel<FILL_RADIUS>,
+        fillPartialLoopsNearest
+    };
+
+    if (params.fillPartialLoopsMethod < FILL_NONE || params.fillPartialLoopsMethod > FILL_NEAREST)
+    {
+        return MStatus::kInvalidParameter;
+    }
+
+    kernels[params.fillPartialLoopsMethod](scene, params, proj);
+
+    return MStatus::kSuccess;
+}
+
+
+bool sameParams(const BoneToMeshParams &a, const BoneToMeshParams &b)
+{
+    return (
+        a.maxDistance == b.maxDistance &&
+        a.boneLength == b.boneLength &&
+        a.subdivisionsX == b.subdivisionsX &&
+        a.subdivisionsY == b.subdivisionsY &&
+        a.direction == b.direction &&
+        a.fillPartialLoopsMethod == b.fillPartialLoopsMethod &&
+        a.radius == b.radius &&
+        a.hitPolicy == b.hitPolicy &&
+        a.hitIndex == b.hitIndex
+    );
+}
+
+
+MStatus rigidState(
+    const std::vector<MObject> &inMeshes, 
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshRigidState &state
+) {
+    MStatus status;
+
+    MMatrix boneInverse = boneMatrix.inverse();
+
+    state.params = params;
+    state.directionMatrix = directionMatrix * boneInverse;
+    state.faces.clear();
+    state.numPoints.clear();
+    state.points.clear();
+
+    for (size_t i = 0; i < inMeshes.size(); i++)
+    {
+        if (i < components.size() && !components[i].isNull())
+        {
+            MIntArray elements;
+
+            status = MFnSingleIndexedComponent(components[i]).getElements(elements);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            for (uint e = 0; e < elements.length(); e++) { state.faces.push_back(elements[e]); }
+        }
+
+        state.faces.push_back(-1);
+
+        MFnMesh inMeshFn(inMeshes[i], &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        int numPoints = inMeshFn.numVertices();
+
+        const float* rawPoints = inMeshFn.getRawPoints(&status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        state.numPoints.push_back(numPoints);
+
+        // Every vertex, as a local deformation may move any few of them.
+        // This is linear in the vertices, far cheaper than tracing the rays.
+        size_t offset = state.points.size();
+        state.points.resize(offset + ((size_t) numPoints * 3));
+
+        float *points = state.points.data() + offset;
+
+        for (int p = 0; p < numPoints; p++)
+        {
+            MPoint pt = MPoint(rawPoints[(p * 3) + 0], rawPoints[(p * 3) + 1], rawPoints[(p * 3) + 2]) * boneInverse;
+
+            points[(p * 3) + 0] = (float) pt.x;
+            points[(p * 3) + 1] = (float) pt.y;
+            points[(p * 3) + 2] = (float) pt.z;
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+// The previous projection still holds in bone space when nothing it depends
+// on changed and every vertex stayed within tolerance in bone space.
+bool isRigidMotion(const BoneToMeshRigidCache &cache, const BoneToMeshRigidState &state, double tolerance)
+{
+    const BoneToMeshRigidState &previous = cache.state;
+
+    if (
+        !cache.valid ||
+        !sameParams(previous.params, state.params) ||
+        !previous.directionMatrix.isEquivalent(state.directionMatrix, tolerance) ||
+        previous.faces != state.faces ||
+        previous.numPoints != state.numPoints ||
+        previous.points.size() != state.points.size()
+    ) {
+        return false;
+    }
+
+    float tolerance2 = (float) (tolerance * tolerance);
+
+    for (size_t i = 0; i < state.points.size(); i += 3)
+    {
+        float dx = state.points[i + 0] - previous.points[i + 0];
+        float dy = state.points[i + 1] - previous.points[i + 1];
+        float dz = state.points[i + 2] - previous.points[i + 2];
+
+        if ((dx * dx) + (dy * dy) + (dz * dz) > tolerance2) { return false; }
+    }
+
+    return true;
+}
+
+
+void storeRigidProjection(BoneToMeshRigidState &state, BoneToMeshProjection &proj, BoneToMeshRigidCache &cache)
+{
+    MMatrix boneInverse = proj.boneMatrix.inverse();
+
+    cache.valid = true;
+    cache.state.params = state.params;
+    cache.state.directionMatrix = state.directionMatrix;
+    cache.state.faces.swap(state.faces);
+    cache.state.numPoints.swap(state.numPoints);
+    cache.state.points.swap(state.points);
+
+    cache.indices = proj.indices;
+    cache.vertexIndex = proj.vertexIndex;
+    cache.points.resize(proj.points.size());
+
+    for (size_t i = 0; i < proj.points.size(); i++)
+    {
+        cache.points[i] = MFloatPoint(MPoint(proj.points[i]) * boneInverse);
+    }
+}
+
+
+// Places the cached bone space projection on the bone of an initialized projection.
+void applyRigidProjection(const BoneToMeshRigidCache &cache, BoneToMeshProjection &proj)
+{
+    proj.indices = cache.indices;
+    proj.vertexIndex = cache.vertexIndex;
+    proj.points.resize(cache.points.size());
+
+    for (size_t i = 0; i < cache.points.size(); i++)
+    {
+        proj.points[i] = MFloatPoint(MPoint(cache.points[i]) * proj.boneMatrix);
+    }
+}
+
+
+size_t memoryProjection(const BoneToMeshProjection &proj)
+{
+    return (
+        ((proj.raySources.capacity() + proj.rayDirections.capacity() + proj.circle.capacity()) * sizeof(float)) +
+        ((proj.hitRaySources.capacity() + proj.hitRayDirections.capacity()) * sizeof(float)) +
+        (proj.indices.capacity() * sizeof(int)) +
+        (proj.points.capacity() * sizeof(MFloatPoint)) +
+        (proj.jointSpokes.capacity() * sizeof(uint)) +
+        (proj.hits.capacity() * sizeof(BoneToMeshHit))
+    );
+}
+
+
+size_t memoryRigidCache(const BoneToMeshRigidCache &cache)
+{
+    return (
+        ((cache.state.faces.capacity() + cache.state.numPoints.capacity() + cache.indices.capacity()) * sizeof(int)) +
+        (cache.state.points.capacity() * sizeof(float)) +
+        (cache.points.capacity() * sizeof(MFloatPoint))
+    );
+}
+
+
+// Frees the hits of the latest trace, so the next one traces every ray.
+void releaseHits(BoneToMeshProjection &proj)
+{
+    std::vector<BoneToMeshHit>().swap(proj.hits);
+    std::vector<float>().swap(proj.hitRaySources);
+    std::vector<float>().swap(proj.hitRayDirections);
+}
+
+
+MMatrix symmetryMatrix(int symmetry)
+{
+    MMatrix reflection;
+
+    switch (symmetry)
+    {
+        case SYMMETRY_X: reflection[0][0] = -1.0; break;
+        case SYMMETRY_Y: reflection[1][1] = -1.0; break;
+        case SYMMETRY_Z: reflection[2][2] = -1.0; break;
+    }
+
+    return reflection;
+}
+
+
+bool isBoneSymmetric(BoneToMeshParams &params, BoneToMeshProjection &proj, BoneToMeshProjection &mirrorProj)
+{
+    MMatrix reflection = symmetryMatrix(params.symmetry);
+
+    MPoint startPoint(MPoint(proj.startPoint) * reflection);
+    MPoint endPoint(MPoint(proj.startPoint + proj.directionVector) * reflection);
+
+    MPoint mirrorStartPoint(mirrorProj.startPoint);
+    MPoint mirrorEndPoint(mirrorProj.startPoint + mirrorProj.directionVector);
+
+    return (
+        startPoint.distanceTo(mirrorStartPoint) <= params.symmetryTolerance &&
+        endPoint.distanceTo(mirrorEndPoint) <= params.symmetryTolerance
+    );
+}
+
+
+MStatus isMeshSymmetric(const BoneToMeshScene &scene, BoneToMeshParams &params, bool &symmetric)
+{
+    std::vector<float> points;
+
+    for (const BoneToMeshBVH &bvh : scene.meshes)
+    {
+        points.insert(points.end(), bvh.points.begin(), bvh.points.end());
+    }
+
+    int numPoints = (int) points.size() / 3;
+    int axis = params.symmetry - 1;
+
+    symmetric = false;
+
+    if (axis < 0 || axis > 2) 
+    {
+        return MStatus::kInvalidParameter;
+    }
+
+    // Spatial hash with cells as large as the tolerance, so any point within 
+    // tolerance of a mirrored point is in one of the 27 surrounding cells.
+    float tolerance = (float) std::max(params.symmetryTolerance, 1e-5);
+    float tolerance2 = tolerance * tolerance;
+
+    auto cellCoord = [tolerance](float v) { return (long long) std::floor(v / tolerance); };
+    auto cellKey = [](long long x, long long y, long long z) { 
+        return ((x & 0x1FFFFF) << 42) | ((y & 0x1FFFFF) << 21) | (z & 0x1FFFFF); 
+    };
+
+    std::unordered_map<long long, int> cellHeads;
+    std::vector<int> cellNext(numPoints, -1);
+
+    cellHeads.reserve(numPoints);
+
+    for (int i = 0; i < numPoints; i++)
+    {
+        const float *p = &points[i * 3];
+        long long key = cellKey(cellCoord(p[0]), cellCoord(p[1]), cellCoord(p[2]));
+        
+        auto head = cellHeads.find(key);
+
+        if (head == cellHeads.end())
+        {
+            cellHeads[key] = i;
+        } else {
+            cellNext[i] = head->second;
+            head->second = i;
+        }
+    }
+
+    for (int i = 0; i < numPoints; i++)
+    {
+        float p[3] = {points[(i * 3) + 0], points[(i * 3) + 1], points[(i * 3) + 2]};
+        p[axis] = -p[axis];
+
+        long long cx = cellCoord(p[0]);
+        long long cy = cellCoord(p[1]);
+        long long cz = cellCoord(p[2]);
+
+        bool found = false;
+
+        for (long long x = cx - 1; x <= cx + 1 && !found; x++)
+        {
+            for (long long y = cy - 1; y <= cy + 1 && !found; y++)
+            {
+                for (long long z = cz - 1; z <= cz + 1 && !found; z++)
+                {
+                    auto head = cellHeads.find(cellKey(x, y, z));
+
+                    if (head == cellHeads.end()) { continue; }
+
+                    for (int j = head->second; j != -1 && !found; j = cellNext[j])
+                    {
+                        float dx = points[(j * 3) + 0] - p[0];
+                        float dy = points[(j * 3) + 1] - p[1];
+                        float dz = points[(j * 3) + 2] - p[2];
+
+                        found = (dx * dx) + (dy * dy) + (dz * dz) <= tolerance2;
+                    }
+                }
+            }
+        }
+
+        if (!found)
+        {
+            return MStatus::kSuccess;
+        }
+    }
+
+    symmetric = true;
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus mirrorProjection(BoneToMeshParams &params, BoneToMeshProjection &proj, BoneToMeshProjection &mirrorProj)
+{
+    MMatrix reflection = symmetryMatrix(params.symmetry);
+
+    mirrorProj.startPoint       = MFloatPoint(MPoint(proj.startPoint) * reflection);
+    mirrorProj.directionVector  = MFloatVector(MVector(proj.directionVector) * reflection);
+    mirrorProj.projectionVector = proj.projectionVector;
+    mirrorProj.longAxis         = proj.longAxis;
+
+    mirrorProj.maxVertices      = proj.maxVertices;
+    mirrorProj.maxPolygons      = proj.maxPolygons;
+    mirrorProj.vertexIndex      = proj.vertexIndex;
+    mirrorProj.indices          = proj.indices;
+
+    mirrorProj.raySources       = proj.raySources;
+    mirrorProj.rayDirections    = proj.rayDirections;
+    mirrorProj.points.resize(proj.points.size());
+
+    int axis = params.symmetry - 1;
+
+    for (size_t i = axis; i < mirrorProj.raySources.size(); i += 3)
+    {
+        mirrorProj.raySources[i] = -mirrorProj.raySources[i];
+    }
+
+    for (size_t i = axis; i < mirrorProj.rayDirections.size(); i += 3)
+    {
+        mirrorProj.rayDirections[i] = -mirrorProj.rayDirections[i];
+    }
+
+    for (size_t i = 0; i < proj.points.size(); i++)
+    {
+        mirrorProj.points[i] = MFloatPoint(MPoint(proj.points[i]) * reflection);
+    }
+
+    // A reflection turns the faces inside out.
+    mirrorProj.reverseWinding = !proj.reverseWinding;
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus createMesh(BoneToMeshParams &params, BoneToMeshProjection &proj, MObject &outMesh) 
+{
+    return createLodMesh(params, proj, 0, outMesh);
+}
+
+
+MStatus createChainMesh(BoneToMeshParams &params, std::vector<BoneToMeshProjection> &projs, MObject &outMesh) 
+{
+    return createLodChainMesh(params, projs, 0, outMesh);
+}
+
+
+void lodStrides(BoneToMeshParams &params, uint lod, uint &strideX, uint &strideY)
+{
+    // Each LOD halves the density of the previous one where the grid allows it. 
+    // Strides must divide the spoke count and the number of ring spans evenly 
+    // so that every coarse vertex lands on a vertex of the full resolution grid.
+    uint numSpansY = params.subdivisionsY > 1 ? params.subdivisionsY - 1 : 1;
+
+    strideX = 1;
+    strideY = 1;
+
+    for (uint l = 0; l < lod; l++)
+    {
+        uint nextX = strideX * 2;
+        uint nextY = strideY * 2;
+
+        if (params.subdivisionsX % nextX == 0 && params.subdivisionsX / nextX >= 3) { strideX = nextX; }
+        if (numSpansY % nextY == 0)                                                { strideY = nextY; }
+    }
+}
+
+
+// Emits a quad for every pair of neighbouring spokes on neighbouring rings. 
+// Every quad is written, and only advances the output when all four of its 
+// vertices exist, so the loop has no data dependent branches.
+template <bool Clockwise>
+static int polygonConnectsKernel(const std::vector<int> &indices, uint numX, uint numY, int* polygonConnects)
+{
+    int numPolygons = 0;
+
+    for (uint sh = 0; sh + 1 < numY; sh++)
+    {
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            uint na = (sa + 1 == numX) ? 0 : sa + 1;
+
+            int vtx0 = indices[(sh * numX) + sa];
+            int vtx1 = indices[(sh * numX) + na];
+            int vtx2 = indices[((sh + 1) * numX) + sa];
+            int vtx3 = indices[((sh + 1) * numX) + na];
+
+            int* quad = polygonConnects + (numPolygons * 4);
+
+            quad[0] = vtx0;
+            quad[1] = Clockwise ? vtx1 : vtx2;
+            quad[2] = vtx3;
+            quad[3] = Clockwise ? vtx2 : vtx1;
+
+            numPolygons += (int) ((vtx0 | vtx1 | vtx2 | vtx3) >= 0);
+        }
+    }
+
+    return numPolygons;
+}
+
+
+void lodMeshArrays(BoneToMeshParams &params, BoneToMeshProjection &proj, uint lod, BoneToMeshArrays &arrays) 
+{
+    typedef int (*Kernel)(const std::vector<int>&, uint, uint, int*);
+
+    static const Kernel kernels[2] = {
+        polygonConnectsKernel<false>,
+        polygonConnectsKernel<true>
+    };
+
+    uint strideX, strideY;
+    lodStrides(params, lod, strideX, strideY);
+
+    uint numX = params.subdivisionsX / strideX;
+    uint numY = params.subdivisionsY > 1 ? ((params.subdivisionsY - 1) / strideY) + 1 : 1;
+    uint maxVertices = numX * numY;
+
+    arrays.points.resize(maxVertices * 3);
+
+    // Vertex indices of the LOD grid, renumbered so that only the 
+    // sampled rings and spokes are emitted.
+    std::vector<int> indices(maxVertices, -1);
+    arrays.polygonConnects.assign((maxVertices * 4) + 4, -1);
+
+    int numVertices = 0;
+
+    // Face order - clockwise vs counter-clockwise
+    bool clockwise = ((int) params.boneLength >= 0) != proj.reverseWinding;
+
+    for (uint sh = 0; sh < numY; sh++)
+    {
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            uint idx = (sh * strideY * params.subdivisionsX) + (sa * strideX);
+
+            if (proj.indices[idx] != -1) 
+            { 
+                indices[(sh * numX) + sa] = numVertices;
+
+                const MFloatPoint &point = proj.points[idx];
+                arrays.points[(numVertices * 3) + 0] = point.x;
+                arrays.points[(numVertices * 3) + 1] = point.y;
+                arrays.points[(numVertices * 3) + 2] = point.z;
+
+                numVertices++;
+            } 
+        }
+    }           
+
+    int numPolygons = kernels[(int) clockwise](indices, numX, numY, arrays.polygonConnects.data());
+
+    arrays.points.resize(numVertices * 3);
+    arrays.polygonCounts.assign(numPolygons, 4);
+    arrays.polygonConnects.resize(numPolygons * 4);
+}
+
+
+MStatus createLodMesh(BoneToMeshParams &params, BoneToMeshProjection &proj, uint lod, MObject &outMesh) 
+{
+    MStatus status;   
+
+    BoneToMeshArrays arrays;
+    lodMeshArrays(params, proj, lod, arrays);
+
+    uint numVertices = (uint) arrays.points.size() / 3;
+    uint numPolygons = (uint) arrays.polygonCounts.size();
+
+    MFloatPointArray vertexArray(numVertices);
+
+    for (uint i = 0; i < numVertices; i++)
+    {
+        vertexArray.set(i, arrays.points[(i * 3) + 0], arrays.points[(i * 3) + 1], arrays.points[(i * 3) + 2]);
+    }
+
+    MIntArray polygonCounts(numPolygons, 4);
+    MIntArray polygonConnectsArray(arrays.polygonConnects.data(), numPolygons * 4);
+
+    MFnMesh outMeshFn;
+
+    outMeshFn.create(
+        numVertices,
+        numPolygons,
+        vertexArray,
+        polygonCounts,
+        polygonConnectsArray,
+        outMesh,
+        &status
+    );
+
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+// Welds the bones of a chain into one mesh, the first ring of each bone 
+// being made of the vertices of its parent's last ring. At coarser LODs the
+// spokes of the two bones need not coincide, so a parent vertex that only 
+// the child samples is emitted for the child.
+MStatus createLodChainMesh(BoneToMeshParams &params, std::vector<BoneToMeshProjection> &projs, uint lod, MObject &outMesh) 
+{
+    typedef int (*Kernel)(const std::vector<int>&, uint, uint, int*);
+
+    static const Kernel kernels[2] = {
+        polygonConnectsKernel<false>,
+        polygonConnectsKernel<true>
+    };
+
+    MStatus status;   
+
+    uint strideX, strideY;
+    lodStrides(params, lod, strideX, strideY);
+
+    uint numX = params.subdivisionsX / strideX;
+    uint numY = params.subdivisionsY > 1 ? ((params.subdivisionsY - 1) / strideY) + 1 : 1;
+    uint maxVertices = numX * numY;
+
+    uint lastRing = (params.subdivisionsY - 1) * params.subdivisionsX;
+
+    MFloatPointArray vertexArray((uint) (projs.size() * maxVertices));
+
+    // Output vertex of each full resolution grid vertex, per bone.
+    std::vector<std::vector<int>> vertices(projs.size());
+
+    std::vector<int> indices(maxVertices, -1);
+    std::vector<int> polygonConnects((projs.size() * maxVertices * 4) + 4, -1);
+
+    int numVertices = 0;
+    int numPolygons = 0;
+
+    for (size_t b = 0; b < projs.size(); b++)
+    {
+        BoneToMeshProjection &proj = projs[b];
+
+        vertices[b].assign(proj.maxVertices, -1);
+
+        bool shared = b > 0 && !proj.jointSpokes.empty();
+
+        for (uint sh = 0; sh < numY; sh++)
+        {
+            for (uint sa = 0; sa < numX; sa++)
+            {
+                uint idx = (sh * strideY * params.subdivisionsX) + (sa * strideX);
+
+                // The vertex of the shared ring is owned by the parent.
+                size_t owner = (shared && sh == 0) ? b - 1 : b;
+                uint   ownerIdx = (shared && sh == 0) ? lastRing + proj.jointSpokes[idx] : idx;
+
+                const BoneToMeshProjection &ownerProj = projs[owner];
+
+                int vertex = -1;
+
+                if (ownerProj.indices[ownerIdx] != -1)
+                {
+                    vertex = vertices[owner][ownerIdx];
+
+                    if (vertex == -1)
+                    {
+                        vertex = numVertices++;
+                        vertices[owner][ownerIdx] = vertex;
+                        vertexArray.set(ownerProj.points[ownerIdx], (uint) vertex);
+                    }
+                }
+
+                indices[(sh * numX) + sa] = vertex;
+            }
+        }
+
+        bool clockwise = ((int) params.boneLength >= 0) != proj.reverseWinding;
+
+        numPolygons += kernels[(int) clockwise](indices, numX, numY, polygonConnects.data() + (numPolygons * 4));
+    }
+
+    vertexArray.setLength(numVertices);
+
+    MIntArray polygonCounts(numPolygons, 4);
+    MIntArray polygonConnectsArray(polygonConnects.data(), numPolygons * 4);
+
+    MFnMesh outMeshFn;
+
+    outMeshFn.create(
+        numVertices,
+        numPolygons,
+        vertexArray,
+        polygonCounts,
+        polygonConnectsArray,
+        outMesh,
+        &status
+    );
+
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+static double determinant3(const double m[3][3])
+{
+    return (
+        (m[0][0] * ((m[1][1] * m[2][2]) - (m[1][2] * m[2][1]))) - 
+        (m[0][1] * ((m[1][0] * m[2][2]) - (m[1][2] * m[2][0]))) + 
+        (m[0][2] * ((m[1][0] * m[2][1]) - (m[1][1] * m[2][0])))
+    );
+}
+
+
+// The spokes of a ring all lie in the plane of the rows of the direction 
+// matrix that the rays are cast along, so the ellipse is fitted in that 
+// plane. The conic ax^2 + bxy + cy^2 = 1 about the centroid is fitted by 
+// least squares, which is exact for points on an ellipse whatever their 
+// spacing. Rings the conic does not fit, such as four spokes along the 
+// axes, fall back to the ellipse of the same second moments.
+void fitRings(const BoneToMeshParams &params, const BoneToMeshProjection &proj, std::vector<BoneToMeshRing> &rings)
+{
+    const int uRow = ((int) proj.longAxis + 1) % 3;
+    const int vRow = ((int) proj.longAxis + 2) % 3;
+
+    MVector e1(proj.directionMatrix[uRow][0], proj.directionMatrix[uRow][1], proj.directionMatrix[uRow][2]);
+    MVector e2(proj.directionMatrix[vRow][0], proj.directionMatrix[vRow][1], proj.directionMatrix[vRow][2]);
+
+    e1.normalize();
+    e2 = (e2 - (e1 * (e2 * e1))).normal();
+
+    const uint numX = params.subdivisionsX;
+    const uint numY = params.subdivisionsY;
+
+    rings.assign(numY, BoneToMeshRing());
+
+    if (proj.points.size() < size_t(numX * numY) || proj.raySources.size() < size_t(numY * 3))
+    {
+        return;
+    }
+
+    for (uint sh = 0; sh < numY; sh++)
+    {
+        BoneToMeshRing &ring = rings[sh];
+
+        const int*         indices = &proj.indices[sh * numX];
+        const MFloatPoint* points  = &proj.points[sh * numX];
+
+        double center[3] = {0.0, 0.0, 0.0};
+
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            if (indices[sa] == -1) { continue; }
+
+            center[0] += points[sa].x;
+            center[1] += points[sa].y;
+            center[2] += points[sa].z;
+
+            ring.numPoints++;
+        }
+
+        if (ring.numPoints == 0)
+        {
+            const float* source = &proj.raySources[sh * 3];
+
+            ring.center = MFloatPoint(source[0], source[1], source[2]);
+            continue;
+        }
+
+        double n = double(ring.numPoints);
+
+        for (int a = 0; a < 3; a++) { center[a] /= n; }
+
+        double radius = 0.0;
+
+        double moments[3] = {0.0, 0.0, 0.0};    // xx, xy, yy
+        double normal[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+        double rhs[3] = {0.0, 0.0, 0.0};
+
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            if (indices[sa] == -1) { continue; }
+
+            MVector offset(points[sa].x - center[0], points[sa].y - center[1], points[sa].z - center[2]);
+
+            double x = offset * e1;
+            double y = offset * e2;
+
+            const double row[3] = {x * x, x * y, y * y};
+
+            radius += offset.length();
+
+            for (int i = 0; i < 3; i++)
+            {
+                moments[i] += row[i];
+                rhs[i] += row[i];
+
+                for (int j = 0; j < 3; j++) { normal[i][j] += row[i] * row[j]; }
+            }
+        }
+
+        ring.center = MFloatPoint((float) center[0], (float) center[1], (float) center[2]);
+        ring.radius = (float) (radius / n);
+
+        // The symmetric matrix [[a, h], [h, c]] of the ellipse, whose 
+        // eigenvalues are the inverse squares of the semi-axes.
+        double a = 0.0;
+        double h = 0.0;
+        double c = 0.0;
+
+        double scale = (normal[0][0] + normal[1][1] + normal[2][2]) / 3.0;
+        double det = determinant3(normal);
+
+        bool conic = ring.numPoints >= 5 && det > (scale * scale * scale * 1e-9);
+
+        if (conic)
+        {
+            double solution[3];
+
+            for (int k = 0; k < 3; k++)
+            {
+                double replaced[3][3];
+
+                for (int i = 0; i < 3; i++)
+                {
+                    for (int j = 0; j < 3; j++) { replaced[i][j] = j == k ? rhs[i] : normal[i][j]; }
+                }
+
+                solution[k] = determinant3(replaced) / det;
+            }
+
+            a = solution[0];
+            h = solution[1] * 0.5;
+            c = solution[2];
+
+            conic = a > 0.0 && c > 0.0 && ((a * c) - (h * h)) > 0.0;
+        }
+
+        double major;
+        double minor;
+        double angle;   // of the major axis from e1
+
+        if (conic)
+        {
+            double mean  = (a + c) * 0.5;
+            double delta = std::sqrt((((a - c) * 0.5) * ((a - c) * 0.5)) + (h * h));
+
+            major = 1.0 / std::sqrt(mean - delta);
+            minor = 1.0 / std::sqrt(mean + delta);
+            angle = (0.5 * std::atan2(2.0 * h, a - c)) + (M_PI * 0.5);
+        } else {
+            // Points spread evenly around an ellipse have a variance of 
+            // half the square of each semi-axis.
+            double sxx = moments[0] / n;
+            double sxy = moments[1] / n;
+            double syy = moments[2] / n;
+
+            double mean  = (sxx + syy) * 0.5;
+            double delta = std::sqrt((((sxx - syy) * 0.5) * ((sxx - syy) * 0.5)) + (sxy * sxy));
+
+            major = std::sqrt(2.0 * (mean + delta));
+            minor = std::sqrt(2.0 * std::max(0.0, mean - delta));
+            angle = 0.5 * std::atan2(2.0 * sxy, sxx - syy);
+        }
+
+        MVector majorDirection = (e1 * std::cos(angle)) + (e2 * std::sin(angle));
+        MVector minorDirection = (e2 * std::cos(angle)) - (e1 * std::sin(angle));
+
+        ring.majorAxis = MFloatVector(majorDirection * major);
+        ring.minorAxis = MFloatVector(minorDirection * minor);
+    }
+}
+
+
+BoneToMeshCapsule fitCapsule(
+    const BoneToMeshParams &params, 
+    const BoneToMeshProjection &proj, 
+    const std::vector<BoneToMeshRing> &rings
+) {
+    BoneToMeshCapsule capsule;
+
+    int first = -1;
+    int last = -1;
+
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        if (rings[i].numPoints == 0) { continue; }
+
+        if (first == -1) { first = (int) i; }
+        last = (int) i;
+    }
+
+    if (first == -1)
+    {
+        if (!rings.empty())
+        {
+            capsule.start = rings.front().center;
+            capsule.end = rings.back().center;
+        }
+
+        return capsule;
+    }
+
+    capsule.start = rings[first].center;
+    capsule.end = rings[last].center;
+
+    // The mean radius of a ring falls short of its widest points wherever
+    // the cross-section is not round, so the radius reaches the point that
+    // lies furthest from the segment.
+    const size_t numPoints = std::min(proj.points.size(), proj.indices.size());
+    const size_t numRays = std::min(numPoints, size_t(params.subdivisionsX * params.subdivisionsY));
+
+    MFloatVector axis = capsule.end - capsule.start;
+    float axisLengthSquared = axis * axis;
+
+    float radiusSquared = 0.0f;
+
+    for (size_t i = 0; i < numRays; i++)
+    {
+        if (proj.indices[i] == -1) { continue; }
+
+        MFloatVector offset = proj.points[i] - capsule.start;
+
+        float t = axisLengthSquared > 0.0f ? std::min(1.0f, std::max(0.0f, (offset * axis) / axisLengthSquared)) : 0.0f;
+
+        MFloatVector away = offset - (axis * t);
+
+        radiusSquared = std::max(radiusSquared, away * away);
+    }
+
+    capsule.radius = std::sqrt(radiusSquared);
+
+    return capsule;
 }
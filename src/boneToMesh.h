@@ -6,7 +6,13 @@
 #ifndef YANTOR_3D_BONE_TO_MESH_H
 #define YANTOR_3D_BONE_TO_MESH_H
 
+#include "boneToMeshBVH.h"
+
+#include <atomic>
 #include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include <maya/MFloatPoint.h>
@@ -27,6 +33,10 @@ struct BoneToMeshParams
     int    direction              = 0;
     int    fillPartialLoopsMethod = 0;
     double  radius                = 1.0;
+    int    symmetry               = 0;
+    double symmetryTolerance      = 0.001;
+    int    hitPolicy              = HIT_NEAREST;
+    int    hitIndex               = 1;
 };
 
 struct BoneToMeshProjection
@@ -39,15 +49,92 @@ struct BoneToMeshProjection
 
     MVector::Axis longAxis;
 
-    std::vector<MFloatPoint>  raySources;
-    std::vector<MFloatVector> rayDirections;
+    std::vector<float>        raySources;       // xyz per ring
+    std::vector<float>        rayDirections;    // xyz per ray
+
+    // Cosine and sine of each spoke angle, kept for as long as the 
+    // number of spokes does not change.
+    uint                      circleSubdivisions = 0;
+    std::vector<float>        circle;
 
     std::vector<int>          indices;
     std::vector<MFloatPoint>  points;
 
+    // Spoke of the parent's last ring that each spoke of the first ring is,
+    // when the first ring is shared with the parent bone of a chain. Shared 
+    // rings are traced with the parent.
+    std::vector<uint>         jointSpokes;
+
+    // Set for projections refined in the background, which are traced 
+    // outside the shared ray queue and given up once it is true.
+    std::shared_ptr<const std::atomic<bool>> cancelled;
+
+    // Hit per ray of the latest trace, with the rays and the scene version
+    // it was traced against.
+    std::vector<BoneToMeshHit> hits;
+    std::vector<float>         hitRaySources;
+    std::vector<float>         hitRayDirections;
+    float                      hitMaxParam = 0.0f;
+    int                        hitPolicy   = HIT_NEAREST;
+    int                        hitIndex    = 1;
+    uint64_t                   hitVersion  = 0;
+
     int vertexIndex = 0;
     int maxVertices = 0;
     int maxPolygons = 0;
+
+    bool reverseWinding = false;
+};
+
+// Output mesh of a projection as flat arrays, xyz per point and the 
+// vertices of each polygon in order.
+struct BoneToMeshArrays
+{
+    std::vector<float> points;
+    std::vector<int>   polygonCounts;
+    std::vector<int>   polygonConnects;
+};
+
+// Primitives fitted to the points of one ring, in the space of the points.
+// The ellipse has the same second moments as the points about the centre.
+struct BoneToMeshRing
+{
+    MFloatPoint  center;            // centroid of the points, the ray source of a ring without any
+    float        radius    = 0.0f;  // mean distance of the points from the centre
+    MFloatVector majorAxis;         // semi-axes of the ellipse
+    MFloatVector minorAxis;
+    int          numPoints = 0;
+};
+
+// Capsule between the first and last rings of a bone that have points,
+// wide enough for the point of any ring furthest from it.
+struct BoneToMeshCapsule
+{
+    MFloatPoint start;
+    MFloatPoint end;
+    float       radius = 0.0f;
+};
+
+// What a projection depends on, with the vertices of the input meshes in bone space.
+// While none of it changes the meshes move rigidly with the bone.
+struct BoneToMeshRigidState
+{
+    BoneToMeshParams   params;
+    MMatrix            directionMatrix;     // relative to the bone
+    std::vector<int>   faces;               // selected faces of each mesh, -1 after each
+    std::vector<int>   numPoints;           // vertex count per mesh
+    std::vector<float> points;              // xyz per vertex of every mesh, in bone space
+};
+
+// Projection of the latest trace in bone space.
+struct BoneToMeshRigidCache
+{
+    bool valid = false;
+
+    BoneToMeshRigidState     state;
+    std::vector<int>         indices;
+    std::vector<MFloatPoint> points;
+    int                      vertexIndex = 0;
 };
 
 MStatus boneToMesh(
@@ -55,13 +142,87 @@ MStatus boneToMesh(
     const MObject &components,
     const MMatrix &boneMatrix, 
     const MMatrix &directionMatrix, 
-    BoneToMeshParams &params,
+    const BoneToMeshParams &params,
+    MObject &outMesh
+);
+
+MStatus boneToMesh(
+    const std::vector<MObject> &inMeshes, 
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    const BoneToMeshParams &params,
     MObject &outMesh
 );
 
+MStatus boneToMeshChain(
+    const BoneToMeshScene &scene,
+    const std::vector<MMatrix> &boneMatrices, 
+    const std::vector<MMatrix> &directionMatrices, 
+    BoneToMeshParams &params,
+    std::vector<BoneToMeshProjection> &projs
+);
+
+MStatus boneToMeshMirror(
+    BoneToMeshScene &mirrorScene,
+    const MMatrix &mirrorBoneMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshProjection &proj,
+    BoneToMeshProjection &mirrorProj,
+    bool &mirrored
+);
+
+MStatus initializeProjection(
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshProjection &proj
+);
+
 MStatus projectionVectors(BoneToMeshParams &params, BoneToMeshProjection &proj);
-MStatus projectBoneToMesh(const MObject &inMesh, const MObject &components, BoneToMeshParams &params, BoneToMeshProjection &proj);
-MStatus fillPartialLoops(BoneToMeshParams &params, BoneToMeshProjection &proj);
+MStatus updateScene(const std::vector<MObject> &inMeshes, const std::vector<MObject> &components, BoneToMeshScene &scene);
+MStatus updateSceneMesh(const MObject &inMesh, const MObject &components, BoneToMeshBVH &bvh, BoneToMeshChange &change, bool &changed);
+
+// Updates a scene of one mesh given as xyz per point and three point 
+// indices per triangle. Each triangle is its own face.
+MStatus updateSceneArrays(const float *points, int numPoints, const int *triangles, int numTriangles, BoneToMeshScene &scene);
+
+MStatus projectBoneToMesh(const BoneToMeshScene &scene, BoneToMeshParams &params, BoneToMeshProjection &proj);
+MStatus fillPartialLoops(const BoneToMeshScene &scene, BoneToMeshParams &params, BoneToMeshProjection &proj);
 MStatus createMesh(BoneToMeshParams &params, BoneToMeshProjection &proj, MObject &outMesh);
+MStatus createLodMesh(BoneToMeshParams &params, BoneToMeshProjection &proj, uint lod, MObject &outMesh);
+void    lodMeshArrays(BoneToMeshParams &params, BoneToMeshProjection &proj, uint lod, BoneToMeshArrays &arrays);
+MStatus createChainMesh(BoneToMeshParams &params, std::vector<BoneToMeshProjection> &projs, MObject &outMesh);
+MStatus createLodChainMesh(BoneToMeshParams &params, std::vector<BoneToMeshProjection> &projs, uint lod, MObject &outMesh);
+
+// Fits each ring of a projection from its points, without building a mesh.
+void              fitRings(const BoneToMeshParams &params, const BoneToMeshProjection &proj, std::vector<BoneToMeshRing> &rings);
+BoneToMeshCapsule fitCapsule(const BoneToMeshParams &params, const BoneToMeshProjection &proj, const std::vector<BoneToMeshRing> &rings);
+
+MStatus rigidState(
+    const std::vector<MObject> &inMeshes, 
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix, 
+    const MMatrix &directionMatrix, 
+    BoneToMeshParams &params,
+    BoneToMeshRigidState &state
+);
+
+bool sameParams(const BoneToMeshParams &a, const BoneToMeshParams &b);
+bool isRigidMotion(const BoneToMeshRigidCache &cache, const BoneToMeshRigidState &state, double tolerance);
+void storeRigidProjection(BoneToMeshRigidState &state, BoneToMeshProjection &proj, BoneToMeshRigidCache &cache);
+void applyRigidProjection(const BoneToMeshRigidCache &cache, BoneToMeshProjection &proj);
+
+// Bytes held by the buffers of a projection and of a rigid cache.
+size_t memoryProjection(const BoneToMeshProjection &proj);
+size_t memoryRigidCache(const BoneToMeshRigidCache &cache);
+void   releaseHits(BoneToMeshProjection &proj);
+
+MMatrix symmetryMatrix(int symmetry);
+bool    isBoneSymmetric(BoneToMeshParams &params, BoneToMeshProjection &proj, BoneToMeshProjection &mirrorProj);
+MStatus isMeshSymmetric(const BoneToMeshScene &scene, BoneToMeshParams &params, bool &symmetric);
+MStatus mirrorProjection(BoneToMeshParams &params, BoneToMeshProjection &proj, BoneToMeshProjection &mirrorProj);
+
+void lodStrides(BoneToMeshParams &params, uint lod, uint &strideX, uint &strideY);
 
 #endif 
\ No newline at end of file
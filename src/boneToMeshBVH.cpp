@@ -0,0 +1,2515 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshBVH.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+const int BVH_BINS          = 16;
+const int BVH_LEAF_SIZE     = 4;
+const int BVH_MAX_LEAF_SIZE = 16;
+const int BVH_MAX_SAH_DEPTH = 192;
+const int BVH_STACK_SIZE    = 256;
+
+// Refits are kept until the tree costs this much more than when it was built.
+const float BVH_REFIT_DEGRADATION = 1.5f;
+
+// Smaller trees are refit on the calling thread.
+const int BVH_PARALLEL_REFIT_TRIANGLES = 10000;
+
+// Nodes with more primitives than this are split with data parallel passes,
+// smaller ones are handed out whole as subtree builds.
+const int BVH_PARALLEL_BUILD_PRIMITIVES = 4096;
+
+// Primitives per chunk of a data parallel pass.
+const int BVH_BUILD_GRAIN = 1024;
+
+// Morton codes quantize each centroid axis to this many bits.
+const int BVH_MORTON_BITS = 10;
+
+// Costs of the automatic build method in ray-triangle tests, measured with 
+// boneToMeshBenchmark -build on one thread. Builds are per triangle, an SAH
+// build per triangle and level, traces are per ray and level of the tree.
+const float BVH_COST_BRUTE_FORCE_BUILD = 1.0f;
+const float BVH_COST_MORTON_BUILD      = 10.0f;
+const float BVH_COST_SAH_BUILD         = 4.0f;
+const float BVH_COST_SAH_TRACE         = 4.0f;
+const float BVH_COST_MORTON_TRACE      = 1.2f;     // relative to an SAH tree
+const float BVH_COST_REFIT             = 2.0f;
+
+// A tree that can be kept is only replaced by one this much cheaper.
+const float BVH_SWITCH_SAVING = 0.75f;
+
+// Children per wide node, and steps per axis of their quantized bounds.
+const int BVH_WIDTH           = 8;
+const int BVH_QUANTIZED_STEPS = 256;
+
+const unsigned char BVH_WIDE_META_LEAF = 0x80;
+
+// Expanded child references of the wide traversal, see wideChildren.
+const unsigned int BVH_WIDE_LEAF        = 0x80000000u;
+const unsigned int BVH_WIDE_COUNT_SHIFT = 27;
+const unsigned int BVH_WIDE_INDEX_MASK  = (1u << BVH_WIDE_COUNT_SHIFT) - 1u;
+
+// The task building the tree holds the tree alone, never this, so the 
+// future it completes does not keep itself alive.
+struct BoneToMeshBVHRebuild
+{
+    std::shared_ptr<BoneToMeshBVH> bvh;
+    std::future<void>              done;
+};
+
+// Primitive bounds and centroids shared by the bottom and top level builds.
+struct BVHBuildState
+{
+    std::vector<float> bounds;      // min xyz, max xyz per primitive
+    std::vector<float> centroids;   // xyz per primitive
+
+    std::vector<unsigned int> codes;     // Morton code per order entry
+    std::vector<int>          scratch;   // partition buffer for parallel splits
+
+    std::vector<int>               *order;
+    std::vector<BoneToMeshBVHNode> *nodes;
+
+    int leafSize;
+};
+
+// Range of the primitives that still has to be built below a node.
+struct BVHBuildTask
+{
+    int node;
+    int begin;
+    int end;
+    int depth;
+};
+
+// Per bin bounds and counts along one axis.
+struct BVHBins
+{
+    int   counts[BVH_BINS];
+    float min[BVH_BINS][3];
+    float max[BVH_BINS][3];
+};
+
+
+static void emptyBounds(float *min, float *max)
+{
+    min[0] = min[1] = min[2] = FLT_MAX;
+    max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+
+static void growBounds(float *min, float *max, const float *bounds)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = std::min(min[i], bounds[i]);
+        max[i] = std::max(max[i], bounds[i + 3]);
+    }
+}
+
+
+static float surfaceArea(const float *min, const float *max)
+{
+    float dx = std::max(0.0f, max[0] - min[0]);
+    float dy = std::max(0.0f, max[1] - min[1]);
+    float dz = std::max(0.0f, max[2] - min[2]);
+
+    return (dx * dy) + (dy * dz) + (dz * dx);
+}
+
+
+static int numBuildChunks(int count)
+{
+    return std::max(1, std::min(numThreads() * 4, count / BVH_BUILD_GRAIN));
+}
+
+
+// Calls body(chunk, chunkBegin, chunkEnd) for evenly sized chunks of [begin, end).
+template <typename Body>
+static void forEachChunk(int begin, int end, int chunks, const Body &body)
+{
+    long long count = end - begin;
+
+    parallelFor(0, chunks, 1, [&](int first, int last) {
+        for (int c = first; c < last; c++)
+        {
+            body(c, begin + int((count * c) / chunks), begin + int((count * (c + 1)) / chunks));
+        }
+    });
+}
+
+
+// Bounds of the primitives and of their centroids, 12 floats.
+static void rangeBounds(const BVHBuildState &state, int begin, int end, float *bounds)
+{
+    const std::vector<int> &order = *state.order;
+
+    emptyBounds(bounds, bounds + 3);
+    emptyBounds(bounds + 6, bounds + 9);
+
+    for (int i = begin; i < end; i++)
+    {
+        const float *c = &state.centroids[order[i] * 3];
+        float centroidBounds[6] = {c[0], c[1], c[2], c[0], c[1], c[2]};
+
+        growBounds(bounds, bounds + 3, &state.bounds[order[i] * 6]);
+        growBounds(bounds + 6, bounds + 9, centroidBounds);
+    }
+}
+
+
+static void binRange(const BVHBuildState &state, int begin, int end, int axis, float offset, float scale, BVHBins &bins)
+{
+    const std::vector<int> &order = *state.order;
+
+    for (int b = 0; b < BVH_BINS; b++) 
+    { 
+        bins.counts[b] = 0;
+        emptyBounds(bins.min[b], bins.max[b]); 
+    }
+
+    for (int i = begin; i < end; i++)
+    {
+        int p = order[i];
+        int b = std::min(BVH_BINS - 1, int((state.centroids[(p * 3) + axis] - offset) * scale));
+
+        bins.counts[b]++;
+        growBounds(bins.min[b], bins.max[b], &state.bounds[p * 6]);
+    }
+}
+
+
+// Stable partition of order[begin, end) in chunks - each chunk counts the 
+// primitives going left, and prefix sums of those counts place every chunk's 
+// primitives in the scratch buffer.
+template <typename Pred>
+static int parallelPartition(BVHBuildState &state, int begin, int end, int chunks, const Pred &goesLeft)
+{
+    std::vector<int> &order = *state.order;
+    std::vector<int> &scratch = state.scratch;
+
+    std::vector<int> leftCounts(chunks, 0);
+    std::vector<int> chunkBegins(chunks, 0);
+
+    forEachChunk(begin, end, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+        int n = 0;
+
+        for (int i = chunkBegin; i < chunkEnd; i++) { n += goesLeft(order[i]) ? 1 : 0; }
+
+        leftCounts[c] = n;
+        chunkBegins[c] = chunkBegin;
+    });
+
+    std::vector<int> leftOffsets(chunks, begin);
+    std::vector<int> rightOffsets(chunks, 0);
+
+    int numLeft = 0;
+
+    for (int c = 0; c < chunks; c++) 
+    { 
+        leftOffsets[c] = begin + numLeft;
+        numLeft += leftCounts[c]; 
+    }
+
+    for (int c = 0; c < chunks; c++)
+    {
+        rightOffsets[c] = begin + numLeft + (chunkBegins[c] - begin) - (leftOffsets[c] - begin);
+    }
+
+    forEachChunk(begin, end, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+        int left = leftOffsets[c];
+        int right = rightOffsets[c];
+
+        for (int i = chunkBegin; i < chunkEnd; i++)
+        {
+            int p = order[i];
+            scratch[goesLeft(p) ? left++ : right++] = p;
+        }
+    });
+
+    forEachChunk(begin, end, chunks, [&](int, int chunkBegin, int chunkEnd) {
+        std::copy(scratch.begin() + chunkBegin, scratch.begin() + chunkEnd, order.begin() + chunkBegin);
+    });
+
+    return begin + numLeft;
+}
+
+
+static void makeLeaf(BoneToMeshBVHNode &node, int begin, int end)
+{
+    node.index = begin;
+    node.count = end - begin;
+}
+
+
+static int medianSplit(BVHBuildState &state, int begin, int end, const float *cmin, const float *cmax)
+{
+    std::vector<int> &order = *state.order;
+
+    int axis = 0;
+
+    for (int a = 1; a < 3; a++)
+    {
+        if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis]) { axis = a; }
+    }
+
+    int mid = begin + ((end - begin) / 2);
+
+    std::nth_element(
+        order.begin() + begin,
+        order.begin() + mid,
+        order.begin() + end,
+        [&](int a, int b) { return state.centroids[(a * 3) + axis] < state.centroids[(b * 3) + axis]; }
+    );
+
+    return mid;
+}
+
+
+// Either makes the node a leaf and returns false, or partitions its range 
+// at mid and returns true. Splits with more than one chunk run in parallel.
+template <int Method>
+static bool splitNode(BVHBuildState &state, BoneToMeshBVHNode &node, int begin, int end, int depth, int chunks, int &mid);
+
+
+template <>
+bool splitNode<BVH_BUILD_SAH>(BVHBuildState &state, BoneToMeshBVHNode &node, int begin, int end, int depth, int chunks, int &mid)
+{
+    float bounds[12];
+
+    if (chunks == 1)
+    {
+        rangeBounds(state, begin, end, bounds);
+    } else {
+        std::vector<float> chunkBounds(chunks * 12);
+
+        forEachChunk(begin, end, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+            rangeBounds(state, chunkBegin, chunkEnd, &chunkBounds[c * 12]);
+        });
+
+        emptyBounds(bounds, bounds + 3);
+        emptyBounds(bounds + 6, bounds + 9);
+
+        for (int c = 0; c < chunks; c++)
+        {
+            growBounds(bounds, bounds + 3, &chunkBounds[c * 12]);
+            growBounds(bounds + 6, bounds + 9, &chunkBounds[(c * 12) + 6]);
+        }
+    }
+
+    const float *min = bounds;
+    const float *max = bounds + 3;
+    const float *cmin = bounds + 6;
+    const float *cmax = bounds + 9;
+
+    std::copy(min, min + 3, node.min);
+    std::copy(max, max + 3, node.max);
+
+    int count = end - begin;
+
+    if (count <= state.leafSize)
+    {
+        makeLeaf(node, begin, end);
+        return false;
+    }
+
+    // Binned surface area heuristic over all three axes.
+    int   bestAxis = -1;
+    int   bestBin  = 0;
+    float bestCost = FLT_MAX;
+
+    std::vector<BVHBins> chunkBins(chunks > 1 ? chunks : 0);
+
+    for (int axis = 0; axis < 3 && depth < BVH_MAX_SAH_DEPTH; axis++)
+    {
+        float extent = cmax[axis] - cmin[axis];
+
+        if (extent <= 0.0f) { continue; }
+
+        float scale = float(BVH_BINS) / extent;
+
+        BVHBins bins;
+
+        if (chunks == 1)
+        {
+            binRange(state, begin, end, axis, cmin[axis], scale, bins);
+        } else {
+            forEachChunk(begin, end, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+                binRange(state, chunkBegin, chunkEnd, axis, cmin[axis], scale, chunkBins[c]);
+            });
+
+            bins = chunkBins[0];
+
+            for (int c = 1; c < chunks; c++)
+            {
+                for (int b = 0; b < BVH_BINS; b++)
+                {
+                    float binBounds[6] = {
+                        chunkBins[c].min[b][0], chunkBins[c].min[b][1], chunkBins[c].min[b][2], 
+                        chunkBins[c].max[b][0], chunkBins[c].max[b][1], chunkBins[c].max[b][2]
+                    };
+
+                    bins.counts[b] += chunkBins[c].counts[b];
+                    growBounds(bins.min[b], bins.max[b], binBounds);
+                }
+            }
+        }
+
+        float rightArea[BVH_BINS];
+        int   rightCount[BVH_BINS];
+
+        float rmin[3], rmax[3];
+        int   rcount = 0;
+
+        emptyBounds(rmin, rmax);
+
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            float binBounds[6] = {bins.min[b][0], bins.min[b][1], bins.min[b][2], bins.max[b][0], bins.max[b][1], bins.max[b][2]};
+            growBounds(rmin, rmax, binBounds);
+            rcount += bins.counts[b];
+
+            rightArea[b]  = surfaceArea(rmin, rmax);
+            rightCount[b] = rcount;
+        }
+
+        float lmin[3], lmax[3];
+        int   lcount = 0;
+
+        emptyBounds(lmin, lmax);
+
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            float binBounds[6] = {bins.min[b][0], bins.min[b][1], bins.min[b][2], bins.max[b][0], bins.max[b][1], bins.max[b][2]};
+            growBounds(lmin, lmax, binBounds);
+            lcount += bins.counts[b];
+
+            if (lcount == 0 || rightCount[b + 1] == 0) { continue; }
+
+            float cost = (surfaceArea(lmin, lmax) * float(lcount)) + (rightArea[b + 1] * float(rightCount[b + 1]));
+
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin  = b;
+            }
+        }
+    }
+
+    float leafCost = surfaceArea(min, max) * float(count);
+
+    if (bestAxis != -1 && bestCost >= leafCost && count <= BVH_MAX_LEAF_SIZE)
+    {
+        makeLeaf(node, begin, end);
+        return false;
+    }
+
+    mid = begin;
+
+    if (bestAxis != -1)
+    {
+        float scale = float(BVH_BINS) / (cmax[bestAxis] - cmin[bestAxis]);
+        float split = cmin[bestAxis];
+
+        auto goesLeft = [&](int p) {
+            int b = std::min(BVH_BINS - 1, int((state.centroids[(p * 3) + bestAxis] - split) * scale));
+            return b <= bestBin;
+        };
+
+        if (chunks == 1)
+        {
+            std::vector<int> &order = *state.order;
+            mid = int(std::partition(order.begin() + begin, order.begin() + end, goesLeft) - order.begin());
+        } else {
+            mid = parallelPartition(state, begin, end, chunks, goesLeft);
+        }
+    }
+
+    // Coincident centroids or a degenerate split fall back to a median split.
+    if (mid == begin || mid == end)
+    {
+        mid = medianSplit(state, begin, end, cmin, cmax);
+    }
+
+    return true;
+}
+
+
+// Splits at the highest bit in which the first and last Morton code of the 
+// sorted range differ. Bounds are left to a refit once the tree is built.
+template <>
+bool splitNode<BVH_BUILD_MORTON>(BVHBuildState &state, BoneToMeshBVHNode &node, int begin, int end, int, int, int &mid)
+{
+    int count = end - begin;
+
+    if (count <= state.leafSize)
+    {
+        makeLeaf(node, begin, end);
+        return false;
+    }
+
+    unsigned int first = state.codes[begin];
+    unsigned int last = state.codes[end - 1];
+
+    if (first == last)
+    {
+        if (count <= BVH_MAX_LEAF_SIZE)
+        {
+            makeLeaf(node, begin, end);
+            return false;
+        }
+
+        mid = begin + (count / 2);
+        return true;
+    }
+
+    int bit = 31;
+
+    while (((first ^ last) & (1u << bit)) == 0) { bit--; }
+
+    mid = int(std::partition_point(
+        state.codes.begin() + begin,
+        state.codes.begin() + end,
+        [bit](unsigned int code) { return (code & (1u << bit)) == 0; }
+    ) - state.codes.begin());
+
+    return true;
+}
+
+
+template <int Method>
+static void buildNode(BVHBuildState &state, std::vector<BoneToMeshBVHNode> &nodes, int nodeIndex, int begin, int end, int depth)
+{
+    int mid;
+
+    if (!splitNode<Method>(state, nodes[nodeIndex], begin, end, depth, 1, mid)) { return; }
+
+    int children = (int) nodes.size();
+    nodes.resize(children + 2);
+
+    nodes[nodeIndex].index = children;
+    nodes[nodeIndex].count = 0;
+
+    buildNode<Method>(state, nodes, children, begin, mid, depth + 1);
+    buildNode<Method>(state, nodes, children + 1, mid, end, depth + 1);
+}
+
+
+// The upper levels are split one node at a time with every thread working 
+// through its primitives. Once a range is small enough, it becomes a task 
+// that builds its whole subtree on one thread into its own node array, and 
+// the subtrees are packed in after the upper levels.
+template <int Method>
+static void buildTree(BVHBuildState &state, int numPrimitives)
+{
+    std::vector<int> &order = *state.order;
+    std::vector<BoneToMeshBVHNode> &nodes = *state.nodes;
+
+    nodes.clear();
+
+    if (numPrimitives == 0) { return; }
+
+    nodes.resize(1);
+
+    int threads = numThreads();
+    int subtreeSize = std::max(BVH_PARALLEL_BUILD_PRIMITIVES, numPrimitives / (threads * 8));
+
+    std::vector<BVHBuildTask> pending(1, BVHBuildTask{0, 0, numPrimitives, 0});
+    std::vector<BVHBuildTask> subtrees;
+
+    if (numPrimitives > subtreeSize) { state.scratch.resize(order.size()); }
+
+    while (!pending.empty())
+    {
+        BVHBuildTask task = pending.back();
+        pending.pop_back();
+
+        if (task.end - task.begin <= subtreeSize || threads == 1)
+        {
+            subtrees.push_back(task);
+            continue;
+        }
+
+        int mid;
+
+        if (!splitNode<Method>(state, nodes[task.node], task.begin, task.end, task.depth, numBuildChunks(task.end - task.begin), mid)) 
+        { 
+            continue; 
+        }
+
+        int children = (int) nodes.size();
+        nodes.resize(children + 2);
+
+        nodes[task.node].index = children;
+        nodes[task.node].count = 0;
+
+        pending.push_back(BVHBuildTask{children, task.begin, mid, task.depth + 1});
+        pending.push_back(BVHBuildTask{children + 1, mid, task.end, task.depth + 1});
+    }
+
+    state.scratch.clear();
+
+    int numSubtrees = (int) subtrees.size();
+
+    std::vector<std::vector<BoneToMeshBVHNode>> subtreeNodes(numSubtrees);
+
+    parallelFor(0, numSubtrees, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+        {
+            const BVHBuildTask &task = subtrees[i];
+
+            subtreeNodes[i].reserve(2 * (task.end - task.begin) / state.leafSize + 1);
+            subtreeNodes[i].resize(1);
+
+            buildNode<Method>(state, subtreeNodes[i], 0, task.begin, task.end, task.depth);
+        }
+    });
+
+    // The root of each subtree takes the place of its task's node, the rest 
+    // follow the upper levels in subtree order.
+    std::vector<int> offsets(numSubtrees);
+
+    int numNodes = (int) nodes.size();
+
+    for (int i = 0; i < numSubtrees; i++)
+    {
+        offsets[i] = numNodes;
+        numNodes += (int) subtreeNodes[i].size() - 1;
+    }
+
+    nodes.resize(numNodes);
+
+    parallelFor(0, numSubtrees, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+        {
+            const std::vector<BoneToMeshBVHNode> &local = subtreeNodes[i];
+
+            for (size_t n = 0; n < local.size(); n++)
+            {
+                BoneToMeshBVHNode node = local[n];
+
+                if (node.count == 0) { node.index = offsets[i] + node.index - 1; }
+
+                nodes[n == 0 ? subtrees[i].node : offsets[i] + int(n) - 1] = node;
+            }
+        }
+    });
+}
+
+
+// Spreads the low 10 bits of v out to every third bit.
+static unsigned int expandBits(unsigned int v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+
+    return v;
+}
+
+
+static unsigned int mortonCell(float value, float offset, float scale)
+{
+    return std::min((1u << BVH_MORTON_BITS) - 1u, (unsigned int) std::max(0.0f, (value - offset) * scale));
+}
+
+
+// Sorts the primitives along a Morton curve through their centroids, 
+// leaving order and codes in curve order.
+static void mortonOrder(BVHBuildState &state, int numPrimitives)
+{
+    std::vector<int> &order = *state.order;
+
+    int chunks = numBuildChunks(numPrimitives);
+
+    std::vector<float> chunkBounds(chunks * 12);
+
+    forEachChunk(0, numPrimitives, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+        rangeBounds(state, chunkBegin, chunkEnd, &chunkBounds[c * 12]);
+    });
+
+    float cmin[3], cmax[3];
+    emptyBounds(cmin, cmax);
+
+    for (int c = 0; c < chunks; c++) { growBounds(cmin, cmax, &chunkBounds[(c * 12) + 6]); }
+
+    float scale[3];
+    float cells = float((1 << BVH_MORTON_BITS) - 1);
+
+    for (int a = 0; a < 3; a++)
+    {
+        scale[a] = cmax[a] > cmin[a] ? cells / (cmax[a] - cmin[a]) : 0.0f;
+    }
+
+    // Code in the high half, primitive in the low half, so one sort orders both.
+    std::vector<uint64_t> keys(numPrimitives);
+
+    forEachChunk(0, numPrimitives, chunks, [&](int, int chunkBegin, int chunkEnd) {
+        for (int p = chunkBegin; p < chunkEnd; p++)
+        {
+            const float *c = &state.centroids[p * 3];
+
+            unsigned int x = expandBits(mortonCell(c[0], cmin[0], scale[0]));
+            unsigned int y = expandBits(mortonCell(c[1], cmin[1], scale[1]));
+            unsigned int z = expandBits(mortonCell(c[2], cmin[2], scale[2]));
+
+            keys[p] = (uint64_t((x << 2) | (y << 1) | z) << 32) | uint64_t(p);
+        }
+    });
+
+    // Chunks are sorted in parallel, then merged pairwise.
+    std::vector<int> chunkBegins(chunks + 1, numPrimitives);
+
+    forEachChunk(0, numPrimitives, chunks, [&](int c, int chunkBegin, int chunkEnd) {
+        chunkBegins[c] = chunkBegin;
+        std::sort(keys.begin() + chunkBegin, keys.begin() + chunkEnd);
+    });
+
+    for (int width = 1; width < chunks; width *= 2)
+    {
+        int numMerges = (chunks + (2 * width) - 1) / (2 * width);
+
+        parallelFor(0, numMerges, 1, [&](int first, int last) {
+            for (int m = first; m < last; m++)
+            {
+                int left = m * 2 * width;
+                int right = std::min(chunks, left + width);
+                int stop = std::min(chunks, left + (2 * width));
+
+                std::inplace_merge(
+                    keys.begin() + chunkBegins[left], 
+                    keys.begin() + chunkBegins[right], 
+                    keys.begin() + chunkBegins[stop]
+                );
+            }
+        });
+    }
+
+    state.codes.resize(numPrimitives);
+
+    forEachChunk(0, numPrimitives, chunks, [&](int, int chunkBegin, int chunkEnd) {
+        for (int i = chunkBegin; i < chunkEnd; i++)
+        {
+            order[i] = int(keys[i] & 0xFFFFFFFFu);
+            state.codes[i] = (unsigned int) (keys[i] >> 32);
+        }
+    });
+}
+
+
+static void triangleBounds(const BoneToMeshBVH &bvh, int tri, float *min, float *max)
+{
+    const int *vtx = &bvh.triangles[tri * 3];
+
+    for (int v = 0; v < 3; v++)
+    {
+        const float *p = &bvh.points[vtx[v] * 3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            min[a] = std::min(min[a], p[a]);
+            max[a] = std::max(max[a], p[a]);
+        }
+    }
+}
+
+
+// Refits the subtree below nodeIndex and returns its unnormalized cost.
+static float refitNode(BoneToMeshBVH &bvh, int nodeIndex)
+{
+    BoneToMeshBVHNode &node = bvh.nodes[nodeIndex];
+
+    emptyBounds(node.min, node.max);
+
+    if (node.count > 0)
+    {
+        for (int i = node.index; i < node.index + node.count; i++)
+        {
+            triangleBounds(bvh, bvh.order[i], node.min, node.max);
+        }
+
+        return surfaceArea(node.min, node.max) * float(node.count);
+    }
+
+    float cost = refitNode(bvh, node.index) + refitNode(bvh, node.index + 1);
+
+    for (int c = 0; c < 2; c++)
+    {
+        const BoneToMeshBVHNode &child = bvh.nodes[node.index + c];
+        float bounds[6] = {child.min[0], child.min[1], child.min[2], child.max[0], child.max[1], child.max[2]};
+        growBounds(node.min, node.max, bounds);
+    }
+
+    return cost + surfaceArea(node.min, node.max);
+}
+
+
+// Refits the whole tree and returns its unnormalized cost. The top of the 
+// tree is split into subtrees that are refit in parallel, then the nodes 
+// above them are refit bottom-up.
+static float refitNodes(BoneToMeshBVH &bvh)
+{
+    std::vector<int> upperNodes;
+    std::vector<int> subtrees(1, 0);
+
+    int numTriangles = (int) bvh.triangles.size() / 3;
+    size_t numSubtrees = numTriangles < BVH_PARALLEL_REFIT_TRIANGLES ? 1 : size_t(numThreads() * 4);
+
+    while (subtrees.size() < numSubtrees)
+    {
+        std::vector<int> next;
+
+        for (int n : subtrees)
+        {
+            if (bvh.nodes[n].count > 0)
+            {
+                next.push_back(n);
+            } else {
+                upperNodes.push_back(n);
+                next.push_back(bvh.nodes[n].index);
+                next.push_back(bvh.nodes[n].index + 1);
+            }
+        }
+
+        if (next.size() == subtrees.size()) { break; }
+
+        subtrees.swap(next);
+    }
+
+    std::vector<float> subtreeCosts(subtrees.size(), 0.0f);
+
+    parallelFor(0, (int) subtrees.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            subtreeCosts[i] = refitNode(bvh, subtrees[i]);
+        }
+    });
+
+    float cost = 0.0f;
+
+    for (float subtreeCost : subtreeCosts) { cost += subtreeCost; }
+
+    for (auto it = upperNodes.rbegin(); it != upperNodes.rend(); ++it)
+    {
+        BoneToMeshBVHNode &node = bvh.nodes[*it];
+
+        emptyBounds(node.min, node.max);
+
+        for (int c = 0; c < 2; c++)
+        {
+            const BoneToMeshBVHNode &child = bvh.nodes[node.index + c];
+            float bounds[6] = {child.min[0], child.min[1], child.min[2], child.max[0], child.max[1], child.max[2]};
+            growBounds(node.min, node.max, bounds);
+        }
+
+        cost += surfaceArea(node.min, node.max);
+    }
+
+    return cost;
+}
+
+
+// 2^exponent assembled directly in the exponent bits of a float.
+static float exponentStep(signed char exponent)
+{
+    uint32_t bits = uint32_t(int(exponent) + 127) << 23;
+
+    float step;
+    std::memcpy(&step, &bits, sizeof(float));
+
+    return step;
+}
+
+
+static bool isWideLeaf(unsigned int ref)
+{
+    return (ref & BVH_WIDE_LEAF) != 0;
+}
+
+
+static int wideLeafIndex(unsigned int ref)
+{
+    return int(ref & BVH_WIDE_INDEX_MASK);
+}
+
+
+static int wideLeafCount(unsigned int ref)
+{
+    return int((ref & ~BVH_WIDE_LEAF) >> BVH_WIDE_COUNT_SHIFT) + 1;
+}
+
+
+// Expands the children of a wide node into references to either a wide 
+// node, or to the count and first triangle of a leaf with the high bit set.
+static int wideChildren(const BoneToMeshBVHWideNode &node, unsigned int *refs)
+{
+    unsigned int nextNode = node.childIndex;
+    unsigned int nextTriangle = node.triangleIndex;
+
+    for (int c = 0; c < node.numChildren; c++)
+    {
+        if (node.meta[c] & BVH_WIDE_META_LEAF)
+        {
+            unsigned int count = node.meta[c] & ~BVH_WIDE_META_LEAF;
+
+            refs[c] = BVH_WIDE_LEAF | ((count - 1u) << BVH_WIDE_COUNT_SHIFT) | nextTriangle;
+            nextTriangle += count;
+        } else {
+            refs[c] = nextNode++;
+        }
+    }
+
+    return node.numChildren;
+}
+
+
+// Bounds of one child decoded from its quantized bounds, min xyz, max xyz.
+static void wideChildBounds(const BoneToMeshBVHWideNode &node, int child, float *bounds)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        float step = exponentStep(node.exponent[a]);
+
+        bounds[a]     = node.origin[a] + (float(node.qmin[a][child]) * step);
+        bounds[a + 3] = node.origin[a] + (float(node.qmax[a][child]) * step);
+    }
+}
+
+
+// Quantizes the bounds of the children (6 floats each) within their union. 
+// The step of each axis is the power of two that fits the union in 254 
+// steps, and every quantized box is widened until it contains its child.
+static void quantizeWideNode(BoneToMeshBVHWideNode &node, const float *childBounds)
+{
+    float min[3], max[3];
+    emptyBounds(min, max);
+
+    for (int c = 0; c < node.numChildren; c++) { growBounds(min, max, &childBounds[c * 6]); }
+
+    for (int a = 0; a < 3; a++)
+    {
+        float extent = max[a] - min[a];
+        int exponent = -126;
+
+        if (extent > 0.0f)
+        {
+            std::frexp(extent / float(BVH_QUANTIZED_STEPS - 1), &exponent);
+            exponent = std::max(-126, std::min(127, exponent));
+        }
+
+        node.origin[a] = min[a];
+        node.exponent[a] = (signed char) exponent;
+
+        float step = exponentStep(node.exponent[a]);
+
+        for (int c = 0; c < BVH_WIDTH; c++)
+        {
+            if (c >= node.numChildren)
+            {
+                node.qmin[a][c] = (unsigned char) (BVH_QUANTIZED_STEPS - 1);
+                node.qmax[a][c] = 0;
+                continue;
+            }
+
+            const float *bounds = &childBounds[c * 6];
+
+            int lo = std::max(0, std::min(BVH_QUANTIZED_STEPS - 1, int(std::floor((bounds[a] - min[a]) / step))));
+            int hi = std::max(0, std::min(BVH_QUANTIZED_STEPS - 1, int(std::ceil((bounds[a + 3] - min[a]) / step))));
+
+            while (lo > 0 && min[a] + (float(lo) * step) > bounds[a]) { lo--; }
+            while (hi < BVH_QUANTIZED_STEPS - 1 && min[a] + (float(hi) * step) < bounds[a + 3]) { hi++; }
+
+            node.qmin[a][c] = (unsigned char) lo;
+            node.qmax[a][c] = (unsigned char) hi;
+        }
+    }
+}
+
+
+// Collapses the binary subtree below nodeIndex into the wide node at 
+// wideIndex. The interior child with the largest surface area is opened 
+// until the node has eight children. Interior children are allocated next 
+// to each other, and the triangles of the leaves are appended to leafOrder 
+// in child order, so the node only needs to know where each run starts.
+static void compactNode(BoneToMeshBVH &bvh, int nodeIndex, int wideIndex, std::vector<int> &leafOrder)
+{
+    int children[BVH_WIDTH];
+    int numChildren = 0;
+
+    const BoneToMeshBVHNode &node = bvh.nodes[nodeIndex];
+
+    if (node.count > 0)
+    {
+        children[numChildren++] = nodeIndex;
+    } else {
+        children[numChildren++] = node.index;
+        children[numChildren++] = node.index + 1;
+    }
+
+    while (numChildren < BVH_WIDTH)
+    {
+        int   largest = -1;
+        float largestArea = -1.0f;
+
+        for (int c = 0; c < numChildren; c++)
+        {
+            const BoneToMeshBVHNode &child = bvh.nodes[children[c]];
+            float area = surfaceArea(child.min, child.max);
+
+            if (child.count == 0 && area > largestArea)
+            {
+                largest = c;
+                largestArea = area;
+            }
+        }
+
+        if (largest == -1) { break; }
+
+        int opened = bvh.nodes[children[largest]].index;
+
+        children[largest] = opened;
+        children[numChildren++] = opened + 1;
+    }
+
+    int interiorChildren[BVH_WIDTH];
+    int numInterior = 0;
+
+    int childIndex = (int) bvh.wideNodes.size();
+    int triangleIndex = (int) leafOrder.size();
+
+    float childBounds[BVH_WIDTH * 6];
+    unsigned char meta[BVH_WIDTH];
+
+    for (int c = 0; c < numChildren; c++)
+    {
+        const BoneToMeshBVHNode &child = bvh.nodes[children[c]];
+
+        std::copy(child.min, child.min + 3, &childBounds[c * 6]);
+        std::copy(child.max, child.max + 3, &childBounds[(c * 6) + 3]);
+
+        if (child.count > 0)
+        {
+            meta[c] = (unsigned char) (BVH_WIDE_META_LEAF | child.count);
+            leafOrder.insert(leafOrder.end(), bvh.order.begin() + child.index, bvh.order.begin() + child.index + child.count);
+        } else {
+            meta[c] = 0;
+            interiorChildren[numInterior++] = children[c];
+        }
+    }
+
+    bvh.wideNodes.resize(childIndex + numInterior);
+
+    BoneToMeshBVHWideNode &wideNode = bvh.wideNodes[wideIndex];
+
+    wideNode.numChildren = (unsigned char) numChildren;
+    wideNode.childIndex = (unsigned int) childIndex;
+    wideNode.triangleIndex = (unsigned int) triangleIndex;
+
+    for (int c = 0; c < BVH_WIDTH; c++) { wideNode.meta[c] = c < numChildren ? meta[c] : 0; }
+
+    quantizeWideNode(wideNode, childBounds);
+
+    for (int i = 0; i < numInterior; i++)
+    {
+        compactNode(bvh, interiorChildren[i], childIndex + i, leafOrder);
+    }
+}
+
+
+// Replaces the binary nodes with wide nodes. The triangles and their faces 
+// are stored in leaf order, which leaves the order array unused.
+static void compactBVH(BoneToMeshBVH &bvh)
+{
+    std::vector<int> leafOrder;
+
+    bvh.wideNodes.clear();
+
+    if (!bvh.nodes.empty())
+    {
+        leafOrder.reserve(bvh.order.size());
+
+        bvh.wideNodes.reserve((bvh.nodes.size() / 6) + 1);
+        bvh.wideNodes.resize(1);
+
+        compactNode(bvh, 0, 0, leafOrder);
+    }
+
+    std::vector<int> triangles(leafOrder.size() * 3);
+    std::vector<int> faces(leafOrder.size());
+
+    for (size_t i = 0; i < leafOrder.size(); i++)
+    {
+        std::copy(&bvh.triangles[leafOrder[i] * 3], &bvh.triangles[leafOrder[i] * 3] + 3, &triangles[i * 3]);
+        faces[i] = bvh.faces[leafOrder[i]];
+    }
+
+    bvh.triangles.swap(triangles);
+    bvh.faces.swap(faces);
+
+    bvh.wideNodes.shrink_to_fit();
+
+    std::vector<BoneToMeshBVHNode>().swap(bvh.nodes);
+    std::vector<int>().swap(bvh.order);
+}
+
+
+// Refits the wide subtree below nodeIndex and writes its bounds. Children 
+// found in refitBounds already have theirs.
+static void refitWideNode(
+    BoneToMeshBVH &bvh, 
+    int nodeIndex, 
+    float *bounds, 
+    const std::unordered_map<int, const float*> *refitBounds
+) {
+    BoneToMeshBVHWideNode &node = bvh.wideNodes[nodeIndex];
+
+    unsigned int refs[BVH_WIDTH];
+    float childBounds[BVH_WIDTH * 6];
+
+    int numChildren = wideChildren(node, refs);
+
+    for (int c = 0; c < numChildren; c++)
+    {
+        float *cb = &childBounds[c * 6];
+
+        if (isWideLeaf(refs[c]))
+        {
+            emptyBounds(cb, cb + 3);
+
+            int index = wideLeafIndex(refs[c]);
+            int count = wideLeafCount(refs[c]);
+
+            for (int t = index; t < index + count; t++) { triangleBounds(bvh, t, cb, cb + 3); }
+
+            continue;
+        }
+
+        if (refitBounds)
+        {
+            auto it = refitBounds->find(int(refs[c]));
+
+            if (it != refitBounds->end())
+            {
+                std::copy(it->second, it->second + 6, cb);
+                continue;
+            }
+        }
+
+        refitWideNode(bvh, int(refs[c]), cb, refitBounds);
+    }
+
+    quantizeWideNode(node, childBounds);
+
+    emptyBounds(bounds, bounds + 3);
+
+    for (int c = 0; c < numChildren; c++) { growBounds(bounds, bounds + 3, &childBounds[c * 6]); }
+}
+
+
+// Same as refitNodes, over the wide nodes.
+static void refitWideNodes(BoneToMeshBVH &bvh)
+{
+    std::vector<int> upperNodes;
+    std::vector<int> subtrees(1, 0);
+
+    int numTriangles = (int) bvh.triangles.size() / 3;
+    size_t numSubtrees = numTriangles < BVH_PARALLEL_REFIT_TRIANGLES ? 1 : size_t(numThreads() * 4);
+
+    while (subtrees.size() < numSubtrees)
+    {
+        std::vector<int> next;
+
+        for (int n : subtrees)
+        {
+            unsigned int refs[BVH_WIDTH];
+            int numChildren = wideChildren(bvh.wideNodes[n], refs);
+
+            size_t numNext = next.size();
+
+            for (int c = 0; c < numChildren; c++)
+            {
+                if (!isWideLeaf(refs[c])) { next.push_back(int(refs[c])); }
+            }
+
+            if (next.size() == numNext)
+            {
+                next.push_back(n);
+            } else {
+                upperNodes.push_back(n);
+            }
+        }
+
+        if (next == subtrees) { break; }
+
+        subtrees.swap(next);
+    }
+
+    std::vector<float> bounds((subtrees.size() + upperNodes.size()) * 6);
+
+    parallelFor(0, (int) subtrees.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            refitWideNode(bvh, subtrees[i], &bounds[i * 6], nullptr);
+        }
+    });
+
+    std::unordered_map<int, const float*> refitBounds;
+
+    for (size_t i = 0; i < subtrees.size(); i++) { refitBounds[subtrees[i]] = &bounds[i * 6]; }
+
+    for (size_t i = upperNodes.size(); i > 0; i--)
+    {
+        int n = upperNodes[i - 1];
+        float *nodeBounds = &bounds[(subtrees.size() + i - 1) * 6];
+
+        refitWideNode(bvh, n, nodeBounds, &refitBounds);
+
+        refitBounds[n] = nodeBounds;
+    }
+}
+
+
+void buildBVH(BoneToMeshBVH &bvh)
+{
+    int numTriangles = (int) bvh.triangles.size() / 3;
+
+    // A brute force tree is its root leaf. Wide leaves hold too few
+    // triangles for it, so it keeps the binary layout.
+    if (bvh.buildMethod == BVH_BUILD_BRUTE_FORCE)
+    {
+        bvh.order.resize(numTriangles);
+
+        for (int t = 0; t < numTriangles; t++) { bvh.order[t] = t; }
+
+        bvh.nodes.assign(numTriangles > 0 ? 1 : 0, BoneToMeshBVHNode());
+        bvh.wideNodes.clear();
+
+        if (numTriangles > 0)
+        {
+            makeLeaf(bvh.nodes[0], 0, numTriangles);
+            refitNodes(bvh);
+        }
+
+        bvh.rebuild.reset();
+        bvh.buildCost = bvh.cost = costBVH(bvh);
+
+        return;
+    }
+
+    BVHBuildState state;
+    state.bounds.resize(numTriangles * 6);
+    state.centroids.resize(numTriangles * 3);
+    state.order = &bvh.order;
+    state.nodes = &bvh.nodes;
+    state.leafSize = BVH_LEAF_SIZE;
+
+    parallelFor(0, numTriangles, BVH_BUILD_GRAIN, [&](int begin, int end) {
+        for (int t = begin; t < end; t++)
+        {
+            float *bounds = &state.bounds[t * 6];
+            emptyBounds(bounds, bounds + 3);
+            triangleBounds(bvh, t, bounds, bounds + 3);
+
+            for (int a = 0; a < 3; a++)
+            {
+                state.centroids[(t * 3) + a] = 0.5f * (bounds[a] + bounds[a + 3]);
+            }
+        }
+    });
+
+    bvh.order.resize(numTriangles);
+
+    for (int t = 0; t < numTriangles; t++) { bvh.order[t] = t; }
+
+    if (bvh.buildMethod == BVH_BUILD_MORTON)
+    {
+        mortonOrder(state, numTriangles);
+        buildTree<BVH_BUILD_MORTON>(state, numTriangles);
+
+        if (!bvh.nodes.empty()) { refitNodes(bvh); }
+    } else {
+        buildTree<BVH_BUILD_SAH>(state, numTriangles);
+    }
+
+    if (bvh.compact) 
+    { 
+        compactBVH(bvh); 
+    } else {
+        bvh.wideNodes.clear();
+    }
+
+    bvh.rebuild.reset();
+    bvh.buildCost = bvh.cost = costBVH(bvh);
+}
+
+
+static float buildMethodCost(int buildMethod, float numTriangles)
+{
+    float depth = std::log2(std::max(2.0f, numTriangles));
+
+    switch (buildMethod)
+    {
+        case BVH_BUILD_BRUTE_FORCE: return numTriangles * BVH_COST_BRUTE_FORCE_BUILD;
+        case BVH_BUILD_MORTON:      return numTriangles * BVH_COST_MORTON_BUILD;
+        default:                    return numTriangles * depth * BVH_COST_SAH_BUILD;
+    }
+}
+
+
+static float traceMethodCost(int buildMethod, float numTriangles)
+{
+    float depth = std::log2(std::max(2.0f, numTriangles));
+
+    switch (buildMethod)
+    {
+        case BVH_BUILD_BRUTE_FORCE: return numTriangles;
+        case BVH_BUILD_MORTON:      return depth * BVH_COST_SAH_TRACE * BVH_COST_MORTON_TRACE;
+        default:                    return depth * BVH_COST_SAH_TRACE;
+    }
+}
+
+
+int chooseBuildMethod(const BoneToMeshBVH &bvh, int numTriangles, int numRays, bool sameTopology, bool samePoints)
+{
+    static const int methods[3] = {BVH_BUILD_BRUTE_FORCE, BVH_BUILD_MORTON, BVH_BUILD_SAH};
+
+    float triangles = float(numTriangles);
+    float rays = float(std::max(1, numRays));
+
+    int   best = BVH_BUILD_SAH;
+    float bestCost = FLT_MAX;
+
+    for (int method : methods)
+    {
+        float cost = buildMethodCost(method, triangles) + (rays * traceMethodCost(method, triangles));
+
+        if (cost < bestCost)
+        {
+            best = method;
+            bestCost = cost;
+        }
+    }
+
+    // A tree with the same topology is refit, or kept as it is if the points
+    // did not move either.
+    bool built = !bvh.nodes.empty() || !bvh.wideNodes.empty();
+
+    if (built && sameTopology)
+    {
+        float keepCost = (rays * traceMethodCost(bvh.buildMethod, triangles)) + (samePoints ? 0.0f : triangles * BVH_COST_REFIT);
+
+        if (bestCost >= keepCost * BVH_SWITCH_SAVING) { return bvh.buildMethod; }
+    }
+
+    return best;
+}
+
+
+static float nodeCost(const BoneToMeshBVH &bvh, int nodeIndex)
+{
+    const BoneToMeshBVHNode &node = bvh.nodes[nodeIndex];
+
+    float area = surfaceArea(node.min, node.max);
+
+    if (node.count > 0)
+    {
+        return area * float(node.count);
+    }
+
+    return area + nodeCost(bvh, node.index) + nodeCost(bvh, node.index + 1);
+}
+
+
+// Cost of the wide subtree below nodeIndex, from the decoded child bounds.
+static float wideNodeCost(const BoneToMeshBVH &bvh, int nodeIndex)
+{
+    const BoneToMeshBVHWideNode &node = bvh.wideNodes[nodeIndex];
+
+    unsigned int refs[BVH_WIDTH];
+    int numChildren = wideChildren(node, refs);
+
+    float cost = 0.0f;
+
+    for (int c = 0; c < numChildren; c++)
+    {
+        float bounds[6];
+        wideChildBounds(node, c, bounds);
+
+        float area = surfaceArea(bounds, bounds + 3);
+
+        if (isWideLeaf(refs[c]))
+        {
+            cost += area * float(wideLeafCount(refs[c]));
+        } else {
+            cost += area + wideNodeCost(bvh, int(refs[c]));
+        }
+    }
+
+    return cost;
+}
+
+
+// Bounds of the whole tree, false if it is empty.
+static bool rootBounds(const BoneToMeshBVH &bvh, float *bounds)
+{
+    if (!bvh.wideNodes.empty())
+    {
+        const BoneToMeshBVHWideNode &root = bvh.wideNodes[0];
+
+        emptyBounds(bounds, bounds + 3);
+
+        for (int c = 0; c < root.numChildren; c++)
+        {
+            float childBounds[6];
+            wideChildBounds(root, c, childBounds);
+            growBounds(bounds, bounds + 3, childBounds);
+        }
+
+        return true;
+    } else if (!bvh.nodes.empty()) {
+        std::copy(bvh.nodes[0].min, bvh.nodes[0].min + 3, bounds);
+        std::copy(bvh.nodes[0].max, bvh.nodes[0].max + 3, bounds + 3);
+
+        return true;
+    }
+
+    return false;
+}
+
+
+float costBVH(const BoneToMeshBVH &bvh)
+{
+    float bounds[6];
+
+    if (!rootBounds(bvh, bounds)) { return 0.0f; }
+
+    float rootArea = surfaceArea(bounds, bounds + 3);
+
+    if (rootArea <= 0.0f) { return 0.0f; }
+
+    return (bvh.wideNodes.empty() ? nodeCost(bvh, 0) : rootArea + wideNodeCost(bvh, 0)) / rootArea;
+}
+
+
+size_t memoryBVH(const BoneToMeshBVH &bvh)
+{
+    return (
+        (bvh.nodes.capacity() * sizeof(BoneToMeshBVHNode)) + 
+        (bvh.wideNodes.capacity() * sizeof(BoneToMeshBVHWideNode)) + 
+        (bvh.order.capacity() * sizeof(int))
+    );
+}
+
+
+// Trees, the copies of the meshes they were built from and the changes of
+// the latest update. A rebuild running in the background is left out.
+size_t memoryScene(const BoneToMeshScene &scene)
+{
+    size_t bytes = (scene.nodes.capacity() * sizeof(BoneToMeshBVHNode)) + (scene.order.capacity() * sizeof(int));
+
+    for (const BoneToMeshBVH &bvh : scene.meshes)
+    {
+        bytes += memoryBVH(bvh);
+        bytes += bvh.points.capacity() * sizeof(float);
+        bytes += (bvh.triangles.capacity() + bvh.faces.capacity()) * sizeof(int);
+    }
+
+    for (const BoneToMeshChange &change : scene.changes)
+    {
+        bytes += change.triangles.capacity();
+    }
+
+    return bytes;
+}
+
+
+// Returns true if a finished background rebuild was swapped in, which 
+// reorders the triangles of a compact tree.
+bool refitBVH(BoneToMeshBVH &bvh)
+{
+    if (bvh.nodes.empty() && bvh.wideNodes.empty()) { return false; }
+
+    // A finished rebuild was built from older points, but the topology 
+    // is the same, so refitting it brings it up to date.
+    bool rebuilt = false;
+
+    if (bvh.rebuild && bvh.rebuild->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        BoneToMeshBVH &rebuildBVH = *bvh.rebuild->bvh;
+
+        bvh.nodes.swap(rebuildBVH.nodes);
+        bvh.wideNodes.swap(rebuildBVH.wideNodes);
+        bvh.order.swap(rebuildBVH.order);
+        bvh.triangles.swap(rebuildBVH.triangles);
+        bvh.faces.swap(rebuildBVH.faces);
+        bvh.rebuild.reset();
+
+        rebuilt = true;
+    }
+
+    if (bvh.wideNodes.empty())
+    {
+        float cost = refitNodes(bvh);
+        float rootArea = surfaceArea(bvh.nodes[0].min, bvh.nodes[0].max);
+
+        bvh.cost = rootArea > 0.0f ? cost / rootArea : 0.0f;
+    } else {
+        refitWideNodes(bvh);
+
+        bvh.cost = costBVH(bvh);
+    }
+
+    if (rebuilt)
+    {
+        bvh.buildCost = bvh.cost;
+    } else if (!bvh.rebuild && bvh.cost > bvh.buildCost * BVH_REFIT_DEGRADATION) {
+        std::shared_ptr<BoneToMeshBVH> rebuildBVH = std::make_shared<BoneToMeshBVH>();
+        rebuildBVH->points = bvh.points;
+        rebuildBVH->triangles = bvh.triangles;
+        rebuildBVH->faces = bvh.faces;
+        rebuildBVH->buildMethod = bvh.buildMethod;
+        rebuildBVH->compact = bvh.compact;
+
+        std::shared_ptr<BoneToMeshBVHRebuild> rebuild = std::make_shared<BoneToMeshBVHRebuild>();
+        rebuild->bvh = rebuildBVH;
+        rebuild->done = runAsync([rebuildBVH]() { buildBVH(*rebuildBVH); });
+
+        bvh.rebuild = rebuild;
+    }
+
+    return rebuilt;
+}
+
+
+void buildSceneBVH(BoneToMeshScene &scene)
+{
+    int numMeshes = (int) scene.meshes.size();
+
+    BVHBuildState state;
+    state.bounds.resize(numMeshes * 6);
+    state.centroids.resize(numMeshes * 3);
+    state.order = &scene.order;
+    state.nodes = &scene.nodes;
+    state.leafSize = 1;
+
+    // Meshes without triangles are left out of the top level.
+    int numPrimitives = 0;
+    std::vector<int> meshIndices;
+
+    for (int m = 0; m < numMeshes; m++)
+    {
+        const BoneToMeshBVH &bvh = scene.meshes[m];
+
+        float *bounds = &state.bounds[numPrimitives * 6];
+
+        if (!rootBounds(bvh, bounds)) { continue; }
+
+        for (int a = 0; a < 3; a++)
+        {
+            state.centroids[(numPrimitives * 3) + a] = 0.5f * (bounds[a] + bounds[a + 3]);
+        }
+
+        meshIndices.push_back(m);
+        numPrimitives++;
+    }
+
+    scene.order.resize(numPrimitives);
+
+    for (int i = 0; i < numPrimitives; i++) { scene.order[i] = i; }
+
+    buildTree<BVH_BUILD_SAH>(state, numPrimitives);
+
+    for (size_t i = 0; i < scene.order.size(); i++)
+    {
+        scene.order[i] = meshIndices[scene.order[i]];
+    }
+}
+
+
+static bool intersectBounds(const BoneToMeshBVHNode &node, const float *origin, const float *invDirection, float maxParam, float &param)
+{
+    float tmin = 0.0f;
+    float tmax = maxParam;
+
+    for (int a = 0; a < 3; a++)
+    {
+        float t0 = (node.min[a] - origin[a]) * invDirection[a];
+        float t1 = (node.max[a] - origin[a]) * invDirection[a];
+
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+    }
+
+    param = tmin;
+
+    return tmin <= tmax;
+}
+
+
+// Moller-Trumbore. The ray faces the front of the triangle when it sees its
+// vertices counter-clockwise, against the normal.
+static inline bool intersectTriangle(
+    const float *origin,
+    const float *direction,
+    const float *p0,
+    const float *p1,
+    const float *p2,
+    float &t,
+    float &u,
+    float &v,
+    bool &frontFacing
+) {
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+    float pv[3] = {
+        (direction[1] * e2[2]) - (direction[2] * e2[1]),
+        (direction[2] * e2[0]) - (direction[0] * e2[2]),
+        (direction[0] * e2[1]) - (direction[1] * e2[0])
+    };
+
+    float det = (e1[0] * pv[0]) + (e1[1] * pv[1]) + (e1[2] * pv[2]);
+
+    if (det == 0.0f) { return false; }
+
+    float invDet = 1.0f / det;
+    float tv[3] = {origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2]};
+
+    u = ((tv[0] * pv[0]) + (tv[1] * pv[1]) + (tv[2] * pv[2])) * invDet;
+
+    if (u < -TRIANGLE_TOLERANCE || u > 1.0f + TRIANGLE_TOLERANCE) { return false; }
+
+    float qv[3] = {
+        (tv[1] * e1[2]) - (tv[2] * e1[1]),
+        (tv[2] * e1[0]) - (tv[0] * e1[2]),
+        (tv[0] * e1[1]) - (tv[1] * e1[0])
+    };
+
+    v = ((direction[0] * qv[0]) + (direction[1] * qv[1]) + (direction[2] * qv[2])) * invDet;
+
+    if (v < -TRIANGLE_TOLERANCE || u + v > 1.0f + TRIANGLE_TOLERANCE) { return false; }
+
+    t = ((e2[0] * qv[0]) + (e2[1] * qv[1]) + (e2[2] * qv[2])) * invDet;
+    frontFacing = det > 0.0f;
+
+    return t >= 0.0f;
+}
+
+
+static void inverseDirection(const float *direction, float *invDirection)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        invDirection[a] = direction[a] != 0.0f ? 1.0f / direction[a] : FLT_MAX;
+    }
+}
+
+
+// Hits kept by a traversal under one hit policy. Nodes are visited in
+// priority order, nearest entry first or farthest exit first for 
+// HIT_FARTHEST, and skipped once their priority shows no triangle in them 
+// can change the result.
+template <int Policy>
+struct BVHHits
+{
+    float maxParam;
+    float bound;        // entry param beyond which nothing is kept
+    int   hitIndex;
+    int   numHits = 0;
+    int   mesh = -1;
+
+    BoneToMeshHit hits[HIT_MAX_NTH];    // near to far for HIT_NTH, otherwise the one kept hit
+
+    BVHHits(float maxParam, int hitIndex) : 
+        maxParam(maxParam), 
+        bound(maxParam), 
+        hitIndex(Policy == HIT_NTH ? std::max(1, std::min(HIT_MAX_NTH, hitIndex)) : 1)
+    {
+    }
+
+    static float priority(float tmin, float tmax) { return Policy == HIT_FARTHEST ? -tmax : tmin; }
+
+    bool visit(float priority) const
+    {
+        if (Policy == HIT_FARTHEST) { return numHits == 0 || -priority >= hits[0].param; }
+
+        return priority <= bound;
+    }
+
+    void add(float t, int triangle, int face, float u, float v, bool frontFacing)
+    {
+        if (Policy == HIT_FRONT_FACING && !frontFacing) { return; }
+
+        if (Policy == HIT_FARTHEST)
+        {
+            if (t > maxParam || (numHits > 0 && t < hits[0].param)) { return; }
+        } else if (t > bound) {
+            return;
+        }
+
+        int i = 0;
+
+        if (Policy == HIT_NTH)
+        {
+            // A ray through an edge or vertex hits every triangle around it 
+            // at the same param, which still counts as one hit.
+            for (int h = 0; h < numHits; h++)
+            {
+                if (std::abs(hits[h].param - t) <= HIT_MERGE_TOLERANCE * std::max(1.0f, t)) { return; }
+            }
+
+            i = std::min(numHits, hitIndex - 1);
+
+            while (i > 0 && hits[i - 1].param > t)
+            {
+                hits[i] = hits[i - 1];
+                i--;
+            }
+
+            numHits = std::min(numHits + 1, hitIndex);
+        } else {
+            numHits = 1;
+        }
+
+        BoneToMeshHit &hit = hits[i];
+
+        hit.param    = t;
+        hit.mesh     = mesh;
+        hit.triangle = triangle;
+        hit.face     = face;
+        hit.u        = u;
+        hit.v        = v;
+
+        if (Policy == HIT_NTH)
+        {
+            if (numHits == hitIndex) { bound = hits[hitIndex - 1].param; }
+        } else if (Policy != HIT_FARTHEST) {
+            bound = t;
+        }
+    }
+
+    bool found() const { return numHits == hitIndex; }
+
+    const BoneToMeshHit& hit() const { return hits[hitIndex - 1]; }
+};
+
+
+static inline bool boundsInterval(const float *min, const float *max, const float *origin, const float *invDirection, float maxParam, float &tmin, float &tmax)
+{
+    tmin = 0.0f;
+    tmax = maxParam;
+
+    for (int a = 0; a < 3; a++)
+    {
+        float t0 = (min[a] - origin[a]) * invDirection[a];
+        float t1 = (max[a] - origin[a]) * invDirection[a];
+
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+    }
+
+    return tmin <= tmax;
+}
+
+
+// Tests the triangles at order[begin, begin + count). Without an order, as
+// in the compact layout, the triangles themselves are in leaf order.
+template <int Policy>
+static void intersectLeaf(
+    const BoneToMeshBVH &bvh, 
+    const int *order,
+    int begin, 
+    int count, 
+    const BoneToMeshRay &ray, 
+    BVHHits<Policy> &hits
+) {
+    for (int i = begin; i < begin + count; i++)
+    {
+        int tri = order ? order[i] : i;
+
+        const int *vtx = &bvh.triangles[tri * 3];
+
+        float t, u, v;
+        bool frontFacing;
+
+        bool intersects = intersectTriangle(
+            ray.origin,
+            ray.direction,
+            &bvh.points[vtx[0] * 3],
+            &bvh.points[vtx[1] * 3],
+            &bvh.points[vtx[2] * 3],
+            t, u, v, frontFacing
+        );
+
+        if (intersects) { hits.add(t, tri, bvh.faces[tri], u, v, frontFacing); }
+    }
+}
+
+
+template <int Policy>
+static void intersectWideBVH(const BoneToMeshBVH &bvh, const BoneToMeshRay &ray, BVHHits<Policy> &hits)
+{
+    float invDirection[3];
+    inverseDirection(ray.direction, invDirection);
+
+    bool parallel[3] = {ray.direction[0] == 0.0f, ray.direction[1] == 0.0f, ray.direction[2] == 0.0f};
+
+    // Priorities are kept with the stack so children the result has since 
+    // moved past are skipped.
+    unsigned int stack[BVH_STACK_SIZE];
+    float        stackPriorities[BVH_STACK_SIZE];
+    int stackSize = 0;
+
+    stack[stackSize] = 0;
+    stackPriorities[stackSize++] = BVHHits<Policy>::priority(0.0f, ray.maxParam);
+
+    while (stackSize > 0)
+    {
+        unsigned int ref = stack[--stackSize];
+
+        if (!hits.visit(stackPriorities[stackSize])) { continue; }
+
+        if (isWideLeaf(ref))
+        {
+            intersectLeaf(bvh, nullptr, wideLeafIndex(ref), wideLeafCount(ref), ray, hits);
+            continue;
+        }
+
+        const BoneToMeshBVHWideNode &node = bvh.wideNodes[ref];
+
+        // The slabs of every child are offsets from the same origin, so the 
+        // ray is moved into the node's frame once. A ray parallel to an axis
+        // is compared with the slabs of that axis in quantized steps instead,
+        // as its huge inverse would turn the offsets into inf - inf.
+        float step[3], offset[3], cell[3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            float scale = exponentStep(node.exponent[a]);
+
+            step[a] = scale * invDirection[a];
+            offset[a] = (node.origin[a] - ray.origin[a]) * invDirection[a];
+            cell[a] = (ray.origin[a] - node.origin[a]) / scale;
+        }
+
+        unsigned int refs[BVH_WIDTH];
+        int numChildren = wideChildren(node, refs);
+
+        unsigned int hitChildren[BVH_WIDTH];
+        float        hitPriorities[BVH_WIDTH];
+        int          numHits = 0;
+
+        for (int c = 0; c < numChildren; c++)
+        {
+            float tmin = 0.0f;
+            float tmax = ray.maxParam;
+
+            for (int a = 0; a < 3; a++)
+            {
+                if (parallel[a])
+                {
+                    if (cell[a] < float(node.qmin[a][c]) || cell[a] > float(node.qmax[a][c])) { tmax = -1.0f; }
+                    continue;
+                }
+
+                float t0 = offset[a] + (float(node.qmin[a][c]) * step[a]);
+                float t1 = offset[a] + (float(node.qmax[a][c]) * step[a]);
+
+                tmin = std::max(tmin, std::min(t0, t1));
+                tmax = std::min(tmax, std::max(t0, t1));
+            }
+
+            float priority = BVHHits<Policy>::priority(tmin, tmax);
+
+            if (tmin > tmax || !hits.visit(priority)) { continue; }
+
+            // Kept sorted last to first, so the first child is popped first.
+            int i = numHits++;
+
+            while (i > 0 && hitPriorities[i - 1] < priority)
+            {
+                hitChildren[i] = hitChildren[i - 1];
+                hitPriorities[i] = hitPriorities[i - 1];
+                i--;
+            }
+
+            hitChildren[i] = refs[c];
+            hitPriorities[i] = priority;
+        }
+
+        for (int i = 0; i < numHits; i++) 
+        { 
+            stack[stackSize] = hitChildren[i];
+            stackPriorities[stackSize++] = hitPriorities[i];
+        }
+    }
+}
+
+
+template <int Policy>
+static void intersectBVH(const BoneToMeshBVH &bvh, const BoneToMeshRay &ray, BVHHits<Policy> &hits)
+{
+    if (!bvh.wideNodes.empty()) 
+    { 
+        intersectWideBVH(bvh, ray, hits); 
+        return;
+    }
+
+    if (bvh.nodes.empty()) { return; }
+
+    float invDirection[3];
+    inverseDirection(ray.direction, invDirection);
+
+    int   stack[BVH_STACK_SIZE];
+    float stackPriorities[BVH_STACK_SIZE];
+    int stackSize = 0;
+
+    float tmin, tmax;
+
+    if (!boundsInterval(bvh.nodes[0].min, bvh.nodes[0].max, ray.origin, invDirection, ray.maxParam, tmin, tmax)) { return; }
+
+    stack[stackSize] = 0;
+    stackPriorities[stackSize++] = BVHHits<Policy>::priority(tmin, tmax);
+
+    while (stackSize > 0)
+    {
+        const BoneToMeshBVHNode &node = bvh.nodes[stack[--stackSize]];
+
+        if (!hits.visit(stackPriorities[stackSize])) { continue; }
+
+        if (node.count > 0)
+        {
+            intersectLeaf(bvh, bvh.order.data(), node.index, node.count, ray, hits);
+        } else {
+            // Visit the first child first so it can narrow the result for the other.
+            int first  = node.index;
+            int second = node.index + 1;
+
+            float firstMin, firstMax, secondMin, secondMax;
+
+            bool hitsFirst  = boundsInterval(bvh.nodes[first].min,  bvh.nodes[first].max,  ray.origin, invDirection, ray.maxParam, firstMin,  firstMax);
+            bool hitsSecond = boundsInterval(bvh.nodes[second].min, bvh.nodes[second].max, ray.origin, invDirection, ray.maxParam, secondMin, secondMax);
+
+            float firstPriority  = BVHHits<Policy>::priority(firstMin, firstMax);
+            float secondPriority = BVHHits<Policy>::priority(secondMin, secondMax);
+
+            hitsFirst  = hitsFirst  && hits.visit(firstPriority);
+            hitsSecond = hitsSecond && hits.visit(secondPriority);
+
+            if (hitsFirst && hitsSecond && secondPriority < firstPriority)
+            {
+                std::swap(first, second);
+                std::swap(firstPriority, secondPriority);
+            }
+
+            if (hitsFirst && hitsSecond)
+            {
+                stack[stackSize] = second;
+                stackPriorities[stackSize++] = secondPriority;
+                stack[stackSize] = first;
+                stackPriorities[stackSize++] = firstPriority;
+            } else if (hitsFirst || hitsSecond) {
+                stack[stackSize] = hitsFirst ? first : second;
+                stackPriorities[stackSize++] = hitsFirst ? firstPriority : secondPriority;
+            }
+        }
+    }
+}
+
+
+template <int Policy>
+static bool intersectBVH(const BoneToMeshBVH &bvh, const BoneToMeshRay &ray, int hitIndex, BoneToMeshHit &hit)
+{
+    BVHHits<Policy> hits(ray.maxParam, hitIndex);
+
+    intersectBVH(bvh, ray, hits);
+
+    if (hits.found()) { hit = hits.hit(); }
+
+    return hits.found();
+}
+
+
+bool intersectBVH(const BoneToMeshBVH &bvh, const BoneToMeshRay &ray, BoneToMeshHit &hit, int hitPolicy, int hitIndex)
+{
+    switch (hitPolicy)
+    {
+        case HIT_FARTHEST:     return intersectBVH<HIT_FARTHEST>(bvh, ray, hitIndex, hit);
+        case HIT_NTH:          return intersectBVH<HIT_NTH>(bvh, ray, hitIndex, hit);
+        case HIT_FRONT_FACING: return intersectBVH<HIT_FRONT_FACING>(bvh, ray, hitIndex, hit);
+        default:               return intersectBVH<HIT_NEAREST>(bvh, ray, hitIndex, hit);
+    }
+}
+
+
+// The first hit policies take each mesh's first hit along the ray, and the
+// outermost of those wins - a ray leaving the body through a sleeve and an
+// armour plate lands on the armour.
+template <int Policy>
+static bool intersectSceneFirst(const BoneToMeshScene &scene, const BoneToMeshRay &ray, BoneToMeshHit &hit)
+{
+    float invDirection[3];
+    inverseDirection(ray.direction, invDirection);
+
+    bool found = false;
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const BoneToMeshBVHNode &node = scene.nodes[stack[--stackSize]];
+
+        float param;
+
+        if (!intersectBounds(node, ray.origin, invDirection, ray.maxParam, param)) { continue; }
+
+        if (node.count > 0)
+        {
+            for (int i = node.index; i < node.index + node.count; i++)
+            {
+                int m = scene.order[i];
+
+                BVHHits<Policy> meshHits(ray.maxParam, 1);
+                meshHits.mesh = m;
+
+                intersectBVH(scene.meshes[m], ray, meshHits);
+
+                if (meshHits.found() && (!found || meshHits.hit().param > hit.param))
+                {
+                    hit = meshHits.hit();
+                    found = true;
+                }
+            }
+        } else {
+            stack[stackSize++] = node.index;
+            stack[stackSize++] = node.index + 1;
+        }
+    }
+
+    return found;
+}
+
+
+// The other policies rank the hits of every mesh together, and the meshes 
+// are visited in priority order to narrow the result as early as possible.
+template <int Policy>
+static bool intersectSceneRanked(const BoneToMeshScene &scene, const BoneToMeshRay &ray, int hitIndex, BoneToMeshHit &hit)
+{
+    float invDirection[3];
+    inverseDirection(ray.direction, invDirection);
+
+    BVHHits<Policy> hits(ray.maxParam, hitIndex);
+
+    int   stack[BVH_STACK_SIZE];
+    float stackPriorities[BVH_STACK_SIZE];
+    int stackSize = 0;
+
+    float tmin, tmax;
+
+    if (!boundsInterval(scene.nodes[0].min, scene.nodes[0].max, ray.origin, invDirection, ray.maxParam, tmin, tmax)) { return false; }
+
+    stack[stackSize] = 0;
+    stackPriorities[stackSize++] = BVHHits<Policy>::priority(tmin, tmax);
+
+    while (stackSize > 0)
+    {
+        const BoneToMeshBVHNode &node = scene.nodes[stack[--stackSize]];
+
+        if (!hits.visit(stackPriorities[stackSize])) { continue; }
+
+        if (node.count > 0)
+        {
+            for (int i = node.index; i < node.index + node.count; i++)
+            {
+                hits.mesh = scene.order[i];
+
+                intersectBVH(scene.meshes[hits.mesh], ray, hits);
+            }
+        } else {
+            int first  = node.index;
+            int second = node.index + 1;
+
+            float firstMin, firstMax, secondMin, secondMax;
+
+            bool hitsFirst  = boundsInterval(scene.nodes[first].min,  scene.nodes[first].max,  ray.origin, invDirection, ray.maxParam, firstMin,  firstMax);
+            bool hitsSecond = boundsInterval(scene.nodes[second].min, scene.nodes[second].max, ray.origin, invDirection, ray.maxParam, secondMin, secondMax);
+
+            float firstPriority  = BVHHits<Policy>::priority(firstMin, firstMax);
+            float secondPriority = BVHHits<Policy>::priority(secondMin, secondMax);
+
+            if (hitsFirst && hitsSecond && secondPriority < firstPriority)
+            {
+                std::swap(first, second);
+                std::swap(firstPriority, secondPriority);
+            }
+
+            if (hitsFirst && hitsSecond)
+            {
+                stack[stackSize] = second;
+                stackPriorities[stackSize++] = secondPriority;
+                stack[stackSize] = first;
+                stackPriorities[stackSize++] = firstPriority;
+            } else if (hitsFirst || hitsSecond) {
+                stack[stackSize] = hitsFirst ? first : second;
+                stackPriorities[stackSize++] = hitsFirst ? firstPriority : secondPriority;
+            }
+        }
+    }
+
+    if (hits.found()) { hit = hits.hit(); }
+
+    return hits.found();
+}
+
+
+bool intersectScene(const BoneToMeshScene &scene, const BoneToMeshRay &ray, BoneToMeshHit &hit, int hitPolicy, int hitIndex)
+{
+    if (scene.nodes.empty()) { return false; }
+
+    switch (hitPolicy)
+    {
+        case HIT_FARTHEST:     return intersectSceneRanked<HIT_FARTHEST>(scene, ray, hitIndex, hit);
+        case HIT_NTH:          return intersectSceneRanked<HIT_NTH>(scene, ray, hitIndex, hit);
+        case HIT_FRONT_FACING: return intersectSceneFirst<HIT_FRONT_FACING>(scene, ray, hit);
+        default:               return intersectSceneFirst<HIT_NEAREST>(scene, ray, hit);
+    }
+}
+
+
+static float boxDistance2(const float *min, const float *max, const float *point)
+{
+    float distance2 = 0.0f;
+
+    for (int a = 0; a < 3; a++)
+    {
+        float d = std::max(0.0f, std::max(min[a] - point[a], point[a] - max[a]));
+        distance2 += d * d;
+    }
+
+    return distance2;
+}
+
+
+static float dot3(const float *a, const float *b)
+{
+    return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+}
+
+
+// Closest point on the triangle abc to p, from Ericson's Real-Time Collision
+// Detection: find the Voronoi region of the triangle that p lies in.
+static void closestPointTriangle(const float *p, const float *a, const float *b, const float *c, float *closest)
+{
+    float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    float ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+
+    float d1 = dot3(ab, ap);
+    float d2 = dot3(ac, ap);
+
+    if (d1 <= 0.0f && d2 <= 0.0f) { std::copy(a, a + 3, closest); return; }
+
+    float bp[3] = {p[0] - b[0], p[1] - b[1], p[2] - b[2]};
+
+    float d3 = dot3(ab, bp);
+    float d4 = dot3(ac, bp);
+
+    if (d3 >= 0.0f && d4 <= d3) { std::copy(b, b + 3, closest); return; }
+
+    float vc = (d1 * d4) - (d3 * d2);
+
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        float v = d1 / (d1 - d3);
+
+        for (int i = 0; i < 3; i++) { closest[i] = a[i] + (v * ab[i]); }
+        return;
+    }
+
+    float cp[3] = {p[0] - c[0], p[1] - c[1], p[2] - c[2]};
+
+    float d5 = dot3(ab, cp);
+    float d6 = dot3(ac, cp);
+
+    if (d6 >= 0.0f && d5 <= d6) { std::copy(c, c + 3, closest); return; }
+
+    float vb = (d5 * d2) - (d1 * d6);
+
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        float w = d2 / (d2 - d6);
+
+        for (int i = 0; i < 3; i++) { closest[i] = a[i] + (w * ac[i]); }
+        return;
+    }
+
+    float va = (d3 * d6) - (d5 * d4);
+
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+    {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+
+        for (int i = 0; i < 3; i++) { closest[i] = b[i] + (w * (c[i] - b[i])); }
+        return;
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    float v = vb * denom;
+    float w = vc * denom;
+
+    for (int i = 0; i < 3; i++) { closest[i] = a[i] + (ab[i] * v) + (ac[i] * w); }
+}
+
+
+static void closestPointLeaf(
+    const BoneToMeshBVH &bvh, 
+    const int *order, 
+    int begin, 
+    int count, 
+    const float *point, 
+    float &bestDistance2, 
+    float *closest
+) {
+    for (int i = begin; i < begin + count; i++)
+    {
+        int tri = order ? order[i] : i;
+
+        const int *vtx = &bvh.triangles[tri * 3];
+
+        float candidate[3];
+
+        closestPointTriangle(point, &bvh.points[vtx[0] * 3], &bvh.points[vtx[1] * 3], &bvh.points[vtx[2] * 3], candidate);
+
+        float d[3] = {candidate[0] - point[0], candidate[1] - point[1], candidate[2] - point[2]};
+        float distance2 = dot3(d, d);
+
+        if (distance2 < bestDistance2)
+        {
+            bestDistance2 = distance2;
+            std::copy(candidate, candidate + 3, closest);
+        }
+    }
+}
+
+
+// Same traversal as the ray queries, nearest box first, with boxes farther
+// than the closest point found so far skipped.
+static void closestPointBVH(const BoneToMeshBVH &bvh, const float *point, float &bestDistance2, float *closest)
+{
+    if (!bvh.wideNodes.empty())
+    {
+        unsigned int stack[BVH_STACK_SIZE];
+        float        stackDistances[BVH_STACK_SIZE];
+        int stackSize = 0;
+
+        stack[stackSize] = 0;
+        stackDistances[stackSize++] = 0.0f;
+
+        while (stackSize > 0)
+        {
+            unsigned int ref = stack[--stackSize];
+
+            if (stackDistances[stackSize] >= bestDistance2) { continue; }
+
+            if (isWideLeaf(ref))
+            {
+                closestPointLeaf(bvh, nullptr, wideLeafIndex(ref), wideLeafCount(ref), point, bestDistance2, closest);
+                continue;
+            }
+
+            const BoneToMeshBVHWideNode &node = bvh.wideNodes[ref];
+
+            unsigned int refs[BVH_WIDTH];
+            int numChildren = wideChildren(node, refs);
+
+            unsigned int children[BVH_WIDTH];
+            float        distances[BVH_WIDTH];
+            int          numVisits = 0;
+
+            for (int c = 0; c < numChildren; c++)
+            {
+                float bounds[6];
+                wideChildBounds(node, c, bounds);
+
+                float distance2 = boxDistance2(bounds, bounds + 3, point);
+
+                if (distance2 >= bestDistance2) { continue; }
+
+                // Kept sorted far to near, so the nearest child is popped first.
+                int i = numVisits++;
+
+                while (i > 0 && distances[i - 1] < distance2)
+                {
+                    children[i] = children[i - 1];
+                    distances[i] = distances[i - 1];
+                    i--;
+                }
+
+                children[i] = refs[c];
+                distances[i] = distance2;
+            }
+
+            for (int i = 0; i < numVisits; i++)
+            {
+                stack[stackSize] = children[i];
+                stackDistances[stackSize++] = distances[i];
+            }
+        }
+
+        return;
+    }
+
+    if (bvh.nodes.empty()) { return; }
+
+    int   stack[BVH_STACK_SIZE];
+    float stackDistances[BVH_STACK_SIZE];
+    int stackSize = 0;
+
+    stack[stackSize] = 0;
+    stackDistances[stackSize++] = boxDistance2(bvh.nodes[0].min, bvh.nodes[0].max, point);
+
+    while (stackSize > 0)
+    {
+        const BoneToMeshBVHNode &node = bvh.nodes[stack[--stackSize]];
+
+        if (stackDistances[stackSize] >= bestDistance2) { continue; }
+
+        if (node.count > 0)
+        {
+            closestPointLeaf(bvh, bvh.order.data(), node.index, node.count, point, bestDistance2, closest);
+            continue;
+        }
+
+        int near = node.index;
+        int far  = node.index + 1;
+
+        float nearDistance2 = boxDistance2(bvh.nodes[near].min, bvh.nodes[near].max, point);
+        float farDistance2  = boxDistance2(bvh.nodes[far].min,  bvh.nodes[far].max,  point);
+
+        if (farDistance2 < nearDistance2)
+        {
+            std::swap(near, far);
+            std::swap(nearDistance2, farDistance2);
+        }
+
+        if (farDistance2 < bestDistance2)
+        {
+            stack[stackSize] = far;
+            stackDistances[stackSize++] = farDistance2;
+        }
+
+        if (nearDistance2 < bestDistance2)
+        {
+            stack[stackSize] = near;
+            stackDistances[stackSize++] = nearDistance2;
+        }
+    }
+}
+
+
+// Each query starts out bounded by its distance to the previous answer, 
+// which is a point on the scene, so a batch of nearby points is answered 
+// with little more than the leaves around the answers.
+bool closestPoints(const BoneToMeshScene &scene, const float *points, int numPoints, float *closest)
+{
+    if (scene.nodes.empty()) { return false; }
+
+    for (int i = 0; i < numPoints; i++)
+    {
+        const float *point = &points[i * 3];
+        float *result = &closest[i * 3];
+
+        float bestDistance2 = FLT_MAX;
+
+        if (i == 0)
+        {
+            std::copy(point, point + 3, result);
+        } else {
+            std::copy(result - 3, result, result);
+
+            float d[3] = {result[0] - point[0], result[1] - point[1], result[2] - point[2]};
+            bestDistance2 = dot3(d, d);
+        }
+
+        int   stack[BVH_STACK_SIZE];
+        int   stackSize = 0;
+
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0)
+        {
+            const BoneToMeshBVHNode &node = scene.nodes[stack[--stackSize]];
+
+            if (boxDistance2(node.min, node.max, point) >= bestDistance2) { continue; }
+
+            if (node.count > 0)
+            {
+                for (int m = node.index; m < node.index + node.count; m++)
+                {
+                    closestPointBVH(scene.meshes[scene.order[m]], point, bestDistance2, result);
+                }
+            } else {
+                stack[stackSize++] = node.index;
+                stack[stackSize++] = node.index + 1;
+            }
+        }
+
+        // Only a scene without triangles has no closest point.
+        if (bestDistance2 == FLT_MAX) { return false; }
+    }
+
+    return true;
+}
+
+
+
+// Compares the points of the tree with the new points, which must have the
+// same topology, and marks every triangle with a moved vertex.
+void diffBVH(const BoneToMeshBVH &bvh, const float *points, BoneToMeshChange &change)
+{
+    int numPoints = (int) bvh.points.size() / 3;
+    int numTriangles = (int) bvh.triangles.size() / 3;
+
+    std::vector<unsigned char> movedPoints(numPoints, 0);
+
+    bool moved = false;
+
+    for (int p = 0; p < numPoints; p++)
+    {
+        const float *a = &bvh.points[p * 3];
+        const float *b = &points[p * 3];
+
+        movedPoints[p] = (unsigned char) (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]);
+        moved = moved || movedPoints[p];
+    }
+
+    change.all = false;
+    change.triangles.clear();
+
+    emptyBounds(change.min, change.max);
+
+    if (!moved) { return; }
+
+    change.triangles.assign(numTriangles, 0);
+
+    for (int t = 0; t < numTriangles; t++)
+    {
+        const int *vtx = &bvh.triangles[t * 3];
+
+        if (!(movedPoints[vtx[0]] | movedPoints[vtx[1]] | movedPoints[vtx[2]])) { continue; }
+
+        change.triangles[t] = 1;
+
+        // Where the triangle was and where it is now.
+        for (int v = 0; v < 3; v++)
+        {
+            const float *a = &bvh.points[vtx[v] * 3];
+            const float *b = &points[vtx[v] * 3];
+
+            float bounds[6] = {
+                std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]),
+                std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2])
+            };
+
+            growBounds(change.min, change.max, bounds);
+        }
+    }
+}
+
+
+// A ray keeps its hit unless the triangle it hit moved, or the ray passes
+// through the bounds of the moved triangles of any mesh within the part of
+// the ray that decides the hit. That is the part before the hit when hits 
+// are ranked nearest first over every mesh, or there is only one mesh, and 
+// the part after the hit for the farthest hit.
+bool isRayDirty(const BoneToMeshScene &scene, const BoneToMeshRay &ray, const BoneToMeshHit &hit, int hitPolicy)
+{
+    if (scene.changes.size() != scene.meshes.size()) { return true; }
+
+    if (hit.mesh >= 0)
+    {
+        const BoneToMeshChange &change = scene.changes[hit.mesh];
+
+        if (change.all || (!change.triangles.empty() && change.triangles[hit.triangle])) { return true; }
+    }
+
+    float invDirection[3];
+    inverseDirection(ray.direction, invDirection);
+
+    float minParam = 0.0f;
+    float maxParam = ray.maxParam;
+
+    if (hit.mesh >= 0)
+    {
+        if (hitPolicy == HIT_FARTHEST)
+        {
+            minParam = hit.param;
+        } else if (hitPolicy == HIT_NTH || scene.meshes.size() == 1) {
+            maxParam = hit.param;
+        }
+    }
+
+    for (const BoneToMeshChange &change : scene.changes)
+    {
+        if (change.all) { return true; }
+
+        if (change.triangles.empty()) { continue; }
+
+        float tmin, tmax;
+
+        if (boundsInterval(change.min, change.max, ray.origin, invDirection, maxParam, tmin, tmax) && tmax >= minParam) 
+        { 
+            return true; 
+        }
+    }
+
+    return false;
+}
+
+
+// Direction octant above a Morton code of the origin within the scene 
+// bounds, so rays sorted by key leave from nearby and head the same way.
+uint64_t rayCoherenceKey(const BoneToMeshScene &scene, const BoneToMeshRay &ray)
+{
+    uint64_t octant = (
+        (ray.direction[0] < 0.0f ? 1 : 0) |
+        (ray.direction[1] < 0.0f ? 2 : 0) |
+        (ray.direction[2] < 0.0f ? 4 : 0)
+    );
+
+    if (scene.nodes.empty()) { return octant << (3 * BVH_MORTON_BITS); }
+
+    const BoneToMeshBVHNode &root = scene.nodes[0];
+
+    unsigned int code = 0;
+
+    for (int a = 0; a < 3; a++)
+    {
+        float extent = root.max[a] - root.min[a];
+        float scale = extent > 0.0f ? float(1u << BVH_MORTON_BITS) / extent : 0.0f;
+
+        code |= expandBits(mortonCell(ray.origin[a], root.min[a], scale)) << (2 - a);
+    }
+
+    return (octant << (3 * BVH_MORTON_BITS)) | uint64_t(code);
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_BVH_H
+#define YANTOR_3D_BONE_TO_MESH_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Acceleration structure build methods.
+const int BVH_BUILD_SAH         = 0;    // binned surface area heuristic, fastest to trace
+const int BVH_BUILD_MORTON      = 1;    // linear BVH over Morton codes, fastest to build
+const int BVH_BUILD_BRUTE_FORCE = 2;    // one leaf over every triangle, nothing to build
+const int BVH_BUILD_AUTOMATIC   = 3;    // chosen per mesh and update by chooseBuildMethod
+
+// Which hit along a ray is kept.
+const int HIT_NEAREST      = 0;     // first hit on each mesh, the outermost of those
+const int HIT_FARTHEST     = 1;     // last hit on any mesh within the max distance
+const int HIT_NTH          = 2;     // nth hit on any mesh, counting from 1
+const int HIT_FRONT_FACING = 3;     // first hit facing the ray on each mesh, the outermost of those
+
+const int HIT_MAX_NTH = 16;
+
+const float TRIANGLE_TOLERANCE  = 1e-6f;    // barycentric slack of the triangle test
+const float HIT_MERGE_TOLERANCE = 1e-5f;    // relative distance within which hits count as one
+
+// Leaf nodes have a non-zero count of primitives starting at index in the
+// owner's order array. Interior nodes have a count of zero and their
+// children are stored next to each other starting at index.
+struct BoneToMeshBVHNode
+{
+    float min[3];
+    float max[3];
+    int   index = 0;
+    int   count = 0;
+};
+
+// Compact node with up to eight children whose bounds are quantized to 8 
+// bits within the bounds of the node. The interior children are stored 
+// next to each other from childIndex, and the triangles of the leaf 
+// children follow each other from triangleIndex.
+struct BoneToMeshBVHWideNode
+{
+    float         origin[3];
+    signed char   exponent[3];      // each axis is quantized in steps of 2^exponent
+    unsigned char numChildren;
+
+    unsigned int  childIndex;
+    unsigned int  triangleIndex;
+
+    unsigned char meta[8];          // leaf flag in the high bit, triangle count below it
+    unsigned char qmin[3][8];       // per axis, per child
+    unsigned char qmax[3][8];
+};
+
+struct BoneToMeshBVHRebuild;
+
+// Bottom level acceleration structure over the triangles of one mesh.
+struct BoneToMeshBVH
+{
+    std::vector<float> points;      // 3 floats per vertex
+    std::vector<int>   triangles;   // 3 vertex indices per triangle
+    std::vector<int>   faces;       // polygon index per triangle
+    std::vector<int>   order;       // triangle indices in leaf order
+
+    // Hash of the triangles and faces as they were given, the compact 
+    // layout reorders them.
+    uint64_t topology = 0;
+
+    std::vector<BoneToMeshBVHNode> nodes;
+
+    // Compact layout of the tree, which replaces the nodes when compact is set.
+    std::vector<BoneToMeshBVHWideNode> wideNodes;
+
+    int  buildMethod = BVH_BUILD_SAH;
+    bool compact     = false;
+
+    // Set when the build method is chosen on every update, from the 
+    // triangles and the rays expected to be traced through the tree.
+    bool automatic = false;
+    int  rays      = 0;
+
+    // Surface area heuristic cost of the tree when it was built and after 
+    // the latest refit, relative to the area of the root.
+    float buildCost = 0.0f;
+    float cost      = 0.0f;
+
+    // Rebuild running in the background after refits degraded the tree.
+    std::shared_ptr<BoneToMeshBVHRebuild> rebuild;
+};
+
+// Triangles of one mesh that moved in the latest update of its scene.
+struct BoneToMeshChange
+{
+    bool  all = true;                       // new mesh, new topology or reordered triangles
+    float min[3];                           // bounds of the moved triangles before and after
+    float max[3];
+
+    std::vector<unsigned char> triangles;   // non-zero per moved triangle, empty if none moved
+};
+
+// Top level acceleration structure over the bottom levels of every input mesh.
+struct BoneToMeshScene
+{
+    std::vector<BoneToMeshBVH> meshes;
+
+    // What changed per mesh between the previous and the current version. 
+    // Versions are unique across scenes and only advance when a mesh changes.
+    std::vector<BoneToMeshChange> changes;
+
+    uint64_t version         = 0;
+    uint64_t previousVersion = 0;
+
+    // Build method and layout of the bottom levels, the top level is always 
+    // an uncompressed SAH tree. Brute force trees are never compact.
+    int  buildMethod = BVH_BUILD_SAH;
+    bool compact     = false;
+
+    // Rays expected per update, which automatic build methods weigh 
+    // against the triangles of each mesh.
+    int  rays = 0;
+
+    std::vector<int>               order;   // mesh indices in leaf order
+    std::vector<BoneToMeshBVHNode> nodes;
+};
+
+struct BoneToMeshRay
+{
+    float origin[3];
+    float direction[3];
+    float maxParam;
+};
+
+struct BoneToMeshHit
+{
+    float param    = 0.0f;
+    int   mesh     = -1;
+    int   triangle = -1;
+    int   face     = -1;
+    float u        = 0.0f;
+    float v        = 0.0f;
+};
+
+void buildBVH(BoneToMeshBVH &bvh);
+
+// Build method with the least estimated cost of bringing the tree up to 
+// date and tracing numRays rays through it. A tree that can be kept or 
+// refit is only replaced when another method is clearly cheaper.
+int chooseBuildMethod(const BoneToMeshBVH &bvh, int numTriangles, int numRays, bool sameTopology, bool samePoints);
+bool refitBVH(BoneToMeshBVH &bvh);
+float costBVH(const BoneToMeshBVH &bvh);
+size_t memoryBVH(const BoneToMeshBVH &bvh);
+size_t memoryScene(const BoneToMeshScene &scene);
+void buildSceneBVH(BoneToMeshScene &scene);
+
+void diffBVH(const BoneToMeshBVH &bvh, const float *points, BoneToMeshChange &change);
+bool isRayDirty(const BoneToMeshScene &scene, const BoneToMeshRay &ray, const BoneToMeshHit &hit, int hitPolicy = HIT_NEAREST);
+
+uint64_t rayCoherenceKey(const BoneToMeshScene &scene, const BoneToMeshRay &ray);
+
+bool intersectBVH(const BoneToMeshBVH &bvh, const BoneToMeshRay &ray, BoneToMeshHit &hit, int hitPolicy = HIT_NEAREST, int hitIndex = 1);
+bool intersectScene(const BoneToMeshScene &scene, const BoneToMeshRay &ray, BoneToMeshHit &hit, int hitPolicy = HIT_NEAREST, int hitIndex = 1);
+
+bool closestPoints(const BoneToMeshScene &scene, const float *points, int numPoints, float *closest);
+
+#endif
\ No newline at end of file
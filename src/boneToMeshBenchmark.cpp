@@ -0,0 +1,1077 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshBenchmark.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshRayQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+const double BENCHMARK_PI = 3.14159265358979323846;
+
+const int BENCHMARK_RAYS = 100000;
+
+const int BENCHMARK_SPOKES = 64;
+const int BENCHMARK_RINGS  = 32;
+
+const int BENCHMARK_FRAMES = 8;
+
+
+void benchmarkMesh(int numTriangles, BoneToMeshBVH &bvh)
+{
+    // A grid of rows x columns quads wrapped around a sphere, with its 
+    // radius rippled so the triangles are not evenly spread.
+    int rows = std::max(2, int(std::ceil(std::sqrt(double(numTriangles) / 4.0))));
+    int columns = std::max(3, (numTriangles + (2 * rows) - 1) / (2 * rows));
+
+    bvh = BoneToMeshBVH();
+    bvh.points.reserve((rows + 1) * columns * 3);
+    bvh.triangles.reserve(rows * columns * 6);
+    bvh.faces.reserve(rows * columns * 2);
+
+    for (int r = 0; r <= rows; r++)
+    {
+        double theta = BENCHMARK_PI * double(r) / double(rows);
+
+        for (int c = 0; c < columns; c++)
+        {
+            double phi = 2.0 * BENCHMARK_PI * double(c) / double(columns);
+            double radius = 1.0 + (0.25 * std::sin(theta * 7.0) * std::cos(phi * 5.0));
+
+            bvh.points.push_back(float(radius * std::sin(theta) * std::cos(phi)));
+            bvh.points.push_back(float(radius * std::cos(theta) * 2.0));
+            bvh.points.push_back(float(radius * std::sin(theta) * std::sin(phi)));
+        }
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            int v0 = (r * columns) + c;
+            int v1 = (r * columns) + ((c + 1) % columns);
+            int v2 = v1 + columns;
+            int v3 = v0 + columns;
+
+            int face = (r * columns) + c;
+
+            int quad[6] = {v0, v1, v2, v0, v2, v3};
+
+            bvh.triangles.insert(bvh.triangles.end(), quad, quad + 6);
+            bvh.faces.push_back(face);
+            bvh.faces.push_back(face);
+        }
+    }
+}
+
+
+// Rays from points inside the middle of the mesh in every direction, 
+// much like the rays of a bone running through it.
+static void benchmarkRays(std::vector<BoneToMeshRay> &rays)
+{
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    rays.resize(BENCHMARK_RAYS);
+
+    for (BoneToMeshRay &ray : rays)
+    {
+        ray.origin[0] = 0.1f * distribution(generator);
+        ray.origin[1] = 1.5f * distribution(generator);
+        ray.origin[2] = 0.1f * distribution(generator);
+
+        for (int a = 0; a < 3; a++) { ray.direction[a] = distribution(generator); }
+
+        ray.maxParam = FLT_MAX;
+    }
+}
+
+
+BoneToMeshBuildTiming benchmarkBuild(int numTriangles, int buildMethod, bool compact, int repeats)
+{
+    BoneToMeshBuildTiming timing;
+
+    BoneToMeshBVH bvh;
+    benchmarkMesh(numTriangles, bvh);
+
+    bvh.buildMethod = buildMethod;
+    bvh.compact = compact;
+
+    timing.triangles = (int) bvh.triangles.size() / 3;
+    timing.buildMethod = buildMethod;
+    timing.compact = compact;
+
+    for (int i = 0; i < std::max(1, repeats); i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        buildBVH(bvh);
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i == 0 || elapsed.count() < timing.seconds) { timing.seconds = elapsed.count(); }
+    }
+
+    timing.nodes = (int) (bvh.wideNodes.empty() ? bvh.nodes.size() : bvh.wideNodes.size());
+    timing.bytes = memoryBVH(bvh);
+    timing.cost = bvh.cost;
+
+    std::vector<BoneToMeshRay> rays;
+    benchmarkRays(rays);
+
+    for (int i = 0; i < std::max(1, repeats); i++)
+    {
+        int numHits = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (const BoneToMeshRay &ray : rays)
+        {
+            BoneToMeshHit hit;
+            numHits += intersectBVH(bvh, ray, hit) ? 1 : 0;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i == 0 || elapsed.count() < timing.traceSeconds) { timing.traceSeconds = elapsed.count(); }
+
+        timing.hits = numHits;
+    }
+
+    return timing;
+}
+
+
+// Rings of spokes along a bone from origin to origin + direction, each 
+// spoke cos(a) * u + sin(a) * v for the ring axis u x v.
+static void benchmarkBoneRays(const float *origin, const float *direction, const float *axis, std::vector<BoneToMeshRay> &rays)
+{
+    float up[3] = {0.0f, 1.0f, 0.0f};
+
+    if (std::abs(axis[1]) > 0.9f) { up[0] = 1.0f; up[1] = 0.0f; }
+
+    float u[3] = {
+        (axis[1] * up[2]) - (axis[2] * up[1]),
+        (axis[2] * up[0]) - (axis[0] * up[2]),
+        (axis[0] * up[1]) - (axis[1] * up[0])
+    };
+
+    float length = std::sqrt((u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]));
+
+    for (int a = 0; a < 3; a++) { u[a] /= length; }
+
+    float v[3] = {
+        (axis[1] * u[2]) - (axis[2] * u[1]),
+        (axis[2] * u[0]) - (axis[0] * u[2]),
+        (axis[0] * u[1]) - (axis[1] * u[0])
+    };
+
+    for (int ring = 0; ring < BENCHMARK_RINGS; ring++)
+    {
+        float t = float(ring) / float(BENCHMARK_RINGS);
+
+        for (int spoke = 0; spoke < BENCHMARK_SPOKES; spoke++)
+        {
+            float angle = float(2.0 * BENCHMARK_PI * double(spoke) / double(BENCHMARK_SPOKES));
+
+            BoneToMeshRay ray;
+
+            for (int a = 0; a < 3; a++)
+            {
+                ray.origin[a] = origin[a] + (direction[a] * t);
+                ray.direction[a] = (std::cos(angle) * u[a]) + (std::sin(angle) * v[a]);
+            }
+
+            ray.maxParam = FLT_MAX;
+
+            rays.push_back(ray);
+        }
+    }
+}
+
+
+BoneToMeshRayOrderTiming benchmarkRayOrder(int numTriangles, int numBones, bool world, int repeats)
+{
+    BoneToMeshRayOrderTiming timing;
+
+    BoneToMeshScene scene;
+    scene.meshes.resize(1);
+
+    benchmarkMesh(numTriangles, scene.meshes[0]);
+    buildBVH(scene.meshes[0]);
+    buildSceneBVH(scene);
+
+    std::shared_ptr<BoneToMeshRayBatch> batch = std::make_shared<BoneToMeshRayBatch>();
+    batch->scene = &scene;
+
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    for (int b = 0; b < numBones; b++)
+    {
+        float origin[3] = {0.3f * distribution(generator), 1.5f * distribution(generator), 0.3f * distribution(generator)};
+        float direction[3] = {distribution(generator), distribution(generator), distribution(generator)};
+
+        float length = std::max(1e-6f, std::sqrt((direction[0] * direction[0]) + (direction[1] * direction[1]) + (direction[2] * direction[2])));
+
+        float axis[3] = {1.0f, 0.0f, 0.0f};
+
+        for (int a = 0; a < 3; a++)
+        {
+            direction[a] /= length * 3.0f;
+
+            if (!world) { axis[a] = direction[a] * 3.0f; }
+        }
+
+        benchmarkBoneRays(origin, direction, axis, batch->rays);
+    }
+
+    timing.triangles = (int) scene.meshes[0].triangles.size() / 3;
+    timing.rays = (int) batch->rays.size();
+    timing.world = world;
+
+    for (int order : {RAY_ORDER_GRID, RAY_ORDER_COHERENT})
+    {
+        batch->order = order;
+
+        double &seconds = order == RAY_ORDER_GRID ? timing.gridSeconds : timing.coherentSeconds;
+
+        for (int i = 0; i < std::max(1, repeats); i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            traceRays(batch);
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (i == 0 || elapsed.count() < seconds) { seconds = elapsed.count(); }
+        }
+    }
+
+    return timing;
+}
+
+// One rig of the concurrency benchmark and the hits of each of its frames.
+struct BenchmarkInstance
+{
+    BoneToMeshScene            scene;
+    std::vector<float>         restPoints;
+    std::vector<BoneToMeshRay> rays;
+
+    std::vector<std::vector<BoneToMeshHit>> hits;
+};
+
+
+static void evaluateInstance(BenchmarkInstance &instance, int index)
+{
+    BoneToMeshBVH &bvh = instance.scene.meshes[0];
+
+    for (int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+    {
+        // Breathes the mesh in and out, differently for every rig.
+        float scale = 1.0f + (0.05f * float(std::sin(double(frame + index))));
+
+        for (size_t p = 0; p < bvh.points.size(); p++)
+        {
+            bvh.points[p] = instance.restPoints[p] * scale;
+        }
+
+        refitBVH(bvh);
+        buildSceneBVH(instance.scene);
+
+        std::shared_ptr<BoneToMeshRayBatch> batch = std::make_shared<BoneToMeshRayBatch>();
+        batch->scene = &instance.scene;
+        batch->rays = instance.rays;
+
+        traceRays(batch);
+
+        instance.hits[frame].swap(batch->hits);
+    }
+}
+
+
+BoneToMeshConcurrencyTiming benchmarkConcurrency(int numTriangles, int numInstances, int repeats)
+{
+    BoneToMeshConcurrencyTiming timing;
+
+    numInstances = std::max(1, numInstances);
+
+    BoneToMeshBVH mesh;
+    benchmarkMesh(numTriangles, mesh);
+    buildBVH(mesh);
+
+    std::vector<BenchmarkInstance> instances(numInstances);
+
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    for (BenchmarkInstance &instance : instances)
+    {
+        instance.scene.meshes.assign(1, mesh);
+        instance.restPoints = mesh.points;
+        instance.hits.resize(BENCHMARK_FRAMES);
+
+        float origin[3] = {0.3f * distribution(generator), -1.0f, 0.3f * distribution(generator)};
+        float direction[3] = {0.0f, 2.0f, 0.0f};
+        float axis[3] = {0.0f, 1.0f, 0.0f};
+
+        benchmarkBoneRays(origin, direction, axis, instance.rays);
+    }
+
+    timing.triangles = (int) mesh.triangles.size() / 3;
+    timing.instances = numInstances;
+    timing.rays = (int) instances[0].rays.size();
+
+    std::vector<std::vector<std::vector<BoneToMeshHit>>> serialHits(numInstances);
+
+    for (int i = 0; i < std::max(1, repeats); i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (int n = 0; n < numInstances; n++) { evaluateInstance(instances[n], n); }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i == 0 || elapsed.count() < timing.serialSeconds) { timing.serialSeconds = elapsed.count(); }
+    }
+
+    for (int n = 0; n < numInstances; n++) { serialHits[n] = instances[n].hits; }
+
+    for (int i = 0; i < std::max(1, repeats); i++)
+    {
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (int n = 0; n < numInstances; n++)
+        {
+            threads.push_back(std::thread([&instances, n]() { evaluateInstance(instances[n], n); }));
+        }
+
+        for (std::thread &thread : threads) { thread.join(); }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i == 0 || elapsed.count() < timing.concurrentSeconds) { timing.concurrentSeconds = elapsed.count(); }
+
+        for (int n = 0; n < numInstances; n++)
+        {
+            for (int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+            {
+                const std::vector<BoneToMeshHit> &expected = serialHits[n][frame];
+                const std::vector<BoneToMeshHit> &hits = instances[n].hits[frame];
+
+                for (size_t r = 0; r < expected.size(); r++)
+                {
+                    bool same = (
+                        r < hits.size() &&
+                        hits[r].mesh == expected[r].mesh && 
+                        hits[r].triangle == expected[r].triangle && 
+                        hits[r].param == expected[r].param
+                    );
+
+                    timing.mismatches += same ? 0 : 1;
+                }
+            }
+        }
+    }
+
+    return timing;
+}
+
+
+const float FUZZ_TOLERANCE = 1e-4f;     // relative distance between hit points that still match
+
+// Crossings the reference leaves out, as float tests may go either way.
+const double FUZZ_EDGE_MARGIN     = 1e-4;   // share of the area of the triangle from an edge
+const double FUZZ_PARAM_MARGIN    = 1e-4;   // relative distance from either end of the ray
+const double FUZZ_PARALLEL_MARGIN = 1e-4;   // sine of the angle between the ray and the plane
+
+const int FUZZ_MISS      = 0;
+const int FUZZ_HIT       = 1;
+const int FUZZ_AMBIGUOUS = 2;
+
+const int FUZZ_CLOSEST_QUERIES = 64;
+
+static const char* FUZZ_ENGINE_NAMES[FUZZ_ENGINES] = {
+    "direct sah binary",
+    "direct sah compact",
+    "direct morton binary",
+    "direct morton compact",
+    "queue grid",
+    "queue coherent",
+    "background",
+    "concurrent",
+    "dirty retrace",
+    "closest points",
+    "direct brute force"
+};
+
+
+const char* fuzzEngineName(int engine)
+{
+    return engine >= 0 && engine < FUZZ_ENGINES ? FUZZ_ENGINE_NAMES[engine] : "";
+}
+
+
+// Random scene and bone of one fuzz case.
+struct FuzzCase
+{
+    std::vector<BoneToMeshBVH> meshes;      // points, triangles and faces only
+    std::vector<BoneToMeshRay> rays;
+
+    int  hitPolicy   = HIT_NEAREST;
+    int  hitIndex    = 1;
+    int  buildMethod = BVH_BUILD_SAH;
+    bool compact     = false;
+};
+
+
+static void fuzzMesh(std::mt19937 &generator, BoneToMeshBVH &bvh)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> kind(0, 1);
+
+    if (kind(generator) == 0)
+    {
+        std::uniform_int_distribution<int> numTriangles(50, 3000);
+        benchmarkMesh(numTriangles(generator), bvh);
+    } else {
+        // Soup of triangles of every size, some of them slivers.
+        std::uniform_int_distribution<int> numTriangles(50, 500);
+        int count = numTriangles(generator);
+
+        bvh = BoneToMeshBVH();
+
+        for (int t = 0; t < count; t++)
+        {
+            float center[3] = {unit(generator), 2.0f * unit(generator), unit(generator)};
+            float size = 0.05f + (0.5f * std::abs(unit(generator)));
+
+            for (int v = 0; v < 3; v++)
+            {
+                for (int a = 0; a < 3; a++) { bvh.points.push_back(center[a] + (size * unit(generator))); }
+
+                bvh.triangles.push_back((t * 3) + v);
+            }
+
+            bvh.faces.push_back(t);
+        }
+    }
+
+    float scale = 0.5f + (0.75f * (unit(generator) + 1.0f));
+    float offset[3] = {0.5f * unit(generator), 0.5f * unit(generator), 0.5f * unit(generator)};
+
+    for (size_t p = 0; p < bvh.points.size(); p++)
+    {
+        bvh.points[p] = (bvh.points[p] * scale) + offset[p % 3];
+    }
+}
+
+
+static void normalize3(float *v)
+{
+    float length = std::sqrt((v[0] * v[0]) + (v[1] * v[1]) + (v[2] * v[2]));
+
+    for (int a = 0; a < 3; a++) { v[a] /= length; }
+}
+
+
+static void fuzzCase(unsigned int seed, FuzzCase &fuzz)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> numMeshes(1, 3);
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::uniform_int_distribution<int> axisKind(0, 2);
+    std::uniform_int_distribution<int> policy(HIT_NEAREST, HIT_FRONT_FACING);
+    std::uniform_int_distribution<int> hitIndex(1, 4);
+    std::uniform_int_distribution<int> buildMethod(BVH_BUILD_SAH, BVH_BUILD_BRUTE_FORCE);
+    std::uniform_int_distribution<int> spokes(3, 24);
+    std::uniform_int_distribution<int> rings(1, 12);
+
+    fuzz.meshes.resize(numMeshes(generator));
+
+    for (BoneToMeshBVH &bvh : fuzz.meshes) { fuzzMesh(generator, bvh); }
+
+    fuzz.hitPolicy = policy(generator);
+    fuzz.hitIndex = hitIndex(generator);
+    fuzz.buildMethod = buildMethod(generator);
+    fuzz.compact = coin(generator) == 1;
+
+    // Bones along a world axis have ray directions with zero components.
+    float axis[3] = {unit(generator), unit(generator), unit(generator)};
+
+    if (axisKind(generator) == 0)
+    {
+        int a = std::abs(int(unit(generator) * 3.0f)) % 3;
+
+        axis[0] = axis[1] = axis[2] = 0.0f;
+        axis[a] = 1.0f;
+    }
+
+    normalize3(axis);
+
+    float side[3] = {1.0f, 0.0f, 0.0f};
+
+    if (std::abs(axis[0]) > 0.9f) { side[0] = 0.0f; side[1] = 1.0f; }
+
+    float u[3] = {
+        (axis[1] * side[2]) - (axis[2] * side[1]),
+        (axis[2] * side[0]) - (axis[0] * side[2]),
+        (axis[0] * side[1]) - (axis[1] * side[0])
+    };
+
+    normalize3(u);
+
+    float v[3] = {
+        (axis[1] * u[2]) - (axis[2] * u[1]),
+        (axis[2] * u[0]) - (axis[0] * u[2]),
+        (axis[0] * u[1]) - (axis[1] * u[0])
+    };
+
+    float origin[3] = {0.5f * unit(generator), 0.5f * unit(generator), 0.5f * unit(generator)};
+    float length = 0.5f + (1.25f * (unit(generator) + 1.0f));
+    float maxParam = coin(generator) ? FLT_MAX : 0.2f + (1.5f * (unit(generator) + 1.0f));
+
+    int numSpokes = spokes(generator);
+    int numRings = rings(generator);
+
+    fuzz.rays.clear();
+
+    for (int r = 0; r < numRings; r++)
+    {
+        float along = numRings > 1 ? length * float(r) / float(numRings - 1) : 0.0f;
+
+        for (int s = 0; s < numSpokes; s++)
+        {
+            double angle = 2.0 * BENCHMARK_PI * double(s) / double(numSpokes);
+
+            BoneToMeshRay ray;
+
+            for (int a = 0; a < 3; a++)
+            {
+                ray.origin[a] = origin[a] + (axis[a] * along);
+                ray.direction[a] = float((std::cos(angle) * u[a]) + (std::sin(angle) * v[a]));
+            }
+
+            ray.maxParam = maxParam;
+
+            fuzz.rays.push_back(ray);
+        }
+    }
+}
+
+
+// Where the ray crosses the plane of the triangle, in double precision,
+// and whether that point is inside by the areas it makes with each edge.
+// It shares nothing with the Möller-Trumbore test of the trees, so a bug
+// in that test shows up as mismatches. Crossings this close to an edge, to
+// either end of the ray or along the plane could go either way in float
+// and are left out.
+static int referenceTriangle(const BoneToMeshRay &ray, const float *p0, const float *p1, const float *p2, double &t, bool &frontFacing)
+{
+    double o[3], d[3], e1[3], e2[3];
+
+    for (int a = 0; a < 3; a++)
+    {
+        o[a] = double(ray.origin[a]);
+        d[a] = double(ray.direction[a]);
+        e1[a] = double(p1[a]) - double(p0[a]);
+        e2[a] = double(p2[a]) - double(p0[a]);
+    }
+
+    double n[3] = {(e1[1] * e2[2]) - (e1[2] * e2[1]), (e1[2] * e2[0]) - (e1[0] * e2[2]), (e1[0] * e2[1]) - (e1[1] * e2[0])};
+    double nn = (n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]);
+
+    if (nn == 0.0) { return FUZZ_MISS; }
+
+    double toPlane = (n[0] * (double(p0[0]) - o[0])) + (n[1] * (double(p0[1]) - o[1])) + (n[2] * (double(p0[2]) - o[2]));
+    double denom = (n[0] * d[0]) + (n[1] * d[1]) + (n[2] * d[2]);
+    double length = std::sqrt(nn * ((d[0] * d[0]) + (d[1] * d[1]) + (d[2] * d[2])));
+
+    bool parallel = std::abs(denom) <= FUZZ_PARALLEL_MARGIN * length;
+
+    if (denom == 0.0)
+    {
+        return std::abs(toPlane) <= FUZZ_PARALLEL_MARGIN * std::sqrt(nn) ? FUZZ_AMBIGUOUS : FUZZ_MISS;
+    }
+
+    t = toPlane / denom;
+    frontFacing = denom < 0.0;
+
+    double q[3] = {o[0] + (t * d[0]), o[1] + (t * d[1]), o[2] + (t * d[2])};
+    const float *corners[3] = {p0, p1, p2};
+
+    // Share of the area of the triangle on the inner side of each edge.
+    double lowest = DBL_MAX;
+
+    for (int i = 0; i < 3; i++)
+    {
+        const float *s = corners[(i + 1) % 3];
+        const float *e = corners[(i + 2) % 3];
+
+        double toS[3] = {double(s[0]) - q[0], double(s[1]) - q[1], double(s[2]) - q[2]};
+        double toE[3] = {double(e[0]) - q[0], double(e[1]) - q[1], double(e[2]) - q[2]};
+        double cross[3] = {
+            (toS[1] * toE[2]) - (toS[2] * toE[1]),
+            (toS[2] * toE[0]) - (toS[0] * toE[2]),
+            (toS[0] * toE[1]) - (toS[1] * toE[0])
+        };
+
+        lowest = std::min(lowest, ((cross[0] * n[0]) + (cross[1] * n[1]) + (cross[2] * n[2])) / nn);
+    }
+
+    double maxParam = double(ray.maxParam);
+    double paramMargin = FUZZ_PARAM_MARGIN * std::max(1.0, std::abs(t));
+
+    if (lowest < -FUZZ_EDGE_MARGIN) { return FUZZ_MISS; }
+    if (t < -paramMargin || t > maxParam + paramMargin) { return FUZZ_MISS; }
+
+    if (parallel || lowest <= FUZZ_EDGE_MARGIN || t <= paramMargin || std::abs(t - maxParam) <= paramMargin)
+    {
+        return FUZZ_AMBIGUOUS;
+    }
+
+    return FUZZ_HIT;
+}
+
+
+// Every hit of the ray on every triangle, then the hit policy applied to
+// the lot. Sets param to that of the kept hit, or -1 for a miss, and
+// returns false if the ray is too close to call.
+static bool referenceHit(const std::vector<BoneToMeshBVH> &meshes, const BoneToMeshRay &ray, int hitPolicy, int hitIndex, float &param)
+{
+    std::vector<double> params;
+    double kept = -1.0;
+
+    for (const BoneToMeshBVH &bvh : meshes)
+    {
+        double first = -1.0;
+
+        for (size_t tri = 0; tri < bvh.triangles.size() / 3; tri++)
+        {
+            const int *vtx = &bvh.triangles[tri * 3];
+
+            double t = 0.0;
+            bool frontFacing = false;
+
+            int crossing = referenceTriangle(ray, &bvh.points[vtx[0] * 3], &bvh.points[vtx[1] * 3], &bvh.points[vtx[2] * 3], t, frontFacing);
+
+            if (crossing == FUZZ_AMBIGUOUS) { return false; }
+            if (crossing == FUZZ_MISS) { continue; }
+            if (hitPolicy == HIT_FRONT_FACING && !frontFacing) { continue; }
+
+            params.push_back(t);
+
+            if (first < 0.0 || t < first) { first = t; }
+        }
+
+        // The outermost of the first hits on each mesh.
+        if (first >= 0.0 && (hitPolicy == HIT_NEAREST || hitPolicy == HIT_FRONT_FACING))
+        {
+            kept = std::max(kept, first);
+        }
+    }
+
+    if (hitPolicy == HIT_FARTHEST)
+    {
+        for (double t : params) { kept = std::max(kept, t); }
+    } else if (hitPolicy == HIT_NTH) {
+        std::sort(params.begin(), params.end());
+
+        int numHits = 0;
+        double last = -1.0;
+
+        for (double t : params)
+        {
+            double merge = double(HIT_MERGE_TOLERANCE) * std::max(1.0, t);
+
+            // Hits about the merge distance apart may or may not be merged.
+            if (numHits > 0 && std::abs((t - last) - merge) <= 0.5 * merge) { return false; }
+            if (numHits > 0 && t - last <= merge) { continue; }
+
+            last = t;
+
+            if (++numHits == hitIndex) 
+            { 
+                kept = t; 
+                break;
+            }
+        }
+    }
+
+    param = float(kept);
+
+    return true;
+}
+
+
+static bool sameHit(const BoneToMeshRay &ray, float expected, const BoneToMeshHit &hit)
+{
+    bool found = hit.mesh >= 0;
+
+    if (found != (expected >= 0.0f)) { return false; }
+    if (!found) { return true; }
+
+    double distance = 0.0;
+    double scale = 1.0;
+
+    for (int a = 0; a < 3; a++)
+    {
+        double point = double(ray.origin[a]) + (double(ray.direction[a]) * double(expected));
+        double other = double(ray.origin[a]) + (double(ray.direction[a]) * double(hit.param));
+
+        distance = std::max(distance, std::abs(point - other));
+        scale = std::max(scale, std::abs(point));
+    }
+
+    return distance <= FUZZ_TOLERANCE * scale;
+}
+
+
+static void fuzzScene(const FuzzCase &fuzz, int buildMethod, bool compact, BoneToMeshScene &scene)
+{
+    scene = BoneToMeshScene();
+    scene.meshes = fuzz.meshes;
+    scene.changes.resize(scene.meshes.size());
+    scene.buildMethod = buildMethod;
+    scene.compact = compact;
+
+    for (BoneToMeshBVH &bvh : scene.meshes)
+    {
+        bvh.buildMethod = buildMethod;
+        bvh.compact = compact;
+
+        buildBVH(bvh);
+    }
+
+    buildSceneBVH(scene);
+}
+
+
+static void traceFuzzRays(const FuzzCase &fuzz, const BoneToMeshScene &scene, int order, bool background, std::vector<BoneToMeshHit> &hits)
+{
+    std::shared_ptr<BoneToMeshRayBatch> batch = std::make_shared<BoneToMeshRayBatch>();
+    batch->scene = &scene;
+    batch->hitPolicy = fuzz.hitPolicy;
+    batch->hitIndex = fuzz.hitIndex;
+    batch->order = order;
+    batch->rays = fuzz.rays;
+    batch->background = background;
+
+    if (background) { batch->cancelled = std::make_shared<std::atomic<bool>>(false); }
+
+    traceRays(batch);
+
+    hits.swap(batch->hits);
+}
+
+
+// Projects onto the plane and falls back to the edges when the projection
+// is outside.
+double referenceTriangleDistance(const float *p, const float *a, const float *b, const float *c)
+{
+    const float *corners[3] = {a, b, c};
+
+    double e1[3], e2[3], n[3], ap[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        e1[i] = double(b[i]) - double(a[i]);
+        e2[i] = double(c[i]) - double(a[i]);
+        ap[i] = double(p[i]) - double(a[i]);
+    }
+
+    n[0] = (e1[1] * e2[2]) - (e1[2] * e2[1]);
+    n[1] = (e1[2] * e2[0]) - (e1[0] * e2[2]);
+    n[2] = (e1[0] * e2[1]) - (e1[1] * e2[0]);
+
+    double n2 = (n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]);
+
+    if (n2 > 0.0)
+    {
+        double d = ((ap[0] * n[0]) + (ap[1] * n[1]) + (ap[2] * n[2])) / n2;
+        double q[3] = {double(p[0]) - (d * n[0]), double(p[1]) - (d * n[1]), double(p[2]) - (d * n[2])};
+
+        // Inside when q is on the inner side of every edge.
+        bool inside = true;
+
+        for (int i = 0; i < 3; i++)
+        {
+            const float *s = corners[i];
+            const float *e = corners[(i + 1) % 3];
+
+            double edge[3] = {double(e[0]) - double(s[0]), double(e[1]) - double(s[1]), double(e[2]) - double(s[2])};
+            double toQ[3] = {q[0] - double(s[0]), q[1] - double(s[1]), q[2] - double(s[2])};
+            double cross[3] = {
+                (edge[1] * toQ[2]) - (edge[2] * toQ[1]),
+                (edge[2] * toQ[0]) - (edge[0] * toQ[2]),
+                (edge[0] * toQ[1]) - (edge[1] * toQ[0])
+            };
+
+            inside = inside && ((cross[0] * n[0]) + (cross[1] * n[1]) + (cross[2] * n[2])) >= 0.0;
+        }
+
+        if (inside) { return std::abs(d) * std::sqrt(n2); }
+    }
+
+    double best = DBL_MAX;
+
+    for (int i = 0; i < 3; i++)
+    {
+        const float *s = corners[i];
+        const float *e = corners[(i + 1) % 3];
+
+        double edge[3] = {double(e[0]) - double(s[0]), double(e[1]) - double(s[1]), double(e[2]) - double(s[2])};
+        double toP[3] = {double(p[0]) - double(s[0]), double(p[1]) - double(s[1]), double(p[2]) - double(s[2])};
+
+        double edge2 = (edge[0] * edge[0]) + (edge[1] * edge[1]) + (edge[2] * edge[2]);
+        double t = edge2 > 0.0 ? ((toP[0] * edge[0]) + (toP[1] * edge[1]) + (toP[2] * edge[2])) / edge2 : 0.0;
+
+        t = std::max(0.0, std::min(1.0, t));
+
+        double distance2 = 0.0;
+
+        for (int a = 0; a < 3; a++)
+        {
+            double delta = toP[a] - (t * edge[a]);
+            distance2 += delta * delta;
+        }
+
+        best = std::min(best, distance2);
+    }
+
+    return std::sqrt(best);
+}
+
+
+// Rays the reference could not call are counted rather than compared.
+static void compareHits(
+    const FuzzCase &fuzz, 
+    const std::vector<float> &expected, 
+    const std::vector<bool> &decided,
+    const std::vector<BoneToMeshHit> &hits, 
+    int engine, 
+    int c,
+    BoneToMeshFuzzReport &report
+) {
+    for (size_t r = 0; r < fuzz.rays.size(); r++)
+    {
+        if (!decided[r])
+        {
+            report.ambiguous[engine]++;
+            continue;
+        }
+
+        bool same = r < hits.size() && sameHit(fuzz.rays[r], expected[r], hits[r]);
+
+        if (same) { continue; }
+
+        report.mismatches[engine]++;
+
+        if (report.firstCase[engine] < 0) { report.firstCase[engine] = c; }
+    }
+}
+
+
+BoneToMeshFuzzReport fuzzEquivalence(int numCases, unsigned int seed)
+{
+    BoneToMeshFuzzReport report;
+
+    for (int e = 0; e < FUZZ_ENGINES; e++) { report.firstCase[e] = -1; }
+
+    for (int c = 0; c < numCases; c++)
+    {
+        FuzzCase fuzz;
+        fuzzCase(seed + (unsigned int) c, fuzz);
+
+        int numRays = (int) fuzz.rays.size();
+
+        std::vector<float> expected(numRays);
+        std::vector<bool>  decided(numRays);
+
+        for (int r = 0; r < numRays; r++)
+        {
+            decided[r] = referenceHit(fuzz.meshes, fuzz.rays[r], fuzz.hitPolicy, fuzz.hitIndex, expected[r]);
+        }
+
+        std::vector<BoneToMeshHit> hits(numRays);
+
+        // Every build method and layout, one ray at a time.
+        for (int engine = FUZZ_DIRECT_SAH_BINARY; engine <= FUZZ_DIRECT_MORTON_COMPACT; engine++)
+        {
+            BoneToMeshScene scene;
+            fuzzScene(fuzz, engine >= FUZZ_DIRECT_MORTON_BINARY ? BVH_BUILD_MORTON : BVH_BUILD_SAH, (engine % 2) == 1, scene);
+
+            for (int r = 0; r < numRays; r++)
+            {
+                hits[r] = BoneToMeshHit();
+                intersectScene(scene, fuzz.rays[r], hits[r], fuzz.hitPolicy, fuzz.hitIndex);
+            }
+
+            compareHits(fuzz, expected, decided, hits, engine, c, report);
+        }
+
+        {
+            BoneToMeshScene scene;
+            fuzzScene(fuzz, BVH_BUILD_BRUTE_FORCE, false, scene);
+
+            for (int r = 0; r < numRays; r++)
+            {
+                hits[r] = BoneToMeshHit();
+                intersectScene(scene, fuzz.rays[r], hits[r], fuzz.hitPolicy, fuzz.hitIndex);
+            }
+
+            compareHits(fuzz, expected, decided, hits, FUZZ_DIRECT_BRUTE_FORCE, c, report);
+        }
+
+        // The threading modes, on the tree of the case.
+        BoneToMeshScene scene;
+        fuzzScene(fuzz, fuzz.buildMethod, fuzz.compact, scene);
+
+        traceFuzzRays(fuzz, scene, RAY_ORDER_GRID, false, hits);
+        compareHits(fuzz, expected, decided, hits, FUZZ_QUEUE_GRID, c, report);
+
+        traceFuzzRays(fuzz, scene, RAY_ORDER_COHERENT, false, hits);
+        compareHits(fuzz, expected, decided, hits, FUZZ_QUEUE_COHERENT, c, report);
+
+        traceFuzzRays(fuzz, scene, RAY_ORDER_AUTO, true, hits);
+        compareHits(fuzz, expected, decided, hits, FUZZ_BACKGROUND, c, report);
+
+        {
+            const int numCallers = 4;
+
+            std::vector<std::vector<BoneToMeshHit>> callerHits(numCallers);
+            std::vector<std::thread> callers;
+
+            for (int t = 0; t < numCallers; t++)
+            {
+                callers.push_back(std::thread([&fuzz, &scene, &callerHits, t]() {
+                    traceFuzzRays(fuzz, scene, t % 2 ? RAY_ORDER_COHERENT : RAY_ORDER_GRID, false, callerHits[t]);
+                }));
+            }
+
+            for (std::thread &caller : callers) { caller.join(); }
+
+            for (int t = 0; t < numCallers; t++)
+            {
+                compareHits(fuzz, expected, decided, callerHits[t], FUZZ_CONCURRENT, c, report);
+            }
+        }
+
+        // Bump part of the first mesh, then keep the old hits of the rays 
+        // isRayDirty lets through and retrace the rest.
+        {
+            std::vector<BoneToMeshHit> oldHits;
+            traceFuzzRays(fuzz, scene, RAY_ORDER_GRID, false, oldHits);
+
+            std::mt19937 generator(seed + (unsigned int) c);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+            FuzzCase deformed = fuzz;
+            std::vector<float> &points = deformed.meshes[0].points;
+
+            size_t center = size_t(std::abs(unit(generator)) * float(points.size() / 3 - 1)) * 3;
+            float offset[3] = {0.2f * unit(generator), 0.2f * unit(generator), 0.2f * unit(generator)};
+            float reach = 0.1f + (0.4f * std::abs(unit(generator)));
+
+            float centerPoint[3] = {points[center], points[center + 1], points[center + 2]};
+
+            for (size_t p = 0; p < points.size(); p += 3)
+            {
+                float d2 = 0.0f;
+
+                for (int a = 0; a < 3; a++) { d2 += (points[p + a] - centerPoint[a]) * (points[p + a] - centerPoint[a]); }
+
+                if (d2 > reach * reach) { continue; }
+
+                for (int a = 0; a < 3; a++) { points[p + a] += offset[a]; }
+            }
+
+            for (size_t m = 0; m < scene.meshes.size(); m++)
+            {
+                BoneToMeshBVH &bvh = scene.meshes[m];
+                BoneToMeshChange &change = scene.changes[m];
+
+                diffBVH(bvh, deformed.meshes[m].points.data(), change);
+
+                bvh.points = deformed.meshes[m].points;
+
+                change.all = refitBVH(bvh) && bvh.compact;
+            }
+
+            buildSceneBVH(scene);
+
+            for (int r = 0; r < numRays; r++)
+            {
+                decided[r] = referenceHit(deformed.meshes, fuzz.rays[r], fuzz.hitPolicy, fuzz.hitIndex, expected[r]);
+
+                hits[r] = oldHits[r];
+
+                if (isRayDirty(scene, fuzz.rays[r], oldHits[r], fuzz.hitPolicy))
+                {
+                    hits[r] = BoneToMeshHit();
+                    intersectScene(scene, fuzz.rays[r], hits[r], fuzz.hitPolicy, fuzz.hitIndex);
+                }
+            }
+
+            compareHits(fuzz, expected, decided, hits, FUZZ_DIRTY_RETRACE, c, report);
+
+            // Points around the deformed scene for the nearest surface fill.
+            std::vector<float> queries(FUZZ_CLOSEST_QUERIES * 3);
+            std::vector<float> closest(FUZZ_CLOSEST_QUERIES * 3);
+
+            for (float &q : queries) { q = 3.0f * unit(generator); }
+
+            closestPoints(scene, queries.data(), FUZZ_CLOSEST_QUERIES, closest.data());
+
+            for (int q = 0; q < FUZZ_CLOSEST_QUERIES; q++)
+            {
+                const float *p = &queries[q * 3];
+
+                double best = DBL_MAX;
+
+                for (const BoneToMeshBVH &bvh : deformed.meshes)
+                {
+                    for (size_t tri = 0; tri < bvh.triangles.size() / 3; tri++)
+                    {
+                        const int *vtx = &bvh.triangles[tri * 3];
+
+                        best = std::min(best, referenceTriangleDistance(p, &bvh.points[vtx[0] * 3], &bvh.points[vtx[1] * 3], &bvh.points[vtx[2] * 3]));
+                    }
+                }
+
+                double distance = 0.0;
+
+                for (int a = 0; a < 3; a++) { distance += double(closest[(q * 3) + a] - p[a]) * double(closest[(q * 3) + a] - p[a]); }
+
+                distance = std::sqrt(distance);
+
+                if (std::abs(distance - best) > FUZZ_TOLERANCE * std::max(1.0, best))
+                {
+                    report.mismatches[FUZZ_CLOSEST_POINTS]++;
+
+                    if (report.firstCase[FUZZ_CLOSEST_POINTS] < 0) { report.firstCase[FUZZ_CLOSEST_POINTS] = c; }
+                }
+            }
+        }
+
+        report.cases++;
+        report.rays += numRays;
+    }
+
+    return report;
+}
@@ -0,0 +1,103 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_BENCHMARK_H
+#define YANTOR_3D_BONE_TO_MESH_BENCHMARK_H
+
+#include "boneToMeshBVH.h"
+
+#include <cstddef>
+
+struct BoneToMeshBuildTiming
+{
+    int    triangles    = 0;
+    int    buildMethod  = BVH_BUILD_SAH;
+    bool   compact      = false;
+    double seconds      = 0.0;   // fastest of the repeats
+    double traceSeconds = 0.0;   // fastest trace of the benchmark rays
+    int    hits         = 0;     // benchmark rays that hit the mesh
+    int    nodes        = 0;
+    size_t bytes        = 0;     // acceleration data, see memoryBVH
+    float  cost         = 0.0f;  // SAH cost relative to the root
+};
+
+struct BoneToMeshRayOrderTiming
+{
+    int    triangles       = 0;
+    int    rays            = 0;
+    bool   world           = false;
+    double gridSeconds     = 0.0;   // fastest trace in the order the rays were made
+    double coherentSeconds = 0.0;   // fastest trace sorted by rayCoherenceKey, sort included
+};
+
+struct BoneToMeshConcurrencyTiming
+{
+    int    triangles         = 0;
+    int    instances         = 0;
+    int    rays              = 0;     // per evaluation of one instance
+    double serialSeconds     = 0.0;   // fastest run of every instance in turn
+    double concurrentSeconds = 0.0;   // fastest run of every instance on its own thread
+    int    mismatches        = 0;     // concurrent hits that differ from the serial ones
+};
+
+// Engines the fuzz harness checks against its brute force reference.
+const int FUZZ_DIRECT_SAH_BINARY     = 0;   // intersectScene per ray
+const int FUZZ_DIRECT_SAH_COMPACT    = 1;
+const int FUZZ_DIRECT_MORTON_BINARY  = 2;
+const int FUZZ_DIRECT_MORTON_COMPACT = 3;
+const int FUZZ_QUEUE_GRID            = 4;   // shared ray queue, as submitted
+const int FUZZ_QUEUE_COHERENT        = 5;   // shared ray queue, sorted
+const int FUZZ_BACKGROUND            = 6;   // background batch
+const int FUZZ_CONCURRENT            = 7;   // four callers of the ray queue at once
+const int FUZZ_DIRTY_RETRACE         = 8;   // old hits kept unless isRayDirty after a deformation
+const int FUZZ_CLOSEST_POINTS        = 9;   // closestPoints for the nearest surface fill
+const int FUZZ_DIRECT_BRUTE_FORCE    = 10;  // intersectScene per ray on one leaf per mesh
+const int FUZZ_ENGINES               = 11;
+
+struct BoneToMeshFuzzReport
+{
+    int       cases = 0;
+    long long rays  = 0;                    // per engine
+
+    long long mismatches[FUZZ_ENGINES] = {};
+    long long ambiguous[FUZZ_ENGINES]  = {};   // rays too close to call, left out
+    int       firstCase[FUZZ_ENGINES];      // first case an engine got wrong, -1 if none
+};
+
+// Fills the bvh with a lumpy sphere of at least numTriangles triangles, so
+// the timings do not depend on what is loaded in the scene.
+void benchmarkMesh(int numTriangles, BoneToMeshBVH &bvh);
+
+// Builds the tree, then traces a fixed set of rays cast outward from inside the mesh.
+BoneToMeshBuildTiming benchmarkBuild(int numTriangles, int buildMethod, bool compact, int repeats);
+
+// Traces the rings of rays of numBones bones at random inside the mesh 
+// through the ray queue, in grid order and then in coherent order. World 
+// rings are square to the X axis instead of to their bone.
+BoneToMeshRayOrderTiming benchmarkRayOrder(int numTriangles, int numBones, bool world, int repeats);
+
+// Evaluates numInstances rigs, each a deforming mesh with a bone in it, for
+// a few frames: one rig after another, then every rig on its own thread 
+// at once as parallel evaluation would. Each frame refits the mesh and 
+// traces the bone's rings through the ray queue, and every hit of the 
+// concurrent run is checked against the serial run.
+BoneToMeshConcurrencyTiming benchmarkConcurrency(int numTriangles, int numInstances, int repeats);
+
+// Generates numCases random scenes of lumpy spheres and triangle soups and
+// random bones of rings of rays, with random axes, spokes, rings, max 
+// distances and hit policies. Case c is generated from seed + c, so a 
+// failing case can be run again on its own. Every engine is compared with 
+// a straightforward loop over every triangle, with a double precision test
+// of its own: hit or miss must match exactly and hit points within a 
+// relative tolerance. Rays that graze an edge, end on a triangle or run
+// along one are too close to call and only counted.
+BoneToMeshFuzzReport fuzzEquivalence(int numCases, unsigned int seed);
+const char* fuzzEngineName(int engine);
+
+// Distance from p to the closest point of the triangle abc, worked out in
+// double precision without the trees, for checking closestPoints against.
+double referenceTriangleDistance(const float *p, const float *a, const float *b, const float *c);
+
+#endif
\ No newline at end of file
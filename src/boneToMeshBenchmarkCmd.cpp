@@ -0,0 +1,795 @@
+/**
+    Copyright (c) 2017 Ryan Porter    
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#include "boneToMeshBenchmark.h"
+#include "boneToMeshBenchmarkCmd.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshEquivalence.h"
+#include "boneToMeshScaling.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <maya/MArgList.h>
+#include <maya/MArgDatabase.h>
+#include <maya/MGlobal.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+#include <maya/MSyntax.h>
+
+
+const char* BENCHMARK_BASELINE_FLAG = "-bl";
+const char* BENCHMARK_BASELINE_LONG = "-baseline";
+
+const char* BENCHMARK_BUILD_METHOD_FLAG = "-bm";
+const char* BENCHMARK_BUILD_METHOD_LONG = "-buildMethod";
+
+const char* BENCHMARK_CONCURRENCY_FLAG = "-cc";
+const char* BENCHMARK_CONCURRENCY_LONG = "-concurrency";
+
+const char* BENCHMARK_COUNTERS_FLAG = "-pc";
+const char* BENCHMARK_COUNTERS_LONG = "-counters";
+
+const char* BENCHMARK_FUZZ_FLAG = "-fz";
+const char* BENCHMARK_FUZZ_LONG = "-fuzz";
+
+const char* BENCHMARK_HELP_FLAG = "-h";
+const char* BENCHMARK_HELP_LONG = "-help";
+
+const char* BENCHMARK_JSON_FLAG = "-js";
+const char* BENCHMARK_JSON_LONG = "-json";
+
+const char* BENCHMARK_LAYOUT_FLAG = "-l";
+const char* BENCHMARK_LAYOUT_LONG = "-layout";
+
+const char* BENCHMARK_RAY_ORDER_FLAG = "-ro";
+const char* BENCHMARK_RAY_ORDER_LONG = "-rayOrder";
+
+const char* BENCHMARK_REPEATS_FLAG = "-r";
+const char* BENCHMARK_REPEATS_LONG = "-repeats";
+
+const char* BENCHMARK_SCALING_FLAG = "-sc";
+const char* BENCHMARK_SCALING_LONG = "-scaling";
+
+const char* BENCHMARK_SEED_FLAG = "-s";
+const char* BENCHMARK_SEED_LONG = "-seed";
+
+const char* BENCHMARK_THRESHOLD_FLAG = "-th";
+const char* BENCHMARK_THRESHOLD_LONG = "-threshold";
+
+const char* BENCHMARK_TRIANGLES_FLAG = "-t";
+const char* BENCHMARK_TRIANGLES_LONG = "-triangles";
+
+const int BENCHMARK_BONE_COUNTS[] = {1, 10, 100};
+const int BENCHMARK_INSTANCE_COUNTS[] = {1, 4, 16, 64};
+
+
+void* BoneToMeshBenchmarkCommand::creator()
+{
+    return new BoneToMeshBenchmarkCommand();
+}
+
+
+void BoneToMeshBenchmarkCommand::help()
+{
+    MString helpMessage(
+        "\nboneToMeshBenchmark\n"
+        "\n"
+        "Times acceleration structure builds and traces over generated meshes of increasing size.\n"
+        "Returns the fastest build time of each mesh size, build method and layout in milliseconds.\n"
+        "With -rayOrder, times traces in grid and coherent ray order instead and returns the speedup\n"
+        "of coherent order for each mesh size, bone count and ring space.\n"
+        "With -concurrency, evaluates rigs one after another and all at once and returns the speedup\n"
+        "of concurrent evaluation for each mesh size and rig count, failing if any result differs.\n"
+        "With -counters, counts cycles, instructions, cache misses and branch misses of each stage of\n"
+        "a projection on one thread and returns the counts as JSON. Where the hardware counters are\n"
+        "not available, only the times are returned.\n"
+        "With -fuzz, checks every way of tracing against a brute force reference over random meshes\n"
+        "and bones, then every fill method and the mesh topology of each LOD against the loops they\n"
+        "replaced, and returns the number of mismatches of each, failing if any.\n"
+        "With -scaling, projects a bone onto cylinders, blobs and characters of every mesh size at\n"
+        "every subdivision, thread count and fill method, on the whole mesh and on the faces around\n"
+        "the bone, and returns the results as JSON. With -baseline as well, fails if any result is\n"
+        "slower than the same result of the baseline by more than the threshold.\n"
+        "\n"
+        "FLAGS\n"
+        "Long Name            Short Name   Argument Type(s)    Description\n"
+        "-baseline            -bl          string              JSON file of an earlier -scaling run to compare the results with.\n"
+        "-buildMethod         -bm          string              Build method to time, \"sah\", \"morton\" or \"bruteForce\". May be used more\n"
+        "                                                      than once. SAH and Morton are timed if not set.\n"
+        "-concurrency         -cc          boolean             Time 1, 4, 16 and 64 rigs evaluated serially against concurrently.\n"
+        "                                                      Mesh sizes default to 10000 and 100000 triangles.\n"
+        "-counters            -pc          boolean             Count hardware events of ray generation, traversal, fill and mesh assembly\n"
+        "                                                      for each mesh size and layout, with perf_event_open on Linux.\n"
+        "-fuzz                -fz          int                 Number of random cases to check every trace against brute force.\n"
+        "-json                -js          string              File the JSON results of -scaling or -counters are written to.\n"
+        "-layout              -l           string              Layout to time, \"binary\" or \"compact\". May be used more than once.\n"
+        "                                                      Both are timed if not set.\n"
+        "-rayOrder            -ro          boolean             Time grid against coherent ray order for rings of 1, 10 and 100 bones\n"
+        "                                                      in local and in world space.\n"
+        "-repeats             -r           int                 Number of builds and traces of each mesh, the fastest is reported.\n"
+        "-scaling             -sc          boolean             Time the projection of meshes of each size at subdivisions of 8x4 to 256x128,\n"
+        "                                                      1 to every thread, with and without components and with every fill method.\n"
+        "                                                      Mesh sizes default to 1000 to 5000000 triangles.\n"
+        "-seed                -s           int                 Seed of the random cases of -fuzz, so a failure can be repeated.\n"
+        "-threshold           -th          float               Fraction a result of -scaling may be slower than the baseline, 0.1 by default.\n"
+        "-triangles           -t           int                 Number of triangles in a generated mesh. May be used more than once.\n"
+        "                                                      Defaults to 10000, 100000, 1000000 and 2000000.\n"
+    );
+
+    MGlobal::displayInfo(helpMessage);
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::parseArguments(MArgDatabase &argsData)
+{
+    MStatus status;
+
+    // -help flag
+    if (argsData.isFlagSet(BENCHMARK_HELP_FLAG))
+    {
+        this->showHelp = true;
+        return MStatus::kSuccess;
+    } else {
+        this->showHelp = false;
+    }
+
+    // -baseline flag
+    if (argsData.isFlagSet(BENCHMARK_BASELINE_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_BASELINE_FLAG, 0, this->baselinePath);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->baselinePath = "";
+    }
+
+    // -buildMethod flag
+    this->buildMethods.clear();
+
+    uint numBuildMethods = argsData.numberOfFlagUses(BENCHMARK_BUILD_METHOD_FLAG);
+
+    for (uint i = 0; i < numBuildMethods; i++)
+    {
+        MArgList args;
+        status = argsData.getFlagArgumentList(BENCHMARK_BUILD_METHOD_FLAG, i, args);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        MString buildMethod = args.asString(0, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (buildMethod == "sah")
+        {
+            this->buildMethods.push_back(BVH_BUILD_SAH);
+        } else if (buildMethod == "morton") {
+            this->buildMethods.push_back(BVH_BUILD_MORTON);
+        } else if (buildMethod == "bruteForce") {
+            this->buildMethods.push_back(BVH_BUILD_BRUTE_FORCE);
+        } else {
+            MGlobal::displayError("-buildMethod/-bm flag must be set to \"sah\", \"morton\" or \"bruteForce\".");
+            return MStatus::kFailure;
+        }
+    }
+
+    if (this->buildMethods.empty())
+    {
+        this->buildMethods.push_back(BVH_BUILD_SAH);
+        this->buildMethods.push_back(BVH_BUILD_MORTON);
+    }
+
+    // -concurrency flag
+    if (argsData.isFlagSet(BENCHMARK_CONCURRENCY_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_CONCURRENCY_FLAG, 0, this->concurrency);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->concurrency = false;
+    }
+
+    // -counters flag
+    if (argsData.isFlagSet(BENCHMARK_COUNTERS_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_COUNTERS_FLAG, 0, this->counters);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->counters = false;
+    }
+
+    // -fuzz flag
+    if (argsData.isFlagSet(BENCHMARK_FUZZ_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_FUZZ_FLAG, 0, this->fuzzCases);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (this->fuzzCases < 1)
+        {
+            MGlobal::displayError("-fuzz/-fz flag must be at least 1.");
+            return MStatus::kFailure;
+        }
+    } else {
+        this->fuzzCases = 0;
+    }
+
+    // -json flag
+    if (argsData.isFlagSet(BENCHMARK_JSON_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_JSON_FLAG, 0, this->jsonPath);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->jsonPath = "";
+    }
+
+    // -layout flag
+    this->layouts.clear();
+
+    uint numLayouts = argsData.numberOfFlagUses(BENCHMARK_LAYOUT_FLAG);
+
+    for (uint i = 0; i < numLayouts; i++)
+    {
+        MArgList args;
+        status = argsData.getFlagArgumentList(BENCHMARK_LAYOUT_FLAG, i, args);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        MString layout = args.asString(0, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (layout == "binary")
+        {
+            this->layouts.push_back(false);
+        } else if (layout == "compact") {
+            this->layouts.push_back(true);
+        } else {
+            MGlobal::displayError("-layout/-l flag must be set to \"binary\" or \"compact\".");
+            return MStatus::kFailure;
+        }
+    }
+
+    if (this->layouts.empty())
+    {
+        this->layouts.push_back(false);
+        this->layouts.push_back(true);
+    }
+
+    // -rayOrder flag
+    if (argsData.isFlagSet(BENCHMARK_RAY_ORDER_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_RAY_ORDER_FLAG, 0, this->rayOrder);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->rayOrder = false;
+    }
+
+    // -repeats flag
+    if (argsData.isFlagSet(BENCHMARK_REPEATS_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_REPEATS_FLAG, 0, this->repeats);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (this->repeats < 1) { this->repeats = 1; }
+    }
+
+    // -scaling flag
+    if (argsData.isFlagSet(BENCHMARK_SCALING_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_SCALING_FLAG, 0, this->scaling);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->scaling = false;
+    }
+
+    // -seed flag
+    if (argsData.isFlagSet(BENCHMARK_SEED_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_SEED_FLAG, 0, this->seed);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->seed = 1;
+    }
+
+    // -threshold flag
+    if (argsData.isFlagSet(BENCHMARK_THRESHOLD_FLAG))
+    {
+        status = argsData.getFlagArgument(BENCHMARK_THRESHOLD_FLAG, 0, this->threshold);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (this->threshold < 0.0)
+        {
+            MGlobal::displayError("-threshold/-th flag must be at least 0.");
+            return MStatus::kFailure;
+        }
+    } else {
+        this->threshold = 0.1;
+    }
+
+    // -triangles flag
+    this->triangleCounts.clear();
+
+    uint numTriangleCounts = argsData.numberOfFlagUses(BENCHMARK_TRIANGLES_FLAG);
+
+    for (uint i = 0; i < numTriangleCounts; i++)
+    {
+        MArgList args;
+        status = argsData.getFlagArgumentList(BENCHMARK_TRIANGLES_FLAG, i, args);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        int numTriangles = args.asInt(0, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (numTriangles < 1)
+        {
+            MGlobal::displayError("-triangles/-t flag must be at least 1.");
+            return MStatus::kFailure;
+        }
+
+        this->triangleCounts.push_back(numTriangles);
+    }
+
+    if (this->triangleCounts.empty() && (this->scaling || this->counters))
+    {
+        this->triangleCounts = BoneToMeshScalingOptions().triangleCounts;
+    } else if (this->triangleCounts.empty() && this->concurrency) {
+        this->triangleCounts = {10000, 100000};
+    } else if (this->triangleCounts.empty()) {
+        this->triangleCounts = {10000, 100000, 1000000, 2000000};
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MSyntax BoneToMeshBenchmarkCommand::getSyntax()
+{
+    MSyntax syntax;
+
+    syntax.addFlag(BENCHMARK_BASELINE_FLAG, BENCHMARK_BASELINE_LONG, MSyntax::kString);
+    syntax.addFlag(BENCHMARK_BUILD_METHOD_FLAG, BENCHMARK_BUILD_METHOD_LONG, MSyntax::kString);
+    syntax.addFlag(BENCHMARK_CONCURRENCY_FLAG, BENCHMARK_CONCURRENCY_LONG, MSyntax::kBoolean);
+    syntax.addFlag(BENCHMARK_COUNTERS_FLAG, BENCHMARK_COUNTERS_LONG, MSyntax::kBoolean);
+    syntax.addFlag(BENCHMARK_FUZZ_FLAG, BENCHMARK_FUZZ_LONG, MSyntax::kLong);
+    syntax.addFlag(BENCHMARK_HELP_FLAG, BENCHMARK_HELP_LONG, MSyntax::kBoolean);
+    syntax.addFlag(BENCHMARK_JSON_FLAG, BENCHMARK_JSON_LONG, MSyntax::kString);
+    syntax.addFlag(BENCHMARK_LAYOUT_FLAG, BENCHMARK_LAYOUT_LONG, MSyntax::kString);
+    syntax.addFlag(BENCHMARK_RAY_ORDER_FLAG, BENCHMARK_RAY_ORDER_LONG, MSyntax::kBoolean);
+    syntax.addFlag(BENCHMARK_REPEATS_FLAG, BENCHMARK_REPEATS_LONG, MSyntax::kLong);
+    syntax.addFlag(BENCHMARK_SCALING_FLAG, BENCHMARK_SCALING_LONG, MSyntax::kBoolean);
+    syntax.addFlag(BENCHMARK_SEED_FLAG, BENCHMARK_SEED_LONG, MSyntax::kLong);
+    syntax.addFlag(BENCHMARK_THRESHOLD_FLAG, BENCHMARK_THRESHOLD_LONG, MSyntax::kDouble);
+    syntax.addFlag(BENCHMARK_TRIANGLES_FLAG, BENCHMARK_TRIANGLES_LONG, MSyntax::kLong);
+
+    syntax.makeFlagMultiUse(BENCHMARK_BUILD_METHOD_FLAG);
+    syntax.makeFlagMultiUse(BENCHMARK_LAYOUT_FLAG);
+    syntax.makeFlagMultiUse(BENCHMARK_TRIANGLES_FLAG);
+
+    syntax.enableQuery(false);
+    syntax.enableEdit(false);
+
+    return syntax;
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::doIt(const MArgList& argList)
+{
+    MStatus status;
+
+    MArgDatabase argsData(syntax(), argList, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = this->parseArguments(argsData);
+    if (!status) { return status; }
+
+    if (this->showHelp)
+    {
+        help();
+        return MStatus::kSuccess;
+    }
+
+    if (this->scaling)
+    {
+        return this->benchmarkScalingMatrix();
+    }
+
+    if (this->counters)
+    {
+        return this->benchmarkStageCounters();
+    }
+
+    if (this->fuzzCases > 0)
+    {
+        return this->fuzzEngines();
+    }
+
+    if (this->concurrency)
+    {
+        return this->benchmarkConcurrentInstances();
+    }
+
+    if (this->rayOrder)
+    {
+        return this->benchmarkRayOrders();
+    }
+
+    MString infoMsg("boneToMeshBenchmark: ");
+    infoMsg += numThreads();
+    infoMsg += " threads, fastest of ";
+    infoMsg += this->repeats;
+    infoMsg += " builds.";
+    MGlobal::displayInfo(infoMsg);
+
+    for (int numTriangles : this->triangleCounts)
+    {
+        for (int buildMethod : this->buildMethods)
+        {
+            for (bool compact : this->layouts)
+            {
+                BoneToMeshBuildTiming timing = benchmarkBuild(numTriangles, buildMethod, compact, this->repeats);
+
+                double milliseconds = timing.seconds * 1000.0;
+
+                MString resultMsg(buildMethod == BVH_BUILD_MORTON ? "morton " : buildMethod == BVH_BUILD_BRUTE_FORCE ? "brute  " : "sah    ");
+                resultMsg += compact ? "compact  " : "binary   ";
+                resultMsg += timing.triangles;
+                resultMsg += " triangles  build ";
+                resultMsg += milliseconds;
+                resultMsg += " ms  trace ";
+                resultMsg += timing.traceSeconds * 1000.0;
+                resultMsg += " ms  ";
+                resultMsg += double(timing.bytes) / double(std::max(1, timing.triangles));
+                resultMsg += " bytes/triangle  ";
+                resultMsg += timing.nodes;
+                resultMsg += " nodes  cost ";
+                resultMsg += timing.cost;
+                MGlobal::displayInfo(resultMsg);
+
+                this->appendToResult(milliseconds);
+            }
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+// Writes the results to the file, if one was given.
+static MStatus writeJson(const MString &path, const std::string &json)
+{
+    if (path.length() == 0) { return MStatus::kSuccess; }
+
+    std::ofstream file(path.asChar());
+    file << json;
+
+    if (!file)
+    {
+        MString errorMsg("boneToMeshBenchmark: cannot write the results to '");
+        errorMsg += path;
+        errorMsg += "'.";
+        MGlobal::displayError(errorMsg);
+        return MStatus::kFailure;
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::benchmarkRayOrders()
+{
+    MString infoMsg("boneToMeshBenchmark: ");
+    infoMsg += numThreads();
+    infoMsg += " threads, fastest of ";
+    infoMsg += this->repeats;
+    infoMsg += " traces.";
+    MGlobal::displayInfo(infoMsg);
+
+    for (int numTriangles : this->triangleCounts)
+    {
+        for (int numBones : BENCHMARK_BONE_COUNTS)
+        {
+            for (bool world : {false, true})
+            {
+                BoneToMeshRayOrderTiming timing = benchmarkRayOrder(numTriangles, numBones, world, this->repeats);
+
+                double speedup = timing.gridSeconds / std::max(1e-9, timing.coherentSeconds);
+
+                MString resultMsg(world ? "world  " : "local  ");
+                resultMsg += timing.triangles;
+                resultMsg += " triangles  ";
+                resultMsg += timing.rays;
+                resultMsg += " rays  grid ";
+                resultMsg += timing.gridSeconds * 1000.0;
+                resultMsg += " ms  coherent ";
+                resultMsg += timing.coherentSeconds * 1000.0;
+                resultMsg += " ms  speedup ";
+                resultMsg += speedup;
+                MGlobal::displayInfo(resultMsg);
+
+                this->appendToResult(speedup);
+            }
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
+MStatus BoneToMeshBenchmarkCommand::benchmarkConcurrentInstances()
+{
+    MString infoMsg("boneToMeshBenchmark: ");
+    infoMsg += numThreads();
+    infoMsg += " threads, fastest of ";
+    infoMsg += this->repeats;
+    infoMsg += " evaluations.";
+    MGlobal::displayInfo(infoMsg);
+
+    int mismatches = 0;
+
+    for (int numTriangles : this->triangleCounts)
+    {
+        for (int numInstances : BENCHMARK_INSTANCE_COUNTS)
+        {
+            BoneToMeshConcurrencyTiming timing = benchmarkConcurrency(numTriangles, numInstances, this->repeats);
+
+            double speedup = timing.serialSeconds / std::max(1e-9, timing.concurrentSeconds);
+
+            MString resultMsg;
+            resultMsg += timing.instances;
+            resultMsg += " rigs  ";
+            resultMsg += timing.triangles;
+            resultMsg += " triangles  ";
+            resultMsg += timing.rays;
+            resultMsg += " rays  serial ";
+            resultMsg += timing.serialSeconds * 1000.0;
+            resultMsg += " ms  concurrent ";
+            resultMsg += timing.concurrentSeconds * 1000.0;
+            resultMsg += " ms  speedup ";
+            resultMsg += speedup;
+            resultMsg += "  mismatches ";
+            resultMsg += timing.mismatches;
+            MGlobal::displayInfo(resultMsg);
+
+            this->appendToResult(speedup);
+
+            mismatches += timing.mismatches;
+        }
+    }
+
+    if (mismatches != 0)
+    {
+        MString errorMsg("boneToMeshBenchmark: ");
+        errorMsg += mismatches;
+        errorMsg += " hits of concurrent evaluation differ from serial evaluation.";
+        MGlobal::displayError(errorMsg);
+        return MStatus::kFailure;
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::fuzzEngines()
+{
+    MString infoMsg("boneToMeshBenchmark: ");
+    infoMsg += this->fuzzCases;
+    infoMsg += " random cases, seed ";
+    infoMsg += this->seed;
+    infoMsg += ".";
+    MGlobal::displayInfo(infoMsg);
+
+    BoneToMeshFuzzReport report = fuzzEquivalence(this->fuzzCases, (unsigned int) this->seed);
+
+    long long mismatches = 0;
+
+    for (int engine = 0; engine < FUZZ_ENGINES; engine++)
+    {
+        MString resultMsg(fuzzEngineName(engine));
+        resultMsg += "  ";
+        resultMsg += int(report.mismatches[engine]);
+        resultMsg += " mismatches, ";
+        resultMsg += int(report.ambiguous[engine]);
+        resultMsg += " rays too close to call";
+
+        if (report.firstCase[engine] != -1)
+        {
+            resultMsg += ", first in case ";
+            resultMsg += report.firstCase[engine];
+        }
+
+        MGlobal::displayInfo(resultMsg);
+
+        this->appendToResult(int(report.mismatches[engine]));
+
+        mismatches += report.mismatches[engine];
+    }
+
+    BoneToMeshMeshFuzzReport meshReport = fuzzMeshEquivalence(this->fuzzCases, (unsigned int) this->seed);
+
+    for (int method = 0; method < FUZZ_FILL_METHODS; method++)
+    {
+        MString resultMsg("fill ");
+        resultMsg += scalingFillName(method);
+        resultMsg += "  ";
+        resultMsg += int(meshReport.fillMismatches[method]);
+        resultMsg += " mismatches";
+        MGlobal::displayInfo(resultMsg);
+
+        this->appendToResult(int(meshReport.fillMismatches[method]));
+
+        mismatches += meshReport.fillMismatches[method];
+    }
+
+    MString topologyMsg("mesh topology  ");
+    topologyMsg += int(meshReport.topologyMismatches + meshReport.meshMismatches);
+    topologyMsg += " mismatches";
+
+    if (meshReport.firstCase != -1)
+    {
+        topologyMsg += ", first fill or mesh mismatch in case ";
+        topologyMsg += meshReport.firstCase;
+    }
+
+    MGlobal::displayInfo(topologyMsg);
+
+    this->appendToResult(int(meshReport.topologyMismatches + meshReport.meshMismatches));
+
+    mismatches += meshReport.topologyMismatches + meshReport.meshMismatches;
+
+    if (mismatches != 0)
+    {
+        MString errorMsg("boneToMeshBenchmark: ");
+        errorMsg += int(mismatches);
+        errorMsg += " hits, fills or meshes differ from their references.";
+        MGlobal::displayError(errorMsg);
+        return MStatus::kFailure;
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::benchmarkScalingMatrix()
+{
+    MStatus status;
+
+    MString infoMsg("boneToMeshBenchmark: ");
+    infoMsg += numThreads();
+    infoMsg += " threads, fastest of ";
+    infoMsg += this->repeats;
+    infoMsg += " projections.";
+    MGlobal::displayInfo(infoMsg);
+
+    std::vector<BoneToMeshScalingResult> baseline;
+
+    if (this->baselinePath.length() > 0 && !readScalingBaseline(this->baselinePath.asChar(), baseline))
+    {
+        MString errorMsg("boneToMeshBenchmark: cannot read the results of baseline '");
+        errorMsg += this->baselinePath;
+        errorMsg += "'.";
+        MGlobal::displayError(errorMsg);
+        return MStatus::kFailure;
+    }
+
+    BoneToMeshScalingOptions options;
+    options.triangleCounts = this->triangleCounts;
+    options.repeats = this->repeats;
+
+    std::vector<BoneToMeshScalingResult> results;
+
+    benchmarkScaling(options, results, [](const BoneToMeshScalingResult &result) {
+        MString resultMsg(result.name.c_str());
+        resultMsg += "  ";
+        resultMsg += result.triangles;
+        resultMsg += " triangles  build ";
+        resultMsg += result.buildMs;
+        resultMsg += " ms  project ";
+        resultMsg += result.projectMs;
+        resultMsg += " ms";
+        MGlobal::displayInfo(resultMsg);
+    });
+
+    std::string json = scalingJson(results, this->repeats);
+
+    status = writeJson(this->jsonPath, json);
+    if (!status) { return status; }
+
+    this->setResult(MString(json.c_str()));
+
+    if (baseline.empty()) { return MStatus::kSuccess; }
+
+    std::vector<std::string> regressions;
+    int numCompared = compareScaling(results, baseline, this->threshold, regressions);
+
+    for (const std::string &regression : regressions)
+    {
+        MGlobal::displayWarning(MString("boneToMeshBenchmark: slower than baseline: ") + regression.c_str());
+    }
+
+    MString compareMsg("boneToMeshBenchmark: ");
+    compareMsg += numCompared;
+    compareMsg += " of ";
+    compareMsg += int(results.size());
+    compareMsg += " results compared with the baseline, ";
+    compareMsg += int(regressions.size());
+    compareMsg += " slower by more than ";
+    compareMsg += this->threshold * 100.0;
+    compareMsg += "%.";
+
+    if (!regressions.empty())
+    {
+        MGlobal::displayError(compareMsg);
+        return MStatus::kFailure;
+    }
+
+    MGlobal::displayInfo(compareMsg);
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus BoneToMeshBenchmarkCommand::benchmarkStageCounters()
+{
+    MStatus status;
+
+    MString infoMsg("boneToMeshBenchmark: 1 thread, fastest of ");
+    infoMsg += this->repeats;
+    infoMsg += " projections.";
+    MGlobal::displayInfo(infoMsg);
+
+    BoneToMeshScalingOptions options;
+    options.triangleCounts = this->triangleCounts;
+    options.repeats = this->repeats;
+
+    std::vector<BoneToMeshCounterResult> results;
+
+    if (!benchmarkCounters(options, this->layouts, results))
+    {
+        MGlobal::displayWarning("boneToMeshBenchmark: hardware counters are not available, only times are reported.");
+    }
+
+    for (const BoneToMeshCounterResult &result : results)
+    {
+        for (int s = 0; s < STAGES; s++)
+        {
+            const BoneToMeshStageCounters &stage = result.stages[s];
+
+            MString resultMsg(result.name.c_str());
+            resultMsg += "  ";
+            resultMsg += stageName(s);
+            resultMsg += "  ";
+            resultMsg += stage.ms;
+            resultMsg += " ms";
+
+            long long cycles = stage.values[COUNTER_CYCLES];
+            long long instructions = stage.values[COUNTER_INSTRUCTIONS];
+
+            if (cycles > 0 && instructions >= 0)
+            {
+                resultMsg += "  IPC ";
+                resultMsg += double(instructions) / double(cycles);
+            }
+
+            if (stage.values[COUNTER_CACHE_MISSES] >= 0)
+            {
+                resultMsg += "  cache misses/ray ";
+                resultMsg += double(stage.values[COUNTER_CACHE_MISSES]) / double(std::max(1, result.rays));
+            }
+
+            if (stage.values[COUNTER_BRANCH_MISSES] >= 0)
+            {
+                resultMsg += "  branch misses/ray ";
+                resultMsg += double(stage.values[COUNTER_BRANCH_MISSES]) / double(std::max(1, result.rays));
+            }
+
+            MGlobal::displayInfo(resultMsg);
+        }
+    }
+
+    std::string json = countersJson(results, this->repeats);
+
+    status = writeJson(this->jsonPath, json);
+    if (!status) { return status; }
+
+    this->setResult(MString(json.c_str()));
+
+    return MStatus::kSuccess;
+}
@@ -0,0 +1,60 @@
+/**
+    Copyright (c) 2017 Ryan Porter    
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_BENCHMARK_CMD_H
+#define YANTOR_3D_BONE_TO_MESH_BENCHMARK_CMD_H
+
+#include <vector>
+
+#include <maya/MArgDatabase.h>
+#include <maya/MArgList.h>
+#include <maya/MPxCommand.h>
+#include <maya/MString.h>
+#include <maya/MStatus.h>
+#include <maya/MSyntax.h>
+
+class BoneToMeshBenchmarkCommand : public MPxCommand
+{
+public:
+    static void*        creator();
+
+    static MSyntax      getSyntax();
+    virtual MStatus     parseArguments(MArgDatabase &argsData);
+
+    virtual MStatus     doIt(const MArgList& argList);
+
+    virtual bool        isUndoable() const { return false; }
+    virtual bool        hasSyntax()  const { return true; }
+
+private:
+    virtual void        help();
+    virtual MStatus     benchmarkRayOrders();
+    virtual MStatus     benchmarkConcurrentInstances();
+    virtual MStatus     fuzzEngines();
+    virtual MStatus     benchmarkScalingMatrix();
+    virtual MStatus     benchmarkStageCounters();
+
+public:
+    static MString      COMMAND_NAME;
+
+private:
+    std::vector<int>    triangleCounts;
+    std::vector<int>    buildMethods;
+    std::vector<bool>   layouts;
+
+    int                 repeats = 3;
+    int                 fuzzCases = 0;
+    int                 seed = 1;
+    bool                scaling = false;
+    bool                counters = false;
+    double              threshold = 0.1;
+    MString             jsonPath;
+    MString             baselinePath;
+    bool                concurrency = false;
+    bool                rayOrder = false;
+    bool                showHelp = false;
+};
+
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <cfloat>
+#include <string>
 
 #include <maya/MArgList.h>
 #include <maya/MArgDatabase.h>
@@ -40,15 +41,27 @@ const char* BONE_LONG = "-bone";
 const char* CONSTRUCTION_HISTORY_FLAG = "-ch";
 const char* CONSTRUCTION_HISTORY_LONG = "-constructionHistory";
 
+const char* END_BONE_FLAG = "-eb";
+const char* END_BONE_LONG = "-endBone";
+
 const char* FILL_PARTIAL_LOOPS_FLAG = "-fp";
 const char* FILL_PARTIAL_LOOPS_LONG = "-fillPartialLoops";
 
+const char* HIT_INDEX_FLAG = "-hi";
+const char* HIT_INDEX_LONG = "-hitIndex";
+
+const char* HIT_POLICY_FLAG = "-hp";
+const char* HIT_POLICY_LONG = "-hitPolicy";
+
 const char* HELP_FLAG = "-h";
 const char* HELP_LONG = "-help";
 
 const char* LENGTH_FLAG = "-l";
 const char* LENGTH_LONG = "-length";
 
+const char* MIRROR_BONE_FLAG = "-mb";
+const char* MIRROR_BONE_LONG = "-mirrorBone";
+
 const char* MAX_DISTANCE_FLAG = "-md";
 const char* MAX_DISTANCE_LONG = "-maxDistance";
 
@@ -61,6 +74,15 @@ const char* SUBDIVISIONS_X_LONG = "-subdivisionsX";
 const char* SUBDIVISIONS_Y_FLAG = "-sy";
 const char* SUBDIVISIONS_Y_LONG = "-subdivisionsY";
 
+const char* SYMMETRY_FLAG = "-sym";
+const char* SYMMETRY_LONG = "-symmetry";
+
+const char* SYMMETRY_TOLERANCE_FLAG = "-st";
+const char* SYMMETRY_TOLERANCE_LONG = "-symmetryTolerance";
+
+const char* WELD_FLAG = "-wd";
+const char* WELD_LONG = "-weld";
+
 const char* WORLD_SPACE_FLAG = "-w";
 const char* WORLD_SPACE_LONG = "-world";
 
@@ -88,20 +110,36 @@ void BoneToMeshCommand::help()
     MString helpMessage(
         "\nboneToMesh\n"
         "\n"
-        "Creates a cylindrical mesh around the specified bone and projects it outward onto the selected mesh.\n"
+        "Creates a cylindrical mesh around the specified bone and projects it outward onto the selected meshes.\n"
+        "By default each ray lands on the outermost of the selected meshes it passes through.\n"
         "\n"
         "FLAGS\n"
         "Long Name            Short Name   Argument Type(s)    Description\n"
         "-axis                -a           string              Long axis of the bone. Accepted values are \"x\", \"y\", or \"z\".\n"
         "-bone                -b           string              Transform at the base of the \"bone\".\n"
         "-constructionHistory -ch          boolean             Toggles construction history on/off.\n"
+        "-endBone             -eb          string              Last bone of a chain that starts at -bone. Each bone of the chain gets a mesh that\n"
+        "                                                      ends at the next bone, and neighbouring meshes share the ring at their joint.\n"
         "-fillPartialLoops    -fp          string              Method by which partial loops have their missing points filled\n"
-        "                                                      Accepted values are 0 - \"none\", 1 - \"shortest\", 2 - \"longest\", 3 - \"average\", or 4 - \"radius\".\n"
+        "                                                      Accepted values are 0 - \"none\", 1 - \"shortest\", 2 - \"longest\", 3 - \"average\", 4 - \"radius\",\n"
+        "                                                      or 5 - \"nearest\", which snaps them to the nearest point on the mesh.\n"
+        "-hitIndex            -hi          int                 Which hit along the ray to use when -hitPolicy is \"nth\", counting from 1.\n"
+        "-hitPolicy           -hp          string              Which hit along each ray to use. Accepted values are \"nearest\" - the first hit\n"
+        "                                                      on each mesh, the outermost of those; \"farthest\" - the last hit within\n"
+        "                                                      -maxDistance; \"nth\" - the -hitIndex hit over every mesh; or \"frontFacing\" -\n"
+        "                                                      the first hit facing the bone on each mesh, the outermost of those.\n"
         "-length              -l           double              Length of the bone.\n"
         "-maxDistance         -md          double              Maximum distance from the bone an intersection with the mesh may occur.\n"
+        "-mirrorBone          -mb          string              Transform at the base of the mirrored \"bone\" when -symmetry is set.\n"
+        "                                                      Found by swapping the side prefix or suffix of the -bone name if not set.\n"
         "-radius              -r           double              Distance from the bone of filled in points if -fillPartialLoops is set to \"radius\".\n"
         "-subdivisionsX       -sx          int                 Specifies the number of subdivisions around the bone.\n"
         "-subdivisionsY       -sy          int                 Specifies the number of subdivisions along the bone.\n"
+        "-symmetry            -sym         string              Also creates a mesh for the mirror bone, reflected across the \"x\", \"y\", or \"z\" plane.\n"
+        "                                                      The mirror bone is traced instead if the mesh or bones are not symmetric.\n"
+        "-symmetryTolerance   -st          double              Distance within which points are considered symmetric.\n"
+        "-weld                -wd          boolean             Creates a single welded mesh for the chain of -endBone instead of one mesh per bone.\n"
+        "                                                      Required with -constructionHistory.\n"
         "-world               -w           boolean             Toggles the axis between world and local.\n"
     );
 
@@ -133,7 +171,15 @@ MStatus BoneToMeshCommand::parseArguments(MArgDatabase &argsData)
             return MStatus::kFailure;
         }
 
-        selection.getDagPath(0, this->inMesh, this->components);
+        uint numSelected = selection.length();
+
+        this->inMeshes.resize(numSelected);
+        this->components.resize(numSelected);
+
+        for (uint i = 0; i < numSelected; i++)
+        {
+            selection.getDagPath(i, this->inMeshes[i], this->components[i]);
+        }
     }
     
     // -axis flag
@@ -178,6 +224,29 @@ MStatus BoneToMeshCommand::parseArguments(MArgDatabase &argsData)
         CHECK_MSTATUS_AND_RETURN_IT(status);
     }  
 
+    // -endBone flag
+    if (argsData.isFlagSet(END_BONE_FLAG))
+    {
+        MSelectionList selection;
+        MString objectName;
+
+        status = argsData.getFlagArgument(END_BONE_FLAG, 0, objectName);        
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        status = selection.add(objectName);
+
+        if (status)
+        {
+            status = selection.getDependNode(0, this->endBoneObj);    
+            RETURN_IF_ERROR(status);
+        } else {
+            MString errorMsg("Object '^1s does not exist.");
+            errorMsg.format(errorMsg, objectName);
+            MGlobal::displayError(errorMsg);
+            return status;
+        }
+    }
+
     // -fillPartialLoops flag
     if (argsData.isFlagSet(FILL_PARTIAL_LOOPS_FLAG))
     {
@@ -185,7 +254,23 @@ MStatus BoneToMeshCommand::parseArguments(MArgDatabase &argsData)
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
         if (params.fillPartialLoopsMethod < 0) { params.fillPartialLoopsMethod = 0; }
-        if (params.fillPartialLoopsMethod > 4) { params.fillPartialLoopsMethod = 4; }
+        if (params.fillPartialLoopsMethod > 5) { params.fillPartialLoopsMethod = 5; }
+    }
+
+    // -hitIndex flag
+    if (argsData.isFlagSet(HIT_INDEX_FLAG))
+    {
+        status = argsData.getFlagArgument(HIT_INDEX_FLAG, 0, params.hitIndex);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    // -hitPolicy flag
+    if (argsData.isFlagSet(HIT_POLICY_FLAG))
+    {
+        status = argsData.getFlagArgument(HIT_POLICY_FLAG, 0, this->hitPolicy);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->hitPolicy = "nearest";
     }
 
     // -length flag
@@ -204,6 +289,29 @@ MStatus BoneToMeshCommand::parseArguments(MArgDatabase &argsData)
         CHECK_MSTATUS_AND_RETURN_IT(status);
     }
 
+    // -mirrorBone flag
+    if (argsData.isFlagSet(MIRROR_BONE_FLAG))
+    {
+        MSelectionList selection;
+        MString objectName;
+
+        status = argsData.getFlagArgument(MIRROR_BONE_FLAG, 0, objectName);        
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        status = selection.add(objectName);
+
+        if (status)
+        {
+            status = selection.getDependNode(0, this->mirrorBoneObj);    
+            RETURN_IF_ERROR(status);
+        } else {
+            MString errorMsg("Object '^1s does not exist.");
+            errorMsg.format(errorMsg, objectName);
+            MGlobal::displayError(errorMsg);
+            return status;
+        }
+    }
+
     // -radius flag
     if (argsData.isFlagSet(RADIUS_FLAG))
     {
@@ -225,6 +333,31 @@ MStatus BoneToMeshCommand::parseArguments(MArgDatabase &argsData)
         CHECK_MSTATUS_AND_RETURN_IT(status);
     }
 
+    // -symmetry flag
+    if (argsData.isFlagSet(SYMMETRY_FLAG))
+    {
+        status = argsData.getFlagArgument(SYMMETRY_FLAG, 0, this->symmetry);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->symmetry = "";
+    }
+
+    // -symmetryTolerance flag
+    if (argsData.isFlagSet(SYMMETRY_TOLERANCE_FLAG))
+    {
+        status = argsData.getFlagArgument(SYMMETRY_TOLERANCE_FLAG, 0, params.symmetryTolerance);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    // -weld flag
+    if (argsData.isFlagSet(WELD_FLAG))
+    {
+        status = argsData.getFlagArgument(WELD_FLAG, 0, this->weld);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    } else {
+        this->weld = false;
+    }
+
     // -world flag
     if (argsData.isFlagSet(WORLD_SPACE_FLAG))
     {
@@ -252,14 +385,35 @@ MStatus BoneToMeshCommand::validateArguments()
         return MStatus::kFailure;
     }
     
-    if (this->inMesh.hasFn(MFn::kMesh))
+    for (MDagPath &inMesh : this->inMeshes)
     {
-        if (this->inMesh.node().hasFn(MFn::kTransform))
+        if (inMesh.hasFn(MFn::kMesh))
         {
-            this->inMesh.extendToShapeDirectlyBelow(0);
+            if (inMesh.node().hasFn(MFn::kTransform))
+            {
+                inMesh.extendToShapeDirectlyBelow(0);
+            }
+        } else {
+            MGlobal::displayError("Must select a mesh.");
+            return MStatus::kFailure;
         }
-    } else {
-        MGlobal::displayError("Must select a mesh.");
+    }
+
+    if (
+        this->hitPolicy != "nearest" &&
+        this->hitPolicy != "farthest" &&
+        this->hitPolicy != "nth" &&
+        this->hitPolicy != "frontFacing"
+    ) {
+        MGlobal::displayError("-hitPolicy/-hp flag must be set to \"nearest\", \"farthest\", \"nth\", or \"frontFacing\".");
+        return MStatus::kFailure;
+    }
+
+    if (params.hitIndex < 1 || params.hitIndex > HIT_MAX_NTH) {
+        MString errorMsg("The -hitIndex/-hi flag must be between 1 and ");
+        errorMsg += HIT_MAX_NTH;
+        errorMsg += ".";
+        MGlobal::displayError(errorMsg);
         return MStatus::kFailure;
     }
 
@@ -268,6 +422,36 @@ MStatus BoneToMeshCommand::validateArguments()
         return MStatus::kFailure;
     }
 
+    this->chainBoneObjs.clear();
+
+    if (!this->endBoneObj.isNull())
+    {
+        status = this->findChainBones();
+
+        if (!status)
+        {
+            MGlobal::displayError("The -endBone/-eb flag expects a transform below the -bone/-b transform.");
+            return MStatus::kFailure;
+        }
+
+        if (this->symmetry != "")
+        {
+            MGlobal::displayError("The -symmetry/-sym flag cannot be used with the -endBone/-eb flag.");
+            return MStatus::kFailure;
+        }
+
+        if (this->constructionHistory && !this->weld)
+        {
+            MGlobal::displayError("The boneToMesh node welds chains, the -weld/-wd flag must be set with -constructionHistory/-ch.");
+            return MStatus::kFailure;
+        }
+
+        if (params.subdivisionsY < 2) {
+            MGlobal::displayError("The -subdivisionsY/-sy flag must be at least 2 with the -endBone/-eb flag.");
+            return MStatus::kFailure;
+        }
+    }
+
     if (params.subdivisionsX < 3) {
         MGlobal::displayError("The -subdivisionsX/-sx flag must be at least 3.");
         return MStatus::kFailure;
@@ -278,6 +462,29 @@ MStatus BoneToMeshCommand::validateArguments()
         return MStatus::kFailure;
     }
 
+    if (
+        this->symmetry != "" &&
+        this->symmetry != "x" &&
+        this->symmetry != "y" &&
+        this->symmetry != "z"
+    ) {
+        MGlobal::displayError("-symmetry/-sym flag must be set to \"x\", \"y\", or \"z\".");
+        return MStatus::kFailure;
+    }
+
+    if (this->symmetry != "")
+    {
+        if (this->mirrorBoneObj.isNull())
+        {
+            this->findMirrorBone();
+        }
+
+        if (!this->mirrorBoneObj.isNull() && !this->mirrorBoneObj.hasFn(MFn::kTransform)) {
+            MGlobal::displayError("The -mirrorBone/-mb flag expects a transform.");
+            return MStatus::kFailure;
+        }
+    }
+
     return MStatus::kSuccess;
 }
 
@@ -289,17 +496,24 @@ MSyntax BoneToMeshCommand::getSyntax()
     syntax.addFlag(AXIS_FLAG, AXIS_LONG, MSyntax::kString);
     syntax.addFlag(BONE_FLAG, BONE_LONG, MSyntax::kString);
     syntax.addFlag(CONSTRUCTION_HISTORY_FLAG, CONSTRUCTION_HISTORY_LONG, MSyntax::kBoolean);
+    syntax.addFlag(END_BONE_FLAG, END_BONE_LONG, MSyntax::kString);
     syntax.addFlag(FILL_PARTIAL_LOOPS_FLAG, FILL_PARTIAL_LOOPS_LONG, MSyntax::kLong);
     syntax.addFlag(HELP_FLAG, HELP_LONG, MSyntax::kBoolean);
+    syntax.addFlag(HIT_INDEX_FLAG, HIT_INDEX_LONG, MSyntax::kLong);
+    syntax.addFlag(HIT_POLICY_FLAG, HIT_POLICY_LONG, MSyntax::kString);
     syntax.addFlag(LENGTH_FLAG, LENGTH_LONG, MSyntax::kDouble);
     syntax.addFlag(MAX_DISTANCE_FLAG, MAX_DISTANCE_LONG, MSyntax::kDouble);
+    syntax.addFlag(MIRROR_BONE_FLAG, MIRROR_BONE_LONG, MSyntax::kString);
     syntax.addFlag(RADIUS_FLAG, RADIUS_LONG, MSyntax::kDouble);
     syntax.addFlag(SUBDIVISIONS_X_FLAG, SUBDIVISIONS_X_LONG, MSyntax::kLong);
     syntax.addFlag(SUBDIVISIONS_Y_FLAG, SUBDIVISIONS_Y_LONG, MSyntax::kLong);
+    syntax.addFlag(SYMMETRY_FLAG, SYMMETRY_LONG, MSyntax::kString);
+    syntax.addFlag(SYMMETRY_TOLERANCE_FLAG, SYMMETRY_TOLERANCE_LONG, MSyntax::kDouble);
+    syntax.addFlag(WELD_FLAG, WELD_LONG, MSyntax::kBoolean);
     syntax.addFlag(WORLD_SPACE_FLAG, WORLD_SPACE_LONG, MSyntax::kBoolean);
 
     syntax.useSelectionAsDefault(true);
-    syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+    syntax.setObjectType(MSyntax::kSelectionList, 1);
 
     syntax.enableQuery(false);
     syntax.enableEdit(false);
@@ -340,57 +554,158 @@ MStatus BoneToMeshCommand::redoIt()
     else if (this->axis == "y") { params.direction = 1; }
     else if (this->axis == "z") { params.direction = 2; }
 
+    if (this->hitPolicy == "farthest")         { params.hitPolicy = HIT_FARTHEST; }
+    else if (this->hitPolicy == "nth")         { params.hitPolicy = HIT_NTH; }
+    else if (this->hitPolicy == "frontFacing") { params.hitPolicy = HIT_FRONT_FACING; }
+    else                                       { params.hitPolicy = HIT_NEAREST; }
+
+    if (this->symmetry == "x")      { params.symmetry = 1; }
+    else if (this->symmetry == "y") { params.symmetry = 2; }
+    else if (this->symmetry == "z") { params.symmetry = 3; }
+    else                            { params.symmetry = 0; }
+
     MFnTransform fnXform(this->boneObj, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
     MMatrix boneMatrix = fnXform.transformation().asMatrix();
     MMatrix directionMatrix = this->useWorldDirection ? MMatrix::identity : MMatrix(boneMatrix);
 
-    MDagModifier dagMod;
+    // The bones of a chain are parented to each other, so they are placed 
+    // by their world matrices.
+    std::vector<MMatrix> chainMatrices;
+    std::vector<MMatrix> chainDirectionMatrices;
 
-    MObject newMeshParent;
-    MObject newMesh = dagMod.createNode("transform", MObject::kNullObj, &status);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+    for (MObject &chainBoneObj : this->chainBoneObjs)
+    {
+        MDagPath chainBone;
+        MDagPath::getAPathTo(chainBoneObj, chainBone);
 
-    status = dagMod.doIt();
-    CHECK_MSTATUS_AND_RETURN_IT(status);
-    
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+        MMatrix chainMatrix = chainBone.inclusiveMatrix();
 
-    status = dagMod.doIt();
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+        chainMatrices.push_back(chainMatrix);
+        chainDirectionMatrices.push_back(this->useWorldDirection ? MMatrix::identity : chainMatrix);
+    }
 
-    MDagPath parentTransform;
-    MDagPath::getAPathTo(newMesh, parentTransform);
+    if (!chainMatrices.empty())
+    {
+        boneMatrix = chainMatrices[0];
+        directionMatrix = chainDirectionMatrices[0];
+    }
 
-    MObject inMeshObj = this->inMesh.node();
-    
-    status = boneToMesh(
-        inMeshObj,
-        this->components,
-        boneMatrix,
-        directionMatrix,
-        params,
-        newMesh
-    );
+    std::vector<MObject> inMeshObjs;
 
-    RETURN_IF_ERROR(status);
+    for (MDagPath &inMesh : this->inMeshes)
+    {
+        inMeshObjs.push_back(inMesh.node());
+    }
 
-    MGlobal::executeCommand("sets -e -forceElement initialShadingGroup " + parentTransform.partialPathName());
+    BoneToMeshScene scene;
+    BoneToMeshProjection proj;
 
-    newMeshParent = MObject(parentTransform.node());
-    parentTransform.extendToShape();
-    newMesh = MObject(parentTransform.node());
-    parentTransform.pop();
+    status = updateScene(inMeshObjs, this->components, scene);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
 
     MString boneName = MFnDagNode(this->boneObj).name();
 
-    dagMod.renameNode(newMeshParent, boneName + "_Mesh");
-    dagMod.renameNode(newMesh, boneName + "_MeshShape");
-    status = dagMod.doIt();
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MObject newMeshParent;
+    MObject newMesh;
 
-    this->appendToResult(parentTransform.partialPathName());
+    this->undoCreatedChainMeshes.clear();
+
+    if (chainMatrices.empty())
+    {
+        initializeProjection(boneMatrix, directionMatrix, params, proj);
+        projectionVectors(params, proj);
+        projectBoneToMesh(scene, params, proj);
+        fillPartialLoops(scene, params, proj);
+
+        status = this->createProxyMesh(proj, boneName, newMeshParent, newMesh);
+        RETURN_IF_ERROR(status);
+    } else {
+        std::vector<BoneToMeshProjection> chainProjs;
+
+        status = boneToMeshChain(scene, chainMatrices, chainDirectionMatrices, params, chainProjs);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (this->weld)
+        {
+            status = this->createChainProxyMesh(chainProjs, boneName, newMeshParent, newMesh);
+            RETURN_IF_ERROR(status);
+        } else {
+            for (size_t i = 0; i < chainProjs.size(); i++)
+            {
+                MObject chainMeshParent;
+                MObject chainMesh;
+
+                status = this->createProxyMesh(chainProjs[i], MFnDagNode(this->chainBoneObjs[i]).name(), chainMeshParent, chainMesh);
+                RETURN_IF_ERROR(status);
+
+                if (i == 0)
+                {
+                    newMeshParent = chainMeshParent;
+                    newMesh = chainMesh;
+                } else {
+                    this->undoCreatedChainMeshes.push_back(chainMeshParent);
+                }
+            }
+        }
+    }
+
+    MObject newMirrorMeshParent;
+    MObject newMirrorMesh;
+
+    if (params.symmetry != 0)
+    {
+        BoneToMeshProjection mirrorProj;
+
+        MMatrix reflection = symmetryMatrix(params.symmetry);
+        MMatrix mirrorBoneMatrix = reflection * boneMatrix * reflection;
+        MString mirrorBoneName = boneName + "_Mirror";
+
+        if (!this->mirrorBoneObj.isNull())
+        {
+            MFnTransform fnMirrorXform(this->mirrorBoneObj, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            mirrorBoneMatrix = fnMirrorXform.transformation().asMatrix();
+            mirrorBoneName = fnMirrorXform.name();
+        }
+
+        // Mirroring and the fallback trace both need the whole meshes.
+        BoneToMeshScene fullScene;
+        BoneToMeshScene* mirrorScene = &scene;
+
+        bool useComponents = std::any_of(
+            this->components.begin(), 
+            this->components.end(), 
+            [](const MObject &c) { return !c.isNull(); }
+        );
+
+        if (useComponents)
+        {
+            std::vector<MObject> noComponents;
+
+            status = updateScene(inMeshObjs, noComponents, fullScene);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            mirrorScene = &fullScene;
+        }
+
+        bool mirrored;
+
+        status = boneToMeshMirror(*mirrorScene, mirrorBoneMatrix, params, proj, mirrorProj, mirrored);
+        RETURN_IF_ERROR(status);
+
+        if (!mirrored)
+        {
+            MString infoMsg("^1s is not symmetric with ^2s, tracing it instead.");
+            infoMsg.format(infoMsg, mirrorBoneName, boneName);
+            MGlobal::displayInfo(infoMsg);
+        }
+
+        status = this->createProxyMesh(mirrorProj, mirrorBoneName, newMirrorMeshParent, newMirrorMesh);
+        RETURN_IF_ERROR(status);
+    }
 
     if (this->constructionHistory)
     {
@@ -402,17 +717,17 @@ MStatus BoneToMeshCommand::redoIt()
         status = dgMod.doIt();
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
-        MFnDagNode        fnInMesh(this->inMesh);
+        MFnDagNode        fnInMesh(this->inMeshes[0]);
         MFnDependencyNode fnBone(this->boneObj);
         MFnDependencyNode fnNode(newNode);
         MFnDependencyNode fnNewMesh(newMesh);
 
-        if (!this->components.isNull())
+        if (!this->components[0].isNull())
         {
             MFnComponentListData fnComponentList;
             MObject componentList = fnComponentList.create();
 
-            MItMeshPolygon itPoly(this->inMesh, this->components);
+            MItMeshPolygon itPoly(this->inMeshes[0], this->components[0]);
 
             while (!itPoly.isDone())
             {
@@ -435,11 +750,17 @@ MStatus BoneToMeshCommand::redoIt()
         MPlug node_boneMatrixPlug      = fnNode.findPlug("boneMatrix", false);
         MPlug node_directionPlug       = fnNode.findPlug("direction", false);
         MPlug node_directionMatrixPlug = fnNode.findPlug("directionMatrix", false);
+        MPlug node_hitIndexPlug        = fnNode.findPlug("hitIndex", false);
+        MPlug node_hitPolicyPlug       = fnNode.findPlug("hitPolicy", false);
         MPlug node_inMeshPlug          = fnNode.findPlug("inMesh", false);
         MPlug node_maxDistancePlug     = fnNode.findPlug("maxDistance", false);
+        MPlug node_mirrorBoneMatrixPlug = fnNode.findPlug("mirrorBoneMatrix", false);
+        MPlug node_outMirrorMeshPlug   = fnNode.findPlug("outMirrorMesh", false);
         MPlug node_outMeshPlug         = fnNode.findPlug("outMesh", false);
         MPlug node_subdivisionsXPlug   = fnNode.findPlug("subdivisionsAxis", false);
         MPlug node_subdivisionsYPlug   = fnNode.findPlug("subdivisionsHeight", false);
+        MPlug node_symmetryPlug        = fnNode.findPlug("symmetry", false);
+        MPlug node_symmetryTolerancePlug = fnNode.findPlug("symmetryTolerance", false);
         MPlug node_useMaxDistancePlug  = fnNode.findPlug("useMaxDistance", false);
 
         MPlug newMesh_inMeshPlug       = fnNewMesh.findPlug("inMesh", false, &status);
@@ -453,8 +774,40 @@ MStatus BoneToMeshCommand::redoIt()
         }
 
         dgMod.connect(inMesh_worldMeshPlug, node_inMeshPlug);
+
+        // The node's components only apply to the first mesh.
+        MPlug node_inMeshesPlug = fnNode.findPlug("inMeshes", false);
+
+        for (uint i = 1; i < this->inMeshes.size(); i++)
+        {
+            MFnDagNode fnOtherMesh(this->inMeshes[i]);
+            MPlug otherMesh_worldMeshPlug = fnOtherMesh.findPlug("worldMesh", false, &status).elementByLogicalIndex(0);
+
+            dgMod.connect(otherMesh_worldMeshPlug, node_inMeshesPlug.elementByLogicalIndex(i - 1));
+
+            if (!this->components[i].isNull())
+            {
+                MString warningMsg("The boneToMesh node uses every face of ^1s.");
+                warningMsg.format(warningMsg, fnOtherMesh.name());
+                MGlobal::displayWarning(warningMsg);
+            }
+        }
         dgMod.connect(bone_worldMatrixPlug, node_boneMatrixPlug);
 
+        MPlug node_chainMatricesPlug = fnNode.findPlug("chainMatrices", false);
+        MPlug node_chainDirectionMatricesPlug = fnNode.findPlug("chainDirectionMatrices", false);
+
+        for (uint i = 1; i < this->chainBoneObjs.size(); i++)
+        {
+            MFnDependencyNode fnChainBone(this->chainBoneObjs[i]);
+            MPlug chainBone_worldMatrixPlug = fnChainBone.findPlug("worldMatrix", false, &status).elementByLogicalIndex(0);
+
+            dgMod.connect(chainBone_worldMatrixPlug, node_chainMatricesPlug.elementByLogicalIndex(i - 1));
+
+            MObject chainDirectionMatrixData = MFnMatrixData().create(chainDirectionMatrices[i]);
+            node_chainDirectionMatricesPlug.elementByLogicalIndex(i - 1).setMObject(chainDirectionMatrixData);
+        }
+
         status = dgMod.doIt();
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -468,10 +821,36 @@ MStatus BoneToMeshCommand::redoIt()
         status = node_subdivisionsYPlug.setInt(params.subdivisionsY);
         status = node_directionPlug.setShort(params.direction);
         CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = node_hitPolicyPlug.setShort((short) params.hitPolicy);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = node_hitIndexPlug.setInt(params.hitIndex);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
 
         status = dgMod.connect(node_outMeshPlug, newMesh_inMeshPlug);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
+        if (params.symmetry != 0)
+        {
+            status = node_symmetryPlug.setShort((short) params.symmetry);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            status = node_symmetryTolerancePlug.setDouble(params.symmetryTolerance);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            if (!this->mirrorBoneObj.isNull())
+            {
+                MFnDependencyNode fnMirrorBone(this->mirrorBoneObj);
+                MPlug mirrorBone_worldMatrixPlug = fnMirrorBone.findPlug("worldMatrix", false, &status).elementByLogicalIndex(0);
+
+                status = dgMod.connect(mirrorBone_worldMatrixPlug, node_mirrorBoneMatrixPlug);
+                CHECK_MSTATUS_AND_RETURN_IT(status);
+            }
+
+            MPlug newMirrorMesh_inMeshPlug = MFnDependencyNode(newMirrorMesh).findPlug("inMesh", false, &status);
+
+            status = dgMod.connect(node_outMirrorMeshPlug, newMirrorMesh_inMeshPlug);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        }
+
         status = dgMod.doIt();
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -481,11 +860,162 @@ MStatus BoneToMeshCommand::redoIt()
     }
 
     this->undoCreatedMesh = newMeshParent;
+    this->undoCreatedMirrorMesh = newMirrorMeshParent;
 
     return MStatus::kSuccess;
 }
 
 
+MStatus BoneToMeshCommand::createProxyMesh(
+    BoneToMeshProjection &proj, 
+    const MString &name, 
+    MObject &meshParent, 
+    MObject &meshShape
+) {
+    MStatus status;
+
+    MDagModifier dagMod;
+
+    meshParent = dagMod.createNode("transform", MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = dagMod.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = createMesh(params, proj, meshParent);
+    RETURN_IF_ERROR(status);
+
+    return this->nameProxyMesh(name, meshParent, meshShape);
+}
+
+
+MStatus BoneToMeshCommand::createChainProxyMesh(
+    std::vector<BoneToMeshProjection> &projs, 
+    const MString &name, 
+    MObject &meshParent, 
+    MObject &meshShape
+) {
+    MStatus status;
+
+    MDagModifier dagMod;
+
+    meshParent = dagMod.createNode("transform", MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = dagMod.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = createChainMesh(params, projs, meshParent);
+    RETURN_IF_ERROR(status);
+
+    return this->nameProxyMesh(name, meshParent, meshShape);
+}
+
+
+MStatus BoneToMeshCommand::nameProxyMesh(const MString &name, MObject &meshParent, MObject &meshShape)
+{
+    MStatus status;
+
+    MDagModifier dagMod;
+
+    MDagPath parentTransform;
+    MDagPath::getAPathTo(meshParent, parentTransform);
+
+    MGlobal::executeCommand("sets -e -forceElement initialShadingGroup " + parentTransform.partialPathName());
+
+    parentTransform.extendToShape();
+    meshShape = MObject(parentTransform.node());
+    parentTransform.pop();
+
+    dagMod.renameNode(meshParent, name + "_Mesh");
+    dagMod.renameNode(meshShape, name + "_MeshShape");
+    status = dagMod.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    this->appendToResult(parentTransform.partialPathName());
+
+    return MStatus::kSuccess;
+}
+
+
+MStatus BoneToMeshCommand::findMirrorBone()
+{
+    MStatus status;
+
+    const char* sides[][2] = {
+        {"L_", "R_"}, {"_L", "_R"},
+        {"l_", "r_"}, {"_l", "_r"},
+        {"Lf", "Rt"}, {"lf", "rt"},
+        {"Left", "Right"}, {"left", "right"}
+    };
+
+    std::string boneName(MFnDependencyNode(this->boneObj).name().asChar());
+
+    for (const auto &side : sides)
+    {
+        for (int s = 0; s < 2; s++)
+        {
+            std::string token(side[s]);
+            std::string other(side[1 - s]);
+            std::string mirrorName(boneName);
+
+            size_t pos = mirrorName.find(token);
+
+            if (pos == std::string::npos) { continue; }
+
+            while (pos != std::string::npos)
+            {
+                mirrorName.replace(pos, token.length(), other);
+                pos = mirrorName.find(token, pos + other.length());
+            }
+
+            MSelectionList selection;
+            MObject mirrorObj;
+
+            if (selection.add(mirrorName.c_str()) && selection.getDependNode(0, mirrorObj))
+            {
+                if (mirrorObj != this->boneObj && mirrorObj.hasFn(MFn::kTransform))
+                {
+                    this->mirrorBoneObj = mirrorObj;
+                    return MStatus::kSuccess;
+                }
+            }
+        }
+    }
+
+    return MStatus::kNotFound;
+}
+
+
+// Walks up from the end bone to the bone, the chain is stored from the bone down.
+MStatus BoneToMeshCommand::findChainBones()
+{
+    MStatus status;
+
+    std::vector<MObject> chainBoneObjs;
+
+    MObject chainBoneObj = this->endBoneObj;
+
+    while (!chainBoneObj.isNull() && chainBoneObj.hasFn(MFn::kTransform))
+    {
+        chainBoneObjs.push_back(chainBoneObj);
+
+        if (chainBoneObj == this->boneObj)
+        {
+            this->chainBoneObjs.assign(chainBoneObjs.rbegin(), chainBoneObjs.rend());
+            return MStatus::kSuccess;
+        }
+
+        MFnDagNode fnChainBone(chainBoneObj, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        chainBoneObj = fnChainBone.parentCount() > 0 ? fnChainBone.parent(0) : MObject::kNullObj;
+    }
+
+    return MStatus::kNotFound;
+}
+
+
 MStatus BoneToMeshCommand::undoIt()
 {
     MStatus status;
@@ -493,6 +1023,30 @@ MStatus BoneToMeshCommand::undoIt()
     bool createdMesh = !undoCreatedMesh.isNull();
     bool createdNode = !undoCreatedNode.isNull();
 
+    for (MObject &chainMesh : this->undoCreatedChainMeshes)
+    {
+        MString deleteCmd("delete ^1s");
+        deleteCmd.format(
+            deleteCmd,
+            MFnDependencyNode(chainMesh).name()
+        );
+
+        status = MGlobal::executeCommand(deleteCmd);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    if (!undoCreatedMirrorMesh.isNull())
+    {
+        MString deleteCmd("delete ^1s");
+        deleteCmd.format(
+            deleteCmd,
+            MFnDependencyNode(undoCreatedMirrorMesh).name()
+        );
+
+        status = MGlobal::executeCommand(deleteCmd);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
     if (createdNode && createdMesh)
     {
         MString deleteCmd("delete ^1s ^2s");
@@ -8,6 +8,8 @@
 
 #include "boneToMesh.h"
 
+#include <vector>
+
 #include <maya/MArgDatabase.h>
 #include <maya/MArgList.h>
 #include <maya/MDagPath.h>
@@ -39,15 +41,26 @@ public:
 private:
     virtual void        help();
 
+    MStatus             createProxyMesh(BoneToMeshProjection &proj, const MString &name, MObject &meshParent, MObject &meshShape);
+    MStatus             createChainProxyMesh(std::vector<BoneToMeshProjection> &projs, const MString &name, MObject &meshParent, MObject &meshShape);
+    MStatus             nameProxyMesh(const MString &name, MObject &meshParent, MObject &meshShape);
+    MStatus             findChainBones();
+    MStatus             findMirrorBone();
+
 public:
     static MString      COMMAND_NAME;
 
 private:
-    MDagPath            inMesh;
-    MObject             components;
+    std::vector<MDagPath> inMeshes;
+    std::vector<MObject>  components;
 
     MString             axis;
     MObject             boneObj;
+    std::vector<MObject> chainBoneObjs;
+    MObject             endBoneObj;
+    MString             hitPolicy;
+    MObject             mirrorBoneObj;
+    MString             symmetry;
 
     BoneToMeshParams    params;
 
@@ -55,8 +68,11 @@ private:
     bool                showHelp = false;
     bool                useMaxDistance = false;
     bool                useWorldDirection = false;
+    bool                weld = false;
 
     MObject             undoCreatedMesh;
+    std::vector<MObject> undoCreatedChainMeshes;
+    MObject             undoCreatedMirrorMesh;
     MObject             undoCreatedNode;
 };
 
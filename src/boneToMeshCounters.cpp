@@ -0,0 +1,134 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshCounters.h"
+
+#ifdef __linux__
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* COUNTER_NAMES[COUNTERS] = {"cycles", "instructions", "cacheMisses", "branchMisses"};
+
+
+const char* counterName(int counter)
+{
+    return counter >= 0 && counter < COUNTERS ? COUNTER_NAMES[counter] : "";
+}
+
+
+#ifdef __linux__
+
+static const uint64_t COUNTER_EVENTS[COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+
+bool openCounters(BoneToMeshCounters &counters)
+{
+    bool opened = false;
+
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = COUNTER_EVENTS[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // This thread on any CPU. Each event on its own rather than in a
+        // group, so one the CPU lacks does not take the others with it.
+        counters.fds[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+
+        opened = opened || counters.fds[i] != -1;
+    }
+
+    return opened;
+}
+
+
+void closeCounters(BoneToMeshCounters &counters)
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        if (counters.fds[i] != -1) { close(counters.fds[i]); }
+
+        counters.fds[i] = -1;
+    }
+}
+
+
+void startCounters(BoneToMeshCounters &counters)
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        if (counters.fds[i] == -1) { continue; }
+
+        ioctl(counters.fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters.fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+
+void stopCounters(BoneToMeshCounters &counters, long long values[COUNTERS])
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        if (counters.fds[i] != -1) { ioctl(counters.fds[i], PERF_EVENT_IOC_DISABLE, 0); }
+    }
+
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        values[i] = -1;
+
+        uint64_t data[3];   // value, time enabled, time running
+
+        if (counters.fds[i] == -1 || read(counters.fds[i], data, sizeof(data)) != (ssize_t) sizeof(data)) { continue; }
+
+        if (data[2] == 0) { continue; }
+
+        values[i] = (long long) (double(data[0]) * (double(data[1]) / double(data[2])));
+    }
+}
+
+#else
+
+bool openCounters(BoneToMeshCounters &counters)
+{
+    return false;
+}
+
+
+void closeCounters(BoneToMeshCounters &counters)
+{
+}
+
+
+void startCounters(BoneToMeshCounters &counters)
+{
+}
+
+
+void stopCounters(BoneToMeshCounters &counters, long long values[COUNTERS])
+{
+    for (int i = 0; i < COUNTERS; i++) { values[i] = -1; }
+}
+
+#endif
@@ -0,0 +1,36 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_COUNTERS_H
+#define YANTOR_3D_BONE_TO_MESH_COUNTERS_H
+
+// Hardware events counted for the calling thread, in user space only.
+const int COUNTER_CYCLES        = 0;
+const int COUNTER_INSTRUCTIONS  = 1;
+const int COUNTER_CACHE_MISSES  = 2;   // last level cache
+const int COUNTER_BRANCH_MISSES = 3;
+const int COUNTERS              = 4;
+
+// Counters opened with perf_event_open on Linux. Elsewhere, or where the
+// kernel refuses them (perf_event_paranoid, virtual machines without a
+// PMU), they are never available and read as -1.
+struct BoneToMeshCounters
+{
+    int fds[COUNTERS] = {-1, -1, -1, -1};
+};
+
+// Returns false if none of the counters could be opened.
+bool openCounters(BoneToMeshCounters &counters);
+void closeCounters(BoneToMeshCounters &counters);
+
+// Counts from zero until stopCounters, which fills values with the count
+// of each event, or -1 for the ones that are not available. Counts the
+// kernel had to multiplex are scaled up to the whole time.
+void startCounters(BoneToMeshCounters &counters);
+void stopCounters(BoneToMeshCounters &counters, long long values[COUNTERS]);
+
+const char* counterName(int counter);
+
+#endif
@@ -0,0 +1,436 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBenchmark.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshEquivalence.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <maya/MFloatPoint.h>
+#include <maya/MFloatPointArray.h>
+#include <maya/MFloatVector.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
+#include <maya/MIntArray.h>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+
+const float MESH_FUZZ_TOLERANCE = 1e-5f;    // relative distance between filled points that still match
+const float NEAREST_TOLERANCE   = 1e-4f;    // relative distance to the surface the nearest fill may be off by
+
+const int MESH_FUZZ_LODS = 4;
+
+const short REFERENCE_FILL_NONE     = 0;
+const short REFERENCE_FILL_SHORTEST = 1;
+const short REFERENCE_FILL_LONGEST  = 2;
+const short REFERENCE_FILL_AVERAGE  = 3;
+const short REFERENCE_FILL_RADIUS   = 4;
+const short REFERENCE_FILL_NEAREST  = 5;
+
+
+// Rings of rays around a random bone, some of them hit at random lengths,
+// numbered in grid order as projectBoneToMesh leaves them.
+static void meshFuzzCase(std::mt19937 &generator, BoneToMeshParams &params, BoneToMeshProjection &proj)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> spokes(3, 24);
+    std::uniform_int_distribution<int> rings(1, 12);
+    std::uniform_int_distribution<int> ringKind(0, 3);
+    std::uniform_int_distribution<int> coin(0, 1);
+
+    params.subdivisionsX = (uint) spokes(generator);
+    params.subdivisionsY = (uint) rings(generator);
+
+    // Lengths between -1 and 0 wind as positive ones once truncated.
+    params.boneLength = 3.0 * unit(generator);
+    params.radius = 0.1 + (2.0 * std::abs(unit(generator)));
+
+    proj.reverseWinding = coin(generator) == 1;
+    proj.maxVertices = (int) (params.subdivisionsX * params.subdivisionsY);
+    proj.maxPolygons = proj.maxVertices;
+
+    proj.raySources.resize(params.subdivisionsY * 3);
+    proj.rayDirections.resize(proj.maxVertices * 3);
+    proj.indices.assign(proj.maxVertices, -1);
+    proj.points.assign(proj.maxVertices, MFloatPoint());
+    proj.vertexIndex = 0;
+
+    float origin[3] = {0.5f * unit(generator), 0.5f * unit(generator), 0.5f * unit(generator)};
+    float axis[3] = {unit(generator), unit(generator), unit(generator)};
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        for (int a = 0; a < 3; a++) { proj.raySources[(sh * 3) + a] = origin[a] + (axis[a] * float(sh) * 0.25f); }
+
+        // Rings missed entirely, hit entirely, and hit in part.
+        int kind = ringKind(generator);
+        float hitChance = kind == 0 ? 0.0f : (kind == 1 ? 1.0f : std::abs(unit(generator)));
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            int idx = (int) ((sh * params.subdivisionsX) + sa);
+
+            float *direction = &proj.rayDirections[idx * 3];
+            float length = 0.0f;
+
+            for (int a = 0; a < 3; a++)
+            {
+                direction[a] = unit(generator);
+                length += direction[a] * direction[a];
+            }
+
+            length = std::sqrt(std::max(length, 1e-6f));
+
+            for (int a = 0; a < 3; a++) { direction[a] /= length; }
+
+            if ((0.5f * (unit(generator) + 1.0f)) >= hitChance) { continue; }
+
+            float distance = 0.2f + (1.8f * std::abs(unit(generator)));
+            const float *source = &proj.raySources[sh * 3];
+
+            proj.indices[idx] = proj.vertexIndex++;
+            proj.points[idx] = MFloatPoint(
+                source[0] + (direction[0] * distance),
+                source[1] + (direction[1] * distance),
+                source[2] + (direction[2] * distance)
+            );
+        }
+    }
+}
+
+
+// The fill as it was written before the kernels: one loop over every vertex
+// switching on the method. The nearest surface fill stops at the guesses
+// the surface is searched around, which are left in guesses.
+static void referenceFill(BoneToMeshParams &params, BoneToMeshProjection &proj, std::vector<MFloatPoint> &guesses)
+{
+    if (params.fillPartialLoopsMethod == REFERENCE_FILL_NONE) { return; }
+
+    guesses.assign(proj.maxVertices, MFloatPoint());
+
+    bool nearest = params.fillPartialLoopsMethod == REFERENCE_FILL_NEAREST;
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        MFloatPoint raySource(proj.raySources[sh * 3], proj.raySources[(sh * 3) + 1], proj.raySources[(sh * 3) + 2]);
+
+        int numHits = 0;
+
+        float rayLength = params.fillPartialLoopsMethod == REFERENCE_FILL_SHORTEST ? FLT_MAX : 0.0f;
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            if (proj.indices[idx] != -1)
+            {
+                switch (params.fillPartialLoopsMethod)
+                {
+                    case REFERENCE_FILL_SHORTEST:
+                        rayLength = std::min(rayLength, (proj.points[idx] - raySource).length());
+                        break;
+                    case REFERENCE_FILL_LONGEST:
+                        rayLength = std::max(rayLength, (proj.points[idx] - raySource).length());
+                        break;
+                    case REFERENCE_FILL_AVERAGE:
+                    case REFERENCE_FILL_NEAREST:
+                        rayLength += (proj.points[idx] - raySource).length();
+                        break;
+                }
+
+                numHits++;
+            }
+        }
+
+        if (numHits == 0)
+        {
+            continue;
+        }
+
+        switch (params.fillPartialLoopsMethod)
+        {
+            case REFERENCE_FILL_AVERAGE: rayLength /= float(numHits); break;
+            case REFERENCE_FILL_NEAREST: rayLength /= float(numHits); break;
+            case REFERENCE_FILL_RADIUS:  rayLength = (float) params.radius; break;
+        }
+
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            if (proj.indices[idx] == -1)
+            {
+                const float *direction = &proj.rayDirections[idx * 3];
+
+                proj.indices[idx] = proj.vertexIndex++;
+                proj.points[idx] = raySource + (MFloatVector(direction[0], direction[1], direction[2]) * rayLength);
+
+                if (nearest) { guesses[idx] = proj.points[idx]; }
+            }
+        }
+    }
+
+    // Reset the vertex indices
+    proj.vertexIndex = 0;
+
+    for (uint sh = 0; sh < params.subdivisionsY; sh++)
+    {
+        for (uint sa = 0; sa < params.subdivisionsX; sa++)
+        {
+            uint idx = (sh * params.subdivisionsX) + sa;
+
+            if (proj.indices[idx] != -1)
+            {
+                proj.indices[idx] = proj.vertexIndex++;
+            }
+        }
+    }
+}
+
+
+static bool samePoint(const MFloatPoint &a, const MFloatPoint &b, float tolerance)
+{
+    float scale = std::max(1.0f, std::max(std::abs(a.x), std::max(std::abs(a.y), std::abs(a.z))));
+
+    return std::abs(a.x - b.x) <= tolerance * scale && std::abs(a.y - b.y) <= tolerance * scale && std::abs(a.z - b.z) <= tolerance * scale;
+}
+
+
+// Filled points of the nearest surface fill must be as far from their
+// guesses as the closest point of any triangle.
+static bool onNearestSurface(const BoneToMeshBVH &mesh, const MFloatPoint &guess, const MFloatPoint &point)
+{
+    float p[3] = {guess.x, guess.y, guess.z};
+
+    double best = DBL_MAX;
+
+    for (size_t tri = 0; tri < mesh.triangles.size() / 3; tri++)
+    {
+        const int *vtx = &mesh.triangles[tri * 3];
+
+        best = std::min(best, referenceTriangleDistance(p, &mesh.points[vtx[0] * 3], &mesh.points[vtx[1] * 3], &mesh.points[vtx[2] * 3]));
+    }
+
+    double distance = (point - guess).length();
+
+    return std::abs(distance - best) <= NEAREST_TOLERANCE * std::max(1.0, best);
+}
+
+
+static bool sameFill(
+    const BoneToMeshProjection &hits,
+    const BoneToMeshProjection &proj,
+    const BoneToMeshProjection &expected,
+    const std::vector<MFloatPoint> &guesses,
+    const BoneToMeshBVH &mesh,
+    bool nearest
+) {
+    if (proj.vertexIndex != expected.vertexIndex || proj.indices != expected.indices) { return false; }
+
+    for (int idx = 0; idx < expected.maxVertices; idx++)
+    {
+        if (expected.indices[idx] == -1) { continue; }
+
+        if (nearest && hits.indices[idx] == -1)
+        {
+            if (!onNearestSurface(mesh, guesses[idx], proj.points[idx])) { return false; }
+        } else if (!samePoint(proj.points[idx], expected.points[idx], MESH_FUZZ_TOLERANCE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// The quads of the original createMesh on the grid of the LOD, wound by
+// picking the corners with a multiply rather than a branch.
+static void referenceMeshArrays(BoneToMeshParams &params, BoneToMeshProjection &proj, uint lod, BoneToMeshArrays &arrays)
+{
+    uint strideX, strideY;
+    lodStrides(params, lod, strideX, strideY);
+
+    uint numX = params.subdivisionsX / strideX;
+    uint numY = params.subdivisionsY > 1 ? ((params.subdivisionsY - 1) / strideY) + 1 : 1;
+
+    std::vector<int> indices(numX * numY, -1);
+
+    arrays.points.clear();
+    arrays.polygonCounts.clear();
+    arrays.polygonConnects.clear();
+
+    // Face order - clockwise vs counter-clockwise
+    int cw = (int) (((int) params.boneLength >= 0) != proj.reverseWinding);
+    int cc = 1 - cw;
+
+    int numVertices = 0;
+
+    for (uint sh = 0; sh < numY; sh++)
+    {
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            uint idx = (sh * strideY * params.subdivisionsX) + (sa * strideX);
+
+            if (proj.indices[idx] != -1)
+            {
+                indices[(sh * numX) + sa] = numVertices++;
+
+                arrays.points.push_back(proj.points[idx].x);
+                arrays.points.push_back(proj.points[idx].y);
+                arrays.points.push_back(proj.points[idx].z);
+            }
+        }
+    }
+
+    for (uint sh = 0; sh + 1 < numY; sh++)
+    {
+        for (uint sa = 0; sa < numX; sa++)
+        {
+            uint na = (sa + 1) % numX;
+
+            int vtx0 = indices[(sh * numX) + sa];
+            int vtx1 = indices[(sh * numX) + na];
+            int vtx2 = indices[((sh + 1) * numX) + sa];
+            int vtx3 = indices[((sh + 1) * numX) + na];
+
+            if (vtx0 == -1 || vtx1 == -1 || vtx2 == -1 || vtx3 == -1) { continue; }
+
+            arrays.polygonCounts.push_back(4);
+            arrays.polygonConnects.push_back((vtx0 * cw) + (vtx0 * cc));
+            arrays.polygonConnects.push_back((vtx1 * cw) + (vtx2 * cc));
+            arrays.polygonConnects.push_back((vtx3 * cw) + (vtx3 * cc));
+            arrays.polygonConnects.push_back((vtx2 * cw) + (vtx1 * cc));
+        }
+    }
+}
+
+
+static bool sameArrays(const BoneToMeshArrays &a, const BoneToMeshArrays &b)
+{
+    return a.points == b.points && a.polygonCounts == b.polygonCounts && a.polygonConnects == b.polygonConnects;
+}
+
+
+// Corners of every face of the created mesh against the arrays it was made
+// from, by position, so the check holds however Maya numbers the vertices.
+static bool sameMesh(const MObject &meshData, const BoneToMeshArrays &arrays)
+{
+    MStatus status;
+
+    MFnMesh fnMesh(meshData, &status);
+    if (!status) { return false; }
+
+    MFloatPointArray points;
+    MIntArray polygonCounts;
+    MIntArray polygonConnects;
+
+    fnMesh.getPoints(points);
+    fnMesh.getVertices(polygonCounts, polygonConnects);
+
+    if (polygonCounts.length() != arrays.polygonCounts.size() || polygonConnects.length() != arrays.polygonConnects.size())
+    {
+        return false;
+    }
+
+    for (uint i = 0; i < polygonCounts.length(); i++)
+    {
+        if (polygonCounts[i] != arrays.polygonCounts[i]) { return false; }
+    }
+
+    for (uint i = 0; i < polygonConnects.length(); i++)
+    {
+        const float *expected = &arrays.points[arrays.polygonConnects[i] * 3];
+
+        if (!samePoint(points[polygonConnects[i]], MFloatPoint(expected[0], expected[1], expected[2]), 0.0f)) { return false; }
+    }
+
+    return true;
+}
+
+
+static void mismatch(BoneToMeshMeshFuzzReport &report, long long &count, int c)
+{
+    count++;
+
+    if (report.firstCase < 0) { report.firstCase = c; }
+}
+
+
+BoneToMeshMeshFuzzReport fuzzMeshEquivalence(int numCases, unsigned int seed)
+{
+    BoneToMeshMeshFuzzReport report;
+
+    for (int c = 0; c < numCases; c++)
+    {
+        std::mt19937 generator(seed + (unsigned int) c);
+        std::uniform_int_distribution<int> numTriangles(50, 500);
+
+        BoneToMeshParams params;
+        BoneToMeshProjection hits;
+
+        meshFuzzCase(generator, params, hits);
+
+        BoneToMeshBVH mesh;
+        benchmarkMesh(numTriangles(generator), mesh);
+
+        BoneToMeshScene scene;
+        updateSceneArrays(mesh.points.data(), (int) mesh.points.size() / 3, mesh.triangles.data(), (int) mesh.triangles.size() / 3, scene);
+
+        for (int method = 0; method < FUZZ_FILL_METHODS; method++)
+        {
+            params.fillPartialLoopsMethod = method;
+
+            BoneToMeshProjection proj = hits;
+            BoneToMeshProjection expected = hits;
+            std::vector<MFloatPoint> guesses;
+
+            fillPartialLoops(scene, params, proj);
+            referenceFill(params, expected, guesses);
+
+            if (!sameFill(hits, proj, expected, guesses, mesh, method == REFERENCE_FILL_NEAREST))
+            {
+                mismatch(report, report.fillMismatches[method], c);
+            }
+
+            // The topology only depends on which rays have points, so one
+            // mesh per fill is made from the arrays.
+            for (uint lod = 0; lod < (uint) MESH_FUZZ_LODS; lod++)
+            {
+                BoneToMeshArrays arrays;
+                BoneToMeshArrays reference;
+
+                lodMeshArrays(params, proj, lod, arrays);
+                referenceMeshArrays(params, proj, lod, reference);
+
+                if (!sameArrays(arrays, reference))
+                {
+                    mismatch(report, report.topologyMismatches, c);
+                }
+
+                if (lod != (uint) (c % MESH_FUZZ_LODS) || arrays.polygonCounts.empty()) { continue; }
+
+                MFnMeshData fnMeshData;
+                MObject meshData = fnMeshData.create();
+
+                if (!createLodMesh(params, proj, lod, meshData) || !sameMesh(meshData, arrays))
+                {
+                    mismatch(report, report.meshMismatches, c);
+                }
+            }
+        }
+
+        report.cases++;
+    }
+
+    return report;
+}
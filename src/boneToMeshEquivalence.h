@@ -0,0 +1,30 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_EQUIVALENCE_H
+#define YANTOR_3D_BONE_TO_MESH_EQUIVALENCE_H
+
+const int FUZZ_FILL_METHODS = 6;
+
+struct BoneToMeshMeshFuzzReport
+{
+    int cases = 0;
+
+    long long fillMismatches[FUZZ_FILL_METHODS] = {};   // projections filled unlike the reference
+    long long topologyMismatches = 0;                   // LOD arrays unlike the reference quads
+    long long meshMismatches     = 0;                   // meshes created unlike their arrays
+    int       firstCase          = -1;                  // first case with any mismatch
+};
+
+// Generates numCases random projections, with rings of every mix of hits
+// and misses, bones of either direction and both windings, and a mesh for
+// the nearest surface fill. Every fill method is compared with the loop
+// over every vertex it replaced, and the mesh arrays of each LOD with the
+// quad loop of the original createMesh: indices, polygon counts and
+// connects must match exactly, points within a relative tolerance. Case c
+// is generated from seed + c.
+BoneToMeshMeshFuzzReport fuzzMeshEquivalence(int numCases, unsigned int seed);
+
+#endif
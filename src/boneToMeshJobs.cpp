@@ -0,0 +1,257 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshJobs.h"
+#include "boneToMeshMemory.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MStatus.h>
+
+
+static bool isLowerPriority(const std::shared_ptr<BoneToMeshJob> &a, const std::shared_ptr<BoneToMeshJob> &b)
+{
+    if (a->priority != b->priority) { return a->priority < b->priority; }
+
+    return a->sequence > b->sequence;
+}
+
+
+BoneToMeshJobQueue::BoneToMeshJobQueue()
+{
+    this->memoryOwner = registerMemoryOwner([this](BoneToMeshMemoryUsage &usage) {
+        std::unique_lock<std::mutex> lock(this->sceneMutex, std::try_to_lock);
+
+        if (!lock.owns_lock()) { return false; }
+
+        this->scenes.clear();
+        this->sceneBytes = 0;
+
+        usage = BoneToMeshMemoryUsage();
+
+        return true;
+    });
+}
+
+
+BoneToMeshJobQueue::~BoneToMeshJobQueue()
+{
+    unregisterMemoryOwner(this->memoryOwner);
+}
+
+
+// Snapshot of the scene of the meshes, brought up to date and moved to
+// the front of the cache. Entries are keyed on the handles rather than
+// their hash codes, which different objects can share.
+static MStatus acquireScene(
+    BoneToMeshJobQueue &queue,
+    const std::vector<MObject> &inMeshes,
+    const std::vector<MObject> &components,
+    std::shared_ptr<const BoneToMeshScene> &scene
+) {
+    MStatus status;
+
+    std::vector<MObjectHandle> key;
+
+    for (size_t i = 0; i < inMeshes.size(); i++)
+    {
+        key.push_back(MObjectHandle(inMeshes[i]));
+        key.push_back(MObjectHandle(i < components.size() ? components[i] : MObject::kNullObj));
+    }
+
+    auto entry = std::find_if(
+        queue.scenes.begin(),
+        queue.scenes.end(),
+        [&key](const BoneToMeshJobScene &s) { return s.key == key; }
+    );
+
+    if (entry == queue.scenes.end())
+    {
+        queue.scenes.push_front(BoneToMeshJobScene());
+        queue.scenes.front().key = key;
+    } else {
+        queue.scenes.splice(queue.scenes.begin(), queue.scenes, entry);
+    }
+
+    BoneToMeshJobScene &jobScene = queue.scenes.front();
+
+    uint64_t version = jobScene.latest.version;
+
+    status = updateScene(inMeshes, components, jobScene.latest);
+
+    if (!status)
+    {
+        queue.sceneBytes -= jobScene.bytes;
+        queue.scenes.pop_front();
+        return status;
+    }
+
+    if (!jobScene.snapshot || jobScene.latest.version != version)
+    {
+        jobScene.snapshot = std::make_shared<const BoneToMeshScene>(jobScene.latest);
+    }
+
+    queue.sceneBytes -= jobScene.bytes;
+    jobScene.bytes = memoryScene(jobScene.latest) * 2;
+    queue.sceneBytes += jobScene.bytes;
+
+    scene = jobScene.snapshot;
+
+    // Reporting may evict the caches of other owners to make room for these.
+    BoneToMeshMemoryUsage usage;
+    usage.acceleration = queue.sceneBytes;
+
+    reportMemory(queue.memoryOwner, usage);
+
+    return MStatus::kSuccess;
+}
+
+
+// Projects the bone of the job on the scene it was submitted with.
+static void runJob(BoneToMeshJob &job, BoneToMeshJobResult &result)
+{
+    if (job.cancelled->load())
+    {
+        result.status = MStatus::kFailure;
+        result.cancelled = true;
+        return;
+    }
+
+    BoneToMeshProjection proj;
+    proj.cancelled = job.cancelled;
+
+    initializeProjection(job.boneMatrix, job.directionMatrix, job.params, proj);
+    projectionVectors(job.params, proj);
+    projectBoneToMesh(*job.scene, job.params, proj);
+
+    // The rays left untraced came back as misses.
+    if (job.cancelled->load())
+    {
+        result.status = MStatus::kFailure;
+        result.cancelled = true;
+        return;
+    }
+
+    fillPartialLoops(*job.scene, job.params, proj);
+    lodMeshArrays(job.params, proj, job.lod, result.mesh);
+}
+
+
+// Runs the highest priority pending job, which need not be the one this
+// task was queued for.
+static void runNextJob(std::shared_ptr<BoneToMeshJobQueue> queue)
+{
+    std::shared_ptr<BoneToMeshJob> job;
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        if (queue->pending.empty()) { return; }
+
+        std::pop_heap(queue->pending.begin(), queue->pending.end(), isLowerPriority);
+        job = queue->pending.back();
+        queue->pending.pop_back();
+    }
+
+    BoneToMeshJobResult result;
+
+    try
+    {
+        runJob(*job, result);
+
+        // An evicted scene is freed once the last job using it lets go.
+        job->scene.reset();
+
+        if (job->callback) { job->callback(result); }
+    } catch (...) {
+        job->scene.reset();
+        job->promise.set_exception(std::current_exception());
+        return;
+    }
+
+    job->promise.set_value(std::move(result));
+}
+
+
+MStatus submitJob(
+    const std::shared_ptr<BoneToMeshJobQueue> &queue,
+    const std::vector<MObject> &inMeshes,
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix,
+    const MMatrix &directionMatrix,
+    const BoneToMeshParams &params,
+    uint lod,
+    int priority,
+    const BoneToMeshJobCallback &callback,
+    BoneToMeshJobHandle &handle
+) {
+    MStatus status;
+
+    std::shared_ptr<BoneToMeshJob> job = std::make_shared<BoneToMeshJob>();
+    job->boneMatrix = boneMatrix;
+    job->directionMatrix = directionMatrix;
+    job->params = params;
+    job->lod = lod;
+    job->priority = priority;
+    job->cancelled = std::make_shared<std::atomic<bool>>(false);
+    job->callback = callback;
+
+    {
+        std::lock_guard<std::mutex> lock(queue->sceneMutex);
+
+        status = acquireScene(*queue, inMeshes, components, job->scene);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        job->sequence = queue->submitted++;
+
+        handle.result = job->promise.get_future().share();
+        handle.cancelled = job->cancelled;
+
+        queue->pending.push_back(job);
+        std::push_heap(queue->pending.begin(), queue->pending.end(), isLowerPriority);
+    }
+
+    std::shared_ptr<BoneToMeshJobQueue> jobQueue = queue;
+    runAsync([jobQueue]() { runNextJob(jobQueue); });
+
+    return MStatus::kSuccess;
+}
+
+
+void cancelJob(const BoneToMeshJobHandle &handle)
+{
+    if (handle.cancelled) { handle.cancelled->store(true); }
+}
+
+
+void cancelJobs(BoneToMeshJobQueue &queue)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    for (std::shared_ptr<BoneToMeshJob> &job : queue.pending)
+    {
+        job->cancelled->store(true);
+    }
+}
+
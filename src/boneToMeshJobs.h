@@ -0,0 +1,117 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_JOBS_H
+#define YANTOR_3D_BONE_TO_MESH_JOBS_H
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MStatus.h>
+
+struct BoneToMeshJobResult
+{
+    MStatus          status = MStatus::kSuccess;
+    bool             cancelled = false;
+    BoneToMeshArrays mesh;
+};
+
+typedef std::function<void(const BoneToMeshJobResult&)> BoneToMeshJobCallback;
+
+// Projection of one bone, run on the worker pool.
+struct BoneToMeshJob
+{
+    std::shared_ptr<const BoneToMeshScene> scene;
+
+    MMatrix          boneMatrix;
+    MMatrix          directionMatrix;
+    BoneToMeshParams params;
+    uint             lod = 0;
+
+    int              priority = 0;      // higher runs first
+    uint64_t         sequence = 0;      // submission order among equal priorities
+
+    std::shared_ptr<std::atomic<bool>>   cancelled;
+    std::promise<BoneToMeshJobResult>    promise;
+    BoneToMeshJobCallback                callback;
+};
+
+struct BoneToMeshJobHandle
+{
+    std::shared_future<BoneToMeshJobResult> result;
+    std::shared_ptr<std::atomic<bool>>      cancelled;
+};
+
+// Scene built for one set of input meshes, shared by every job submitted
+// for them. Jobs hold on to the snapshot they were submitted with, so it
+// is replaced rather than updated once the meshes change.
+struct BoneToMeshJobScene
+{
+    std::vector<MObjectHandle> key;         // the meshes and their components
+
+    BoneToMeshScene                        latest;
+    std::shared_ptr<const BoneToMeshScene> snapshot;
+
+    size_t bytes = 0;
+};
+
+// Jobs waiting for a worker, by priority, and the scenes of recently used
+// meshes. The scenes count towards the memory budget of the plugin, and
+// are dropped when other owners need the room; running jobs keep theirs
+// until they finish.
+struct BoneToMeshJobQueue
+{
+    BoneToMeshJobQueue();
+    ~BoneToMeshJobQueue();
+
+    std::mutex mutex;
+
+    std::vector<std::shared_ptr<BoneToMeshJob>> pending;    // heap by priority
+    uint64_t                                    submitted = 0;
+
+    // Guards the scenes, which are built while workers keep taking jobs.
+    std::mutex sceneMutex;
+
+    std::list<BoneToMeshJobScene> scenes;                   // most recently used first
+    size_t                        sceneBytes  = 0;
+    int                           memoryOwner = 0;
+};
+
+// Reads the meshes on the calling thread, then projects the bone on the
+// worker pool. The callback is called from the worker, before the result
+// is ready, and must not use the Maya API. If the projection or the callback
+// throws, the exception is rethrown by the result's get().
+MStatus submitJob(
+    const std::shared_ptr<BoneToMeshJobQueue> &queue,
+    const std::vector<MObject> &inMeshes,
+    const std::vector<MObject> &components,
+    const MMatrix &boneMatrix,
+    const MMatrix &directionMatrix,
+    const BoneToMeshParams &params,
+    uint lod,
+    int priority,
+    const BoneToMeshJobCallback &callback,
+    BoneToMeshJobHandle &handle
+);
+
+// A pending job finishes without running, a running one stops tracing.
+// Both come back with cancelled set. cancelJobs cancels every pending job.
+void cancelJob(const BoneToMeshJobHandle &handle);
+void cancelJobs(BoneToMeshJobQueue &queue);
+
+#endif
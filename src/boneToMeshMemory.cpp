@@ -0,0 +1,189 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshMemory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
+
+struct MemoryOwner
+{
+    BoneToMeshMemoryUsage   usage;
+    uint64_t                lastUsed = 0;
+    BoneToMeshEvictCallback evict;
+};
+
+struct MemoryRegistry
+{
+    MemoryRegistry()
+    {
+        const char* megabytes = std::getenv("BONE_TO_MESH_MEMORY_BUDGET");
+
+        if (megabytes != nullptr) { budget = size_t(std::max(0.0, std::atof(megabytes)) * 1024.0 * 1024.0); }
+    }
+
+    std::mutex mutex;
+
+    std::map<int, MemoryOwner> owners;
+    int                        nextOwner = 1;
+    uint64_t                   clock     = 0;
+
+    BoneToMeshMemoryUsage      total;
+    size_t                     budget = 0;
+};
+
+
+static MemoryRegistry& memoryRegistry()
+{
+    static MemoryRegistry registry;
+    return registry;
+}
+
+
+static void addUsage(BoneToMeshMemoryUsage &total, const BoneToMeshMemoryUsage &usage, bool subtract)
+{
+    if (subtract)
+    {
+        total.acceleration -= usage.acceleration;
+        total.hits -= usage.hits;
+        total.output -= usage.output;
+    } else {
+        total.acceleration += usage.acceleration;
+        total.hits += usage.hits;
+        total.output += usage.output;
+    }
+}
+
+
+// Evicts the least recently used caches other than those of keep until
+// the total fits in the budget, or nothing more can be evicted. Owners lock
+// themselves before they report, and only try to lock themselves when
+// evicted, so calling them with the registry locked cannot deadlock.
+static void evictOverBudget(MemoryRegistry &registry, int keep)
+{
+    std::set<int> tried;
+
+    while (registry.budget > 0 && registry.total.total() > registry.budget)
+    {
+        std::map<int, MemoryOwner>::iterator oldest = registry.owners.end();
+
+        for (auto it = registry.owners.begin(); it != registry.owners.end(); ++it)
+        {
+            if (it->first == keep || it->second.usage.caches() == 0 || tried.count(it->first) != 0) { continue; }
+
+            if (oldest == registry.owners.end() || it->second.lastUsed < oldest->second.lastUsed) { oldest = it; }
+        }
+
+        if (oldest == registry.owners.end()) { break; }
+
+        tried.insert(oldest->first);
+
+        BoneToMeshMemoryUsage usage = oldest->second.usage;
+
+        if (!oldest->second.evict || !oldest->second.evict(usage)) { continue; }
+
+        addUsage(registry.total, oldest->second.usage, true);
+        addUsage(registry.total, usage, false);
+
+        oldest->second.usage = usage;
+    }
+}
+
+
+int registerMemoryOwner(const BoneToMeshEvictCallback &evict)
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    int owner = registry.nextOwner++;
+
+    registry.owners[owner].evict = evict;
+    registry.owners[owner].lastUsed = ++registry.clock;
+
+    return owner;
+}
+
+
+void unregisterMemoryOwner(int owner)
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto it = registry.owners.find(owner);
+    if (it == registry.owners.end()) { return; }
+
+    addUsage(registry.total, it->second.usage, true);
+
+    registry.owners.erase(it);
+}
+
+
+void reportMemory(int owner, const BoneToMeshMemoryUsage &usage)
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto it = registry.owners.find(owner);
+    if (it == registry.owners.end()) { return; }
+
+    addUsage(registry.total, it->second.usage, true);
+    addUsage(registry.total, usage, false);
+
+    it->second.usage = usage;
+    it->second.lastUsed = ++registry.clock;
+
+    evictOverBudget(registry, owner);
+}
+
+
+BoneToMeshMemoryUsage totalMemoryUsage()
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    return registry.total;
+}
+
+
+int numMemoryOwners()
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    return (int) registry.owners.size();
+}
+
+
+size_t memoryBudget()
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    return registry.budget;
+}
+
+
+void setMemoryBudget(size_t bytes)
+{
+    MemoryRegistry &registry = memoryRegistry();
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.budget = bytes;
+
+    evictOverBudget(registry, 0);
+}
@@ -0,0 +1,45 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_MEMORY_H
+#define YANTOR_3D_BONE_TO_MESH_MEMORY_H
+
+#include <cstddef>
+#include <functional>
+
+// Bytes one owner holds. The caches can be dropped and built again, the
+// output meshes belong to Maya once they are handed over.
+struct BoneToMeshMemoryUsage
+{
+    size_t acceleration = 0;    // scenes, their trees and copies of the meshes
+    size_t hits         = 0;    // projections, hit buffers and rigid caches
+    size_t output       = 0;    // output meshes, estimated from their counts
+
+    size_t caches() const { return acceleration + hits; }
+    size_t total()  const { return acceleration + hits + output; }
+};
+
+// Drops the caches of an owner and sets usage to what it still holds. It
+// is called from whichever thread went over the budget, so an owner that
+// is busy returns false rather than wait.
+typedef std::function<bool(BoneToMeshMemoryUsage&)> BoneToMeshEvictCallback;
+
+int  registerMemoryOwner(const BoneToMeshEvictCallback &evict);
+void unregisterMemoryOwner(int owner);
+
+// Records what the owner holds and marks it the most recently used. While
+// the plugin then holds more than the budget, the caches of the least
+// recently used other owners are evicted.
+void reportMemory(int owner, const BoneToMeshMemoryUsage &usage);
+
+BoneToMeshMemoryUsage totalMemoryUsage();
+int                   numMemoryOwners();
+
+// Zero for no budget, which is the default unless the
+// BONE_TO_MESH_MEMORY_BUDGET environment variable sets one in megabytes.
+size_t memoryBudget();
+void   setMemoryBudget(size_t bytes);
+
+#endif
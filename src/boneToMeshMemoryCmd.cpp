@@ -0,0 +1,212 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#include "boneToMeshMemory.h"
+#include "boneToMeshMemoryCmd.h"
+
+#include <cstddef>
+
+#include <maya/MArgList.h>
+#include <maya/MArgDatabase.h>
+#include <maya/MGlobal.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+#include <maya/MSyntax.h>
+
+
+const char* MEMORY_ACCELERATION_FLAG = "-a";
+const char* MEMORY_ACCELERATION_LONG = "-acceleration";
+
+const char* MEMORY_BUDGET_FLAG = "-b";
+const char* MEMORY_BUDGET_LONG = "-budget";
+
+const char* MEMORY_HELP_FLAG = "-h";
+const char* MEMORY_HELP_LONG = "-help";
+
+const char* MEMORY_HITS_FLAG = "-hi";
+const char* MEMORY_HITS_LONG = "-hits";
+
+const char* MEMORY_NODES_FLAG = "-n";
+const char* MEMORY_NODES_LONG = "-nodes";
+
+const char* MEMORY_OUTPUT_FLAG = "-o";
+const char* MEMORY_OUTPUT_LONG = "-output";
+
+const double MEMORY_MEGABYTE = 1024.0 * 1024.0;
+
+
+void* BoneToMeshMemoryCommand::creator()
+{
+    return new BoneToMeshMemoryCommand();
+}
+
+
+void BoneToMeshMemoryCommand::help()
+{
+    MString helpMessage(
+        "\nboneToMeshMemory\n"
+        "\n"
+        "Returns the megabytes held by every boneToMesh node together: in total, in acceleration structures,\n"
+        "in cached hits and in output meshes. In query mode, returns only the value of the flag queried.\n"
+        "Once the total is over the budget, the caches of the least recently evaluated nodes are dropped\n"
+        "and built again when those nodes next evaluate.\n"
+        "\n"
+        "FLAGS\n"
+        "Long Name            Short Name   Argument Type(s)    Description\n"
+        "-acceleration        -a                               Query the megabytes held in scenes and acceleration structures.\n"
+        "-budget              -b           double              Megabytes the nodes may hold before caches are dropped, 0 for no budget.\n"
+        "                                                      Defaults to the BONE_TO_MESH_MEMORY_BUDGET environment variable.\n"
+        "-hits                -hi                              Query the megabytes held in projections and cached hits.\n"
+        "-nodes               -n                               Query the number of boneToMesh nodes.\n"
+        "-output              -o                               Query the megabytes held in output meshes.\n"
+    );
+
+    MGlobal::displayInfo(helpMessage);
+}
+
+
+MStatus BoneToMeshMemoryCommand::parseArguments(MArgDatabase &argsData)
+{
+    MStatus status;
+
+    // -help flag
+    if (argsData.isFlagSet(MEMORY_HELP_FLAG))
+    {
+        this->showHelp = true;
+        return MStatus::kSuccess;
+    } else {
+        this->showHelp = false;
+    }
+
+    this->query = argsData.isQuery();
+
+    this->queryAcceleration = argsData.isFlagSet(MEMORY_ACCELERATION_FLAG);
+    this->queryHits = argsData.isFlagSet(MEMORY_HITS_FLAG);
+    this->queryNodes = argsData.isFlagSet(MEMORY_NODES_FLAG);
+    this->queryOutput = argsData.isFlagSet(MEMORY_OUTPUT_FLAG);
+
+    // -budget flag
+    this->queryBudget = false;
+    this->setBudget = false;
+
+    if (argsData.isFlagSet(MEMORY_BUDGET_FLAG))
+    {
+        if (this->query)
+        {
+            this->queryBudget = true;
+        } else {
+            status = argsData.getFlagArgument(MEMORY_BUDGET_FLAG, 0, this->budget);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            if (this->budget < 0.0)
+            {
+                MGlobal::displayError("-budget/-b flag must be at least 0.");
+                return MStatus::kFailure;
+            }
+
+            this->setBudget = true;
+        }
+    }
+
+    if (!this->query && (this->queryAcceleration || this->queryHits || this->queryNodes || this->queryOutput))
+    {
+        MGlobal::displayError("The -acceleration, -hits, -nodes and -output flags are only used in query mode.");
+        return MStatus::kFailure;
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+MSyntax BoneToMeshMemoryCommand::getSyntax()
+{
+    MSyntax syntax;
+
+    syntax.addFlag(MEMORY_ACCELERATION_FLAG, MEMORY_ACCELERATION_LONG);
+    syntax.addFlag(MEMORY_BUDGET_FLAG, MEMORY_BUDGET_LONG, MSyntax::kDouble);
+    syntax.addFlag(MEMORY_HELP_FLAG, MEMORY_HELP_LONG, MSyntax::kBoolean);
+    syntax.addFlag(MEMORY_HITS_FLAG, MEMORY_HITS_LONG);
+    syntax.addFlag(MEMORY_NODES_FLAG, MEMORY_NODES_LONG);
+    syntax.addFlag(MEMORY_OUTPUT_FLAG, MEMORY_OUTPUT_LONG);
+
+    syntax.enableQuery(true);
+    syntax.enableEdit(false);
+
+    return syntax;
+}
+
+
+MStatus BoneToMeshMemoryCommand::doIt(const MArgList& argList)
+{
+    MStatus status;
+
+    MArgDatabase argsData(syntax(), argList, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = this->parseArguments(argsData);
+    if (!status) { return status; }
+
+    if (this->showHelp)
+    {
+        help();
+        return MStatus::kSuccess;
+    }
+
+    if (this->setBudget)
+    {
+        setMemoryBudget(size_t(this->budget * MEMORY_MEGABYTE));
+    }
+
+    BoneToMeshMemoryUsage usage = totalMemoryUsage();
+
+    if (this->query)
+    {
+        if (this->queryBudget)
+        {
+            this->setResult(double(memoryBudget()) / MEMORY_MEGABYTE);
+        } else if (this->queryAcceleration) {
+            this->setResult(double(usage.acceleration) / MEMORY_MEGABYTE);
+        } else if (this->queryHits) {
+            this->setResult(double(usage.hits) / MEMORY_MEGABYTE);
+        } else if (this->queryNodes) {
+            this->setResult(numMemoryOwners());
+        } else if (this->queryOutput) {
+            this->setResult(double(usage.output) / MEMORY_MEGABYTE);
+        } else {
+            this->setResult(double(usage.total()) / MEMORY_MEGABYTE);
+        }
+
+        return MStatus::kSuccess;
+    }
+
+    MString infoMsg("boneToMeshMemory: ");
+    infoMsg += numMemoryOwners();
+    infoMsg += " nodes hold ";
+    infoMsg += double(usage.total()) / MEMORY_MEGABYTE;
+    infoMsg += " MB, acceleration ";
+    infoMsg += double(usage.acceleration) / MEMORY_MEGABYTE;
+    infoMsg += " MB, hits ";
+    infoMsg += double(usage.hits) / MEMORY_MEGABYTE;
+    infoMsg += " MB, output ";
+    infoMsg += double(usage.output) / MEMORY_MEGABYTE;
+    infoMsg += " MB, budget ";
+
+    if (memoryBudget() == 0)
+    {
+        infoMsg += "none.";
+    } else {
+        infoMsg += double(memoryBudget()) / MEMORY_MEGABYTE;
+        infoMsg += " MB.";
+    }
+
+    MGlobal::displayInfo(infoMsg);
+
+    this->appendToResult(double(usage.total()) / MEMORY_MEGABYTE);
+    this->appendToResult(double(usage.acceleration) / MEMORY_MEGABYTE);
+    this->appendToResult(double(usage.hits) / MEMORY_MEGABYTE);
+    this->appendToResult(double(usage.output) / MEMORY_MEGABYTE);
+
+    return MStatus::kSuccess;
+}
@@ -0,0 +1,48 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_MEMORY_CMD_H
+#define YANTOR_3D_BONE_TO_MESH_MEMORY_CMD_H
+
+#include <maya/MArgDatabase.h>
+#include <maya/MArgList.h>
+#include <maya/MPxCommand.h>
+#include <maya/MString.h>
+#include <maya/MStatus.h>
+#include <maya/MSyntax.h>
+
+class BoneToMeshMemoryCommand : public MPxCommand
+{
+public:
+    static void*        creator();
+
+    static MSyntax      getSyntax();
+    virtual MStatus     parseArguments(MArgDatabase &argsData);
+
+    virtual MStatus     doIt(const MArgList& argList);
+
+    virtual bool        isUndoable() const { return false; }
+    virtual bool        hasSyntax()  const { return true; }
+
+private:
+    virtual void        help();
+
+public:
+    static MString      COMMAND_NAME;
+
+private:
+    double              budget = 0.0;
+    bool                setBudget = false;
+
+    bool                query = false;
+    bool                queryAcceleration = false;
+    bool                queryBudget = false;
+    bool                queryHits = false;
+    bool                queryNodes = false;
+    bool                queryOutput = false;
+    bool                showHelp = false;
+};
+
+#endif
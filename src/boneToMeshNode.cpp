@@ -6,16 +6,27 @@
 #define NOMINMAX
 
 #include "boneToMesh.h"
+#include "boneToMeshMemory.h"
 #include "boneToMeshNode.h"
+#include "boneToMeshProgressive.h"
 
 #include <algorithm>
 #include <cfloat>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include <maya/MArrayDataBuilder.h>
+#include <maya/MArrayDataHandle.h>
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
 #include <maya/MFn.h>
 #include <maya/MFnComponentListData.h>
+#include <maya/MFnCompoundAttribute.h>
 #include <maya/MFnData.h>
+#include <maya/MFnDependencyNode.h>
 #include <maya/MFnEnumAttribute.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnNumericData.h>
@@ -24,7 +35,6 @@
 #include <maya/MFnMesh.h>
 #include <maya/MFnMeshData.h>
 #include <maya/MFnSingleIndexedComponent.h>
-#include <maya/MGlobal.h>
 #include <maya/MIntArray.h>
 #include <maya/MMatrix.h>
 #include <maya/MObject.h>
@@ -32,89 +42,633 @@
 #include <maya/MPoint.h>
 #include <maya/MPointArray.h>
 #include <maya/MStatus.h>
+#include <maya/MString.h>
 
 // Input attributes
 MObject BoneToMeshNode::boneLength_attr;
 MObject BoneToMeshNode::boneMatrix_attr;
+MObject BoneToMeshNode::buildMethod_attr;
+MObject BoneToMeshNode::chainDirectionMatrices_attr;
+MObject BoneToMeshNode::chainMatrices_attr;
+MObject BoneToMeshNode::compactAcceleration_attr;
 MObject BoneToMeshNode::components_attr;
 MObject BoneToMeshNode::direction_attr;
 MObject BoneToMeshNode::directionMatrix_attr;
 MObject BoneToMeshNode::fillPartialLoops_attr;
+MObject BoneToMeshNode::hitIndex_attr;
+MObject BoneToMeshNode::hitPolicy_attr;
 MObject BoneToMeshNode::inMesh_attr;
+MObject BoneToMeshNode::inMeshes_attr;
+MObject BoneToMeshNode::lodCount_attr;
 MObject BoneToMeshNode::maxDistance_attr;
+MObject BoneToMeshNode::mirrorBoneMatrix_attr;
+MObject BoneToMeshNode::progressive_attr;
+MObject BoneToMeshNode::progressiveBudget_attr;
 MObject BoneToMeshNode::subdivisionsAxis_attr;
 MObject BoneToMeshNode::subdivisionsHeight_attr;
 MObject BoneToMeshNode::radius_attr;
+MObject BoneToMeshNode::refinement_attr;
+MObject BoneToMeshNode::rigidTolerance_attr;
+MObject BoneToMeshNode::symmetry_attr;
+MObject BoneToMeshNode::symmetryTolerance_attr;
 MObject BoneToMeshNode::useMaxDistance_attr;
 
 // Output attributes
+MObject BoneToMeshNode::activeBuildMethod_attr;
+MObject BoneToMeshNode::capsuleEnd_attr;
+MObject BoneToMeshNode::capsuleRadius_attr;
+MObject BoneToMeshNode::capsuleStart_attr;
+MObject BoneToMeshNode::memoryUsage_attr;
+MObject BoneToMeshNode::outCapsules_attr;
 MObject BoneToMeshNode::outMesh_attr;
+MObject BoneToMeshNode::outLods_attr;
+MObject BoneToMeshNode::outMirrorMesh_attr;
+MObject BoneToMeshNode::outRings_attr;
+MObject BoneToMeshNode::ringCenter_attr;
+MObject BoneToMeshNode::ringMajorAxis_attr;
+MObject BoneToMeshNode::ringMinorAxis_attr;
+MObject BoneToMeshNode::ringRadius_attr;
 
 
 const short X_AXIS = 0;
 const short Y_AXIS = 1;
 const short Z_AXIS = 2;
+
+const short SYMMETRY_NONE = 0;
+const short SYMMETRY_X    = 1;
+const short SYMMETRY_Y    = 2;
+const short SYMMETRY_Z    = 3;
+
+const double MEGABYTE = 1024.0 * 1024.0;
+
+
+// Points, face vertices and face counts, as a mesh would store them at the least.
+static size_t meshBytes(const MObject &mesh)
+{
+    if (mesh.isNull()) { return 0; }
+
+    MFnMesh fnMesh(mesh);
+
+    return (
+        (size_t(fnMesh.numVertices()) * 3 * sizeof(float)) + 
+        ((size_t(fnMesh.numFaceVertices()) + size_t(fnMesh.numPolygons())) * sizeof(int))
+    );
+}
    
 
+BoneToMeshNode::BoneToMeshNode()
+{
+    this->memoryOwner = registerMemoryOwner([this](BoneToMeshMemoryUsage &usage) { return this->releaseCaches(usage); });
+}
+
+
+BoneToMeshNode::~BoneToMeshNode()
+{
+    unregisterMemoryOwner(this->memoryOwner);
+
+    cancelRefinement(*this->progressive);
+}
+
+
+// Everything kept between evaluations, and the scene a background job is
+// refining on once this node has moved on from it. The projection the job
+// is refining into is left out, it is the size of the refined one.
+BoneToMeshMemoryUsage BoneToMeshNode::memoryUsage() const
+{
+    BoneToMeshMemoryUsage usage;
+
+    usage.acceleration = memoryScene(*this->scene) + memoryScene(this->mirrorScene);
+
+    if (this->spareScene) { usage.acceleration += memoryScene(*this->spareScene); }
+
+    usage.hits = (
+        memoryProjection(this->proj) + 
+        memoryProjection(this->mirrorProj) + 
+        memoryRigidCache(this->rigid)
+    );
+
+    for (const BoneToMeshProjection &chainProj : this->chainProjs)
+    {
+        usage.hits += memoryProjection(chainProj);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->progressive->mutex);
+
+        usage.hits += memoryProjection(this->progressive->front);
+
+        const BoneToMeshScene *refining = this->progressive->refining.get();
+
+        if (refining != nullptr && refining != this->scene.get() && refining != this->spareScene.get())
+        {
+            usage.acceleration += memoryScene(*refining);
+        }
+    }
+
+    usage.output = this->outputBytes;
+
+    return usage;
+}
+
+
+// Drops the scenes and the hits, which the next evaluation builds and
+// traces again. A refinement in progress keeps its scene until it is done.
+bool BoneToMeshNode::releaseCaches(BoneToMeshMemoryUsage &usage)
+{
+    std::unique_lock<std::mutex> lock(this->computeMutex, std::try_to_lock);
+
+    if (!lock.owns_lock()) { return false; }
+
+    this->scene = std::make_shared<BoneToMeshScene>();
+    this->spareScene.reset();
+    this->mirrorScene = BoneToMeshScene();
+    this->rigid = BoneToMeshRigidCache();
+
+    releaseHits(this->proj);
+    releaseHits(this->mirrorProj);
+
+    std::vector<BoneToMeshProjection>().swap(this->chainProjs);
+
+    usage = this->memoryUsage();
+
+    return true;
+}
+
+
+// The scene to update and trace in this evaluation. A request still waiting
+// for the refinement job is replaced by this evaluation, so it is dropped 
+// first. The only other hold on a scene is then the job tracing it.
+BoneToMeshScene& BoneToMeshNode::writableScene()
+{
+    withdrawRefinement(*this->progressive);
+
+    if (this->scene.use_count() > 1)
+    {
+        if (!this->spareScene || this->spareScene.use_count() > 1)
+        {
+            this->spareScene = std::make_shared<BoneToMeshScene>();
+        }
+
+        std::swap(this->scene, this->spareScene);
+    }
+
+    return *this->scene;
+}
+
+
+MStatus BoneToMeshNode::setColliders(
+    MDataBlock &dataBlock,
+    const std::vector<BoneToMeshRing> &rings,
+    const std::vector<BoneToMeshCapsule> &capsules
+) {
+    MStatus status;
+
+    MArrayDataHandle outRingsHandle = dataBlock.outputArrayValue(outRings_attr);
+    MArrayDataBuilder outRingsBuilder(&dataBlock, outRings_attr, (uint) rings.size(), &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    for (uint i = 0; i < (uint) rings.size(); i++)
+    {
+        const BoneToMeshRing &ring = rings[i];
+
+        MDataHandle ringHandle = outRingsBuilder.addElement(i, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        ringHandle.child(ringCenter_attr).set3Float(ring.center.x, ring.center.y, ring.center.z);
+        ringHandle.child(ringRadius_attr).setDouble(ring.radius);
+        ringHandle.child(ringMajorAxis_attr).set3Float(ring.majorAxis.x, ring.majorAxis.y, ring.majorAxis.z);
+        ringHandle.child(ringMinorAxis_attr).set3Float(ring.minorAxis.x, ring.minorAxis.y, ring.minorAxis.z);
+    }
+
+    status = outRingsHandle.set(outRingsBuilder);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    outRingsHandle.setAllClean();
+
+    MArrayDataHandle outCapsulesHandle = dataBlock.outputArrayValue(outCapsules_attr);
+    MArrayDataBuilder outCapsulesBuilder(&dataBlock, outCapsules_attr, (uint) capsules.size(), &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    for (uint i = 0; i < (uint) capsules.size(); i++)
+    {
+        const BoneToMeshCapsule &capsule = capsules[i];
+
+        MDataHandle capsuleHandle = outCapsulesBuilder.addElement(i, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        capsuleHandle.child(capsuleStart_attr).set3Float(capsule.start.x, capsule.start.y, capsule.start.z);
+        capsuleHandle.child(capsuleEnd_attr).set3Float(capsule.end.x, capsule.end.y, capsule.end.z);
+        capsuleHandle.child(capsuleRadius_attr).setDouble(capsule.radius);
+    }
+
+    status = outCapsulesHandle.set(outCapsulesBuilder);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    outCapsulesHandle.setAllClean();
+
+    return MStatus::kSuccess;
+}
+
+
 MStatus BoneToMeshNode::compute(const MPlug &plug, MDataBlock &dataBlock)
 {
     MStatus status;
 
-    if (plug != outMesh_attr) { 
+    MPlug outPlug = plug.isChild() ? plug.parent() : plug;
+    outPlug = outPlug.isElement() ? outPlug.array() : outPlug;
+
+    if (
+        outPlug != outMesh_attr && outPlug != outLods_attr && outPlug != outMirrorMesh_attr &&
+        outPlug != outRings_attr && outPlug != outCapsules_attr && outPlug != activeBuildMethod_attr &&
+        outPlug != memoryUsage_attr
+    ) { 
         return MStatus::kUnknownParameter;
     }
 
+    // Everything compute keeps between evaluations belongs to this node, so 
+    // nodes evaluate in parallel, but one node evaluates one plug at a time.
+    std::lock_guard<std::mutex> lock(this->computeMutex);
+
     BoneToMeshParams params;
 
+    // The projection is kept between evaluations so its cached tables can be reused.
+    BoneToMeshProjection &proj = this->proj;
+
     MObject inMesh             = dataBlock.inputValue(inMesh_attr).data();
     MMatrix boneMatrix         = MFnMatrixData(dataBlock.inputValue(boneMatrix_attr).data()).matrix();
     MObject componentsList     = dataBlock.inputValue(components_attr).data();
     MMatrix directionMatrix    = MFnMatrixData(dataBlock.inputValue(directionMatrix_attr).data()).matrix();
+    MObject mirrorBoneData     = dataBlock.inputValue(mirrorBoneMatrix_attr).data();
 
     MObject components = this->unpackComponentList(componentsList);
 
+    // The components only apply to inMesh, every element of inMeshes is used whole.
+    std::vector<MObject> inMeshes;
+    std::vector<MObject> meshComponents;
+
+    if (!inMesh.isNull())
+    {
+        inMeshes.push_back(inMesh);
+        meshComponents.push_back(components);
+    }
+
+    MArrayDataHandle inMeshesHandle = dataBlock.inputArrayValue(inMeshes_attr);
+    uint numInMeshes = inMeshesHandle.elementCount();
+
+    for (uint i = 0; i < numInMeshes; i++)
+    {
+        inMeshesHandle.jumpToArrayElement(i);
+
+        MObject mesh = inMeshesHandle.inputValue().data();
+
+        if (!mesh.isNull() && mesh.hasFn(MFn::kMesh))
+        {
+            inMeshes.push_back(mesh);
+            meshComponents.push_back(MObject::kNullObj);
+        }
+    }
+
+    // The bones following this one down a chain, which are welded into outMesh.
+    // Bones without a direction matrix cast their rays in their own space.
+    std::vector<MMatrix> chainMatrices(1, boneMatrix);
+    std::vector<MMatrix> chainDirectionMatrices(1, directionMatrix);
+
+    MArrayDataHandle chainMatricesHandle = dataBlock.inputArrayValue(chainMatrices_attr);
+    MArrayDataHandle chainDirectionMatricesHandle = dataBlock.inputArrayValue(chainDirectionMatrices_attr);
+    uint numChainMatrices = chainMatricesHandle.elementCount();
+
+    for (uint i = 0; i < numChainMatrices; i++)
+    {
+        chainMatricesHandle.jumpToArrayElement(i);
+
+        MObject matrixData = chainMatricesHandle.inputValue().data();
+
+        if (matrixData.isNull()) { continue; }
+
+        MMatrix chainMatrix = MFnMatrixData(matrixData).matrix();
+        MMatrix chainDirectionMatrix = chainMatrix;
+
+        if (chainDirectionMatricesHandle.jumpToElement(chainMatricesHandle.elementIndex()))
+        {
+            MObject directionData = chainDirectionMatricesHandle.inputValue().data();
+
+            if (!directionData.isNull()) { chainDirectionMatrix = MFnMatrixData(directionData).matrix(); }
+        }
+
+        chainMatrices.push_back(chainMatrix);
+        chainDirectionMatrices.push_back(chainDirectionMatrix);
+    }
+
+    bool chain = chainMatrices.size() > 1;
+
     bool useMaxDistance           = dataBlock.inputValue(useMaxDistance_attr).asBool();
+    uint lodCount                 = (uint) std::max(0, dataBlock.inputValue(lodCount_attr).asLong());
 
     params.boneLength             = (float) dataBlock.inputValue(boneLength_attr).asDouble();
     params.direction              = dataBlock.inputValue(direction_attr).asShort();
     params.fillPartialLoopsMethod = dataBlock.inputValue(fillPartialLoops_attr).asShort();
+    params.hitIndex               = std::max(1, std::min(HIT_MAX_NTH, dataBlock.inputValue(hitIndex_attr).asLong()));
+    params.hitPolicy              = dataBlock.inputValue(hitPolicy_attr).asShort();
     params.maxDistance            = (float) (useMaxDistance ? (dataBlock.inputValue(maxDistance_attr).asDouble()) : DBL_MAX);
     params.radius                 = (float) dataBlock.inputValue(radius_attr).asDouble();
     params.subdivisionsX          = (uint) std::max(4, dataBlock.inputValue(subdivisionsAxis_attr).asLong());
     params.subdivisionsY          = (uint) std::max(2, dataBlock.inputValue(subdivisionsHeight_attr).asLong());
+    params.symmetry               = dataBlock.inputValue(symmetry_attr).asShort();
+    params.symmetryTolerance      = dataBlock.inputValue(symmetryTolerance_attr).asDouble();
 
+    int buildMethod               = dataBlock.inputValue(buildMethod_attr).asShort();
+    bool compactAcceleration      = dataBlock.inputValue(compactAcceleration_attr).asBool();
+    double rigidTolerance         = dataBlock.inputValue(rigidTolerance_attr).asDouble();
+    bool progressive              = dataBlock.inputValue(progressive_attr).asBool();
+    double progressiveBudget      = dataBlock.inputValue(progressiveBudget_attr).asDouble();
 
-    MDataHandle outMeshHandle = dataBlock.outputValue(outMesh_attr);
+    // Only tells the node that a refinement is ready.
+    dataBlock.inputValue(refinement_attr);
+
+    BoneToMeshScene &scene = this->writableScene();
+
+    scene.buildMethod             = buildMethod;
+    scene.compact                 = compactAcceleration;
+    scene.rays                    = int(params.subdivisionsX * params.subdivisionsY * chainMatrices.size());
+    this->mirrorScene.buildMethod = buildMethod;
+    this->mirrorScene.compact     = compactAcceleration;
+    this->mirrorScene.rays        = int(params.subdivisionsX * params.subdivisionsY);
+
+
+    // Only the mesh being evaluated is built. The others are left dirty, so
+    // each is built when it is evaluated in turn. Which of them is read is
+    // not asked of the graph, as compute only touches its data block.
+    bool buildMesh       = outPlug == outMesh_attr;
+    bool buildLods       = outPlug == outLods_attr;
+    bool buildMirrorMesh = outPlug == outMirrorMesh_attr;
 
     MFnMeshData outMeshData;
-    MObject outMesh = outMeshData.create(&status);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MObject outMesh;
+
+    if (buildMesh)
+    {
+        outMesh = outMeshData.create(&status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
    
-    if (inMesh.isNull())
+    // Set when the meshes moved rigidly with the bone, in which case the scene 
+    // is left as it was and the previous projection is carried along.
+    bool rigidMotion = false;
+
+    if (inMeshes.empty())
     {
         return MStatus::kFailure;
+    } else if (chain) {
+        status = updateScene(inMeshes, meshComponents, scene);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        status = boneToMeshChain(scene, chainMatrices, chainDirectionMatrices, params, this->chainProjs);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        if (buildMesh)
+        {
+            status = createChainMesh(params, this->chainProjs, outMesh);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        }
     } else {
-        status = boneToMesh(
-            inMesh, 
-            components,
-            boneMatrix, 
-            directionMatrix,
-            params,
-            outMesh
-        );
+        BoneToMeshRigidState state;
+
+        status = rigidState(inMeshes, meshComponents, boneMatrix, directionMatrix, params, state);
         CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        rigidMotion = isRigidMotion(this->rigid, state, rigidTolerance);
+
+        if (!progressive) { cancelRefinement(*this->progressive); }
+
+        if (rigidMotion)
+        {
+            // Every LOD is assembled from the same full resolution hit buffer.
+            // The rays are not traced, but the ring fits and the mirror read
+            // them, so they are placed on the new bone all the same.
+            initializeProjection(boneMatrix, directionMatrix, params, proj);
+            projectionVectors(params, proj);
+            applyRigidProjection(this->rigid, proj);
+        } else {
+            status = updateScene(inMeshes, meshComponents, scene);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            // In progressive mode a grid that fits in the budget is shown 
+            // until the full resolution one is refined in the background.
+            bool refined = false;
+            bool coarse = false;
+
+            if (progressive)
+            {
+                BoneToMeshRefineRequest request;
+                request.params = params;
+                request.boneMatrix = boneMatrix;
+                request.directionMatrix = directionMatrix;
+                request.sceneVersion = scene.version;
+
+                refined = refinedProjection(*this->progressive, request, proj);
+
+                if (!refined)
+                {
+                    BoneToMeshParams coarseParams = progressiveParams(*this->progressive, params, progressiveBudget);
+
+                    coarse = !sameParams(coarseParams, params);
+
+                    if (coarse)
+                    {
+                        MString dirtyCommand("dgdirty ");
+                        dirtyCommand += MFnDependencyNode(this->thisMObject()).name() + ".refinement";
+
+                        requestRefinement(this->progressive, this->scene, request, dirtyCommand);
+
+                        params = coarseParams;
+                    }
+                }
+            }
+
+            if (!refined)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                initializeProjection(boneMatrix, directionMatrix, params, proj);
+                projectionVectors(params, proj);
+                projectBoneToMesh(scene, params, proj);
+                fillPartialLoops(scene, params, proj);
+
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+                if (progressive) { measureRayRate(*this->progressive, proj.maxVertices, elapsed.count()); }
+            }
+
+            // The coarse grid is not kept, so it is never carried along rigidly.
+            if (!coarse)
+            {
+                storeRigidProjection(state, proj, this->rigid);
+            }
+        }
+
+        if (buildMesh)
+        {
+            status = createMesh(params, proj, outMesh);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        }
     }
 
-    if (outMesh.isNull())
+    // The colliders are fitted straight from the points of the rings. Each 
+    // bone of a chain has a capsule, and rings shared by two bones are 
+    // output once.
+    std::vector<BoneToMeshRing> rings;
+    std::vector<BoneToMeshCapsule> capsules;
+
+    if (chain)
     {
-        MGlobal::displayError("boneToMesh projection failed.");
-        return MStatus::kFailure;
+        std::vector<BoneToMeshRing> boneRings;
+
+        for (size_t b = 0; b < this->chainProjs.size(); b++)
+        {
+            fitRings(params, this->chainProjs[b], boneRings);
+            capsules.push_back(fitCapsule(params, this->chainProjs[b], boneRings));
+
+            bool shared = b > 0 && !this->chainProjs[b].jointSpokes.empty();
+
+            rings.insert(rings.end(), boneRings.begin() + (shared ? 1 : 0), boneRings.end());
+        }
     } else {
+        fitRings(params, proj, rings);
+        capsules.push_back(fitCapsule(params, proj, rings));
+    }
+
+    status = this->setColliders(dataBlock, rings, capsules);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // The build method each input mesh was last built with, which is the 
+    // one the cost model chose when buildMethod is automatic.
+    MArrayDataHandle activeBuildMethodHandle = dataBlock.outputArrayValue(activeBuildMethod_attr);
+    MArrayDataBuilder activeBuildMethodBuilder(&dataBlock, activeBuildMethod_attr, (uint) scene.meshes.size(), &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    for (uint i = 0; i < (uint) scene.meshes.size(); i++)
+    {
+        MDataHandle methodHandle = activeBuildMethodBuilder.addElement(i, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        methodHandle.setShort((short) scene.meshes[i].buildMethod);
+    }
+
+    status = activeBuildMethodHandle.set(activeBuildMethodBuilder);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    activeBuildMethodHandle.setAllClean();
+
+    // Failures are returned rather than displayed, compute may run on any thread.
+    if (buildMesh)
+    {
+        if (outMesh.isNull())
+        {
+            return MStatus::kFailure;
+        }
+
+        MDataHandle outMeshHandle = dataBlock.outputValue(outMesh_attr);
+
         status = outMeshHandle.setMObject(outMesh);    
         CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        outMeshHandle.setClean();
+    }
+
+    size_t outputBytes = meshBytes(outMesh);
+
+    if (buildLods)
+    {
+        MArrayDataHandle outLodsHandle = dataBlock.outputArrayValue(outLods_attr);
+        MArrayDataBuilder outLodsBuilder(&dataBlock, outLods_attr, lodCount, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        for (uint lod = 0; lod < lodCount; lod++)
+        {
+            MObject outLod = outMeshData.create(&status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            status = chain
+                ? createLodChainMesh(params, this->chainProjs, lod + 1, outLod)
+                : createLodMesh(params, proj, lod + 1, outLod);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            MDataHandle outLodHandle = outLodsBuilder.addElement(lod, &status);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            status = outLodHandle.setMObject(outLod);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            outputBytes += meshBytes(outLod);
+        }
+
+        status = outLodsHandle.set(outLodsBuilder);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        outLodsHandle.setAllClean();
+    }
+
+    MObject outMirrorMesh;
+
+    if (buildMirrorMesh)
+    {
+        MDataHandle outMirrorMeshHandle = dataBlock.outputValue(outMirrorMesh_attr);
+
+        outMirrorMesh = outMeshData.create(&status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // Chains are not mirrored.
+        if (params.symmetry != SYMMETRY_NONE && !chain)
+        {
+            BoneToMeshProjection &mirrorProj = this->mirrorProj;
+
+            // Without a mirror bone the proxy is mirrored onto the reflection of this bone.
+            MMatrix reflection = symmetryMatrix(params.symmetry);
+            MMatrix mirrorBoneMatrix = mirrorBoneData.isNull() 
+                ? reflection * boneMatrix * reflection 
+                : MFnMatrixData(mirrorBoneData).matrix();
+
+            // Mirroring and the fallback trace both need the whole meshes.
+            BoneToMeshScene* mirrorScene = &scene;
+
+            if (components.isNull() && rigidMotion)
+            {
+                status = updateScene(inMeshes, meshComponents, scene);
+                CHECK_MSTATUS_AND_RETURN_IT(status);
+            } else if (!components.isNull()) {
+                std::vector<MObject> noComponents;
+
+                status = updateScene(inMeshes, noComponents, this->mirrorScene);
+                CHECK_MSTATUS_AND_RETURN_IT(status);
+
+                mirrorScene = &this->mirrorScene;
+            }
+
+            bool mirrored;
+
+            status = boneToMeshMirror(*mirrorScene, mirrorBoneMatrix, params, proj, mirrorProj, mirrored);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            status = createMesh(params, mirrorProj, outMirrorMesh);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+        }
+
+        status = outMirrorMeshHandle.setMObject(outMirrorMesh);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        outMirrorMeshHandle.setClean();
     }
-    
-    outMeshHandle.setClean();
+
+    this->outputBytes = outputBytes + meshBytes(outMirrorMesh);
+
+    // Reporting may evict the caches of other nodes to make room for these.
+    BoneToMeshMemoryUsage usage = this->memoryUsage();
+
+    reportMemory(this->memoryOwner, usage);
+
+    MDataHandle memoryUsageHandle = dataBlock.outputValue(memoryUsage_attr);
+    memoryUsageHandle.setDouble(double(usage.total()) / MEGABYTE);
+    memoryUsageHandle.setClean();
 
     return MStatus::kSuccess;
 }
@@ -157,6 +711,7 @@ MStatus BoneToMeshNode::initialize()
 {
     MStatus status;
 
+    MFnCompoundAttribute compoundAttr;
     MFnEnumAttribute enumAttr;
     MFnNumericAttribute numAttr;
     MFnTypedAttribute typedAttr;
@@ -164,6 +719,11 @@ MStatus BoneToMeshNode::initialize()
     inMesh_attr = typedAttr.create("inMesh", "im", MFnData::kMesh, MObject::kNullObj, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    inMeshes_attr = typedAttr.create("inMeshes", "ims", MFnData::kMesh, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    typedAttr.setArray(true);
+    typedAttr.setIndexMatters(false);
+
     components_attr = typedAttr.create("components", "c", MFnData::kComponentList, MObject::kNullObj, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -173,6 +733,17 @@ MStatus BoneToMeshNode::initialize()
     directionMatrix_attr = typedAttr.create("directionMatrix", "dm", MFnData::kMatrix, MObject::kNullObj, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    mirrorBoneMatrix_attr = typedAttr.create("mirrorBoneMatrix", "mbm", MFnData::kMatrix, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    chainMatrices_attr = typedAttr.create("chainMatrices", "chm", MFnData::kMatrix, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    typedAttr.setArray(true);
+
+    chainDirectionMatrices_attr = typedAttr.create("chainDirectionMatrices", "cdm", MFnData::kMatrix, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    typedAttr.setArray(true);
+
     boneLength_attr = numAttr.create("boneLength", "len",  MFnNumericData::kDouble, 1.0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
     numAttr.setKeyable(true);
@@ -192,8 +763,23 @@ MStatus BoneToMeshNode::initialize()
     enumAttr.addField("Longest",  2);
     enumAttr.addField("Average",  3);
     enumAttr.addField("Radius",   4);
+    enumAttr.addField("Nearest Surface", 5);
     enumAttr.setKeyable(true);
 
+    hitPolicy_attr = enumAttr.create("hitPolicy", "hp", HIT_NEAREST, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    enumAttr.addField("Nearest",            HIT_NEAREST);
+    enumAttr.addField("Farthest",           HIT_FARTHEST);
+    enumAttr.addField("Nth",                HIT_NTH);
+    enumAttr.addField("First Front Facing", HIT_FRONT_FACING);
+    enumAttr.setKeyable(true);
+
+    hitIndex_attr = numAttr.create("hitIndex", "hi", MFnNumericData::kLong, 1, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setMin(1);
+    numAttr.setMax(HIT_MAX_NTH);
+    numAttr.setKeyable(true);
+
     radius_attr = numAttr.create("radius", "r", MFnNumericData::kDouble, 1.0, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
     numAttr.setMin(0.0);
@@ -220,37 +806,348 @@ MStatus BoneToMeshNode::initialize()
     CHECK_MSTATUS_AND_RETURN_IT(status);
     numAttr.setKeyable(true);
 
+    symmetry_attr = enumAttr.create("symmetry", "sym", SYMMETRY_NONE, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    enumAttr.addField("None", SYMMETRY_NONE);
+    enumAttr.addField("X",    SYMMETRY_X);
+    enumAttr.addField("Y",    SYMMETRY_Y);
+    enumAttr.addField("Z",    SYMMETRY_Z);
+    enumAttr.setKeyable(true);
+
+    symmetryTolerance_attr = numAttr.create("symmetryTolerance", "st", MFnNumericData::kDouble, 0.001, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setMin(0.0);
+    numAttr.setKeyable(true);
+
+    rigidTolerance_attr = numAttr.create("rigidTolerance", "rgt", MFnNumericData::kDouble, 0.0001, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setMin(0.0);
+    numAttr.setKeyable(true);
+
+    // Automatic chooses per mesh and evaluation from a cost model of the 
+    // triangles and rays, the others override it.
+    buildMethod_attr = enumAttr.create("buildMethod", "bld", BVH_BUILD_AUTOMATIC, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    enumAttr.addField("SAH",         BVH_BUILD_SAH);
+    enumAttr.addField("Morton",      BVH_BUILD_MORTON);
+    enumAttr.addField("Brute Force", BVH_BUILD_BRUTE_FORCE);
+    enumAttr.addField("Automatic",   BVH_BUILD_AUTOMATIC);
+
+    compactAcceleration_attr = numAttr.create("compactAcceleration", "cpa", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    progressive_attr = numAttr.create("progressive", "prg", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setKeyable(true);
+
+    progressiveBudget_attr = numAttr.create("progressiveBudget", "prb", MFnNumericData::kDouble, 10.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setMin(0.0);
+    numAttr.setKeyable(true);
+
+    refinement_attr = numAttr.create("refinement", "rfn", MFnNumericData::kLong, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setHidden(true);
+    numAttr.setStorable(false);
+
+    lodCount_attr = numAttr.create("lodCount", "lc", MFnNumericData::kLong, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setMin(0);
+    numAttr.setKeyable(true);
+
+    activeBuildMethod_attr = enumAttr.create("activeBuildMethod", "abm", BVH_BUILD_SAH, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    enumAttr.addField("SAH",         BVH_BUILD_SAH);
+    enumAttr.addField("Morton",      BVH_BUILD_MORTON);
+    enumAttr.addField("Brute Force", BVH_BUILD_BRUTE_FORCE);
+    enumAttr.setArray(true);
+    enumAttr.setUsesArrayDataBuilder(true);
+    enumAttr.setStorable(false);
+    enumAttr.setWritable(false);
+
+    // Megabytes the node holds as of its latest evaluation.
+    memoryUsage_attr = numAttr.create("memoryUsage", "mu", MFnNumericData::kDouble, 0.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+    numAttr.setWritable(false);
+
     outMesh_attr = typedAttr.create("outMesh", "om", MFnData::kMesh, MObject::kNullObj, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
     typedAttr.setStorable(false);
 
+    outLods_attr = typedAttr.create("outLods", "ol", MFnData::kMesh, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    typedAttr.setArray(true);
+    typedAttr.setUsesArrayDataBuilder(true);
+    typedAttr.setStorable(false);
+
+    outMirrorMesh_attr = typedAttr.create("outMirrorMesh", "omm", MFnData::kMesh, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    typedAttr.setStorable(false);
+
+    // Collider primitives fitted to each ring, for simulations that do not 
+    // need the mesh. The axes are the semi-axes of the fitted ellipse.
+    ringCenter_attr = numAttr.createPoint("ringCenter", "rce", &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    ringRadius_attr = numAttr.create("ringRadius", "rra", MFnNumericData::kDouble, 0.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    ringMajorAxis_attr = numAttr.create("ringMajorAxis", "rma", MFnNumericData::k3Float, 0.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    ringMinorAxis_attr = numAttr.create("ringMinorAxis", "rmi", MFnNumericData::k3Float, 0.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    outRings_attr = compoundAttr.create("outRings", "ors", &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    compoundAttr.addChild(ringCenter_attr);
+    compoundAttr.addChild(ringRadius_attr);
+    compoundAttr.addChild(ringMajorAxis_attr);
+    compoundAttr.addChild(ringMinorAxis_attr);
+    compoundAttr.setArray(true);
+    compoundAttr.setUsesArrayDataBuilder(true);
+    compoundAttr.setStorable(false);
+    compoundAttr.setWritable(false);
+
+    // A capsule per bone, between its first and last rings with any points.
+    capsuleStart_attr = numAttr.createPoint("capsuleStart", "cst", &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    capsuleEnd_attr = numAttr.createPoint("capsuleEnd", "cen", &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    capsuleRadius_attr = numAttr.create("capsuleRadius", "cra", MFnNumericData::kDouble, 0.0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    numAttr.setStorable(false);
+
+    outCapsules_attr = compoundAttr.create("outCapsules", "ocs", &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    compoundAttr.addChild(capsuleStart_attr);
+    compoundAttr.addChild(capsuleEnd_attr);
+    compoundAttr.addChild(capsuleRadius_attr);
+    compoundAttr.setArray(true);
+    compoundAttr.setUsesArrayDataBuilder(true);
+    compoundAttr.setStorable(false);
+    compoundAttr.setWritable(false);
+
     addAttribute(boneLength_attr);
     addAttribute(boneMatrix_attr);
+    addAttribute(buildMethod_attr);
+    addAttribute(chainDirectionMatrices_attr);
+    addAttribute(chainMatrices_attr);
+    addAttribute(compactAcceleration_attr);
     addAttribute(components_attr);
     addAttribute(direction_attr);
     addAttribute(directionMatrix_attr);
     addAttribute(fillPartialLoops_attr);
+    addAttribute(hitIndex_attr);
+    addAttribute(hitPolicy_attr);
     addAttribute(inMesh_attr);
+    addAttribute(inMeshes_attr);
+    addAttribute(lodCount_attr);
     addAttribute(maxDistance_attr);
+    addAttribute(mirrorBoneMatrix_attr);
+    addAttribute(progressive_attr);
+    addAttribute(progressiveBudget_attr);
     addAttribute(radius_attr);
+    addAttribute(refinement_attr);
+    addAttribute(rigidTolerance_attr);
+    addAttribute(symmetry_attr);
+    addAttribute(symmetryTolerance_attr);
     addAttribute(subdivisionsAxis_attr);
     addAttribute(subdivisionsHeight_attr);
     addAttribute(useMaxDistance_attr);
+    addAttribute(activeBuildMethod_attr);
+    addAttribute(memoryUsage_attr);
     addAttribute(outMesh_attr);
+    addAttribute(outLods_attr);
+    addAttribute(outMirrorMesh_attr);
+    addAttribute(outRings_attr);
+    addAttribute(outCapsules_attr);
 
     attributeAffects(inMesh_attr, outMesh_attr);
+    attributeAffects(inMeshes_attr, outMesh_attr);
     attributeAffects(boneMatrix_attr, outMesh_attr);
     attributeAffects(boneLength_attr, outMesh_attr);
+    attributeAffects(buildMethod_attr, outMesh_attr);
+    attributeAffects(chainDirectionMatrices_attr, outMesh_attr);
+    attributeAffects(chainMatrices_attr, outMesh_attr);
+    attributeAffects(compactAcceleration_attr, outMesh_attr);
     attributeAffects(components_attr, outMesh_attr);
     attributeAffects(fillPartialLoops_attr, outMesh_attr);
+    attributeAffects(hitIndex_attr, outMesh_attr);
+    attributeAffects(hitPolicy_attr, outMesh_attr);
     attributeAffects(direction_attr, outMesh_attr);
     attributeAffects(directionMatrix_attr, outMesh_attr);
+    attributeAffects(progressive_attr, outMesh_attr);
+    attributeAffects(progressiveBudget_attr, outMesh_attr);
     attributeAffects(radius_attr, outMesh_attr);
+    attributeAffects(refinement_attr, outMesh_attr);
+    attributeAffects(rigidTolerance_attr, outMesh_attr);
     attributeAffects(subdivisionsAxis_attr, outMesh_attr);
     attributeAffects(subdivisionsHeight_attr, outMesh_attr);
     attributeAffects(maxDistance_attr, outMesh_attr);
     attributeAffects(useMaxDistance_attr, outMesh_attr);
 
+    attributeAffects(inMesh_attr, outLods_attr);
+    attributeAffects(inMeshes_attr, outLods_attr);
+    attributeAffects(boneMatrix_attr, outLods_attr);
+    attributeAffects(boneLength_attr, outLods_attr);
+    attributeAffects(buildMethod_attr, outLods_attr);
+    attributeAffects(chainDirectionMatrices_attr, outLods_attr);
+    attributeAffects(chainMatrices_attr, outLods_attr);
+    attributeAffects(compactAcceleration_attr, outLods_attr);
+    attributeAffects(components_attr, outLods_attr);
+    attributeAffects(fillPartialLoops_attr, outLods_attr);
+    attributeAffects(hitIndex_attr, outLods_attr);
+    attributeAffects(hitPolicy_attr, outLods_attr);
+    attributeAffects(direction_attr, outLods_attr);
+    attributeAffects(directionMatrix_attr, outLods_attr);
+    attributeAffects(progressive_attr, outLods_attr);
+    attributeAffects(progressiveBudget_attr, outLods_attr);
+    attributeAffects(radius_attr, outLods_attr);
+    attributeAffects(refinement_attr, outLods_attr);
+    attributeAffects(rigidTolerance_attr, outLods_attr);
+    attributeAffects(subdivisionsAxis_attr, outLods_attr);
+    attributeAffects(subdivisionsHeight_attr, outLods_attr);
+    attributeAffects(maxDistance_attr, outLods_attr);
+    attributeAffects(useMaxDistance_attr, outLods_attr);
+    attributeAffects(lodCount_attr, outLods_attr);
+
+    attributeAffects(inMesh_attr, outMirrorMesh_attr);
+    attributeAffects(inMeshes_attr, outMirrorMesh_attr);
+    attributeAffects(boneMatrix_attr, outMirrorMesh_attr);
+    attributeAffects(boneLength_attr, outMirrorMesh_attr);
+    attributeAffects(buildMethod_attr, outMirrorMesh_attr);
+    attributeAffects(chainDirectionMatrices_attr, outMirrorMesh_attr);
+    attributeAffects(chainMatrices_attr, outMirrorMesh_attr);
+    attributeAffects(compactAcceleration_attr, outMirrorMesh_attr);
+    attributeAffects(components_attr, outMirrorMesh_attr);
+    attributeAffects(fillPartialLoops_attr, outMirrorMesh_attr);
+    attributeAffects(hitIndex_attr, outMirrorMesh_attr);
+    attributeAffects(hitPolicy_attr, outMirrorMesh_attr);
+    attributeAffects(direction_attr, outMirrorMesh_attr);
+    attributeAffects(directionMatrix_attr, outMirrorMesh_attr);
+    attributeAffects(progressive_attr, outMirrorMesh_attr);
+    attributeAffects(progressiveBudget_attr, outMirrorMesh_attr);
+    attributeAffects(radius_attr, outMirrorMesh_attr);
+    attributeAffects(refinement_attr, outMirrorMesh_attr);
+    attributeAffects(rigidTolerance_attr, outMirrorMesh_attr);
+    attributeAffects(subdivisionsAxis_attr, outMirrorMesh_attr);
+    attributeAffects(subdivisionsHeight_attr, outMirrorMesh_attr);
+    attributeAffects(maxDistance_attr, outMirrorMesh_attr);
+    attributeAffects(useMaxDistance_attr, outMirrorMesh_attr);
+    attributeAffects(mirrorBoneMatrix_attr, outMirrorMesh_attr);
+    attributeAffects(symmetry_attr, outMirrorMesh_attr);
+    attributeAffects(symmetryTolerance_attr, outMirrorMesh_attr);
+
+    attributeAffects(inMesh_attr, outRings_attr);
+    attributeAffects(inMeshes_attr, outRings_attr);
+    attributeAffects(boneMatrix_attr, outRings_attr);
+    attributeAffects(boneLength_attr, outRings_attr);
+    attributeAffects(buildMethod_attr, outRings_attr);
+    attributeAffects(chainDirectionMatrices_attr, outRings_attr);
+    attributeAffects(chainMatrices_attr, outRings_attr);
+    attributeAffects(compactAcceleration_attr, outRings_attr);
+    attributeAffects(components_attr, outRings_attr);
+    attributeAffects(fillPartialLoops_attr, outRings_attr);
+    attributeAffects(hitIndex_attr, outRings_attr);
+    attributeAffects(hitPolicy_attr, outRings_attr);
+    attributeAffects(direction_attr, outRings_attr);
+    attributeAffects(directionMatrix_attr, outRings_attr);
+    attributeAffects(progressive_attr, outRings_attr);
+    attributeAffects(progressiveBudget_attr, outRings_attr);
+    attributeAffects(radius_attr, outRings_attr);
+    attributeAffects(refinement_attr, outRings_attr);
+    attributeAffects(rigidTolerance_attr, outRings_attr);
+    attributeAffects(subdivisionsAxis_attr, outRings_attr);
+    attributeAffects(subdivisionsHeight_attr, outRings_attr);
+    attributeAffects(maxDistance_attr, outRings_attr);
+    attributeAffects(useMaxDistance_attr, outRings_attr);
+
+    attributeAffects(inMesh_attr, outCapsules_attr);
+    attributeAffects(inMeshes_attr, outCapsules_attr);
+    attributeAffects(boneMatrix_attr, outCapsules_attr);
+    attributeAffects(boneLength_attr, outCapsules_attr);
+    attributeAffects(buildMethod_attr, outCapsules_attr);
+    attributeAffects(chainDirectionMatrices_attr, outCapsules_attr);
+    attributeAffects(chainMatrices_attr, outCapsules_attr);
+    attributeAffects(compactAcceleration_attr, outCapsules_attr);
+    attributeAffects(components_attr, outCapsules_attr);
+    attributeAffects(fillPartialLoops_attr, outCapsules_attr);
+    attributeAffects(hitIndex_attr, outCapsules_attr);
+    attributeAffects(hitPolicy_attr, outCapsules_attr);
+    attributeAffects(direction_attr, outCapsules_attr);
+    attributeAffects(directionMatrix_attr, outCapsules_attr);
+    attributeAffects(progressive_attr, outCapsules_attr);
+    attributeAffects(progressiveBudget_attr, outCapsules_attr);
+    attributeAffects(radius_attr, outCapsules_attr);
+    attributeAffects(refinement_attr, outCapsules_attr);
+    attributeAffects(rigidTolerance_attr, outCapsules_attr);
+    attributeAffects(subdivisionsAxis_attr, outCapsules_attr);
+    attributeAffects(subdivisionsHeight_attr, outCapsules_attr);
+    attributeAffects(maxDistance_attr, outCapsules_attr);
+    attributeAffects(useMaxDistance_attr, outCapsules_attr);
+
+    attributeAffects(inMesh_attr, activeBuildMethod_attr);
+    attributeAffects(inMeshes_attr, activeBuildMethod_attr);
+    attributeAffects(boneMatrix_attr, activeBuildMethod_attr);
+    attributeAffects(boneLength_attr, activeBuildMethod_attr);
+    attributeAffects(buildMethod_attr, activeBuildMethod_attr);
+    attributeAffects(chainDirectionMatrices_attr, activeBuildMethod_attr);
+    attributeAffects(chainMatrices_attr, activeBuildMethod_attr);
+    attributeAffects(compactAcceleration_attr, activeBuildMethod_attr);
+    attributeAffects(components_attr, activeBuildMethod_attr);
+    attributeAffects(fillPartialLoops_attr, activeBuildMethod_attr);
+    attributeAffects(hitIndex_attr, activeBuildMethod_attr);
+    attributeAffects(hitPolicy_attr, activeBuildMethod_attr);
+    attributeAffects(direction_attr, activeBuildMethod_attr);
+    attributeAffects(directionMatrix_attr, activeBuildMethod_attr);
+    attributeAffects(progressive_attr, activeBuildMethod_attr);
+    attributeAffects(progressiveBudget_attr, activeBuildMethod_attr);
+    attributeAffects(radius_attr, activeBuildMethod_attr);
+    attributeAffects(refinement_attr, activeBuildMethod_attr);
+    attributeAffects(rigidTolerance_attr, activeBuildMethod_attr);
+    attributeAffects(subdivisionsAxis_attr, activeBuildMethod_attr);
+    attributeAffects(subdivisionsHeight_attr, activeBuildMethod_attr);
+    attributeAffects(maxDistance_attr, activeBuildMethod_attr);
+    attributeAffects(useMaxDistance_attr, activeBuildMethod_attr);
+
+    attributeAffects(inMesh_attr, memoryUsage_attr);
+    attributeAffects(inMeshes_attr, memoryUsage_attr);
+    attributeAffects(boneMatrix_attr, memoryUsage_attr);
+    attributeAffects(boneLength_attr, memoryUsage_attr);
+    attributeAffects(buildMethod_attr, memoryUsage_attr);
+    attributeAffects(chainDirectionMatrices_attr, memoryUsage_attr);
+    attributeAffects(chainMatrices_attr, memoryUsage_attr);
+    attributeAffects(compactAcceleration_attr, memoryUsage_attr);
+    attributeAffects(components_attr, memoryUsage_attr);
+    attributeAffects(fillPartialLoops_attr, memoryUsage_attr);
+    attributeAffects(hitIndex_attr, memoryUsage_attr);
+    attributeAffects(hitPolicy_attr, memoryUsage_attr);
+    attributeAffects(direction_attr, memoryUsage_attr);
+    attributeAffects(directionMatrix_attr, memoryUsage_attr);
+    attributeAffects(progressive_attr, memoryUsage_attr);
+    attributeAffects(progressiveBudget_attr, memoryUsage_attr);
+    attributeAffects(radius_attr, memoryUsage_attr);
+    attributeAffects(refinement_attr, memoryUsage_attr);
+    attributeAffects(rigidTolerance_attr, memoryUsage_attr);
+    attributeAffects(subdivisionsAxis_attr, memoryUsage_attr);
+    attributeAffects(subdivisionsHeight_attr, memoryUsage_attr);
+    attributeAffects(maxDistance_attr, memoryUsage_attr);
+    attributeAffects(useMaxDistance_attr, memoryUsage_attr);
+    attributeAffects(lodCount_attr, memoryUsage_attr);
+    attributeAffects(mirrorBoneMatrix_attr, memoryUsage_attr);
+    attributeAffects(symmetry_attr, memoryUsage_attr);
+    attributeAffects(symmetryTolerance_attr, memoryUsage_attr);
+
     return MStatus::kSuccess;
 }
 
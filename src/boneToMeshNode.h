@@ -6,6 +6,15 @@
 #ifndef YANTOR_3D_BONE_TO_MESH_NODE_H
 #define YANTOR_3D_BONE_TO_MESH_NODE_H
 
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshMemory.h"
+#include "boneToMeshProgressive.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <maya/MDataBlock.h>
 #include <maya/MObject.h>
 #include <maya/MPlug.h>
@@ -13,18 +22,55 @@
 #include <maya/MString.h>
 #include <maya/MStatus.h>
 #include <maya/MTypeId.h>
+#include <maya/MTypes.h>
 
 class BoneToMeshNode : public MPxNode
 {
 public:
+                        BoneToMeshNode();
+    virtual             ~BoneToMeshNode();
+
     static  void*       creator();
     static  MStatus     initialize();
     
     virtual MStatus     compute(const MPlug &plug, MDataBlock &dataBlock);
 
+#if MAYA_API_VERSION >= 201600
+    virtual SchedulingType schedulingType() const { return kParallel; }
+#endif
+
 private:
     virtual MObject     unpackComponentList(MObject &componentList);
 
+    MStatus             setColliders(MDataBlock &dataBlock, const std::vector<BoneToMeshRing> &rings, const std::vector<BoneToMeshCapsule> &capsules);
+
+    BoneToMeshMemoryUsage memoryUsage() const;
+    bool                releaseCaches(BoneToMeshMemoryUsage &usage);
+
+    BoneToMeshScene&    writableScene();
+
+private:
+    std::mutex          computeMutex;
+
+    // Refinements trace the scene they were requested with, so it is never 
+    // updated while one does. The spare is brought up to date instead.
+    std::shared_ptr<BoneToMeshScene> scene = std::make_shared<BoneToMeshScene>();
+    std::shared_ptr<BoneToMeshScene> spareScene;
+
+    BoneToMeshScene     mirrorScene;
+
+    BoneToMeshProjection proj;
+    BoneToMeshProjection mirrorProj;
+
+    BoneToMeshRigidCache rigid;
+
+    std::vector<BoneToMeshProjection> chainProjs;
+
+    std::shared_ptr<BoneToMeshProgressive> progressive = std::make_shared<BoneToMeshProgressive>();
+
+    int                 memoryOwner = 0;
+    size_t              outputBytes = 0;    // estimate of the meshes last set on the outputs
+
 public:
     static MString      NODE_NAME;
     static MTypeId      NODE_ID;
@@ -32,18 +78,46 @@ public:
 private:
     static MObject      boneLength_attr;
     static MObject      boneMatrix_attr;
+    static MObject      buildMethod_attr;
+    static MObject      chainDirectionMatrices_attr;
+    static MObject      chainMatrices_attr;
+    static MObject      compactAcceleration_attr;
     static MObject      components_attr;
     static MObject      direction_attr;
     static MObject      directionMatrix_attr;
     static MObject      fillPartialLoops_attr;
+    static MObject      hitIndex_attr;
+    static MObject      hitPolicy_attr;
     static MObject      inMesh_attr;
+    static MObject      inMeshes_attr;
+    static MObject      lodCount_attr;
     static MObject      maxDistance_attr;
+    static MObject      mirrorBoneMatrix_attr;
+    static MObject      progressive_attr;
+    static MObject      progressiveBudget_attr;
     static MObject      subdivisionsAxis_attr;
     static MObject      subdivisionsHeight_attr;
     static MObject      radius_attr;
+    static MObject      refinement_attr;
+    static MObject      rigidTolerance_attr;
+    static MObject      symmetry_attr;
+    static MObject      symmetryTolerance_attr;
     static MObject      useMaxDistance_attr;
 
+    static MObject      activeBuildMethod_attr;
+    static MObject      capsuleEnd_attr;
+    static MObject      capsuleRadius_attr;
+    static MObject      capsuleStart_attr;
+    static MObject      memoryUsage_attr;
+    static MObject      outCapsules_attr;
     static MObject      outMesh_attr;
+    static MObject      outLods_attr;
+    static MObject      outMirrorMesh_attr;
+    static MObject      outRings_attr;
+    static MObject      ringCenter_attr;
+    static MObject      ringMajorAxis_attr;
+    static MObject      ringMinorAxis_attr;
+    static MObject      ringRadius_attr;
 };
 
 #endif
\ No newline at end of file
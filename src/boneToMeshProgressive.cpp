@@ -0,0 +1,227 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshProgressive.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <maya/MGlobal.h>
+#include <maya/MMatrix.h>
+#include <maya/MString.h>
+
+// Weight of the latest measurement in the ray rate.
+const double RAY_RATE_SMOOTHING = 0.5;
+
+
+static bool sameRequest(const BoneToMeshRefineRequest &a, const BoneToMeshRefineRequest &b)
+{
+    return (
+        sameParams(a.params, b.params) &&
+        a.boneMatrix == b.boneMatrix &&
+        a.directionMatrix == b.directionMatrix &&
+        a.sceneVersion == b.sceneVersion
+    );
+}
+
+
+BoneToMeshParams progressiveParams(BoneToMeshProgressive &progressive, const BoneToMeshParams &params, double budget)
+{
+    double rayRate;
+
+    {
+        std::lock_guard<std::mutex> lock(progressive.mutex);
+        rayRate = progressive.rayRate;
+    }
+
+    BoneToMeshParams coarse = params;
+
+    if (rayRate <= 0.0) { return coarse; }
+
+    double maxRays = std::max(0.0, budget) * rayRate;
+
+    while (double(coarse.subdivisionsX * coarse.subdivisionsY) > maxRays)
+    {
+        // Rings keep at least 4 spokes and the bone at least 2 rings.
+        bool halveX = coarse.subdivisionsX / 2 >= 4;
+        bool halveY = coarse.subdivisionsY > 2;
+
+        if (halveX && halveY) 
+        {
+            halveX = coarse.subdivisionsX >= coarse.subdivisionsY;
+            halveY = !halveX;
+        }
+
+        if (halveX)      { coarse.subdivisionsX /= 2; }
+        else if (halveY) { coarse.subdivisionsY = ((coarse.subdivisionsY - 1) / 2) + 1; }
+        else             { break; }
+    }
+
+    return coarse;
+}
+
+
+void measureRayRate(BoneToMeshProgressive &progressive, int numRays, double milliseconds)
+{
+    if (numRays <= 0 || milliseconds <= 0.0) { return; }
+
+    double rayRate = double(numRays) / milliseconds;
+
+    std::lock_guard<std::mutex> lock(progressive.mutex);
+
+    progressive.rayRate = progressive.rayRate > 0.0
+        ? (RAY_RATE_SMOOTHING * rayRate) + ((1.0 - RAY_RATE_SMOOTHING) * progressive.rayRate)
+        : rayRate;
+}
+
+
+bool refinedProjection(BoneToMeshProgressive &progressive, const BoneToMeshRefineRequest &request, BoneToMeshProjection &proj)
+{
+    std::lock_guard<std::mutex> lock(progressive.mutex);
+
+    if (!progressive.frontValid || !sameRequest(progressive.frontRequest, request)) { return false; }
+
+    proj = progressive.front;
+    proj.cancelled.reset();
+
+    return true;
+}
+
+
+// Works through requests until the latest one is refined. Each pass traces
+// into the back buffer, which only the running job touches.
+static void refine(std::shared_ptr<BoneToMeshProgressive> progressive)
+{
+    while (true)
+    {
+        BoneToMeshRefineRequest request;
+        std::shared_ptr<const BoneToMeshScene> scene;
+        uint64_t generation;
+
+        {
+            std::lock_guard<std::mutex> lock(progressive->mutex);
+
+            if (progressive->started == progressive->requested)
+            {
+                progressive->running = false;
+                return;
+            }
+
+            request = progressive->request;
+            scene.swap(progressive->scene);
+            generation = progressive->requested;
+
+            progressive->refining = scene;
+
+            progressive->started = generation;
+            progressive->cancelled = std::make_shared<std::atomic<bool>>(false);
+            progressive->back.cancelled = progressive->cancelled;
+        }
+
+        BoneToMeshProjection &back = progressive->back;
+
+        initializeProjection(request.boneMatrix, request.directionMatrix, request.params, back);
+        projectionVectors(request.params, back);
+        projectBoneToMesh(*scene, request.params, back);
+        fillPartialLoops(*scene, request.params, back);
+
+        MString dirtyCommand;
+
+        {
+            std::lock_guard<std::mutex> lock(progressive->mutex);
+
+            progressive->refining.reset();
+
+            if (progressive->requested == generation)
+            {
+                std::swap(progressive->front, progressive->back);
+
+                progressive->frontRequest = request;
+                progressive->frontValid = true;
+                progressive->pending = false;
+
+                dirtyCommand = progressive->dirtyCommand;
+            } else if (back.cancelled->load()) {
+                // The rays left untraced came back as misses.
+                back.hits.clear();
+            }
+        }
+
+        if (dirtyCommand.length() > 0)
+        {
+            MGlobal::executeCommandOnIdle(dirtyCommand);
+        }
+    }
+}
+
+
+// The job traces the scene it is given, so a request costs no copy of it.
+void requestRefinement(
+    const std::shared_ptr<BoneToMeshProgressive> &progressive, 
+    const std::shared_ptr<const BoneToMeshScene> &scene, 
+    const BoneToMeshRefineRequest &request, 
+    const MString &dirtyCommand
+) {
+    std::lock_guard<std::mutex> lock(progressive->mutex);
+
+    bool pending = progressive->pending && sameRequest(progressive->request, request);
+    bool refined = progressive->frontValid && sameRequest(progressive->frontRequest, request);
+
+    if (pending || refined) { return; }
+
+    progressive->scene = scene;
+    progressive->request = request;
+    progressive->dirtyCommand = dirtyCommand;
+    progressive->requested++;
+    progressive->pending = true;
+
+    if (progressive->cancelled) { progressive->cancelled->store(true); }
+
+    if (!progressive->running)
+    {
+        progressive->running = true;
+        runAsync([progressive]() { refine(progressive); });
+    }
+}
+
+
+void cancelRefinement(BoneToMeshProgressive &progressive)
+{
+    std::lock_guard<std::mutex> lock(progressive.mutex);
+
+    if (!progressive.running) { return; }
+
+    // The running job finds its generation stale and stops.
+    progressive.requested++;
+    progressive.started = progressive.requested;
+    progressive.pending = false;
+    progressive.dirtyCommand = MString();
+    progressive.scene.reset();
+
+    if (progressive.cancelled) { progressive.cancelled->store(true); }
+}
+
+
+void withdrawRefinement(BoneToMeshProgressive &progressive)
+{
+    std::lock_guard<std::mutex> lock(progressive.mutex);
+
+    if (!progressive.pending) { return; }
+
+    // The running job, if any, was cancelled when this request was made 
+    // and finds nothing left to start on.
+    progressive.started = progressive.requested;
+    progressive.pending = false;
+    progressive.scene.reset();
+}
@@ -0,0 +1,78 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_PROGRESSIVE_H
+#define YANTOR_3D_BONE_TO_MESH_PROGRESSIVE_H
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <maya/MMatrix.h>
+#include <maya/MString.h>
+
+// Inputs of a full resolution projection.
+struct BoneToMeshRefineRequest
+{
+    BoneToMeshParams params;
+    MMatrix          boneMatrix;
+    MMatrix          directionMatrix;
+    uint64_t         sceneVersion = 0;
+};
+
+// Full resolution projection refined in the background while a coarse one 
+// is shown. Only the latest request is worth finishing, an older one still
+// running is cancelled.
+struct BoneToMeshProgressive
+{
+    std::mutex mutex;
+
+    uint64_t                requested = 0;      // generation of the latest request
+    uint64_t                started   = 0;      // generation the running job works on
+    bool                    pending   = false;  // the latest request is yet to be refined
+    bool                    running   = false;
+
+    BoneToMeshRefineRequest request;
+    MString                 dirtyCommand;       // run on idle once a refinement is published
+
+    // Scene of the pending request, which the job takes over when it starts
+    // on it. The owner does not update a scene while a job holds it.
+    std::shared_ptr<const BoneToMeshScene> scene;
+    std::shared_ptr<const BoneToMeshScene> refining;    // scene of the running job, for its owner to count
+    std::shared_ptr<std::atomic<bool>>     cancelled;
+
+    // The job refines into back, and swaps it with front once done.
+    BoneToMeshProjection    back;
+    BoneToMeshProjection    front;
+    BoneToMeshRefineRequest frontRequest;
+    bool                    frontValid = false;
+
+    // Rays per millisecond of the latest synchronous evaluations.
+    double                  rayRate = 0.0;
+};
+
+// Grid that fits in the budget at the measured ray rate, halving the 
+// subdivisions around and along the bone. The full grid until a rate is known.
+BoneToMeshParams progressiveParams(BoneToMeshProgressive &progressive, const BoneToMeshParams &params, double budget);
+void measureRayRate(BoneToMeshProgressive &progressive, int numRays, double milliseconds);
+
+bool refinedProjection(BoneToMeshProgressive &progressive, const BoneToMeshRefineRequest &request, BoneToMeshProjection &proj);
+void requestRefinement(
+    const std::shared_ptr<BoneToMeshProgressive> &progressive, 
+    const std::shared_ptr<const BoneToMeshScene> &scene, 
+    const BoneToMeshRefineRequest &request, 
+    const MString &dirtyCommand
+);
+void cancelRefinement(BoneToMeshProgressive &progressive);
+
+// Drops a request that has not started, along with its hold on the scene, 
+// when the caller is about to update the scene and request again.
+void withdrawRefinement(BoneToMeshProgressive &progressive);
+
+#endif
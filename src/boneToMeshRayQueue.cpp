@@ -0,0 +1,230 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshRayQueue.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+const int RAY_PACKET = 64;      // rays traced back to back by one worker
+
+// Sorting rays only paid for itself with incoherent directions, large meshes
+// and many rays in one dispatch, where the tree no longer fits in cache and 
+// sorted rays walk the same nodes back to back. Measured with 
+// boneToMeshBenchmark -rayOrder, world space rings traced 12-24% faster 
+// sorted with 200k rays over 1M triangles or more, while smaller meshes or
+// 20k rays were anywhere from 17% slower to a little faster.
+const int RAY_SORT_MIN_RAYS      = 131072;
+const int RAY_SORT_MIN_TRIANGLES = 1000000;
+
+struct QueuedBatch
+{
+    std::shared_ptr<BoneToMeshRayBatch> batch;
+    std::shared_ptr<std::promise<void>> done;
+};
+
+// Reference to one ray of a dispatch, sorted by its coherence key.
+struct QueuedRay
+{
+    uint64_t key;
+    int      batch;
+    int      ray;
+};
+
+
+static std::mutex               queueMutex;
+static std::vector<QueuedBatch> queuedBatches;
+static bool                     dispatching = false;
+
+
+std::future<void> submitRays(const std::shared_ptr<BoneToMeshRayBatch> &batch)
+{
+    QueuedBatch queued = {batch, std::make_shared<std::promise<void>>()};
+    std::future<void> result = queued.done->get_future();
+
+    batch->hits.assign(batch->rays.size(), BoneToMeshHit());
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queuedBatches.push_back(queued);
+
+    return result;
+}
+
+
+static size_t numSceneTriangles(const BoneToMeshScene &scene)
+{
+    size_t numTriangles = 0;
+
+    for (const BoneToMeshBVH &bvh : scene.meshes) { numTriangles += bvh.triangles.size() / 3; }
+
+    return numTriangles;
+}
+
+
+// Picks the batches whose rays are sorted before tracing.
+static std::vector<bool> coherentBatches(const std::vector<QueuedBatch> &batches)
+{
+    std::vector<bool> coherent(batches.size(), false);
+
+    size_t incoherentRays = 0;
+
+    for (const QueuedBatch &queued : batches)
+    {
+        const BoneToMeshRayBatch &batch = *queued.batch;
+
+        bool candidate = (
+            batch.order == RAY_ORDER_AUTO && 
+            batch.incoherent && 
+            numSceneTriangles(*batch.scene) >= size_t(RAY_SORT_MIN_TRIANGLES)
+        );
+
+        if (candidate) { incoherentRays += batch.rays.size(); }
+    }
+
+    for (size_t b = 0; b < batches.size(); b++)
+    {
+        const BoneToMeshRayBatch &batch = *batches[b].batch;
+
+        coherent[b] = (
+            batch.order == RAY_ORDER_COHERENT ||
+            (
+                batch.order == RAY_ORDER_AUTO && 
+                batch.incoherent && 
+                incoherentRays >= size_t(RAY_SORT_MIN_RAYS) &&
+                numSceneTriangles(*batch.scene) >= size_t(RAY_SORT_MIN_TRIANGLES)
+            )
+        );
+    }
+
+    return coherent;
+}
+
+
+static void traceBatches(std::vector<QueuedBatch> &batches)
+{
+    std::vector<bool> coherent = coherentBatches(batches);
+
+    std::vector<const BoneToMeshScene*> scenes;
+    std::vector<QueuedRay> rays;
+
+    bool sorted = false;
+
+    // Rays that are not sorted keep their submission order after the sorted ones.
+    uint64_t gridKey = uint64_t(1) << 63;
+
+    for (size_t b = 0; b < batches.size(); b++)
+    {
+        const BoneToMeshRayBatch &batch = *batches[b].batch;
+
+        uint64_t sceneGroup = std::find(scenes.begin(), scenes.end(), batch.scene) - scenes.begin();
+
+        if (sceneGroup == scenes.size()) { scenes.push_back(batch.scene); }
+
+        for (size_t r = 0; r < batch.rays.size(); r++)
+        {
+            uint64_t key = coherent[b] ? (sceneGroup << 33) | rayCoherenceKey(*batch.scene, batch.rays[r]) : gridKey++;
+
+            QueuedRay ray = {key, (int) b, (int) r};
+            rays.push_back(ray);
+        }
+
+        sorted = sorted || coherent[b];
+    }
+
+    if (sorted)
+    {
+        std::sort(rays.begin(), rays.end(), [](const QueuedRay &a, const QueuedRay &b) {
+            return a.key != b.key ? a.key < b.key : (a.batch != b.batch ? a.batch < b.batch : a.ray < b.ray);
+        });
+    }
+
+    parallelFor(0, (int) rays.size(), RAY_PACKET, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+        {
+            BoneToMeshRayBatch &batch = *batches[rays[i].batch].batch;
+
+            intersectScene(*batch.scene, batch.rays[rays[i].ray], batch.hits[rays[i].ray], batch.hitPolicy, batch.hitIndex);
+        }
+    });
+
+    for (QueuedBatch &queued : batches) { queued.done->set_value(); }
+}
+
+
+void dispatchRays()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+
+        if (dispatching) { return; }
+
+        dispatching = true;
+    }
+
+    while (true)
+    {
+        std::vector<QueuedBatch> batches;
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+
+            if (queuedBatches.empty())
+            {
+                dispatching = false;
+                return;
+            }
+
+            batches.swap(queuedBatches);
+        }
+
+        traceBatches(batches);
+    }
+}
+
+
+static void traceBackgroundBatch(BoneToMeshRayBatch &batch)
+{
+    batch.hits.assign(batch.rays.size(), BoneToMeshHit());
+
+    parallelFor(0, (int) batch.rays.size(), RAY_PACKET, [&](int begin, int end) {
+        for (int packet = begin; packet < end; packet += RAY_PACKET)
+        {
+            if (batch.cancelled && batch.cancelled->load()) { return; }
+
+            int packetEnd = std::min(end, packet + RAY_PACKET);
+
+            for (int i = packet; i < packetEnd; i++)
+            {
+                intersectScene(*batch.scene, batch.rays[i], batch.hits[i], batch.hitPolicy, batch.hitIndex);
+            }
+        }
+    });
+}
+
+
+void traceRays(const std::shared_ptr<BoneToMeshRayBatch> &batch)
+{
+    if (batch->background)
+    {
+        traceBackgroundBatch(*batch);
+        return;
+    }
+
+    std::future<void> done = submitRays(batch);
+
+    dispatchRays();
+
+    done.wait();
+}
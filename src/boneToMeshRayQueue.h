@@ -0,0 +1,55 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_RAY_QUEUE_H
+#define YANTOR_3D_BONE_TO_MESH_RAY_QUEUE_H
+
+#include "boneToMeshBVH.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+// Order rays are traced in. Results always come back in submission order.
+const int RAY_ORDER_AUTO     = 0;   // coherent where it was measured to pay off
+const int RAY_ORDER_GRID     = 1;   // as submitted
+const int RAY_ORDER_COHERENT = 2;   // by scene, then rayCoherenceKey
+
+// Rays of one caller against one scene. The scene must not change until the
+// batch is done.
+struct BoneToMeshRayBatch
+{
+    const BoneToMeshScene      *scene = nullptr;
+
+    int                         hitPolicy = HIT_NEAREST;
+    int                         hitIndex = 1;
+
+    int                         order = RAY_ORDER_AUTO;
+    bool                        incoherent = false;     // directions not aligned with the bone
+
+    // Background batches are traced by the caller alone, so they never hold 
+    // up the queue, and leave the rays after cancelled is set as misses.
+    bool                        background = false;
+    std::shared_ptr<const std::atomic<bool>> cancelled;
+
+    std::vector<BoneToMeshRay>  rays;
+    std::vector<BoneToMeshHit>  hits;       // one per ray once the batch is done
+};
+
+// Queues the batch to be traced by the next dispatch, together with the 
+// batches of every other caller queued by then.
+std::future<void> submitRays(const std::shared_ptr<BoneToMeshRayBatch> &batch);
+
+// Traces the queued batches on the calling thread and the worker pool until
+// the queue is empty, unless another thread is already doing so, in which 
+// case it picks up the queued batches when its current dispatch is done.
+void dispatchRays();
+
+// Submits the batch, dispatches and waits for the hits. Background batches
+// are traced right away instead.
+void traceRays(const std::shared_ptr<BoneToMeshRayBatch> &batch);
+
+#endif
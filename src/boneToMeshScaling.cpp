@@ -0,0 +1,773 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshCounters.h"
+#include "boneToMeshScaling.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <maya/MMatrix.h>
+
+const double SCALING_PI = 3.14159265358979323846;
+
+// The bone runs up the middle of every shape from -1.5 to 1.5 on Y, and
+// the faces within this distance of its middle are the restricted part.
+const double SCALING_BONE_START  = -1.5;
+const double SCALING_BONE_LENGTH = 3.0;
+const double SCALING_PART_HEIGHT = 1.0;
+
+const int SCALING_COUNTER_SPOKES = 64;
+const int SCALING_COUNTER_FILL   = 5;     // nearest surface
+
+// Rays and triangles the reference workload intersects every one of.
+const int SCALING_REFERENCE_RAYS      = 32;
+const int SCALING_REFERENCE_TRIANGLES = 128;
+
+static const char* SCALING_SHAPE_NAMES[SCALING_SHAPES] = {"cylinder", "blob", "character"};
+
+static const char* SCALING_STAGE_NAMES[STAGES] = {"generation", "traversal", "fill", "mesh"};
+
+static const char* SCALING_FILL_NAMES[SCALING_FILL_METHODS] = {
+    "none", "shortest", "longest", "average", "radius", "nearest"
+};
+
+// Capsules of the character as center, radius, half the length of the
+// straight part, whether it lies along X rather than Y, and its share of
+// the triangles.
+struct ScalingCapsule
+{
+    double center[3];
+    double radius;
+    double halfLength;
+    bool   alongX;
+    double share;
+};
+
+static const ScalingCapsule SCALING_CHARACTER_PARTS[] = {
+    {{ 0.0,  0.0, 0.0}, 0.8,  1.0, false, 0.3},     // torso
+    {{ 0.0,  2.3, 0.0}, 0.5,  0.0, false, 0.1},     // head
+    {{ 1.9,  1.2, 0.0}, 0.3,  0.9, true,  0.15},    // arms
+    {{-1.9,  1.2, 0.0}, 0.3,  0.9, true,  0.15},
+    {{ 0.4, -2.6, 0.0}, 0.35, 1.0, false, 0.15},    // legs
+    {{-0.4, -2.6, 0.0}, 0.35, 1.0, false, 0.15}
+};
+
+
+const char* scalingShapeName(int shape)
+{
+    return shape >= 0 && shape < SCALING_SHAPES ? SCALING_SHAPE_NAMES[shape] : "";
+}
+
+
+const char* stageName(int stage)
+{
+    return stage >= 0 && stage < STAGES ? SCALING_STAGE_NAMES[stage] : "";
+}
+
+
+const char* scalingFillName(int fill)
+{
+    return fill >= 0 && fill < SCALING_FILL_METHODS ? SCALING_FILL_NAMES[fill] : "";
+}
+
+
+// Appends a grid of rows x columns quads of about numTriangles triangles,
+// wrapped around in columns. position(v, u, p) places the point at row v
+// and column u, both from 0 to 1.
+template <typename Position>
+static void scalingGrid(int numTriangles, std::vector<float> &points, std::vector<int> &triangles, Position position)
+{
+    int rows = std::max(2, int(std::ceil(std::sqrt(double(numTriangles) / 4.0))));
+    int columns = std::max(3, (numTriangles + (2 * rows) - 1) / (2 * rows));
+
+    int first = (int) points.size() / 3;
+
+    for (int r = 0; r <= rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            double p[3];
+            position(double(r) / double(rows), double(c) / double(columns), p);
+
+            points.push_back(float(p[0]));
+            points.push_back(float(p[1]));
+            points.push_back(float(p[2]));
+        }
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            int v0 = first + (r * columns) + c;
+            int v1 = first + (r * columns) + ((c + 1) % columns);
+            int v2 = v1 + columns;
+            int v3 = v0 + columns;
+
+            int quad[6] = {v0, v1, v2, v0, v2, v3};
+
+            triangles.insert(triangles.end(), quad, quad + 6);
+        }
+    }
+}
+
+
+// Repeatable noise from -1 to 1 at a point on a grid.
+static double scalingNoise(double v, double u)
+{
+    double n = std::sin((v * 12.9898 * 1000.0) + (u * 78.233 * 1000.0)) * 43758.5453;
+
+    return ((n - std::floor(n)) * 2.0) - 1.0;
+}
+
+
+static void scalingMesh(int shape, int numTriangles, std::vector<float> &points, std::vector<int> &triangles)
+{
+    points.clear();
+    triangles.clear();
+
+    if (shape == SCALING_CYLINDER)
+    {
+        scalingGrid(numTriangles, points, triangles, [](double v, double u, double *p) {
+            p[0] = std::cos(2.0 * SCALING_PI * u);
+            p[1] = (4.0 * v) - 2.0;
+            p[2] = std::sin(2.0 * SCALING_PI * u);
+        });
+    } else if (shape == SCALING_BLOB) {
+        scalingGrid(numTriangles, points, triangles, [](double v, double u, double *p) {
+            double theta = SCALING_PI * v;
+            double phi = 2.0 * SCALING_PI * u;
+            double radius = 1.5 * (1.0 + (0.2 * std::sin(theta * 7.0) * std::cos(phi * 5.0)) + (0.03 * scalingNoise(v, u)));
+
+            p[0] = radius * std::sin(theta) * std::cos(phi);
+            p[1] = radius * std::cos(theta) * 1.5;
+            p[2] = radius * std::sin(theta) * std::sin(phi);
+        });
+    } else {
+        for (const ScalingCapsule &part : SCALING_CHARACTER_PARTS)
+        {
+            scalingGrid(int(numTriangles * part.share) + 1, points, triangles, [&part](double v, double u, double *p) {
+                double theta = SCALING_PI * v;
+                double phi = 2.0 * SCALING_PI * u;
+                double radius = part.radius * (1.0 + (0.01 * scalingNoise(v, u)));
+
+                double x = radius * std::sin(theta) * std::cos(phi);
+                double y = (radius * std::cos(theta)) + (v < 0.5 ? part.halfLength : -part.halfLength);
+                double z = radius * std::sin(theta) * std::sin(phi);
+
+                p[0] = part.center[0] + (part.alongX ? y : x);
+                p[1] = part.center[1] + (part.alongX ? x : y);
+                p[2] = part.center[2] + z;
+            });
+        }
+    }
+}
+
+
+// Triangles with their middle near the middle of the bone, as selected
+// faces would be.
+static void scalingPart(const std::vector<float> &points, const std::vector<int> &triangles, std::vector<int> &part)
+{
+    part.clear();
+
+    double middle = SCALING_BONE_START + (SCALING_BONE_LENGTH * 0.5);
+
+    for (size_t t = 0; t < triangles.size(); t += 3)
+    {
+        double y = (points[(triangles[t] * 3) + 1] + points[(triangles[t + 1] * 3) + 1] + points[(triangles[t + 2] * 3) + 1]) / 3.0;
+
+        if (std::abs(y - middle) < SCALING_PART_HEIGHT)
+        {
+            part.insert(part.end(), triangles.begin() + t, triangles.begin() + t + 3);
+        }
+    }
+}
+
+
+static void defaultThreadCounts(std::vector<int> &threadCounts)
+{
+    setThreadLimit(0);
+
+    int maxThreads = numThreads();
+
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+
+    threadCounts.push_back(maxThreads);
+}
+
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+
+// Intersects a fan of rays with every triangle of a band around them, in
+// plain loops that share no code with the scene, and returns the summed
+// distances so the work is not optimized away. Timed between the runs of
+// a case, it measures how fast the machine is running at the time.
+static double scalingReference()
+{
+    double total = 0.0;
+
+    for (int r = 0; r < SCALING_REFERENCE_RAYS; r++)
+    {
+        double angle = 2.0 * SCALING_PI * double(r) / double(SCALING_REFERENCE_RAYS);
+        float direction[3] = {float(std::cos(angle)), 0.0f, float(std::sin(angle))};
+
+        for (int t = 0; t < SCALING_REFERENCE_TRIANGLES; t++)
+        {
+            double a0 = 2.0 * SCALING_PI * double(t) / double(SCALING_REFERENCE_TRIANGLES);
+            double a1 = 2.0 * SCALING_PI * double(t + 1) / double(SCALING_REFERENCE_TRIANGLES);
+
+            float v0[3] = {float(std::cos(a0)), -1.0f, float(std::sin(a0))};
+            float e1[3] = {float(std::cos(a1)) - v0[0], 0.0f, float(std::sin(a1)) - v0[2]};
+            float e2[3] = {0.0f, 2.0f, 0.0f};
+
+            float p[3] = {
+                (direction[1] * e2[2]) - (direction[2] * e2[1]),
+                (direction[2] * e2[0]) - (direction[0] * e2[2]),
+                (direction[0] * e2[1]) - (direction[1] * e2[0])
+            };
+
+            float det = (e1[0] * p[0]) + (e1[1] * p[1]) + (e1[2] * p[2]);
+            if (std::fabs(det) < 1e-8f) { continue; }
+
+            float inv = 1.0f / det;
+            float s[3] = {-v0[0], -v0[1], -v0[2]};
+
+            float u = ((s[0] * p[0]) + (s[1] * p[1]) + (s[2] * p[2])) * inv;
+            if (u < 0.0f || u > 1.0f) { continue; }
+
+            float q[3] = {
+                (s[1] * e1[2]) - (s[2] * e1[1]),
+                (s[2] * e1[0]) - (s[0] * e1[2]),
+                (s[0] * e1[1]) - (s[1] * e1[0])
+            };
+
+            float v = ((direction[0] * q[0]) + (direction[1] * q[1]) + (direction[2] * q[2])) * inv;
+            if (v < 0.0f || u + v > 1.0f) { continue; }
+
+            total += ((e2[0] * q[0]) + (e2[1] * q[1]) + (e2[2] * q[2])) * inv;
+        }
+    }
+
+    return total;
+}
+
+
+// Times the reference workload, keeping the fastest run in referenceMs.
+static void timeReference(int run, double &referenceMs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    volatile double total = scalingReference();
+    (void) total;
+
+    double ms = elapsedMs(start);
+
+    if (run == 0 || ms < referenceMs) { referenceMs = ms; }
+}
+
+
+void benchmarkScaling(
+    const BoneToMeshScalingOptions &options,
+    std::vector<BoneToMeshScalingResult> &results,
+    const BoneToMeshScalingProgress &progress
+) {
+    std::vector<int> threadCounts = options.threadCounts;
+
+    if (threadCounts.empty()) { defaultThreadCounts(threadCounts); }
+
+    int repeats = std::max(1, options.repeats);
+
+    MMatrix boneMatrix;
+    boneMatrix[3][1] = SCALING_BONE_START;
+
+    std::vector<float> points;
+    std::vector<int>   allTriangles;
+    std::vector<int>   partTriangles;
+
+    for (int shape = 0; shape < SCALING_SHAPES; shape++)
+    {
+        for (int numTriangles : options.triangleCounts)
+        {
+            scalingMesh(shape, numTriangles, points, allTriangles);
+            scalingPart(points, allTriangles, partTriangles);
+
+            for (bool components : {false, true})
+            {
+                const std::vector<int> &triangles = components ? partTriangles : allTriangles;
+
+                for (int threads : threadCounts)
+                {
+                    setThreadLimit(threads);
+
+                    BoneToMeshScene scene;
+                    double buildMs = 0.0;
+                    double buildReferenceMs = 0.0;
+                    double buildTotalMs = 0.0;
+
+                    for (int i = 0; i < repeats || buildTotalMs < options.minMs; i++)
+                    {
+                        scene = BoneToMeshScene();
+
+                        auto start = std::chrono::steady_clock::now();
+
+                        updateSceneArrays(points.data(), (int) points.size() / 3, triangles.data(), (int) triangles.size() / 3, scene);
+
+                        double ms = elapsedMs(start);
+
+                        if (i == 0 || ms < buildMs) { buildMs = ms; }
+
+                        buildTotalMs += ms;
+
+                        timeReference(i, buildReferenceMs);
+                    }
+
+                    for (int spokes : options.subdivisions)
+                    {
+                        for (int fill = 0; fill < SCALING_FILL_METHODS; fill++)
+                        {
+                            BoneToMeshParams params;
+                            params.direction = 1;
+                            params.boneLength = SCALING_BONE_LENGTH;
+                            params.subdivisionsX = (uint) std::max(3, spokes);
+                            params.subdivisionsY = (uint) std::max(2, spokes / 2);
+                            params.fillPartialLoopsMethod = fill;
+
+                            BoneToMeshScalingResult result;
+                            result.shape = shape;
+                            result.triangles = (int) triangles.size() / 3;
+                            result.subdivisionsX = (int) params.subdivisionsX;
+                            result.subdivisionsY = (int) params.subdivisionsY;
+                            result.threads = threads;
+                            result.components = components;
+                            result.fill = fill;
+                            result.buildMs = buildMs;
+                            result.buildReferenceMs = buildReferenceMs;
+
+                            double projectTotalMs = 0.0;
+
+                            for (int i = 0; i < repeats || projectTotalMs < options.minMs; i++)
+                            {
+                                // A new projection each time, as one kept from the
+                                // last run would reuse its hits.
+                                BoneToMeshProjection proj;
+                                BoneToMeshArrays arrays;
+
+                                auto start = std::chrono::steady_clock::now();
+
+                                initializeProjection(boneMatrix, MMatrix::identity, params, proj);
+                                projectionVectors(params, proj);
+                                projectBoneToMesh(scene, params, proj);
+                                fillPartialLoops(scene, params, proj);
+                                lodMeshArrays(params, proj, 0, arrays);
+
+                                double ms = elapsedMs(start);
+
+                                if (i == 0 || ms < result.projectMs) { result.projectMs = ms; }
+
+                                projectTotalMs += ms;
+
+                                timeReference(i, result.projectReferenceMs);
+                            }
+
+                            std::ostringstream name;
+                            name << scalingShapeName(shape) << "/" << numTriangles << "/";
+                            name << result.subdivisionsX << "x" << result.subdivisionsY << "/";
+                            name << threads << "t/" << (components ? "part" : "full") << "/" << scalingFillName(fill);
+                            result.name = name.str();
+
+                            results.push_back(result);
+
+                            if (progress) { progress(result); }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    setThreadLimit(0);
+}
+
+
+// Reads the counters and the time from the last stage to the next.
+static void nextStage(
+    BoneToMeshCounters &counters, 
+    std::chrono::steady_clock::time_point &start, 
+    BoneToMeshStageCounters &stage
+) {
+    stopCounters(counters, stage.values);
+    stage.ms = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    startCounters(counters);
+}
+
+
+bool benchmarkCounters(
+    const BoneToMeshScalingOptions &options,
+    const std::vector<bool> &layouts,
+    std::vector<BoneToMeshCounterResult> &results
+) {
+    BoneToMeshCounters counters;
+    bool available = openCounters(counters);
+
+    int repeats = std::max(1, options.repeats);
+
+    setThreadLimit(1);
+
+    MMatrix boneMatrix;
+    boneMatrix[3][1] = SCALING_BONE_START;
+
+    std::vector<float> points;
+    std::vector<int>   triangles;
+
+    for (int shape = 0; shape < SCALING_SHAPES; shape++)
+    {
+        for (int numTriangles : options.triangleCounts)
+        {
+            scalingMesh(shape, numTriangles, points, triangles);
+
+            for (bool compact : layouts)
+            {
+                BoneToMeshScene scene;
+                scene.compact = compact;
+
+                updateSceneArrays(points.data(), (int) points.size() / 3, triangles.data(), (int) triangles.size() / 3, scene);
+
+                BoneToMeshParams params;
+                params.direction = 1;
+                params.boneLength = SCALING_BONE_LENGTH;
+                params.subdivisionsX = SCALING_COUNTER_SPOKES;
+                params.subdivisionsY = SCALING_COUNTER_SPOKES / 2;
+                params.fillPartialLoopsMethod = SCALING_COUNTER_FILL;
+
+                BoneToMeshCounterResult result;
+                result.shape = shape;
+                result.triangles = (int) triangles.size() / 3;
+                result.compact = compact;
+                result.rays = (int) (params.subdivisionsX * params.subdivisionsY);
+
+                double fastestMs = 0.0;
+
+                for (int i = 0; i < repeats; i++)
+                {
+                    BoneToMeshProjection proj;
+                    BoneToMeshArrays arrays;
+                    BoneToMeshStageCounters stages[STAGES];
+
+                    auto start = std::chrono::steady_clock::now();
+                    startCounters(counters);
+
+                    initializeProjection(boneMatrix, MMatrix::identity, params, proj);
+                    projectionVectors(params, proj);
+                    nextStage(counters, start, stages[STAGE_RAYS]);
+
+                    projectBoneToMesh(scene, params, proj);
+                    nextStage(counters, start, stages[STAGE_TRAVERSAL]);
+
+                    fillPartialLoops(scene, params, proj);
+                    nextStage(counters, start, stages[STAGE_FILL]);
+
+                    lodMeshArrays(params, proj, 0, arrays);
+                    nextStage(counters, start, stages[STAGE_MESH]);
+
+                    double ms = 0.0;
+
+                    for (const BoneToMeshStageCounters &stage : stages) { ms += stage.ms; }
+
+                    if (i == 0 || ms < fastestMs)
+                    {
+                        fastestMs = ms;
+                        std::copy(stages, stages + STAGES, result.stages);
+                    }
+                }
+
+                std::ostringstream name;
+                name << scalingShapeName(shape) << "/" << numTriangles << "/" << (compact ? "compact" : "binary");
+                result.name = name.str();
+
+                results.push_back(result);
+            }
+        }
+    }
+
+    closeCounters(counters);
+
+    setThreadLimit(0);
+
+    return available;
+}
+
+
+std::string scalingJson(const std::vector<BoneToMeshScalingResult> &results, int repeats)
+{
+    std::ostringstream json;
+    json.imbue(std::locale::classic());
+
+    json << "{\n";
+    json << "    \"threads\": " << numThreads() << ",\n";
+    json << "    \"repeats\": " << repeats << ",\n";
+    json << "    \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BoneToMeshScalingResult &result = results[i];
+
+        json << "        {";
+        json << "\"name\": \"" << result.name << "\", ";
+        json << "\"shape\": \"" << scalingShapeName(result.shape) << "\", ";
+        json << "\"triangles\": " << result.triangles << ", ";
+        json << "\"subdivisionsX\": " << result.subdivisionsX << ", ";
+        json << "\"subdivisionsY\": " << result.subdivisionsY << ", ";
+        json << "\"threads\": " << result.threads << ", ";
+        json << "\"components\": " << (result.components ? "true" : "false") << ", ";
+        json << "\"fill\": \"" << scalingFillName(result.fill) << "\", ";
+        json << "\"buildMs\": " << result.buildMs << ", ";
+        json << "\"projectMs\": " << result.projectMs << ", ";
+        json << "\"buildReferenceMs\": " << result.buildReferenceMs << ", ";
+        json << "\"projectReferenceMs\": " << result.projectReferenceMs;
+        json << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+
+    json << "    ]\n";
+    json << "}\n";
+
+    return json.str();
+}
+
+
+std::string countersJson(const std::vector<BoneToMeshCounterResult> &results, int repeats)
+{
+    std::ostringstream json;
+    json.imbue(std::locale::classic());
+
+    json << "{\n";
+    json << "    \"repeats\": " << repeats << ",\n";
+    json << "    \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BoneToMeshCounterResult &result = results[i];
+
+        json << "        {";
+        json << "\"name\": \"" << result.name << "\", ";
+        json << "\"shape\": \"" << scalingShapeName(result.shape) << "\", ";
+        json << "\"triangles\": " << result.triangles << ", ";
+        json << "\"compact\": " << (result.compact ? "true" : "false") << ", ";
+        json << "\"rays\": " << result.rays;
+
+        // Counters that are not available are left out rather than -1.
+        for (int s = 0; s < STAGES; s++)
+        {
+            const BoneToMeshStageCounters &stage = result.stages[s];
+
+            json << ", \"" << stageName(s) << "\": {\"ms\": " << stage.ms;
+
+            for (int c = 0; c < COUNTERS; c++)
+            {
+                if (stage.values[c] >= 0) { json << ", \"" << counterName(c) << "\": " << stage.values[c]; }
+            }
+
+            json << "}";
+        }
+
+        json << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+
+    json << "    ]\n";
+    json << "}\n";
+
+    return json.str();
+}
+
+
+// Start of the value of the key in a flat JSON object, or npos.
+static size_t jsonValue(const std::string &object, const char *key)
+{
+    std::string quoted = std::string("\"") + key + "\"";
+
+    size_t at = object.find(quoted);
+    if (at == std::string::npos) { return at; }
+
+    at = object.find(':', at + quoted.size());
+    if (at == std::string::npos) { return at; }
+
+    return object.find_first_not_of(" \t\r\n", at + 1);
+}
+
+
+static bool jsonString(const std::string &object, const char *key, std::string &value)
+{
+    size_t begin = jsonValue(object, key);
+    if (begin == std::string::npos || object[begin] != '"') { return false; }
+
+    size_t end = object.find('"', begin + 1);
+    if (end == std::string::npos) { return false; }
+
+    value = object.substr(begin + 1, end - begin - 1);
+
+    return true;
+}
+
+
+static bool jsonNumber(const std::string &object, const char *key, double &value)
+{
+    size_t begin = jsonValue(object, key);
+    if (begin == std::string::npos) { return false; }
+
+    std::istringstream stream(object.substr(begin));
+    stream.imbue(std::locale::classic());
+    stream >> value;
+
+    return !stream.fail();
+}
+
+
+bool readScalingBaseline(const std::string &path, std::vector<BoneToMeshScalingResult> &baseline)
+{
+    baseline.clear();
+
+    std::ifstream file(path.c_str());
+    if (!file) { return false; }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    std::string json = contents.str();
+
+    size_t at = json.find("\"results\"");
+
+    // Every result is a flat object, so it ends at the first closing brace.
+    while (at != std::string::npos)
+    {
+        size_t begin = json.find('{', at);
+        if (begin == std::string::npos) { break; }
+
+        size_t end = json.find('}', begin);
+        if (end == std::string::npos) { break; }
+
+        std::string object = json.substr(begin, end - begin + 1);
+
+        BoneToMeshScalingResult result;
+
+        if (jsonString(object, "name", result.name) && jsonNumber(object, "projectMs", result.projectMs))
+        {
+            jsonNumber(object, "buildMs", result.buildMs);
+            jsonNumber(object, "buildReferenceMs", result.buildReferenceMs);
+            jsonNumber(object, "projectReferenceMs", result.projectReferenceMs);
+            baseline.push_back(result);
+        }
+
+        at = end + 1;
+    }
+
+    return !baseline.empty();
+}
+
+
+static bool isRegression(double ms, double baselineMs, double threshold)
+{
+    return baselineMs >= SCALING_GATE_MIN_MS && ms > baselineMs * (1.0 + threshold);
+}
+
+
+// The baseline time as it would be at the speed the machine ran the result
+// at, judged from their reference times where both have them.
+static double scaledBaselineMs(double baselineMs, double referenceMs, double baselineReferenceMs)
+{
+    if (referenceMs <= 0.0 || baselineReferenceMs <= 0.0) { return baselineMs; }
+
+    return baselineMs * (referenceMs / baselineReferenceMs);
+}
+
+
+static std::string regressionMessage(const std::string &name, const char *what, double ms, double baselineMs)
+{
+    std::ostringstream message;
+    message.imbue(std::locale::classic());
+
+    message << name << " " << what << " " << baselineMs << " ms -> " << ms << " ms (+";
+    message << ((ms / std::max(1e-9, baselineMs)) - 1.0) * 100.0 << "%)";
+
+    return message.str();
+}
+
+
+int compareScaling(
+    const std::vector<BoneToMeshScalingResult> &results,
+    const std::vector<BoneToMeshScalingResult> &baseline,
+    double threshold,
+    std::vector<std::string> &regressions
+) {
+    std::unordered_map<std::string, size_t> baselineIndices;
+
+    for (size_t i = 0; i < baseline.size(); i++)
+    {
+        baselineIndices[baseline[i].name] = i;
+    }
+
+    // Every projection of a scene carries the time of its one build, which
+    // is only reported the first time.
+    std::unordered_set<std::string> builds;
+
+    int numCompared = 0;
+
+    for (const BoneToMeshScalingResult &result : results)
+    {
+        auto found = baselineIndices.find(result.name);
+        if (found == baselineIndices.end()) { continue; }
+
+        const BoneToMeshScalingResult &base = baseline[found->second];
+
+        numCompared++;
+
+        // Names are shape/size/subdivisions/threads/part/fill, the build is
+        // the same for every subdivision and fill.
+        std::string build = result.name.substr(0, result.name.rfind('/'));
+        size_t subdivisions = build.find('/', build.find('/') + 1);
+
+        if (subdivisions != std::string::npos)
+        {
+            build.erase(subdivisions, build.find('/', subdivisions + 1) - subdivisions);
+        }
+
+        double buildMs = scaledBaselineMs(base.buildMs, result.buildReferenceMs, base.buildReferenceMs);
+        double projectMs = scaledBaselineMs(base.projectMs, result.projectReferenceMs, base.projectReferenceMs);
+
+        if (isRegression(result.buildMs, buildMs, threshold) && builds.insert(build).second)
+        {
+            regressions.push_back(regressionMessage(build, "build", result.buildMs, buildMs));
+        }
+
+        if (isRegression(result.projectMs, projectMs, threshold))
+        {
+            regressions.push_back(regressionMessage(result.name, "projection", result.projectMs, projectMs));
+        }
+    }
+
+    return numCompared;
+}
@@ -0,0 +1,137 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_SCALING_H
+#define YANTOR_3D_BONE_TO_MESH_SCALING_H
+
+#include "boneToMeshCounters.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Generated meshes the scaling benchmark projects onto.
+const int SCALING_CYLINDER  = 0;    // open tube around the bone
+const int SCALING_BLOB      = 1;    // sphere with noisy, lumpy radius
+const int SCALING_CHARACTER = 2;    // torso, head and limbs as separate capsules
+const int SCALING_SHAPES    = 3;
+
+const int SCALING_FILL_METHODS = 6;
+
+// Builds and projections whose baseline takes less than this many
+// milliseconds are not compared, as noise alone slows them down by more
+// than any useful threshold.
+const double SCALING_GATE_MIN_MS = 0.5;
+
+struct BoneToMeshScalingResult
+{
+    std::string name;               // unique per case, what baselines are matched by
+
+    int    shape         = SCALING_BLOB;
+    int    triangles     = 0;       // as generated and restricted to the part
+    int    subdivisionsX = 8;
+    int    subdivisionsY = 4;
+    int    threads       = 1;
+    bool   components    = false;   // only the faces around the bone
+    int    fill          = 0;
+
+    double buildMs       = 0.0;     // fastest scene update from the arrays
+    double projectMs     = 0.0;     // fastest projection, fill and mesh arrays
+
+    // Fastest run of a fixed reference workload timed between the builds,
+    // and between the projections, see compareScaling.
+    double buildReferenceMs   = 0.0;
+    double projectReferenceMs = 0.0;
+};
+
+struct BoneToMeshScalingOptions
+{
+    std::vector<int> triangleCounts = {1000, 10000, 100000, 1000000, 5000000};
+    std::vector<int> subdivisions   = {8, 32, 128, 256};    // spokes, with half as many rings
+    std::vector<int> threadCounts;                          // 1, 2, 4... and every thread if empty
+
+    int repeats = 3;
+
+    // Each case runs its repeats and then again until its runs add up to
+    // this many milliseconds, so the fastest of a short case is not noise.
+    double minMs = 0.0;
+};
+
+// Stages of a projection the counters are read around.
+const int STAGE_RAYS      = 0;     // initializeProjection and projectionVectors
+const int STAGE_TRAVERSAL = 1;     // projectBoneToMesh
+const int STAGE_FILL      = 2;     // fillPartialLoops, nearest surface
+const int STAGE_MESH      = 3;     // lodMeshArrays
+const int STAGES          = 4;
+
+struct BoneToMeshStageCounters
+{
+    double    ms = 0.0;
+    long long values[COUNTERS] = {-1, -1, -1, -1};     // -1 where not available
+};
+
+struct BoneToMeshCounterResult
+{
+    std::string name;               // shape/size/layout
+
+    int  shape     = SCALING_BLOB;
+    int  triangles = 0;
+    bool compact   = false;
+    int  rays      = 0;
+
+    BoneToMeshStageCounters stages[STAGES];
+};
+
+typedef std::function<void(const BoneToMeshScalingResult&)> BoneToMeshScalingProgress;
+
+// Runs a bone through each shape, size and part of it at each thread count,
+// then projects it at every subdivision and fill method. The scene of a
+// shape is updated from flat arrays as the Python module does, so the
+// timings leave out reading Maya meshes. progress is called after every
+// case when set.
+void benchmarkScaling(
+    const BoneToMeshScalingOptions &options,
+    std::vector<BoneToMeshScalingResult> &results,
+    const BoneToMeshScalingProgress &progress = BoneToMeshScalingProgress()
+);
+
+// Projects a bone of 64x32 rays onto each shape and size in each layout,
+// counting every stage on its own. Counters only follow the thread that 
+// opened them, so the projections run on the calling thread alone. Keeps
+// the fastest of the repeats, and returns false if no counter could be
+// opened, in which case only the times are filled in.
+bool benchmarkCounters(
+    const BoneToMeshScalingOptions &options,
+    const std::vector<bool> &layouts,
+    std::vector<BoneToMeshCounterResult> &results
+);
+
+const char* scalingShapeName(int shape);
+const char* stageName(int stage);
+const char* scalingFillName(int fill);
+
+// The results as a JSON object with one result per line.
+std::string scalingJson(const std::vector<BoneToMeshScalingResult> &results, int repeats);
+
+std::string countersJson(const std::vector<BoneToMeshCounterResult> &results, int repeats);
+
+// Reads the names and timings of the results of a file written from
+// scalingJson. Returns false if the file cannot be read or has no results.
+bool readScalingBaseline(const std::string &path, std::vector<BoneToMeshScalingResult> &baseline);
+
+// Appends a line for each result more than threshold (0.1 is 10%) slower
+// than the baseline result of the same name, and returns how many results
+// had a baseline to compare with. Where both have reference times, the
+// baseline is first scaled by how much slower the reference ran, so a
+// machine that runs slower for a while, as shared and throttled ones do,
+// is not read as a regression.
+int compareScaling(
+    const std::vector<BoneToMeshScalingResult> &results,
+    const std::vector<BoneToMeshScalingResult> &baseline,
+    double threshold,
+    std::vector<std::string> &regressions
+);
+
+#endif
@@ -0,0 +1,301 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#define NOMINMAX
+
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Each worker keeps its own deque of tasks. Tasks pushed from a worker go 
+// on the back of its deque and it takes them back from there, so nested 
+// work finishes before new work starts. Idle workers steal from the front 
+// of the other deques, then take tasks pushed from outside the pool.
+class WorkerPool
+{
+public:
+    WorkerPool()
+    {
+        int numWorkers = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+
+        queues.reset(new TaskQueue[numWorkers + 1]);
+        numQueues = numWorkers + 1;
+
+        for (int i = 0; i < numWorkers; i++)
+        {
+            workers.push_back(std::thread([this, i]() { this->work(i); }));
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (std::thread &worker : workers) { worker.join(); }
+    }
+
+    void push(const std::function<void()> &task)
+    {
+        // Tasks from outside the pool share the last queue.
+        int index = (workerPool == this && workerIndex >= 0) ? workerIndex : numQueues - 1;
+
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(task);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued++;
+        }
+
+        wake.notify_one();
+    }
+
+    int size() const { return (int) workers.size(); }
+
+private:
+    struct TaskQueue
+    {
+        std::mutex                        mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool pop(int index, bool back, std::function<void()> &task)
+    {
+        TaskQueue &queue = queues[index];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty()) { return false; }
+
+        if (back)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+
+        queued--;
+
+        return true;
+    }
+
+    bool findTask(int index, std::function<void()> &task)
+    {
+        if (pop(index, true, task)) { return true; }
+
+        int numWorkers = numQueues - 1;
+
+        for (int i = 1; i < numWorkers; i++)
+        {
+            if (pop((index + i) % numWorkers, false, task)) { return true; }
+        }
+
+        return pop(numQueues - 1, false, task);
+    }
+
+    void work(int index)
+    {
+        workerPool = this;
+        workerIndex = index;
+
+        while (true)
+        {
+            std::function<void()> task;
+
+            if (findTask(index, task))
+            {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+
+            if (stopping && queued.load() == 0) { return; }
+        }
+    }
+
+    static thread_local WorkerPool *workerPool;
+    static thread_local int         workerIndex;
+
+    std::vector<std::thread>      workers;
+    std::unique_ptr<TaskQueue[]>  queues;
+    int                           numQueues = 0;
+
+    std::atomic<int>              queued{0};      // tasks in every queue
+    std::mutex                    mutex;
+    std::condition_variable       wake;
+    bool                          stopping = false;
+};
+
+
+thread_local WorkerPool* WorkerPool::workerPool  = nullptr;
+thread_local int         WorkerPool::workerIndex = -1;
+
+
+static std::mutex                  poolMutex;
+static std::unique_ptr<WorkerPool> pool;
+
+static std::atomic<int>            threadLimit(0);
+
+
+static WorkerPool& workerPool()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    if (!pool) { pool.reset(new WorkerPool()); }
+
+    return *pool;
+}
+
+
+void stopThreads()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    pool.reset();
+}
+
+
+int numThreads()
+{
+    int threads = workerPool().size() + 1;
+    int limit = threadLimit.load();
+
+    return limit > 0 ? std::min(threads, limit) : threads;
+}
+
+
+void setThreadLimit(int limit)
+{
+    threadLimit.store(std::max(0, limit));
+}
+
+
+// Chunks of one parallelFor call, claimed by whichever thread gets to them first.
+struct ParallelForJob
+{
+    std::function<void(int, int)> body;
+
+    int begin;
+    int end;
+    int chunkSize;
+    int numChunks;
+
+    std::atomic<int>  nextChunk;
+    std::atomic<int>  doneChunks;
+    std::atomic<bool> failed;
+
+    std::mutex              mutex;
+    std::condition_variable done;
+
+    // First exception thrown by body, rethrown on the calling thread once
+    // every chunk is done. The chunks after it are skipped but still count.
+    std::exception_ptr error;
+
+    void run()
+    {
+        int chunk;
+
+        while ((chunk = nextChunk.fetch_add(1)) < numChunks)
+        {
+            int chunkBegin = begin + (chunk * chunkSize);
+            int chunkEnd = std::min(end, chunkBegin + chunkSize);
+
+            if (!failed.load())
+            {
+                try
+                {
+                    body(chunkBegin, chunkEnd);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    if (!error) { error = std::current_exception(); }
+
+                    failed.store(true);
+                }
+            }
+
+            if (doneChunks.fetch_add(1) + 1 == numChunks)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+};
+
+
+void parallelFor(int begin, int end, int grainSize, const std::function<void(int, int)> &body)
+{
+    int count = end - begin;
+
+    if (count <= 0) { return; }
+
+    grainSize = std::max(1, grainSize);
+
+    int threads = numThreads();
+    int numChunks = std::min((count + grainSize - 1) / grainSize, threads * 4);
+
+    if (numChunks <= 1 || threads == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    std::shared_ptr<ParallelForJob> job = std::make_shared<ParallelForJob>();
+    job->body = body;
+    job->begin = begin;
+    job->end = end;
+    job->chunkSize = (count + numChunks - 1) / numChunks;
+    job->numChunks = (count + job->chunkSize - 1) / job->chunkSize;
+    job->nextChunk = 0;
+    job->doneChunks = 0;
+    job->failed = false;
+
+    int numHelpers = std::min(threads - 1, job->numChunks - 1);
+
+    for (int i = 0; i < numHelpers; i++)
+    {
+        workerPool().push([job]() { job->run(); });
+    }
+
+    job->run();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&job]() { return job->doneChunks.load() == job->numChunks; });
+
+    if (job->error) { std::rethrow_exception(job->error); }
+}
+
+
+std::future<void> runAsync(const std::function<void()> &task)
+{
+    std::shared_ptr<std::packaged_task<void()>> packagedTask = std::make_shared<std::packaged_task<void()>>(task);
+    std::future<void> result = packagedTask->get_future();
+
+    workerPool().push([packagedTask]() { (*packagedTask)(); });
+
+    return result;
+}
\ No newline at end of file
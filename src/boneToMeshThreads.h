@@ -0,0 +1,32 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+#ifndef YANTOR_3D_BONE_TO_MESH_THREADS_H
+#define YANTOR_3D_BONE_TO_MESH_THREADS_H
+
+#include <functional>
+#include <future>
+
+// Number of threads work is split across, including the calling thread.
+int numThreads();
+
+// Caps numThreads, so scaling can be measured without restarting the pool.
+// Zero lifts the cap.
+void setThreadLimit(int limit);
+
+// Calls body(chunkBegin, chunkEnd) over [begin, end) in chunks of at least
+// grainSize. The calling thread works through chunks as well, so nested
+// calls from inside a body cannot deadlock the pool. If body throws, the 
+// first exception is rethrown once every chunk has finished or been skipped.
+void parallelFor(int begin, int end, int grainSize, const std::function<void(int, int)> &body);
+
+// Runs the task on the worker pool.
+std::future<void> runAsync(const std::function<void()> &task);
+
+// Finishes the queued tasks and joins the workers. Must be called before 
+// the plugin is unloaded; the pool is started again on next use.
+void stopThreads();
+
+#endif
\ No newline at end of file
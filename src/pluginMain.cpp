@@ -3,8 +3,11 @@
     You may use, distribute, or modify this code under the terms of the MIT license.
 */
 
+#include "boneToMeshBenchmarkCmd.h"
 #include "boneToMeshCmd.h"
+#include "boneToMeshMemoryCmd.h"
 #include "boneToMeshNode.h"
+#include "boneToMeshThreads.h"
 
 
 #include <maya/MFnPlugin.h>
@@ -24,6 +27,8 @@ MString BoneToMeshNode::NODE_NAME = "boneToMesh";
 MTypeId BoneToMeshNode::NODE_ID = 0x00126b0f;
 
 MString BoneToMeshCommand::COMMAND_NAME = "boneToMesh";
+MString BoneToMeshBenchmarkCommand::COMMAND_NAME = "boneToMeshBenchmark";
+MString BoneToMeshMemoryCommand::COMMAND_NAME = "boneToMeshMemory";
 
 
 MStatus initializePlugin(MObject obj)
@@ -49,6 +54,22 @@ MStatus initializePlugin(MObject obj)
 
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    status = fnPlugin.registerCommand(
+        BoneToMeshBenchmarkCommand::COMMAND_NAME, 
+        BoneToMeshBenchmarkCommand::creator, 
+        BoneToMeshBenchmarkCommand::getSyntax
+    );
+
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = fnPlugin.registerCommand(
+        BoneToMeshMemoryCommand::COMMAND_NAME, 
+        BoneToMeshMemoryCommand::creator, 
+        BoneToMeshMemoryCommand::getSyntax
+    );
+
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     return MS::kSuccess;
 }
 
@@ -63,6 +84,14 @@ MStatus uninitializePlugin(MObject obj)
 
     status = fnPlugin.deregisterCommand(BoneToMeshCommand::COMMAND_NAME);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = fnPlugin.deregisterCommand(BoneToMeshBenchmarkCommand::COMMAND_NAME);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = fnPlugin.deregisterCommand(BoneToMeshMemoryCommand::COMMAND_NAME);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    stopThreads();
     
     return MS::kSuccess;
 }
\ No newline at end of file
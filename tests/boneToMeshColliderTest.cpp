@@ -0,0 +1,187 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Projects a bone onto a tube with an elliptical cross-section and fits
+// its colliders. The capsule must cover every point of the rings, which
+// reach out to the semi-major axis, well past their mean radius.
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <maya/MFloatPointArray.h>
+#include <maya/MFloatVector.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
+#include <maya/MIntArray.h>
+#include <maya/MLibrary.h>
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+
+const int    COLLIDER_ROWS      = 24;
+const int    COLLIDER_COLUMNS   = 64;
+const double COLLIDER_MAJOR     = 2.0;
+const double COLLIDER_MINOR     = 0.5;
+const float  COLLIDER_TOLERANCE = 1e-3f;
+const double COLLIDER_PI        = 3.14159265358979323846;
+
+
+// Open tube of quads around the Y axis, twice as wide on X as the major
+// semi-axis is long and a quarter as deep on Z.
+static MStatus ellipticalTube(MObject &meshData)
+{
+    MStatus status;
+
+    MFloatPointArray points;
+    MIntArray polygonCounts;
+    MIntArray polygonConnects;
+
+    for (int r = 0; r <= COLLIDER_ROWS; r++)
+    {
+        for (int c = 0; c < COLLIDER_COLUMNS; c++)
+        {
+            double angle = 2.0 * COLLIDER_PI * double(c) / double(COLLIDER_COLUMNS);
+
+            points.append(MFloatPoint(
+                float(COLLIDER_MAJOR * std::cos(angle)),
+                float((4.0 * double(r) / double(COLLIDER_ROWS)) - 2.0),
+                float(COLLIDER_MINOR * std::sin(angle))
+            ));
+        }
+    }
+
+    for (int r = 0; r < COLLIDER_ROWS; r++)
+    {
+        for (int c = 0; c < COLLIDER_COLUMNS; c++)
+        {
+            polygonCounts.append(4);
+            polygonConnects.append((r * COLLIDER_COLUMNS) + c);
+            polygonConnects.append((r * COLLIDER_COLUMNS) + ((c + 1) % COLLIDER_COLUMNS));
+            polygonConnects.append(((r + 1) * COLLIDER_COLUMNS) + ((c + 1) % COLLIDER_COLUMNS));
+            polygonConnects.append(((r + 1) * COLLIDER_COLUMNS) + c);
+        }
+    }
+
+    MFnMeshData dataFn;
+    meshData = dataFn.create(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MFnMesh meshFn;
+    meshFn.create(points.length(), polygonCounts.length(), points, polygonCounts, polygonConnects, meshData, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+// Distance from a point to the segment of the capsule.
+static float segmentDistance(const BoneToMeshCapsule &capsule, const MFloatPoint &point)
+{
+    MFloatVector axis = capsule.end - capsule.start;
+    MFloatVector offset = point - capsule.start;
+
+    float lengthSquared = axis * axis;
+    float t = lengthSquared > 0.0f ? std::min(1.0f, std::max(0.0f, (offset * axis) / lengthSquared)) : 0.0f;
+
+    MFloatVector away = offset - (axis * t);
+
+    return std::sqrt(away * away);
+}
+
+
+int main()
+{
+    MStatus status = MLibrary::initialize("boneToMeshColliderTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    std::vector<MObject> meshes(1);
+    std::vector<MObject> components(1, MObject::kNullObj);
+
+    BoneToMeshScene scene;
+
+    status = ellipticalTube(meshes[0]);
+
+    if (status) { status = updateScene(meshes, components, scene); }
+
+    if (!status)
+    {
+        std::printf("the test mesh could not be read\n");
+        return 1;
+    }
+
+    MMatrix boneMatrix;
+    boneMatrix[3][1] = -1.5;
+
+    BoneToMeshParams params;
+    params.direction = 1;
+    params.boneLength = 3.0f;
+    params.subdivisionsX = 32;
+    params.subdivisionsY = 8;
+
+    BoneToMeshProjection proj;
+
+    initializeProjection(boneMatrix, boneMatrix, params, proj);
+    projectionVectors(params, proj);
+    projectBoneToMesh(scene, params, proj);
+
+    std::vector<BoneToMeshRing> rings;
+
+    fitRings(params, proj, rings);
+
+    BoneToMeshCapsule capsule = fitCapsule(params, proj, rings);
+
+    int numHits = 0;
+    int numOutside = 0;
+    float furthest = 0.0f;
+
+    for (size_t i = 0; i < proj.points.size() && i < proj.indices.size(); i++)
+    {
+        if (proj.indices[i] == -1) { continue; }
+
+        float distance = segmentDistance(capsule, proj.points[i]);
+
+        furthest = std::max(furthest, distance);
+        numHits++;
+
+        if (distance > capsule.radius + COLLIDER_TOLERANCE) { numOutside++; }
+    }
+
+    std::printf(
+        "%d points, capsule radius %g, furthest point %g, %d outside the capsule\n",
+        numHits, capsule.radius, furthest, numOutside
+    );
+
+    int failures = 0;
+
+    if (numHits == 0)
+    {
+        std::printf("no ray hit the tube\n");
+        failures++;
+    }
+
+    if (numOutside > 0) { failures++; }
+
+    // Covering the points must not take a capsule much wider than the tube.
+    if (capsule.radius > COLLIDER_MAJOR + COLLIDER_TOLERANCE)
+    {
+        std::printf("the capsule is wider than the tube\n");
+        failures++;
+    }
+
+    MLibrary::cleanup(0, false);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Fills random projections with every method and builds their meshes at
+// every LOD, against the loops the kernels replaced.
+
+#define NOMINMAX
+
+#include "boneToMeshEquivalence.h"
+#include "boneToMeshThreads.h"
+
+#include <cstdio>
+
+#include <maya/MLibrary.h>
+#include <maya/MStatus.h>
+
+const int          EQUIVALENCE_TEST_CASES = 200;
+const unsigned int EQUIVALENCE_TEST_SEED  = 1;
+
+
+int main()
+{
+    MStatus status = MLibrary::initialize("boneToMeshEquivalenceTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    BoneToMeshMeshFuzzReport report = fuzzMeshEquivalence(EQUIVALENCE_TEST_CASES, EQUIVALENCE_TEST_SEED);
+
+    long long mismatches = report.topologyMismatches + report.meshMismatches;
+
+    for (int method = 0; method < FUZZ_FILL_METHODS; method++)
+    {
+        std::printf("fill %d: %lld mismatches\n", method, report.fillMismatches[method]);
+
+        mismatches += report.fillMismatches[method];
+    }
+
+    std::printf("mesh arrays: %lld mismatches\n", report.topologyMismatches);
+    std::printf("meshes: %lld mismatches\n", report.meshMismatches);
+
+    if (report.firstCase != -1) { std::printf("first in case %d\n", report.firstCase); }
+
+    stopThreads();
+
+    MLibrary::cleanup(0, false);
+
+    return mismatches == 0 ? 0 : 1;
+}
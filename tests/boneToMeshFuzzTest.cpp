@@ -0,0 +1,55 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Runs the fuzz harness of the benchmark command over random scenes and
+// bones: every way of tracing must agree with the brute force reference.
+
+#include "boneToMeshBenchmark.h"
+#include "boneToMeshThreads.h"
+
+#include <cstdio>
+
+const int          FUZZ_TEST_CASES = 100;
+const unsigned int FUZZ_TEST_SEED  = 1;
+
+// Rays the reference may leave out before the check stops meaning much.
+const double FUZZ_TEST_MAX_AMBIGUOUS = 0.01;
+
+
+int main()
+{
+    BoneToMeshFuzzReport report = fuzzEquivalence(FUZZ_TEST_CASES, FUZZ_TEST_SEED);
+
+    int failures = 0;
+
+    for (int engine = 0; engine < FUZZ_ENGINES; engine++)
+    {
+        std::printf(
+            "%s: %lld mismatches, %lld rays too close to call",
+            fuzzEngineName(engine), report.mismatches[engine], report.ambiguous[engine]
+        );
+
+        if (report.firstCase[engine] != -1) { std::printf(", first in case %d", report.firstCase[engine]); }
+
+        std::printf("\n");
+
+        if (report.mismatches[engine] != 0) { failures++; }
+
+        // Four callers trace every ray of the concurrent engine.
+        long long rays = engine == FUZZ_CONCURRENT ? report.rays * 4 : report.rays;
+
+        if (engine != FUZZ_CLOSEST_POINTS && double(report.ambiguous[engine]) > FUZZ_TEST_MAX_AMBIGUOUS * double(rays))
+        {
+            std::printf("%s: too many rays left out\n", fuzzEngineName(engine));
+            failures++;
+        }
+    }
+
+    std::printf("%d cases, %lld rays\n", report.cases, report.rays);
+
+    stopThreads();
+
+    return failures == 0 ? 0 : 1;
+}
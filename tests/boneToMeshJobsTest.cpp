@@ -0,0 +1,255 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Submits many jobs of mixed priorities over two meshes, cancels some of
+// them, and checks every finished one against the same projection run on
+// the calling thread. A job whose callback throws must rethrow from get().
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshJobs.h"
+#include "boneToMeshThreads.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <maya/MFloatPointArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
+#include <maya/MIntArray.h>
+#include <maya/MLibrary.h>
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+
+const int    JOBS_COUNT    = 96;
+const int    JOBS_CANCEL   = 7;     // every seventh job is cancelled
+const double JOBS_PI       = 3.14159265358979323846;
+
+
+// Open tube of quads around the Y axis, rows high and columns around.
+static MStatus tubeMesh(double radius, int rows, int columns, MObject &meshData)
+{
+    MStatus status;
+
+    MFloatPointArray points;
+    MIntArray polygonCounts;
+    MIntArray polygonConnects;
+
+    for (int r = 0; r <= rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            double angle = 2.0 * JOBS_PI * double(c) / double(columns);
+            double wobble = 1.0 + (0.1 * std::sin(3.0 * angle + r));
+
+            points.append(MFloatPoint(
+                float(radius * wobble * std::cos(angle)),
+                float((4.0 * double(r) / double(rows)) - 2.0),
+                float(radius * wobble * std::sin(angle))
+            ));
+        }
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            polygonCounts.append(4);
+            polygonConnects.append((r * columns) + c);
+            polygonConnects.append((r * columns) + ((c + 1) % columns));
+            polygonConnects.append(((r + 1) * columns) + ((c + 1) % columns));
+            polygonConnects.append(((r + 1) * columns) + c);
+        }
+    }
+
+    MFnMeshData dataFn;
+    meshData = dataFn.create(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MFnMesh meshFn;
+    meshFn.create(points.length(), polygonCounts.length(), points, polygonCounts, polygonConnects, meshData, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+static void jobParams(int i, MMatrix &boneMatrix, BoneToMeshParams &params, uint &lod)
+{
+    boneMatrix = MMatrix();
+    boneMatrix[3][1] = -1.0 + (0.02 * (i % 10));
+
+    params.direction = 1;
+    params.boneLength = 2.0;
+    params.subdivisionsX = 8 + (uint) (4 * (i % 3));
+    params.subdivisionsY = 4 + (uint) (i % 4);
+    params.fillPartialLoopsMethod = i % 6;
+
+    lod = (uint) (i % 2);
+}
+
+
+static bool sameArrays(const BoneToMeshArrays &a, const BoneToMeshArrays &b)
+{
+    return a.points == b.points && a.polygonCounts == b.polygonCounts && a.polygonConnects == b.polygonConnects;
+}
+
+
+int main()
+{
+    MStatus status = MLibrary::initialize("boneToMeshJobsTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    std::vector<std::vector<MObject>> meshes(2);
+
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        MObject meshData;
+        status = tubeMesh(1.0 + (0.5 * m), 24, 32, meshData);
+
+        if (!status)
+        {
+            std::printf("the test mesh could not be created\n");
+            return 1;
+        }
+
+        meshes[m].push_back(meshData);
+    }
+
+    std::vector<MObject> components(1, MObject::kNullObj);
+
+    std::shared_ptr<BoneToMeshJobQueue> queue = std::make_shared<BoneToMeshJobQueue>();
+
+    std::vector<BoneToMeshJobHandle> handles(JOBS_COUNT);
+    std::atomic<int> callbacks(0);
+
+    for (int i = 0; i < JOBS_COUNT; i++)
+    {
+        MMatrix boneMatrix;
+        BoneToMeshParams params;
+        uint lod;
+
+        jobParams(i, boneMatrix, params, lod);
+
+        status = submitJob(
+            queue, meshes[i % 2], components, boneMatrix, MMatrix::identity, params, lod, i % 4,
+            [&callbacks](const BoneToMeshJobResult&) { callbacks++; },
+            handles[i]
+        );
+
+        if (!status)
+        {
+            std::printf("job %d could not be submitted\n", i);
+            return 1;
+        }
+
+        if (i % JOBS_CANCEL == 0) { cancelJob(handles[i]); }
+    }
+
+    BoneToMeshJobHandle throwing;
+
+    {
+        MMatrix boneMatrix;
+        BoneToMeshParams params;
+        uint lod;
+
+        jobParams(0, boneMatrix, params, lod);
+
+        submitJob(
+            queue, meshes[0], components, boneMatrix, MMatrix::identity, params, lod, 0,
+            [](const BoneToMeshJobResult&) { throw std::runtime_error("callback failed"); },
+            throwing
+        );
+    }
+
+    int failures = 0;
+    int cancelled = 0;
+
+    std::vector<BoneToMeshScene> scenes(meshes.size());
+
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        updateScene(meshes[m], components, scenes[m]);
+    }
+
+    for (int i = 0; i < JOBS_COUNT; i++)
+    {
+        const BoneToMeshJobResult &result = handles[i].result.get();
+
+        if (result.cancelled)
+        {
+            if (i % JOBS_CANCEL != 0)
+            {
+                std::printf("job %d was cancelled without being asked to\n", i);
+                failures++;
+            }
+
+            cancelled++;
+            continue;
+        }
+
+        MMatrix boneMatrix;
+        BoneToMeshParams params;
+        uint lod;
+
+        jobParams(i, boneMatrix, params, lod);
+
+        BoneToMeshProjection proj;
+        BoneToMeshArrays expected;
+
+        initializeProjection(boneMatrix, MMatrix::identity, params, proj);
+        projectionVectors(params, proj);
+        projectBoneToMesh(scenes[i % 2], params, proj);
+        fillPartialLoops(scenes[i % 2], params, proj);
+        lodMeshArrays(params, proj, lod, expected);
+
+        if (!result.status || !sameArrays(result.mesh, expected) || expected.polygonCounts.empty())
+        {
+            std::printf("job %d does not match its projection\n", i);
+            failures++;
+        }
+    }
+
+    bool rethrown = false;
+
+    try
+    {
+        throwing.result.get();
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+
+    if (!rethrown)
+    {
+        std::printf("the exception of a callback was not rethrown\n");
+        failures++;
+    }
+
+    if (callbacks.load() != JOBS_COUNT)
+    {
+        std::printf("%d callbacks for %d jobs\n", callbacks.load(), JOBS_COUNT);
+        failures++;
+    }
+
+    std::printf("jobs: %d finished, %d cancelled, %d failures\n", JOBS_COUNT - cancelled, cancelled, failures);
+
+    stopThreads();
+
+    MLibrary::cleanup(0, false);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,391 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Evaluates many node instances from many threads at once, the way the
+// parallel evaluation manager does, without the dependency graph. Each
+// instance keeps the state of a boneToMesh node and goes through the steps
+// of its compute:
+// - swapping in the spare scene while a refinement holds the current one
+// - updating the scene from deforming meshes
+// - tracing, or reusing a refinement once the background job has published it
+// - requesting and withdrawing refinements
+// - reporting its memory, half the time against a budget so small that every
+//   report evicts the caches of the other instances
+// Every projection is checked against the same projection onto a scene
+// built on its own. Built with ThreadSanitizer, which fails the test on the
+// first data race.
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshMemory.h"
+#include "boneToMeshProgressive.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <maya/MFloatPointArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
+#include <maya/MIntArray.h>
+#include <maya/MLibrary.h>
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+
+const int    NODE_STRESS_NODES     = 6;
+const int    NODE_STRESS_CALLERS   = 4;
+const int    NODE_STRESS_ROUNDS    = 48;
+const int    NODE_STRESS_FRAMES    = 4;
+const int    NODE_STRESS_HOLD      = 4;         // rounds each caller stays on an instance and frame
+const double NODE_STRESS_BUDGET_MS = 0.001;     // coarse grids once a ray rate is known
+const float  NODE_STRESS_TOLERANCE = 1e-4f;
+const double NODE_STRESS_PI        = 3.14159265358979323846;
+
+
+// Open tube of quads around the Y axis that ripples differently every frame.
+static MStatus tubeMesh(int frame, MObject &meshData)
+{
+    MStatus status;
+
+    const int rows = 24;
+    const int columns = 32;
+
+    MFloatPointArray points;
+    MIntArray polygonCounts;
+    MIntArray polygonConnects;
+
+    for (int r = 0; r <= rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            double angle = 2.0 * NODE_STRESS_PI * double(c) / double(columns);
+            double wobble = 1.0 + (0.1 * std::sin((3.0 * angle) + r + frame));
+
+            points.append(MFloatPoint(
+                float(wobble * std::cos(angle)),
+                float((4.0 * double(r) / double(rows)) - 2.0),
+                float(wobble * std::sin(angle))
+            ));
+        }
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            polygonCounts.append(4);
+            polygonConnects.append((r * columns) + c);
+            polygonConnects.append((r * columns) + ((c + 1) % columns));
+            polygonConnects.append(((r + 1) * columns) + ((c + 1) % columns));
+            polygonConnects.append(((r + 1) * columns) + c);
+        }
+    }
+
+    MFnMeshData dataFn;
+    meshData = dataFn.create(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MFnMesh meshFn;
+    meshFn.create(points.length(), polygonCounts.length(), points, polygonCounts, polygonConnects, meshData, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+static void frameInputs(int frame, MMatrix &boneMatrix, BoneToMeshParams &params)
+{
+    boneMatrix = MMatrix();
+    boneMatrix[3][1] = -1.0 + (0.05 * frame);
+
+    params.direction = 1;
+    params.boneLength = 2.0f;
+    params.subdivisionsX = 32;
+    params.subdivisionsY = 16;
+    params.fillPartialLoopsMethod = frame % 6;
+}
+
+
+// Inputs of every frame, and their scenes built once on the main thread.
+struct NodeStressFrames
+{
+    std::vector<std::vector<MObject>> meshes;
+    std::vector<BoneToMeshScene>      scenes;
+    std::vector<MObject>              components;
+};
+
+
+// What a boneToMesh node keeps between evaluations.
+struct NodeStressInstance
+{
+    std::mutex computeMutex;
+
+    std::shared_ptr<BoneToMeshScene> scene = std::make_shared<BoneToMeshScene>();
+    std::shared_ptr<BoneToMeshScene> spareScene;
+
+    BoneToMeshProjection proj;
+
+    std::shared_ptr<BoneToMeshProgressive> progressive = std::make_shared<BoneToMeshProgressive>();
+
+    int memoryOwner = 0;
+
+    BoneToMeshMemoryUsage memoryUsage()
+    {
+        BoneToMeshMemoryUsage usage;
+
+        usage.acceleration = memoryScene(*this->scene);
+
+        if (this->spareScene) { usage.acceleration += memoryScene(*this->spareScene); }
+
+        usage.hits = memoryProjection(this->proj);
+
+        std::lock_guard<std::mutex> lock(this->progressive->mutex);
+
+        usage.hits += memoryProjection(this->progressive->front);
+
+        const BoneToMeshScene *refining = this->progressive->refining.get();
+
+        if (refining != nullptr && refining != this->scene.get() && refining != this->spareScene.get())
+        {
+            usage.acceleration += memoryScene(*refining);
+        }
+
+        return usage;
+    }
+
+    bool releaseCaches(BoneToMeshMemoryUsage &usage)
+    {
+        std::unique_lock<std::mutex> lock(this->computeMutex, std::try_to_lock);
+
+        if (!lock.owns_lock()) { return false; }
+
+        this->scene = std::make_shared<BoneToMeshScene>();
+        this->spareScene.reset();
+
+        releaseHits(this->proj);
+
+        usage = this->memoryUsage();
+
+        return true;
+    }
+
+    BoneToMeshScene& writableScene()
+    {
+        withdrawRefinement(*this->progressive);
+
+        if (this->scene.use_count() > 1)
+        {
+            if (!this->spareScene || this->spareScene.use_count() > 1)
+            {
+                this->spareScene = std::make_shared<BoneToMeshScene>();
+            }
+
+            std::swap(this->scene, this->spareScene);
+        }
+
+        return *this->scene;
+    }
+
+    // Returns the number of points unlike the projection onto the scene of
+    // the frame built on its own, or -1 if the evaluation failed. Counts the
+    // evaluations that took a published refinement.
+    int evaluate(const NodeStressFrames &frames, int frame, bool progressive, std::atomic<int> &numRefined)
+    {
+        std::lock_guard<std::mutex> lock(this->computeMutex);
+
+        MMatrix boneMatrix;
+        BoneToMeshParams params;
+
+        frameInputs(frame, boneMatrix, params);
+
+        BoneToMeshScene &scene = this->writableScene();
+
+        if (!progressive) { cancelRefinement(*this->progressive); }
+
+        MStatus status = updateScene(frames.meshes[frame], frames.components, scene);
+
+        if (!status) { return -1; }
+
+        bool refined = false;
+
+        if (progressive)
+        {
+            BoneToMeshRefineRequest request;
+            request.params = params;
+            request.boneMatrix = boneMatrix;
+            request.directionMatrix = boneMatrix;
+            request.sceneVersion = scene.version;
+
+            refined = refinedProjection(*this->progressive, request, this->proj);
+
+            if (refined) { numRefined++; }
+
+            if (!refined)
+            {
+                BoneToMeshParams coarseParams = progressiveParams(*this->progressive, params, NODE_STRESS_BUDGET_MS);
+
+                if (!sameParams(coarseParams, params))
+                {
+                    requestRefinement(this->progressive, this->scene, request, MString());
+
+                    params = coarseParams;
+                }
+            }
+        }
+
+        if (!refined)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            initializeProjection(boneMatrix, boneMatrix, params, this->proj);
+            projectionVectors(params, this->proj);
+            projectBoneToMesh(scene, params, this->proj);
+            fillPartialLoops(scene, params, this->proj);
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (progressive) { measureRayRate(*this->progressive, this->proj.maxVertices, elapsed.count()); }
+        }
+
+        BoneToMeshProjection expected;
+
+        initializeProjection(boneMatrix, boneMatrix, params, expected);
+        projectionVectors(params, expected);
+        projectBoneToMesh(frames.scenes[frame], params, expected);
+        fillPartialLoops(frames.scenes[frame], params, expected);
+
+        int mismatches = 0;
+
+        if (expected.points.size() != this->proj.points.size())
+        {
+            mismatches = (int) std::max(expected.points.size(), this->proj.points.size());
+        } else {
+            for (size_t i = 0; i < expected.points.size(); i++)
+            {
+                if (expected.points[i].distanceTo(this->proj.points[i]) > NODE_STRESS_TOLERANCE) { mismatches++; }
+            }
+        }
+
+        // Reporting may evict the caches of other instances to make room for these.
+        reportMemory(this->memoryOwner, this->memoryUsage());
+
+        return mismatches;
+    }
+};
+
+
+int main()
+{
+    MStatus status = MLibrary::initialize("boneToMeshNodeStressTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    NodeStressFrames frames;
+    frames.meshes.resize(NODE_STRESS_FRAMES);
+    frames.scenes.resize(NODE_STRESS_FRAMES);
+    frames.components.push_back(MObject::kNullObj);
+
+    for (int frame = 0; frame < NODE_STRESS_FRAMES; frame++)
+    {
+        MObject meshData;
+        status = tubeMesh(frame, meshData);
+
+        if (status)
+        {
+            frames.meshes[frame].push_back(meshData);
+            status = updateScene(frames.meshes[frame], frames.components, frames.scenes[frame]);
+        }
+
+        if (!status)
+        {
+            std::printf("the mesh of frame %d could not be created\n", frame);
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<NodeStressInstance>> instances;
+
+    for (int n = 0; n < NODE_STRESS_NODES; n++)
+    {
+        instances.push_back(std::unique_ptr<NodeStressInstance>(new NodeStressInstance()));
+
+        NodeStressInstance *instance = instances.back().get();
+
+        instance->memoryOwner = registerMemoryOwner([instance](BoneToMeshMemoryUsage &usage) {
+            return instance->releaseCaches(usage);
+        });
+    }
+
+    std::atomic<int> mismatches(0);
+    std::atomic<int> failures(0);
+    std::atomic<int> refined(0);
+    std::vector<std::thread> callers;
+
+    for (int c = 0; c < NODE_STRESS_CALLERS; c++)
+    {
+        callers.push_back(std::thread([&, c]() {
+            for (int round = 0; round < NODE_STRESS_ROUNDS; round++)
+            {
+                // Playback holds each instance on a frame for a few rounds, 
+                // so refinements are published and picked up, then moves on.
+                // Every other block runs under a budget so small that each
+                // report evicts the caches of the other instances.
+                int block = round / NODE_STRESS_HOLD;
+
+                if (c == 0 && round % NODE_STRESS_HOLD == 0) { setMemoryBudget(block % 2 == 0 ? 1 : 0); }
+
+                NodeStressInstance &instance = *instances[(c + block) % NODE_STRESS_NODES];
+
+                int frame = (block + c) % NODE_STRESS_FRAMES;
+                bool progressive = (block % 4) != 3;
+
+                int result = instance.evaluate(frames, frame, progressive, refined);
+
+                if (result < 0) { failures++; }
+                else            { mismatches += result; }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }));
+    }
+
+    for (std::thread &caller : callers) { caller.join(); }
+
+    for (std::unique_ptr<NodeStressInstance> &instance : instances)
+    {
+        unregisterMemoryOwner(instance->memoryOwner);
+        cancelRefinement(*instance->progressive);
+    }
+
+    stopThreads();
+
+    std::printf(
+        "%d instances, %d evaluations, %d refined: %d points unlike their reference, %d failed evaluations\n",
+        NODE_STRESS_NODES, NODE_STRESS_CALLERS * NODE_STRESS_ROUNDS, refined.load(), mismatches.load(), failures.load()
+    );
+
+    instances.clear();
+    frames = NodeStressFrames();
+
+    MLibrary::cleanup(0, false);
+
+    return mismatches.load() == 0 && failures.load() == 0 ? 0 : 1;
+}
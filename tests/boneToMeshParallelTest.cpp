@@ -0,0 +1,192 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Loads the plug-in, rigs several boneToMesh nodes onto deforming meshes
+// and animated bones, and plays them back under the parallel evaluation
+// manager. Every frame must match the same frame evaluated serially by
+// the dependency graph.
+//
+// Usage: boneToMeshParallelTest <plug-in>
+
+#define NOMINMAX
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <maya/MDoubleArray.h>
+#include <maya/MGlobal.h>
+#include <maya/MLibrary.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+#include <maya/MStringArray.h>
+
+const int    PARALLEL_NODES     = 8;
+const int    PARALLEL_FRAMES    = 12;
+const double PARALLEL_TOLERANCE = 1e-4;
+
+
+// A cylinder whose radius and a locator whose height are keyed over the
+// frames, projected onto by a node that feeds a mesh, so the evaluation
+// manager schedules it. Node n is named proxy<n> and its mesh result<n>.
+static MStatus rigNode(int n)
+{
+    MString rig("{\n");
+
+    rig += "string $source[] = `polyCylinder -r 1 -h 4 -sx 32 -sy 24`;\n";
+    rig += "setKeyframe -t 1 -v 1.0 -at radius $source[1];\n";
+    rig += "setKeyframe -t ";
+    rig += PARALLEL_FRAMES;
+    rig += " -v ";
+    rig += 1.5 + (0.1 * n);
+    rig += " -at radius $source[1];\n";
+
+    rig += "string $bone[] = `spaceLocator`;\n";
+    rig += "setKeyframe -t 1 -v -1.5 -at translateY $bone[0];\n";
+    rig += "setKeyframe -t ";
+    rig += PARALLEL_FRAMES;
+    rig += " -v 0.5 -at translateY $bone[0];\n";
+
+    rig += "string $proxy = `createNode boneToMesh -n proxy";
+    rig += n;
+    rig += "`;\n";
+    rig += "setAttr ($proxy + \".boneLength\") 2;\n";
+    rig += "setAttr ($proxy + \".subdivisionsAxis\") 24;\n";
+    rig += "setAttr ($proxy + \".subdivisionsHeight\") 12;\n";
+    rig += "connectAttr ($source[0] + \".worldMesh[0]\") ($proxy + \".inMesh\");\n";
+    rig += "connectAttr ($bone[0] + \".worldMatrix[0]\") ($proxy + \".boneMatrix\");\n";
+
+    rig += "string $result = `createNode mesh -n result";
+    rig += n;
+    rig += "`;\n";
+    rig += "connectAttr ($proxy + \".outMesh\") ($result + \".inMesh\");\n";
+    rig += "}\n";
+
+    return MGlobal::executeCommand(rig);
+}
+
+
+// Plays every frame in the given evaluation mode and reads the points of
+// every result mesh, frame by frame and node by node.
+static MStatus playBack(const MString &mode, std::vector<MDoubleArray> &points)
+{
+    MStatus status;
+
+    status = MGlobal::executeCommand("evaluationManager -mode \"" + mode + "\";");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MStringArray activeMode;
+
+    status = MGlobal::executeCommand("evaluationManager -q -mode;", activeMode);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    if (activeMode.length() != 1 || activeMode[0] != mode)
+    {
+        std::printf("the evaluation manager did not switch to %s\n", mode.asChar());
+        return MStatus::kFailure;
+    }
+
+    points.clear();
+
+    for (int frame = 1; frame <= PARALLEL_FRAMES; frame++)
+    {
+        MString setTime("currentTime ");
+        setTime += frame;
+        setTime += ";";
+
+        status = MGlobal::executeCommand(setTime);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        for (int n = 0; n < PARALLEL_NODES; n++)
+        {
+            MDoubleArray nodePoints;
+
+            MString query("xform -q -ws -t result");
+            query += n;
+            query += ".vtx[*];";
+
+            status = MGlobal::executeCommand(query, nodePoints);
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            points.push_back(nodePoints);
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: boneToMeshParallelTest <plug-in>\n");
+        return 1;
+    }
+
+    MStatus status = MLibrary::initialize("boneToMeshParallelTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    MString loadPlugin("loadPlugin \"");
+    loadPlugin += argv[1];
+    loadPlugin += "\";";
+
+    status = MGlobal::executeCommand(loadPlugin);
+
+    if (!status)
+    {
+        std::printf("the plug-in '%s' could not be loaded\n", argv[1]);
+        return 1;
+    }
+
+    for (int n = 0; n < PARALLEL_NODES && status; n++) { status = rigNode(n); }
+
+    std::vector<MDoubleArray> parallelPoints;
+    std::vector<MDoubleArray> serialPoints;
+
+    if (status) { status = playBack("parallel", parallelPoints); }
+    if (status) { status = playBack("off", serialPoints); }
+
+    if (!status)
+    {
+        std::printf("the nodes could not be rigged and played back\n");
+        return 1;
+    }
+
+    int mismatches = 0;
+
+    for (size_t i = 0; i < serialPoints.size(); i++)
+    {
+        int frame = 1 + int(i / PARALLEL_NODES);
+        int n = int(i % PARALLEL_NODES);
+
+        const MDoubleArray &parallel = parallelPoints[i];
+        const MDoubleArray &serial = serialPoints[i];
+
+        bool same = parallel.length() == serial.length() && serial.length() > 0;
+
+        for (unsigned int p = 0; same && p < serial.length(); p++)
+        {
+            same = std::fabs(parallel[p] - serial[p]) <= PARALLEL_TOLERANCE;
+        }
+
+        if (!same)
+        {
+            std::printf("frame %d, node %d: parallel and serial evaluation differ\n", frame, n);
+            mismatches++;
+        }
+    }
+
+    std::printf("%d nodes, %d frames, %d mismatches\n", PARALLEL_NODES, PARALLEL_FRAMES, mismatches);
+
+    MLibrary::cleanup(0, false);
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Moves a mesh with its bone, then deforms a few vertices locally, as a
+// blendshape or corrective would. Rigid motion must be reused, and any
+// local deformation must not be, wherever in the vertex list it lands.
+
+#define NOMINMAX
+
+#include "boneToMesh.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <maya/MFloatPointArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
+#include <maya/MIntArray.h>
+#include <maya/MLibrary.h>
+#include <maya/MMatrix.h>
+#include <maya/MObject.h>
+#include <maya/MPoint.h>
+#include <maya/MStatus.h>
+
+const int    RIGID_ROWS      = 64;
+const int    RIGID_COLUMNS   = 32;
+const double RIGID_TOLERANCE = 0.0001;
+const double RIGID_PI        = 3.14159265358979323846;
+
+
+// Open tube of quads around the Y axis, with the points moved by matrix.
+static MStatus tubeMesh(const MMatrix &matrix, const std::vector<int> &moved, MObject &meshData)
+{
+    MStatus status;
+
+    MFloatPointArray points;
+    MIntArray polygonCounts;
+    MIntArray polygonConnects;
+
+    for (int r = 0; r <= RIGID_ROWS; r++)
+    {
+        for (int c = 0; c < RIGID_COLUMNS; c++)
+        {
+            double angle = 2.0 * RIGID_PI * double(c) / double(RIGID_COLUMNS);
+            double y = (4.0 * double(r) / double(RIGID_ROWS)) - 2.0;
+
+            MPoint point(std::cos(angle), y, std::sin(angle));
+
+            points.append(MFloatPoint(point * matrix));
+        }
+    }
+
+    for (int index : moved) { points[(uint) index].x += 0.05f; }
+
+    for (int r = 0; r < RIGID_ROWS; r++)
+    {
+        for (int c = 0; c < RIGID_COLUMNS; c++)
+        {
+            polygonCounts.append(4);
+            polygonConnects.append((r * RIGID_COLUMNS) + c);
+            polygonConnects.append((r * RIGID_COLUMNS) + ((c + 1) % RIGID_COLUMNS));
+            polygonConnects.append(((r + 1) * RIGID_COLUMNS) + ((c + 1) % RIGID_COLUMNS));
+            polygonConnects.append(((r + 1) * RIGID_COLUMNS) + c);
+        }
+    }
+
+    MFnMeshData dataFn;
+    meshData = dataFn.create(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MFnMesh meshFn;
+    meshFn.create(points.length(), polygonCounts.length(), points, polygonCounts, polygonConnects, meshData, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return MStatus::kSuccess;
+}
+
+
+// Whether the mesh moved by matrix, with the vertices in moved displaced,
+// is found to have moved rigidly with a bone, and the direction matrix of
+// its rig, moved by the same matrix.
+static MStatus movedRigidly(
+    const BoneToMeshRigidCache &cache,
+    const MMatrix &matrix,
+    const std::vector<int> &moved,
+    double tolerance,
+    bool &rigid
+) {
+    MStatus status;
+
+    std::vector<MObject> meshes(1);
+    std::vector<MObject> components(1, MObject::kNullObj);
+
+    status = tubeMesh(matrix, moved, meshes[0]);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    BoneToMeshParams params;
+    BoneToMeshRigidState state;
+
+    status = rigidState(meshes, components, matrix, matrix, params, state);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    rigid = isRigidMotion(cache, state, tolerance);
+
+    return MStatus::kSuccess;
+}
+
+
+int main()
+{
+    MStatus status = MLibrary::initialize("boneToMeshRigidTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    std::vector<MObject> meshes(1);
+    std::vector<MObject> components(1, MObject::kNullObj);
+
+    status = tubeMesh(MMatrix::identity, std::vector<int>(), meshes[0]);
+
+    BoneToMeshParams params;
+    BoneToMeshRigidState state;
+    BoneToMeshProjection proj;
+    BoneToMeshRigidCache cache;
+
+    if (status) { status = rigidState(meshes, components, MMatrix::identity, MMatrix::identity, params, state); }
+
+    if (!status)
+    {
+        std::printf("the test mesh could not be read\n");
+        return 1;
+    }
+
+    storeRigidProjection(state, proj, cache);
+
+    // A quarter turn about Z and a step along every axis.
+    MMatrix moved;
+    moved[0][0] = 0.0;  moved[0][1] = 1.0;
+    moved[1][0] = -1.0; moved[1][1] = 0.0;
+    moved[3][0] = 0.5;  moved[3][1] = -0.25; moved[3][2] = 2.0;
+
+    int numVertices = (RIGID_ROWS + 1) * RIGID_COLUMNS;
+
+    struct RigidCase
+    {
+        const char*      name;
+        MMatrix          matrix;
+        std::vector<int> vertices;
+        double           tolerance;
+        bool             rigid;
+    };
+
+    // Sampling 32 evenly spaced vertices, as rigid motion once was found,
+    // reads every 65th, so the local cases move none of those.
+    std::vector<RigidCase> cases = {
+        {"still, zero tolerance", MMatrix::identity, {},                0.0,                   true},
+        {"moved with the bone",   moved,             {},                RIGID_TOLERANCE,       true},
+        {"one vertex",            MMatrix::identity, {1},               RIGID_TOLERANCE,       false},
+        {"moved, three vertices", moved,             {100, 101, 133},   RIGID_TOLERANCE,       false},
+        {"the last vertex",       MMatrix::identity, {numVertices - 1}, RIGID_TOLERANCE,       false}
+    };
+
+    int failures = 0;
+
+    for (const RigidCase &rigidCase : cases)
+    {
+        bool rigid = false;
+
+        status = movedRigidly(cache, rigidCase.matrix, rigidCase.vertices, rigidCase.tolerance, rigid);
+
+        if (!status)
+        {
+            std::printf("%s: the mesh could not be read\n", rigidCase.name);
+            failures++;
+        } else if (rigid != rigidCase.rigid) {
+            std::printf("%s: %s, expected %s\n", rigidCase.name, rigid ? "rigid" : "deformed", rigidCase.rigid ? "rigid" : "deformed");
+            failures++;
+        } else {
+            std::printf("%s: ok\n", rigidCase.name);
+        }
+    }
+
+    MLibrary::cleanup(0, false);
+
+    return failures == 0 ? 0 : 1;
+}
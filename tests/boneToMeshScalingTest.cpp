@@ -0,0 +1,163 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Runs the small end of the scaling matrix on one thread and compares it
+// with a baseline written by an earlier run on the same machine, relative
+// to the reference workload timed with each case. Fails if any case is
+// slower than the threshold allows in every one of three runs, or if the
+// baseline has none of the cases.
+//
+// Usage: boneToMeshScalingTest <baseline> <threshold>
+//
+// Timings only compare on the machine they were taken on, so none are
+// checked in. Without a baseline the results are written as one and the
+// test is skipped. Delete the file to take a new one.
+
+#define NOMINMAX
+
+#include "boneToMeshScaling.h"
+#include "boneToMeshThreads.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <maya/MLibrary.h>
+#include <maya/MStatus.h>
+
+const int    SCALING_TEST_REPEATS = 5;
+const double SCALING_TEST_MIN_MS  = 20.0;   // per case, see BoneToMeshScalingOptions::minMs
+const int    SCALING_TEST_RUNS    = 3;
+const int    SCALING_TEST_SKIPPED = 77;     // SKIP_RETURN_CODE of the test
+
+
+// Whether a time is faster than another, each relative to the reference
+// workload timed alongside it.
+static bool fasterRelative(double ms, double referenceMs, double otherMs, double otherReferenceMs)
+{
+    return ms * otherReferenceMs < otherMs * referenceMs;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::printf("usage: boneToMeshScalingTest <baseline> <threshold>\n");
+        return 1;
+    }
+
+    std::string baselinePath(argv[1]);
+    double threshold = std::atof(argv[2]);
+
+    MStatus status = MLibrary::initialize("boneToMeshScalingTest");
+
+    if (!status)
+    {
+        std::printf("Maya could not be initialized\n");
+        return 1;
+    }
+
+    BoneToMeshScalingOptions options;
+    options.triangleCounts = {10000, 100000};
+    options.subdivisions = {32, 128};
+    options.threadCounts = {1};
+    options.repeats = SCALING_TEST_REPEATS;
+    options.minMs = SCALING_TEST_MIN_MS;
+
+    std::vector<BoneToMeshScalingResult> baseline;
+
+    int failures = 0;
+
+    if (!std::ifstream(baselinePath))
+    {
+        std::vector<BoneToMeshScalingResult> results;
+
+        benchmarkScaling(options, results);
+
+        std::ofstream file(baselinePath);
+        file << scalingJson(results, options.repeats);
+
+        stopThreads();
+
+        MLibrary::cleanup(0, false);
+
+        if (!file)
+        {
+            std::printf("cannot write the baseline '%s'\n", baselinePath.c_str());
+            return 1;
+        }
+
+        std::printf("no baseline yet, wrote '%s' for later runs to compare with\n", baselinePath.c_str());
+        return SCALING_TEST_SKIPPED;
+    }
+
+    if (!readScalingBaseline(baselinePath, baseline))
+    {
+        std::printf("cannot read the results of baseline '%s'\n", baselinePath.c_str());
+        failures++;
+    }
+
+    std::vector<BoneToMeshScalingResult> results;
+    std::vector<std::string> regressions;
+    int numCompared = 0;
+
+    // A case only regresses if it is slow in every run, so a run that
+    // another process slowed down is retried, keeping the fastest times
+    // relative to the reference.
+    for (int run = 0; run < SCALING_TEST_RUNS; run++)
+    {
+        std::vector<BoneToMeshScalingResult> runResults;
+
+        benchmarkScaling(options, runResults);
+
+        if (results.empty()) { results = runResults; }
+
+        for (size_t i = 0; i < results.size() && i < runResults.size(); i++)
+        {
+            BoneToMeshScalingResult &result = results[i];
+            const BoneToMeshScalingResult &runResult = runResults[i];
+
+            if (fasterRelative(runResult.buildMs, runResult.buildReferenceMs, result.buildMs, result.buildReferenceMs))
+            {
+                result.buildMs = runResult.buildMs;
+                result.buildReferenceMs = runResult.buildReferenceMs;
+            }
+
+            if (fasterRelative(runResult.projectMs, runResult.projectReferenceMs, result.projectMs, result.projectReferenceMs))
+            {
+                result.projectMs = runResult.projectMs;
+                result.projectReferenceMs = runResult.projectReferenceMs;
+            }
+        }
+
+        regressions.clear();
+        numCompared = compareScaling(results, baseline, threshold, regressions);
+
+        if (regressions.empty()) { break; }
+    }
+
+    for (const std::string &regression : regressions)
+    {
+        std::printf("slower than baseline: %s\n", regression.c_str());
+    }
+
+    std::printf(
+        "%d of %d results compared with the baseline, %d slower by more than %g%%\n",
+        numCompared, int(results.size()), int(regressions.size()), threshold * 100.0
+    );
+
+    if (numCompared == 0) { failures++; }
+    if (!regressions.empty()) { failures++; }
+
+    stopThreads();
+
+    MLibrary::cleanup(0, false);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+/**
+    Copyright (c) 2017 Ryan Porter
+    You may use, distribute, or modify this code under the terms of the MIT license.
+*/
+
+// Loads the thread pool and the shared ray queue from many threads at once,
+// as parallel evaluation and cached playback do, and checks every result
+// against a serial run. Built with ThreadSanitizer, which fails the test
+// on the first data race.
+
+#include "boneToMeshBenchmark.h"
+#include "boneToMeshBVH.h"
+#include "boneToMeshRayQueue.h"
+#include "boneToMeshThreads.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+const int STRESS_TRIANGLES = 5000;
+const int STRESS_INSTANCES = 8;
+const int STRESS_CALLERS   = 8;
+const int STRESS_ROUNDS    = 12;
+const int STRESS_RAYS      = 512;
+
+
+// Nested parallel loops and async tasks from every caller, while one of
+// them keeps changing the thread limit.
+static int stressThreadPool()
+{
+    std::atomic<long long> total(0);
+    std::vector<std::thread> callers;
+
+    for (int c = 0; c < STRESS_CALLERS; c++)
+    {
+        callers.push_back(std::thread([&total, c]() {
+            for (int round = 0; round < STRESS_ROUNDS; round++)
+            {
+                if (c == 0) { setThreadLimit(round % 4); }
+
+                parallelFor(0, 256, 8, [&total](int begin, int end) {
+                    for (int i = begin; i < end; i++)
+                    {
+                        parallelFor(0, 16, 1, [&total](int b, int e) { total += e - b; });
+                    }
+                });
+
+                std::future<void> task = runAsync([&total]() { total += 1; });
+                task.get();
+            }
+        }));
+    }
+
+    for (std::thread &caller : callers) { caller.join(); }
+
+    setThreadLimit(0);
+
+    long long expected = (long long) STRESS_CALLERS * STRESS_ROUNDS * ((256 * 16) + 1);
+
+    if (total.load() != expected)
+    {
+        std::printf("thread pool: counted %lld of %lld\n", total.load(), expected);
+        return 1;
+    }
+
+    std::printf("thread pool: ok\n");
+    return 0;
+}
+
+
+// Bodies that throw on some chunks, from every caller at once. Each call
+// must rethrow on its caller, and only after every chunk it started has
+// finished, as the bodies write to the caller's stack.
+static int stressExceptions()
+{
+    std::atomic<int> failures(0);
+    std::vector<std::thread> callers;
+
+    for (int c = 0; c < STRESS_CALLERS; c++)
+    {
+        callers.push_back(std::thread([&failures, c]() {
+            for (int round = 0; round < STRESS_ROUNDS; round++)
+            {
+                std::vector<int> written(256, 0);
+                std::atomic<int> running(0);
+                bool thrown = false;
+
+                try
+                {
+                    parallelFor(0, 256, 8, [&written, &running, c, round](int begin, int end) {
+                        running++;
+
+                        for (int i = begin; i < end; i++) { written[i] = 1; }
+
+                        std::this_thread::yield();
+                        running--;
+
+                        int failing = ((c + round) % 4) * 64;
+
+                        if (begin <= failing && failing < end) { throw std::runtime_error("chunk failed"); }
+                    });
+                } catch (const std::runtime_error&) {
+                    thrown = true;
+                }
+
+                if (!thrown || running.load() != 0) { failures++; }
+            }
+        }));
+    }
+
+    for (std::thread &caller : callers) { caller.join(); }
+
+    if (failures.load() != 0)
+    {
+        std::printf("exceptions: %d calls did not rethrow after their chunks\n", failures.load());
+        return 1;
+    }
+
+    std::printf("exceptions: ok\n");
+    return 0;
+}
+
+
+// Rigs that refit their mesh and trace through the queue every frame,
+// each on its own thread, against the same rigs one after another.
+static int stressConcurrentRigs()
+{
+    BoneToMeshConcurrencyTiming timing = benchmarkConcurrency(STRESS_TRIANGLES, STRESS_INSTANCES, 2);
+
+    std::printf(
+        "concurrent rigs: %d instances, %d rays each, %d mismatches\n",
+        timing.instances, timing.rays, timing.mismatches
+    );
+
+    return timing.mismatches == 0 ? 0 : 1;
+}
+
+
+// Callers share scenes and submit batches in every order while background
+// batches on the same scenes are cancelled half way. Queued hits must match
+// tracing each ray on its own; cancelled ones may only come back as misses.
+static int stressRayQueue()
+{
+    const int numScenes = 2;
+
+    std::vector<BoneToMeshScene> scenes(numScenes);
+
+    for (int s = 0; s < numScenes; s++)
+    {
+        scenes[s].meshes.resize(1);
+        scenes[s].changes.resize(1);
+        scenes[s].buildMethod = s == 0 ? BVH_BUILD_SAH : BVH_BUILD_MORTON;
+        scenes[s].compact = s == 1;
+
+        benchmarkMesh(STRESS_TRIANGLES, scenes[s].meshes[0]);
+
+        scenes[s].meshes[0].buildMethod = scenes[s].buildMethod;
+        scenes[s].meshes[0].compact = scenes[s].compact;
+
+        buildBVH(scenes[s].meshes[0]);
+        buildSceneBVH(scenes[s]);
+    }
+
+    std::vector<BoneToMeshRay> rays(STRESS_RAYS);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    for (BoneToMeshRay &ray : rays)
+    {
+        float length = 0.0f;
+
+        for (int a = 0; a < 3; a++)
+        {
+            ray.origin[a] = 0.25f * unit(generator);
+            ray.direction[a] = unit(generator);
+            length += ray.direction[a] * ray.direction[a];
+        }
+
+        for (int a = 0; a < 3; a++) { ray.direction[a] /= std::sqrt(length); }
+
+        ray.maxParam = 1e30f;
+    }
+
+    std::vector<std::vector<BoneToMeshHit>> expected(numScenes, std::vector<BoneToMeshHit>(STRESS_RAYS));
+
+    for (int s = 0; s < numScenes; s++)
+    {
+        for (int r = 0; r < STRESS_RAYS; r++) { intersectScene(scenes[s], rays[r], expected[s][r]); }
+    }
+
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> callers;
+
+    for (int c = 0; c < STRESS_CALLERS; c++)
+    {
+        callers.push_back(std::thread([&, c]() {
+            for (int round = 0; round < STRESS_ROUNDS; round++)
+            {
+                int s = (c + round) % numScenes;
+                bool background = (c % 4) == 3;
+
+                std::shared_ptr<BoneToMeshRayBatch> batch = std::make_shared<BoneToMeshRayBatch>();
+                batch->scene = &scenes[s];
+                batch->order = (c + round) % 3;
+                batch->incoherent = (round % 2) == 1;
+                batch->rays = rays;
+                batch->background = background;
+
+                std::shared_ptr<std::atomic<bool>> cancelled;
+
+                if (background)
+                {
+                    cancelled = std::make_shared<std::atomic<bool>>(false);
+                    batch->cancelled = cancelled;
+                }
+
+                std::thread canceller;
+
+                if (background && (round % 2) == 0)
+                {
+                    canceller = std::thread([cancelled]() { cancelled->store(true); });
+                }
+
+                traceRays(batch);
+
+                if (canceller.joinable()) { canceller.join(); }
+
+                for (int r = 0; r < STRESS_RAYS; r++)
+                {
+                    const BoneToMeshHit &hit = batch->hits[r];
+                    const BoneToMeshHit &want = expected[s][r];
+
+                    bool same = hit.mesh == want.mesh && hit.triangle == want.triangle && hit.param == want.param;
+                    bool missed = background && cancelled->load() && hit.mesh == -1;
+
+                    if (!same && !missed) { mismatches++; }
+                }
+            }
+        }));
+    }
+
+    for (std::thread &caller : callers) { caller.join(); }
+
+    std::printf("ray queue: %d mismatches\n", mismatches.load());
+
+    return mismatches.load() == 0 ? 0 : 1;
+}
+
+
+int main()
+{
+    int failures = 0;
+
+    failures += stressThreadPool();
+    failures += stressExceptions();
+    failures += stressConcurrentRigs();
+    failures += stressRayQueue();
+
+    stopThreads();
+
+    return failures == 0 ? 0 : 1;
+}